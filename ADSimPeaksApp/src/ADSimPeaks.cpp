@@ -12,7 +12,8 @@
  * a flat offset, a slope or a curve, or an exponential with a slope and offset. 
  *
  * The noise type can be either uniformly distributed or distributed
- * according to a Gaussian profile. 
+ * according to a Gaussian profile. The Gaussian noise can also be spatially
+ * correlated, with a given correlation length.
  *
  * The width of the peaks can be restricted by setting hard lower and upper
  * boundaries, which may be useful in some cases (such as saving CPU). 
@@ -22,6 +23,23 @@
  * There are other classes defined in other files that are used by ADSimPeaks:
  * ADSimPeaksPeak - contains the implementation of the various peak shapes
  * ADSimPeaksData - container class to hold peak information
+ * ADSimPeaksDiff - difference array used to render the piecewise peak shapes
+ * ADSimPeaksPlan - plan and row rendering of the background and peaks model
+ * ADSimPeaksStore - compact storage for the peak definitions
+ * ADSimPeaksRandom - counter based random numbers (used for the jitter)
+ * ADSimPeaksSequence - table of per-frame parameter changes
+ * ADSimPeaksClock - frame clock that can be shared by several drivers
+ * ADSimPeaksLoad - load generator schedule and results
+ * ADSimPeaksPlacement - CPU affinity, real-time priority and memory locking
+ * ADSimPeaksCounters - hardware performance counters for each stage of the frame
+ * ADSimPeaksTrace - trace of the frame pipeline, saved as a Chrome trace file
+ * ADSimPeaksWorkers - pool of worker threads used to split up the rendering
+ * ADSimPeaksNoiseField - spatially correlated noise
+ * ADSimPeaksCosmic - cosmic ray tracks and zingers
+ * ADSimPeaksSensor - CCD/CMOS sensor noise model
+ * ADSimPeaksTemporal - temporally correlated per-pixel noise
+ * ADSimPeaksEngine - standalone renderer used by the C API (ADSimPeaksAPI.h)
+ * NDPluginSimPeaks - plugin to add simulated peaks to the NDArrays from another driver
  * 
  * \author Matt Pearson 
  * \date Aug 31st, 2022 
@@ -30,9 +48,13 @@
 
 //Standard 
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <stdexcept>
 #include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <limits>
 
 //EPICS
 #include <epicsTime.h>
@@ -45,6 +67,7 @@
 
 //ADSimPeaks
 #include "ADSimPeaks.h"
+#include "ADSimPeaksProbes.h"
 
 using std::cout;
 using std::cerr;
@@ -56,8 +79,23 @@ static void ADSimPeaksTaskC(void *drvPvt);
 // Static Data
 // Class name
 const string ADSimPeaks::s_className = "ADSimPeaks";
+// Name of the simulation thread
+const string ADSimPeaks::s_taskName = "ADSimPeaksTask";
+const string ADSimPeaks::s_workerName = "ADSimPeaksWorker";
 // Constant used to test for 0.0
-const epicsFloat64 ADSimPeaks::s_zeroCheck = 1e-12;
+// Size of the chunks of the model that are rendered in one go (bytes)
+const size_t ADSimPeaks::s_chunkBytes = 256*1024;
+// Time between checks of the NDArray pool when blocking (seconds)
+const epicsFloat64 ADSimPeaks::s_bpPollTime = 0.005;
+// Range of the extra delay between frames when slowing down (seconds)
+const epicsFloat64 ADSimPeaks::s_bpMinDelay = 0.001;
+const epicsFloat64 ADSimPeaks::s_bpMaxDelay = 1.0;
+const epicsUInt64 ADSimPeaks::s_bandRowStream = 0x1000000000000000ULL;
+const epicsUInt64 ADSimPeaks::s_bandColStream = 0x1800000000000000ULL;
+// Maximum number of 1D frames published together as one 2D array
+const epicsInt32 ADSimPeaks::s_maxBatch = 4096;
+// Maximum time between blocking waits in virtual time mode (seconds)
+const epicsFloat64 ADSimPeaks::s_virtualBlockTime = 0.1;
 
 /**
  * Constructor. This creates the driver object and the thread used for
@@ -65,22 +103,46 @@ const epicsFloat64 ADSimPeaks::s_zeroCheck = 1e-12;
  *
  * \arg \c portName The Asyn port name
  * \arg \c maxSize The maximum number of bins in the NDArray object 
- * \arg \c maxPeaks The maximum number of peaks (i.e. the Asyn addresses)
+ * \arg \c maxPeaks The maximum number of peaks
  * \arg \c dataType The data type (Uint8, UInt16, etc) to initially use
  * \arg \c maxBuffers The asynPortDriver max buffers (0=unlimited)
  * \arg \c maxMemory The asynPortDriver max memory (0=unlimited)
  * \arg \c priority The asynPortDriver priority (0=default)
  * \arg \c stackSize The asynPortDriver stackSize (0=default)
+ * \arg \c maxEditable The number of peaks that can be edited using 
+ *                      the Asyn addresses (0=maxPeaks)
  *
  */
 ADSimPeaks::ADSimPeaks(const char *portName, int maxSizeX, int maxSizeY, int maxPeaks,
 		       NDDataType_t dataType, int maxBuffers, size_t maxMemory,
-		       int priority, int stackSize)
-  : ADDriver(portName, maxPeaks, 0, maxBuffers, maxMemory, 0, 0, 0, 1, priority, stackSize),
+		int priority, int stackSize, int maxEditable)
+  : ADDriver(portName, ((maxEditable > 0) && (maxEditable < maxPeaks)) ? maxEditable : maxPeaks,
+	     0, maxBuffers, maxMemory, 0, 0, 0, 1, priority, stackSize),
     m_maxSizeX(maxSizeX),
     m_maxSizeY(maxSizeY),
     m_maxPeaks(maxPeaks),
-    m_initialized(false)
+    m_maxEditable(((maxEditable > 0) && (maxEditable < maxPeaks)) ? maxEditable : maxPeaks),
+    m_peakWindow(0),
+    m_virtualTime(false),
+    m_virtualElapsed(0.0),
+    m_clock(NULL),
+    m_clockTick(0),
+    m_initialized(false),
+    m_store(maxPeaks),
+    m_modelValid(false),
+    m_configGen(0),
+    m_latencyPending(false),
+    m_latencyGen(0),
+    m_latencyCounter(0),
+    m_latencySum(0.0),
+    m_bpDelay(0.0),
+    m_loadSizeSaved(false),
+    m_loadSizeX(0),
+    m_loadSizeY(0),
+    m_placementPending(false),
+    m_trace(portName),
+    m_workers(s_workerName, m_placement, m_trace),
+    m_cosmicCount(0)
 {
 
   string functionName(s_className + "::" + __func__);
@@ -99,6 +161,13 @@ ADSimPeaks::ADSimPeaks(const char *portName, int maxSizeX, int maxSizeY, int max
     return;
   }
 
+  m_tickEvent = epicsEventMustCreate(epicsEventEmpty);
+  if (!m_tickEvent) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+	      "%s epicsEventCreate failure for clock tick event.\n", functionName.c_str());
+    return;
+  }
+
   //Add the params to the paramLib 
   createParam(ADSPIntegrateParamString, asynParamInt32, &ADSPIntegrateParam);
   createParam(ADSPNoiseTypeParamString, asynParamInt32, &ADSPNoiseTypeParam);
@@ -106,7 +175,86 @@ ADSimPeaks::ADSimPeaks(const char *portName, int maxSizeX, int maxSizeY, int max
   createParam(ADSPNoiseClampParamString, asynParamInt32, &ADSPNoiseClampParam);
   createParam(ADSPNoiseLowerParamString, asynParamFloat64, &ADSPNoiseLowerParam);
   createParam(ADSPNoiseUpperParamString, asynParamFloat64, &ADSPNoiseUpperParam);
+  createParam(ADSPNoiseCorrLengthParamString, asynParamFloat64, &ADSPNoiseCorrLengthParam);
+  createParam(ADSPNoiseCorrMethodParamString, asynParamInt32, &ADSPNoiseCorrMethodParam);
+  createParam(ADSPNoiseTauParamString, asynParamFloat64, &ADSPNoiseTauParam);
+  createParam(ADSPBandRowParamString, asynParamFloat64, &ADSPBandRowParam);
+  createParam(ADSPBandColParamString, asynParamFloat64, &ADSPBandColParam);
+  createParam(ADSPBandFixedParamString, asynParamInt32, &ADSPBandFixedParam);
+  createParam(ADSPSensorDarkParamString, asynParamFloat64, &ADSPSensorDarkParam);
+  createParam(ADSPSensorReadParamString, asynParamFloat64, &ADSPSensorReadParam);
+  createParam(ADSPSensorGainParamString, asynParamFloat64, &ADSPSensorGainParam);
+  createParam(ADSPSensorBiasParamString, asynParamFloat64, &ADSPSensorBiasParam);
+  createParam(ADSPSensorBitsParamString, asynParamInt32, &ADSPSensorBitsParam);
+  createParam(ADSPCosmicRateParamString, asynParamFloat64, &ADSPCosmicRateParam);
+  createParam(ADSPCosmicTracksParamString, asynParamFloat64, &ADSPCosmicTracksParam);
+  createParam(ADSPCosmicLengthParamString, asynParamFloat64, &ADSPCosmicLengthParam);
+  createParam(ADSPCosmicAmpParamString, asynParamFloat64, &ADSPCosmicAmpParam);
+  createParam(ADSPCosmicCountParamString, asynParamInt32, &ADSPCosmicCountParam);
   createParam(ADSPElapsedTimeParamString, asynParamFloat64, &ADSPElapsedTimeParam);
+  createParam(ADSPAntialiasParamString, asynParamInt32, &ADSPAntialiasParam);
+  createParam(ADSPPeakWindowParamString, asynParamInt32, &ADSPPeakWindowParam);
+  createParam(ADSPSeedParamString, asynParamInt32, &ADSPSeedParam);
+  createParam(ADSPScaleParamString, asynParamFloat64, &ADSPScaleParam);
+  createParam(ADSPFrameScaleParamString, asynParamFloat64, &ADSPFrameScaleParam);
+  createParam(ADSPArrayBytesParamString, asynParamFloat64, &ADSPArrayBytesParam);
+  createParam(ADSPModelCacheParamString, asynParamInt32, &ADSPModelCacheParam);
+  createParam(ADSPVirtualTimeParamString, asynParamInt32, &ADSPVirtualTimeParam);
+  createParam(ADSPJitterScaleParamString, asynParamFloat64, &ADSPJitterScaleParam);
+  createParam(ADSPJitterAmpParamString, asynParamFloat64, &ADSPJitterAmpParam);
+  createParam(ADSPJitterPosParamString, asynParamFloat64, &ADSPJitterPosParam);
+  createParam(ADSPJitterFWHMParamString, asynParamFloat64, &ADSPJitterFWHMParam);
+  createParam(ADSPSeqEnableParamString, asynParamInt32, &ADSPSeqEnableParam);
+  createParam(ADSPSeqLoopParamString, asynParamInt32, &ADSPSeqLoopParam);
+  createParam(ADSPSeqFileParamString, asynParamOctet, &ADSPSeqFileParam);
+  createParam(ADSPSeqLoadParamString, asynParamInt32, &ADSPSeqLoadParam);
+  createParam(ADSPSeqRowsParamString, asynParamInt32, &ADSPSeqRowsParam);
+  createParam(ADSPSeqRowParamString, asynParamInt32, &ADSPSeqRowParam);
+  createParam(ADSPSeqStatusParamString, asynParamOctet, &ADSPSeqStatusParam);
+  createParam(ADSPClockLatenessParamString, asynParamFloat64, &ADSPClockLatenessParam);
+  createParam(ADSPClockMaxLatenessParamString, asynParamFloat64, &ADSPClockMaxLatenessParam);
+  createParam(ADSPClockMissedParamString, asynParamInt32, &ADSPClockMissedParam);
+  createParam(ADSPConfigGenParamString, asynParamInt32, &ADSPConfigGenParam);
+  createParam(ADSPLatencyParamString, asynParamFloat64, &ADSPLatencyParam);
+  createParam(ADSPLatencyMinParamString, asynParamFloat64, &ADSPLatencyMinParam);
+  createParam(ADSPLatencyMaxParamString, asynParamFloat64, &ADSPLatencyMaxParam);
+  createParam(ADSPLatencyMeanParamString, asynParamFloat64, &ADSPLatencyMeanParam);
+  createParam(ADSPLatencyFramesParamString, asynParamInt32, &ADSPLatencyFramesParam);
+  createParam(ADSPLatencyCountParamString, asynParamInt32, &ADSPLatencyCountParam);
+  createParam(ADSPLatencyResetParamString, asynParamInt32, &ADSPLatencyResetParam);
+  createParam(ADSPBPPolicyParamString, asynParamInt32, &ADSPBPPolicyParam);
+  createParam(ADSPBPThresholdParamString, asynParamFloat64, &ADSPBPThresholdParam);
+  createParam(ADSPBPSaturatedParamString, asynParamInt32, &ADSPBPSaturatedParam);
+  createParam(ADSPBPDroppedParamString, asynParamInt32, &ADSPBPDroppedParam);
+  createParam(ADSPBPStallsParamString, asynParamInt32, &ADSPBPStallsParam);
+  createParam(ADSPBPStallTimeParamString, asynParamFloat64, &ADSPBPStallTimeParam);
+  createParam(ADSPBPDelayParamString, asynParamFloat64, &ADSPBPDelayParam);
+  createParam(ADSPLoadEnableParamString, asynParamInt32, &ADSPLoadEnableParam);
+  createParam(ADSPLoadModeParamString, asynParamInt32, &ADSPLoadModeParam);
+  createParam(ADSPLoadStepsParamString, asynParamInt32, &ADSPLoadStepsParam);
+  createParam(ADSPLoadRateStartParamString, asynParamFloat64, &ADSPLoadRateStartParam);
+  createParam(ADSPLoadRateStopParamString, asynParamFloat64, &ADSPLoadRateStopParam);
+  createParam(ADSPLoadSizeStartParamString, asynParamInt32, &ADSPLoadSizeStartParam);
+  createParam(ADSPLoadSizeStopParamString, asynParamInt32, &ADSPLoadSizeStopParam);
+  createParam(ADSPLoadHoldParamString, asynParamFloat64, &ADSPLoadHoldParam);
+  createParam(ADSPLoadStepParamString, asynParamInt32, &ADSPLoadStepParam);
+  createParam(ADSPLoadSatStepParamString, asynParamInt32, &ADSPLoadSatStepParam);
+  createParam(ADSPLoadTargetRateParamString, asynParamFloat64Array, &ADSPLoadTargetRateParam);
+  createParam(ADSPLoadRateParamString, asynParamFloat64Array, &ADSPLoadRateParam);
+  createParam(ADSPLoadThroughputParamString, asynParamFloat64Array, &ADSPLoadThroughputParam);
+  createParam(ADSPLoadFrameBytesParamString, asynParamFloat64Array, &ADSPLoadFrameBytesParam);
+  createParam(ADSPLoadDroppedParamString, asynParamFloat64Array, &ADSPLoadDroppedParam);
+  createParam(ADSPLoadStallsParamString, asynParamFloat64Array, &ADSPLoadStallsParam);
+  createParam(ADSPPerfEnableParamString, asynParamInt32, &ADSPPerfEnableParam);
+  createParam(ADSPPerfStatusParamString, asynParamOctet, &ADSPPerfStatusParam);
+  createParam(ADSPPerfCyclesParamString, asynParamFloat64Array, &ADSPPerfCyclesParam);
+  createParam(ADSPPerfInstructionsParamString, asynParamFloat64Array, &ADSPPerfInstructionsParam);
+  createParam(ADSPPerfCacheMissesParamString, asynParamFloat64Array, &ADSPPerfCacheMissesParam);
+  createParam(ADSPPerfBranchMissesParamString, asynParamFloat64Array, &ADSPPerfBranchMissesParam);
+  createParam(ADSPPerfIPCParamString, asynParamFloat64Array, &ADSPPerfIPCParam);
+  createParam(ADSPTraceEnableParamString, asynParamInt32, &ADSPTraceEnableParam);
+  createParam(ADSPThreadsParamString, asynParamInt32, &ADSPThreadsParam);
+  createParam(ADSPBatchSizeParamString, asynParamInt32, &ADSPBatchSizeParam);
   createParam(ADSPPeakType1DParamString, asynParamInt32, &ADSPPeakType1DParam);
   createParam(ADSPPeakType2DParamString, asynParamInt32, &ADSPPeakType2DParam);
   createParam(ADSPPeakPosXParamString, asynParamFloat64, &ADSPPeakPosXParam);
@@ -148,6 +296,18 @@ ADSimPeaks::ADSimPeaks(const char *portName, int maxSizeX, int maxSizeY, int max
   epicsTimeStamp nowTime;
   epicsTimeGetCurrent(&nowTime);
   m_rand_gen.seed(nowTime.secPastEpoch);
+  m_random.setSeed(nowTime.secPastEpoch);
+  m_virtualBlock = nowTime;
+  m_virtualStart = nowTime;
+  m_plan.frame = 0;
+  m_plan.generation = 0;
+  m_plan.sizeX = 0;
+  m_plan.sizeY = 0;
+  m_plan.reset = false;
+  m_plan.scale = 1.0;
+  m_plan.useModel = false;
+  m_plan.modelValid = false;
+  m_plan.keepModel = false;
 
   bool paramStatus = true;
   //Initialise any paramLib parameters that need passing up to device support
@@ -164,25 +324,72 @@ ADSimPeaks::ADSimPeaks(const char *portName, int maxSizeX, int maxSizeY, int max
   paramStatus = ((setIntegerParam(ADSPNoiseClampParam, 0) == asynSuccess) && paramStatus);
   paramStatus = ((setDoubleParam(ADSPNoiseLowerParam, 0.0) == asynSuccess) && paramStatus);
   paramStatus = ((setDoubleParam(ADSPNoiseUpperParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSPNoiseCorrLengthParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPNoiseCorrMethodParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSPNoiseTauParam, 10.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSPBandRowParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSPBandColParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPBandFixedParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSPSensorDarkParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSPSensorReadParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSPSensorGainParam, 1.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSPSensorBiasParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPSensorBitsParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSPCosmicRateParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSPCosmicTracksParam, 0.5) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSPCosmicLengthParam, 20.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSPCosmicAmpParam, 1000.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPCosmicCountParam, 0) == asynSuccess) && paramStatus);
   paramStatus = ((setDoubleParam(ADSPElapsedTimeParam, 0.0) == asynSuccess) && paramStatus);
-  //Peak Params
-  for (epicsUInt32 peak=0; peak<m_maxPeaks; peak++) {
-    paramStatus = ((setIntegerParam(ADSPPeakType1DParam, 0) == asynSuccess) && paramStatus);
-    paramStatus = ((setIntegerParam(ADSPPeakType2DParam, 0) == asynSuccess) && paramStatus);
-    paramStatus = ((setDoubleParam(ADSPPeakPosXParam, 1.0) == asynSuccess) && paramStatus);
-    paramStatus = ((setDoubleParam(ADSPPeakPosYParam, 1.0) == asynSuccess) && paramStatus);
-    paramStatus = ((setDoubleParam(ADSPPeakFWHMXParam, 1.0) == asynSuccess) && paramStatus);
-    paramStatus = ((setDoubleParam(ADSPPeakFWHMYParam, 1.0) == asynSuccess) && paramStatus);
-    paramStatus = ((setDoubleParam(ADSPPeakAmpParam, 1.0) == asynSuccess) && paramStatus);
-    paramStatus = ((setDoubleParam(ADSPPeakCorParam, 1.0) == asynSuccess) && paramStatus);
-    paramStatus = ((setDoubleParam(ADSPPeakP1Param, 0.0) == asynSuccess) && paramStatus);
-    paramStatus = ((setDoubleParam(ADSPPeakP2Param, 0.0) == asynSuccess) && paramStatus);
-    paramStatus = ((setIntegerParam(ADSPPeakMinXParam, 0) == asynSuccess) && paramStatus);
-    paramStatus = ((setIntegerParam(ADSPPeakMinYParam, 0) == asynSuccess) && paramStatus);
-    paramStatus = ((setIntegerParam(ADSPPeakMaxXParam, 0) == asynSuccess) && paramStatus);
-    paramStatus = ((setIntegerParam(ADSPPeakMaxYParam, 0) == asynSuccess) && paramStatus);
-    callParamCallbacks(peak);
-  }
+  paramStatus = ((setIntegerParam(ADSPAntialiasParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPPeakWindowParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPSeedParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSPScaleParam, 1.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSPFrameScaleParam, 1.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSPArrayBytesParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPModelCacheParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPVirtualTimeParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSPJitterScaleParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSPJitterAmpParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSPJitterPosParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSPJitterFWHMParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPSeqEnableParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPSeqLoopParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setStringParam(ADSPSeqFileParam, "") == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPSeqLoadParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPSeqRowsParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPSeqRowParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setStringParam(ADSPSeqStatusParam, "No sequence") == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSPClockLatenessParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSPClockMaxLatenessParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPClockMissedParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPConfigGenParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPLatencyResetParam, 0) == asynSuccess) && paramStatus);
+  resetLatency();
+  paramStatus = ((setIntegerParam(ADSPBPPolicyParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSPBPThresholdParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPBPSaturatedParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPBPDroppedParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPBPStallsParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSPBPStallTimeParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSPBPDelayParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPLoadEnableParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPLoadModeParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPLoadStepsParam, 10) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSPLoadRateStartParam, 10.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSPLoadRateStopParam, 100.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPLoadSizeStartParam, 100) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPLoadSizeStopParam, 1000) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSPLoadHoldParam, 10.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPLoadStepParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPLoadSatStepParam, -1) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPPerfEnableParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setStringParam(ADSPPerfStatusParam, "Disabled") == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPTraceEnableParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPThreadsParam, 1) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSPBatchSizeParam, 1) == asynSuccess) && paramStatus);
+  //Peak Params (the peaks are held in m_store, the addresses show the editable window)
+  refreshPeakWindow();
   //Background Params X
   paramStatus = ((setIntegerParam(ADSPBGTypeXParam, 0) == asynSuccess) && paramStatus);
   paramStatus = ((setDoubleParam(ADSPBGC0XParam, 0.0) == asynSuccess) && paramStatus);
@@ -206,7 +413,7 @@ ADSimPeaks::ADSimPeaks(const char *portName, int maxSizeX, int maxSizeY, int max
 
   int status = asynSuccess;
   //Create the thread that produces the simulation data
-  status = (epicsThreadCreate("ADSimPeaksTask",
+  status = (epicsThreadCreate(s_taskName.c_str(),
 			      epicsThreadPriorityHigh,
 			      epicsThreadGetStackSize(epicsThreadStackMedium),
 			      (EPICSTHREADFUNC)ADSimPeaksTaskC,
@@ -220,6 +427,7 @@ ADSimPeaks::ADSimPeaks(const char *portName, int maxSizeX, int maxSizeY, int max
   cout << functionName << " maxSizeX: " << m_maxSizeX << endl;
   cout << functionName << " maxSizeY: " << m_maxSizeY << endl;
   cout << functionName << " maxPeaks: " << m_maxPeaks << endl;
+  cout << functionName << " maxEditable: " << m_maxEditable << endl;
   if (!m_2d) {
     cout << functionName << " configured for 1D data" << endl;
   } else {
@@ -255,6 +463,8 @@ asynStatus ADSimPeaks::writeInt32(asynUser *pasynUser, epicsInt32 value)
   int imageMode = 0;
   int addr = 0;
   int function = pasynUser->reason;
+  ADSimPeaksStore::e_field field;
+  const char *paramName = NULL;
   
   string functionName(s_className + "::" + __func__);
   
@@ -265,6 +475,11 @@ asynStatus ADSimPeaks::writeInt32(asynUser *pasynUser, epicsInt32 value)
   if (status != asynSuccess) {
     return(status);
   }
+
+  if ((m_trace.enabled() || ADSP_PROBES) && (getParamName(function, &paramName) == asynSuccess)) {
+    m_trace.instant(paramName, value);
+  }
+  ADSP_PROBE4(param__int, this->portName, paramName, addr, value);
   
   getIntegerParam(ADImageMode, &imageMode);
   
@@ -276,6 +491,7 @@ asynStatus ADSimPeaks::writeInt32(asynUser *pasynUser, epicsInt32 value)
     }
     if ((value == 0) && (m_acquiring)) {
       epicsEventSignal(this->m_stopEvent);
+      epicsEventSignal(this->m_tickEvent);
       if (imageMode == ADImageContinuous) {
           setIntegerParam(ADStatus, ADStatusIdle);
       } else {
@@ -303,18 +519,56 @@ asynStatus ADSimPeaks::writeInt32(asynUser *pasynUser, epicsInt32 value)
   } else if (function == ADSPPeakMaxXParam) {
     value = std::max(0, std::min(value, static_cast<int32_t>(m_maxSizeX-1)));
   } else if (function == ADSPPeakMaxYParam) {
-    value = std::max(0, std::min(value, static_cast<int32_t>(m_maxSizeX-1)));
+    value = std::max(0, std::min(value, static_cast<int32_t>(m_maxSizeY-1)));
+  } else if (function == ADSPPeakWindowParam) {
+    value = std::max(0, std::min(value, static_cast<int32_t>(m_maxPeaks-1)));
+  } else if (function == ADSPSeqLoadParam) {
+    if (value != 0) {
+      char fileName[256] = {0};
+      getStringParam(ADSPSeqFileParam, sizeof(fileName), fileName);
+      status = loadSequence(fileName);
+    }
+    value = 0;
+  } else if (function == ADSPTraceEnableParam) {
+    m_trace.enable(value != 0);
+  } else if (function == ADSPThreadsParam) {
+    value = std::max(1, std::min(value, static_cast<int32_t>(ADSimPeaksWorkers::s_maxThreads)));
+  } else if (function == ADSPBatchSizeParam) {
+    value = std::max(1, std::min(value, s_maxBatch));
+  } else if (function == ADSPSensorBitsParam) {
+    value = std::max(0, std::min(value, static_cast<int32_t>(ADSimPeaksSensor::s_maxBits)));
+  } else if (function == ADSPLatencyResetParam) {
+    resetLatency();
+    value = 0;
   } else if (function == NDDataType) {
     m_needNewArray = true;  
+  } else if (function == ADSPLoadStepsParam) {
+    value = std::max(1, std::min(value, static_cast<int32_t>(ADSimPeaksLoad::s_maxSteps)));
+  } else if ((function == ADSPLoadSizeStartParam) || (function == ADSPLoadSizeStopParam)) {
+    value = std::max(1, std::min(value, static_cast<int32_t>(m_maxSizeX)));
   } else if (function == ADNumImages) {
     value = std::max(1, value);
   }
+
+  //Peak parameters are held in m_store, offset by the peak window
+  if (findPeakField(function, field)) {
+    if (m_store.setInteger(m_peakWindow + addr, field, value) != ADSimPeaksStore::e_status::success) {
+      status = asynError;
+    }
+  }
   
   if (status != asynSuccess) {
     callParamCallbacks();
     return asynError;
   }
 
+  if (modelInput(function)) {
+    m_modelValid = false;
+  }
+  if (renderInput(function)) {
+    configChanged(true);
+  }
+
   status = (asynStatus) setIntegerParam(addr, function, value);
   if (status != asynSuccess) {
     asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
@@ -325,6 +579,11 @@ asynStatus ADSimPeaks::writeInt32(asynUser *pasynUser, epicsInt32 value)
  
   callParamCallbacks(addr);
 
+  if (function == ADSPPeakWindowParam) {
+    m_peakWindow = value;
+    refreshPeakWindow();
+  }
+
   return status;
 
 }
@@ -343,6 +602,8 @@ asynStatus ADSimPeaks::writeFloat64(asynUser *pasynUser, epicsFloat64 value)
   asynStatus status = asynSuccess;
   int addr = 0;
   int function = pasynUser->reason;
+  ADSimPeaksStore::e_field field;
+  const char *paramName = NULL;
 
   string functionName(s_className + "::" + __func__);
   
@@ -354,6 +615,11 @@ asynStatus ADSimPeaks::writeFloat64(asynUser *pasynUser, epicsFloat64 value)
     return(status);
   }
 
+  if ((m_trace.enabled() || ADSP_PROBES) && (getParamName(function, &paramName) == asynSuccess)) {
+    m_trace.instant(paramName, value);
+  }
+  ADSP_PROBE4(param__float, this->portName, paramName, addr, value);
+
   if (function == ADAcquirePeriod) {
     value = std::max(0.0, value);
   } else if (function == ADSPPeakFWHMXParam) {
@@ -362,13 +628,40 @@ asynStatus ADSimPeaks::writeFloat64(asynUser *pasynUser, epicsFloat64 value)
     value = std::max(1.0, value);
   } else if (function == ADSPPeakCorParam) {
     value = std::min(1.0, std::max(-1.0, value));
-  } 
+  } else if ((function == ADSPScaleParam) || (function == ADSPJitterScaleParam) ||
+	     (function == ADSPJitterAmpParam) || (function == ADSPJitterPosParam) ||
+	     (function == ADSPJitterFWHMParam) || (function == ADSPNoiseCorrLengthParam) ||
+	     (function == ADSPCosmicRateParam) || (function == ADSPCosmicLengthParam) ||
+	     (function == ADSPSensorDarkParam) || (function == ADSPSensorReadParam) ||
+	     (function == ADSPBandRowParam) || (function == ADSPBandColParam) ||
+	     (function == ADSPNoiseTauParam)) {
+    value = std::max(0.0, value);
+  } else if ((function == ADSPBPThresholdParam) || (function == ADSPCosmicTracksParam)) {
+    value = std::min(1.0, std::max(0.0, value));
+  } else if ((function == ADSPLoadRateStartParam) || (function == ADSPLoadRateStopParam) ||
+	     (function == ADSPLoadHoldParam)) {
+    value = std::max(0.0, value);
+  }
+
+  //Peak parameters are held in m_store, offset by the peak window
+  if (findPeakField(function, field)) {
+    if (m_store.setDouble(m_peakWindow + addr, field, value) != ADSimPeaksStore::e_status::success) {
+      status = asynError;
+    }
+  }
   
   if (status != asynSuccess) {
     callParamCallbacks();
     return asynError;
   }
 
+  if (modelInput(function)) {
+    m_modelValid = false;
+  }
+  if (renderInput(function)) {
+    configChanged(true);
+  }
+
   status = (asynStatus) setDoubleParam(addr, function, value);
   if (status != asynSuccess) {
     asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
@@ -383,6 +676,39 @@ asynStatus ADSimPeaks::writeFloat64(asynUser *pasynUser, epicsFloat64 value)
 
 }
 
+/**
+ * Implementation of readFloat64Array. This is used to read
+ * the load generator results table and the performance counters.
+ *
+ * /arg /c pasynUser Pointer to the asynUser.
+ * /arg /c value Pointer to the array to fill.
+ * /arg /c nElements The size of the array.
+ * /arg /c nIn This will be used to return the number of elements read.
+ *
+ * /return /c asynStatus
+ */
+asynStatus ADSimPeaks::readFloat64Array(asynUser *pasynUser, epicsFloat64 *value,
+					size_t nElements, size_t *nIn)
+{
+  ADSimPeaksLoad::e_column column;
+  const std::vector<epicsFloat64> *pData = NULL;
+  int function = pasynUser->reason;
+
+  if (findLoadColumn(function, column)) {
+    pData = &m_load.column(column);
+  } else {
+    pData = findCounterValues(function);
+  }
+  if (pData == NULL) {
+    return ADDriver::readFloat64Array(pasynUser, value, nElements, nIn);
+  }
+
+  *nIn = std::min(nElements, pData->size());
+  std::copy(pData->begin(), pData->begin() + *nIn, value);
+
+  return asynSuccess;
+}
+
 /**
  * Implementation of the standard report function.
  * This prints the driver configuration.
@@ -401,6 +727,8 @@ void ADSimPeaks::report(FILE *fp, int details)
     fprintf(fp, "  m_maxSizeX: %d\n", m_maxSizeX);
     fprintf(fp, "  m_maxSizeY: %d\n", m_maxSizeY);
     fprintf(fp, "  m_maxPeaks: %d\n", m_maxPeaks);
+    fprintf(fp, "  m_maxEditable: %d\n", m_maxEditable);
+    fprintf(fp, "  m_peakWindow: %d\n", m_peakWindow);
     fprintf(fp, "  m_uniqueId: %d\n", m_uniqueId);
     fprintf(fp, "  m_needNewArray: %d\n", m_needNewArray);
     fprintf(fp, "  m_needReset: %d\n", m_needReset);
@@ -424,6 +752,60 @@ void ADSimPeaks::report(FILE *fp, int details)
     fprintf(fp, "  integrate: %d\n", intParam);
     getDoubleParam(ADSPElapsedTimeParam, &floatParam);
     fprintf(fp, "  elapsed time: %f\n", floatParam);
+    getIntegerParam(ADSPAntialiasParam, &intParam);
+    fprintf(fp, "  antialias: %d\n", intParam);
+    getIntegerParam(ADSPSeedParam, &intParam);
+    fprintf(fp, "  seed: %d (current: %llu)\n", intParam, static_cast<unsigned long long>(m_random.getSeed()));
+    getDoubleParam(ADSPScaleParam, &floatParam);
+    fprintf(fp, "  scale: %f\n", floatParam);
+    getIntegerParam(ADSPModelCacheParam, &intParam);
+    fprintf(fp, "  model cache: %d (valid: %d)\n", intParam, m_modelValid);
+    getIntegerParam(ADSPVirtualTimeParam, &intParam);
+    fprintf(fp, "  virtual time: %d (active: %d)\n", intParam, m_virtualTime);
+    getDoubleParam(ADSPJitterScaleParam, &floatParam);
+    fprintf(fp, "  jitter scale: %f\n", floatParam);
+    getDoubleParam(ADSPJitterAmpParam, &floatParam);
+    fprintf(fp, "  jitter amplitude: %f\n", floatParam);
+    getDoubleParam(ADSPJitterPosParam, &floatParam);
+    fprintf(fp, "  jitter position: %f\n", floatParam);
+    getDoubleParam(ADSPJitterFWHMParam, &floatParam);
+    fprintf(fp, "  jitter fwhm: %f\n", floatParam);
+    getIntegerParam(ADSPSeqEnableParam, &intParam);
+    fprintf(fp, "  sequence enable: %d (rows: %u)\n", intParam, m_sequence.size());
+    getIntegerParam(ADSPSeqLoopParam, &intParam);
+    fprintf(fp, "  sequence loop: %d\n", intParam);
+    fprintf(fp, "  config generation: %u (last frame: %u)\n", m_configGen, m_plan.generation);
+    getIntegerParam(ADSPBPPolicyParam, &intParam);
+    fprintf(fp, "  backpressure policy: %d\n", intParam);
+    getDoubleParam(ADSPBPThresholdParam, &floatParam);
+    fprintf(fp, "  backpressure threshold: %f\n", floatParam);
+    getIntegerParam(ADSPBPDroppedParam, &intParam);
+    fprintf(fp, "  backpressure dropped frames: %d\n", intParam);
+    getIntegerParam(ADSPBPStallsParam, &intParam);
+    fprintf(fp, "  backpressure stalls: %d\n", intParam);
+    getDoubleParam(ADSPBPStallTimeParam, &floatParam);
+    fprintf(fp, "  backpressure stall time: %f\n", floatParam);
+    fprintf(fp, "  backpressure delay: %f\n", m_bpDelay);
+    fprintf(fp, "  load generator: %s (step %u of %u, saturation step: %d)\n",
+	    m_load.active() ? "active" : "idle", m_load.step(), m_load.steps(), m_load.saturationStep());
+    getIntegerParam(ADSPLatencyCountParam, &intParam);
+    fprintf(fp, "  config latency count: %d\n", intParam);
+    getDoubleParam(ADSPLatencyMeanParam, &floatParam);
+    fprintf(fp, "  config latency mean: %f\n", floatParam);
+    getDoubleParam(ADSPLatencyMaxParam, &floatParam);
+    fprintf(fp, "  config latency max: %f\n", floatParam);
+    if (m_clock != NULL) {
+      fprintf(fp, "  frame clock: %s (period: %f)\n", m_clock->getName().c_str(), m_clock->getPeriod());
+      getDoubleParam(ADSPClockLatenessParam, &floatParam);
+      fprintf(fp, "  frame clock lateness: %f\n", floatParam);
+      getDoubleParam(ADSPClockMaxLatenessParam, &floatParam);
+      fprintf(fp, "  frame clock max lateness: %f\n", floatParam);
+      getIntegerParam(ADSPClockMissedParam, &intParam);
+      fprintf(fp, "  frame clock missed ticks: %d\n", intParam);
+    } else {
+      fprintf(fp, "  frame clock: none\n");
+    }
+    m_placement.report(fp);
 
     getIntegerParam(ADSPNoiseTypeParam, &intParam);
     fprintf(fp, "  noise type: %d\n", intParam);
@@ -433,6 +815,13 @@ void ADSimPeaks::report(FILE *fp, int details)
     fprintf(fp, "  noise lower: %f\n", floatParam);
     getDoubleParam(ADSPNoiseUpperParam, &floatParam);
     fprintf(fp, "  noise upper: %f\n", floatParam);
+    getDoubleParam(ADSPNoiseCorrLengthParam, &floatParam);
+    fprintf(fp, "  noise correlation length: %f (method: %d)\n", floatParam, static_cast<int>(m_noiseField.getMethod()));
+    fprintf(fp, "  render threads: %u\n", m_workers.getThreads());
+    getIntegerParam(ADSPBatchSizeParam, &intParam);
+    fprintf(fp, "  batch size: %d\n", intParam);
+    getDoubleParam(ADSPCosmicRateParam, &floatParam);
+    fprintf(fp, "  cosmic rate: %f (last frame: %u events)\n", floatParam, m_cosmicCount);
 
     getIntegerParam(ADSPBGTypeXParam, &intParam);
     fprintf(fp, "  background X type: %d\n", intParam);
@@ -462,45 +851,48 @@ void ADSimPeaks::report(FILE *fp, int details)
     } 
     
     fprintf(fp, " Peak Information:\n");
+    epicsUInt32 enabled = 0;
     for (epicsUInt32 i=0; i<m_maxPeaks; i++) {
+      m_store.getInteger(i, m_2d ? ADSimPeaksStore::e_field::type_2d : ADSimPeaksStore::e_field::type_1d, intParam);
+      if (intParam != 0) {
+	enabled++;
+      }
+      // Print the editable window, and the other enabled peaks if details > 1
+      bool window = ((i >= m_peakWindow) && (i < m_peakWindow + m_maxEditable));
+      if ((!window) && ((intParam == 0) || (details < 2))) {
+	continue;
+      }
       fprintf(fp, "  peak: %d\n", i);
-      if (!m_2d) {
-	getIntegerParam(i, ADSPPeakType1DParam, &intParam);
-	if (intParam == static_cast<epicsUInt32>(m_peaks.e_type_1d::none)) {
-	  fprintf(fp, "   none (disabled)\n");
-	}
-      } else {
-	getIntegerParam(i, ADSPPeakType2DParam, &intParam);
-	if (intParam == static_cast<epicsUInt32>(m_peaks.e_type_2d::none)) {
-	  fprintf(fp, "   none (disabled)\n");
-	}
+      if (intParam == 0) {
+	fprintf(fp, "   none (disabled)\n");
       }
       fprintf(fp, "   type: %d\n", intParam);
-      getDoubleParam(i, ADSPPeakPosXParam, &floatParam);
+      m_store.getDouble(i, ADSimPeaksStore::e_field::pos_x, floatParam);
       fprintf(fp, "   position X: %f\n", floatParam);
-      getDoubleParam(i, ADSPPeakPosYParam, &floatParam);
+      m_store.getDouble(i, ADSimPeaksStore::e_field::pos_y, floatParam);
       fprintf(fp, "   position Y: %f\n", floatParam);
-      getDoubleParam(i, ADSPPeakFWHMXParam, &floatParam);
+      m_store.getDouble(i, ADSimPeaksStore::e_field::fwhm_x, floatParam);
       fprintf(fp, "   fwhm X: %f\n", floatParam);
-      getDoubleParam(i, ADSPPeakFWHMYParam, &floatParam);
+      m_store.getDouble(i, ADSimPeaksStore::e_field::fwhm_y, floatParam);
       fprintf(fp, "   fwhm Y: %f\n", floatParam);
-      getDoubleParam(i, ADSPPeakAmpParam, &floatParam);
+      m_store.getDouble(i, ADSimPeaksStore::e_field::amplitude, floatParam);
       fprintf(fp, "   amplitude: %f\n", floatParam);
-      getDoubleParam(i, ADSPPeakCorParam, &floatParam);
+      m_store.getDouble(i, ADSimPeaksStore::e_field::correlation, floatParam);
       fprintf(fp, "   xy correlation: %f\n", floatParam);
-      getDoubleParam(i, ADSPPeakP1Param, &floatParam);
+      m_store.getDouble(i, ADSimPeaksStore::e_field::param1, floatParam);
       fprintf(fp, "   param 1: %f\n", floatParam);
-      getDoubleParam(i, ADSPPeakP2Param, &floatParam);
+      m_store.getDouble(i, ADSimPeaksStore::e_field::param2, floatParam);
       fprintf(fp, "   param 2: %f\n", floatParam);
-      getIntegerParam(i, ADSPPeakMinXParam, &intParam);
+      m_store.getInteger(i, ADSimPeaksStore::e_field::min_x, intParam);
       fprintf(fp, "   min X: %d\n", intParam);
-      getIntegerParam(i, ADSPPeakMinYParam, &intParam);
+      m_store.getInteger(i, ADSimPeaksStore::e_field::min_y, intParam);
       fprintf(fp, "   min Y: %d\n", intParam);
-      getIntegerParam(i, ADSPPeakMaxXParam, &intParam);
+      m_store.getInteger(i, ADSimPeaksStore::e_field::max_x, intParam);
       fprintf(fp, "   max X: %d\n", intParam);
-      getIntegerParam(i, ADSPPeakMaxYParam, &intParam);
+      m_store.getInteger(i, ADSimPeaksStore::e_field::max_y, intParam);
       fprintf(fp, "   max Y: %d\n", intParam);
     } // end of peak loop
+    fprintf(fp, "  enabled peaks: %d\n", enabled);
   } // end of if (details > 0)
 
   // Invoke the base class method.
@@ -541,10 +933,21 @@ void ADSimPeaks::ADSimPeaksTask(void)
   epicsFloat64 updatePeriod = 0.0;
   double elapsedTime = 0.0;
   epicsEventWaitStatus eventStatus;
+  epicsUInt32 clockTick = 0;
+  epicsTimeStamp clockTime;
+  epicsTimeStamp batchStart;
+  int batchSize = 1;
+  string batchIds;
+  string batchTimes;
+  string batchGenerations;
+  string batchCosmicCounts;
+  string batchCosmicEvents;
+  NDArray *publishArray = NULL;
 
   string functionName(s_className + "::" + __func__);
 
   p_NDArray = NULL;
+  p_NDArrayBatch = NULL;
   m_acquiring = false;
   
   this->lock();
@@ -552,6 +955,8 @@ void ADSimPeaks::ADSimPeaksTask(void)
 
     //Wait for a startEvent
     if (!m_acquiring) {
+      //Put back the frame size if a load generator sweep has changed it
+      restoreLoadSize();
       
       this->unlock();
       eventStatus = epicsEventWait(m_startEvent);
@@ -562,15 +967,101 @@ void ADSimPeaks::ADSimPeaksTask(void)
 		  "%s starting simulation.\n", functionName.c_str());
 	m_acquiring = true;
 	setStringParam(ADStatusMessage, "Simulation Running");
+	//Move this thread onto the configured CPUs and priority, if that has changed
+	if (m_placementPending) {
+	  m_placement.apply(s_taskName);
+	  m_placementPending = false;
+	}
+	//Seed the random numbers, so that a non-zero seed gives a reproducible simulation
+	int seed = 0;
+	getIntegerParam(ADSPSeedParam, &seed);
+	if (seed == 0) {
+	  epicsTimeStamp seedTime;
+	  epicsTimeGetCurrent(&seedTime);
+	  seed = seedTime.secPastEpoch ^ seedTime.nsec;
+	}
+	m_rand_gen.seed(seed);
+	m_random.setSeed(static_cast<epicsUInt32>(seed));
+	m_temporal.reset();
+	//Virtual time mode is fixed for the whole acquisition
+	int virtualTime = 0;
+	getIntegerParam(ADSPVirtualTimeParam, &virtualTime);
+	m_virtualTime = (virtualTime != 0);
+	epicsTimeGetCurrent(&m_virtualBlock);
+	//Reset the frame clock statistics, and ignore any old ticks
+	m_clockTick = 0;
+	epicsEventTryWait(m_tickEvent);
+	epicsEventTryWait(m_stopEvent);
+	setDoubleParam(ADSPClockLatenessParam, 0.0);
+	setDoubleParam(ADSPClockMaxLatenessParam, 0.0);
+	setIntegerParam(ADSPClockMissedParam, 0);
+	//Reset the backpressure counters
+	m_bpDelay = 0.0;
+	setIntegerParam(ADSPBPSaturatedParam, 0);
+	setIntegerParam(ADSPBPDroppedParam, 0);
+	setIntegerParam(ADSPBPStallsParam, 0);
+	setDoubleParam(ADSPBPStallTimeParam, 0.0);
+	setDoubleParam(ADSPBPDelayParam, 0.0);
+	//Start a load generator sweep, if enabled
+	int loadEnable = 0;
+	getIntegerParam(ADSPLoadEnableParam, &loadEnable);
+	if (loadEnable != 0) {
+	  startLoad();
+	} else {
+	  m_load.stop();
+	}
 	setIntegerParam(ADNumImagesCounter, 0);
 	epicsTimeGetCurrent(&startTime);
+	m_virtualStart = startTime;
+	m_virtualElapsed = 0.0;
       } else {
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s eventStatus %d\n", functionName.c_str(), eventStatus);
       }  
     }
     callParamCallbacks();
 
+    if ((m_acquiring) && (m_clock != NULL) && (!m_virtualTime)) {
+      //Wait for the next tick of the frame clock, so that all the 
+      //drivers attached to the clock produce this frame together.
+      epicsUInt64 traceStart = m_trace.now();
+      this->unlock();
+      epicsEventWait(m_tickEvent);
+      this->lock();
+      m_trace.complete("clock wait", traceStart);
+      if (epicsEventTryWait(m_stopEvent) == epicsEventWaitOK) {
+	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
+		  "%s stopping simulation.\n", functionName.c_str());
+	m_acquiring = false;
+	setStringParam(ADStatusMessage, "Simulation Idle");
+	callParamCallbacks();
+	continue;
+      }
+      m_clock->getTick(clockTick, clockTime);
+      if ((m_clockTick != 0) && (clockTick > m_clockTick + 1)) {
+	int missed = 0;
+	getIntegerParam(ADSPClockMissedParam, &missed);
+	setIntegerParam(ADSPClockMissedParam, missed + (clockTick - m_clockTick - 1));
+      }
+      m_clockTick = clockTick;
+    }
+
+    if ((m_acquiring) && (m_load.active()) && (!stepLoad())) {
+      //The load generator sweep is complete
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
+		"%s completed load generator sweep.\n", functionName.c_str());
+      m_acquiring = false;
+      setIntegerParam(ADStatus, ADStatusIdle);
+      setStringParam(ADStatusMessage, "Load Sweep Complete");
+      setIntegerParam(ADAcquire, 0);
+      callParamCallbacks();
+      continue;
+    }
+
     if (m_acquiring) {
+      if (m_virtualTime) {
+	//The real time at the start of the batch, in case the virtual clock has no frame period
+	epicsTimeGetCurrent(&batchStart);
+      }
       getIntegerParam(NDArrayCallbacks, &arrayCallbacks);
 
       getIntegerParam(ADImageMode, &imageMode);
@@ -600,44 +1091,248 @@ void ADSimPeaks::ADSimPeaksTask(void)
 	  asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s released NDArray\n", functionName.c_str());
 	  //TODO - do I need to empty the free list, otherwise the pool keeps growing each time we change the array size?
 	}
-	if ((p_NDArray = this->pNDArrayPool->alloc(ndims, dims, dataType, 0, NULL)) == NULL) {
+	p_NDArray = this->pNDArrayPool->alloc(ndims, dims, dataType, 0, NULL);
+	ADSP_PROBE3(pool__alloc, this->portName, (p_NDArray != NULL) ? p_NDArray->dataSize : 0, p_NDArray);
+	if (p_NDArray == NULL) {
 	  asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s failed to alloc NDArray\n", functionName.c_str());
 	} else {
 	  m_needNewArray = false;
 	  asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s allocated new NDArray\n", functionName.c_str());
+	  if (m_placement.getMemory() == ADSimPeaksPlacement::e_memory::prefault) {
+	    ADSimPeaksPlacement::prefault(p_NDArray->pData, p_NDArray->dataSize);
+	    prefaultBuffers(sizeX, (m_2d) ? sizeY : 1);
+	  }
 	}
       }
 
-      if (p_NDArray != NULL) {
-	//Generate sim data here
-	if (computeData(dataType) != asynSuccess) {
-	  asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s failed to compute data.\n", functionName.c_str());
+      //Batching renders several 1D frames each time round, and publishes them together 
+      //as the rows of a 2D array. It is not used with a frame clock, because each tick 
+      //is one frame.
+      batchSize = 1;
+      if ((!m_2d) && (imageMode != ADImageSingle) && ((m_clock == NULL) || (m_virtualTime))) {
+	getIntegerParam(ADSPBatchSizeParam, &batchSize);
+	if (imageMode == ADImageMultiple) {
+	  batchSize = std::min(batchSize, numImages - imagesCounter + 1);
+	}
+	batchSize = std::max(1, batchSize);
+      }
+
+      //Check if the plugins are keeping up before we render the frame
+      bool render = ((p_NDArray != NULL) && (checkBackpressure(arrayCallbacks != 0, batchSize)));
+      p_NDArrayBatch = NULL;
+      if ((render) && (batchSize > 1) && (arrayCallbacks)) {
+	//This is passed straight to the plugins, so it doesn't need to be copied
+	size_t batchDims[2] = {dims[0], static_cast<size_t>(batchSize)};
+	p_NDArrayBatch = this->pNDArrayPool->alloc(2, batchDims, dataType, 0, NULL);
+	ADSP_PROBE3(pool__alloc, this->portName, (p_NDArrayBatch != NULL) ? p_NDArrayBatch->dataSize : 0, p_NDArrayBatch);
+	if ((p_NDArrayBatch != NULL) && (m_placement.getMemory() == ADSimPeaksPlacement::e_memory::prefault)) {
+	  ADSimPeaksPlacement::prefault(p_NDArrayBatch->pData, p_NDArrayBatch->dataSize);
+	}
+	if (p_NDArrayBatch == NULL) {
+	  //There is nowhere to put the frames, so the batch is skipped
+	  asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s failed to alloc batch NDArray\n", functionName.c_str());
+	  countDropped(batchSize);
+	  render = false;
 	}
+      }
+      if (!render) {
+	//Only the frames that are published count towards the number of images
+	--imagesCounter;
+      } else {
+	batchIds.clear();
+	batchTimes.clear();
+	batchGenerations.clear();
+	batchCosmicCounts.clear();
+	batchCosmicEvents.clear();
+	getDoubleParam(ADAcquirePeriod, &updatePeriod);
+	epicsUInt64 frameStart = m_trace.now();
+	ADSP_PROBE2(frame__start, this->portName, imagesCounter);
+	//The counters are cleared once, so they add up all the frames in a batch
+	checkCounters();
 	
-	epicsTimeGetCurrent(&nowTime);
-	elapsedTime = epicsTimeDiffInSeconds(&nowTime, &startTime);
-        p_NDArray->uniqueId = arrayCounter;
-	p_NDArray->timeStamp = nowTime.secPastEpoch + nowTime.nsec / 1.e9;
-	updateTimeStamp(&p_NDArray->epicsTS);
+	for (int row = 0; row < batchSize; ++row) {
+	  if (row > 0) {
+	    ++arrayCounter;
+	    ++imagesCounter;
+	  }
+	  //Plan the frame, then generate sim data here
+	  epicsUInt64 traceStart = m_trace.now();
+	  ADSP_PROBE2(stage__start, this->portName, "plan");
+	  asynStatus planStatus = planFrame(imagesCounter);
+	  ADSP_PROBE2(stage__end, this->portName, "plan");
+	  m_trace.complete("plan", traceStart, imagesCounter);
+	  if (planStatus != asynSuccess) {
+	    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s failed to plan frame.\n", functionName.c_str());
+	  } else if (computeData(dataType) != asynSuccess) {
+	    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s failed to compute data.\n", functionName.c_str());
+	  }
+	  
+	  if (m_virtualTime) {
+	    //Use the nominal time of the frame, rather than the real time. This advances
+	    //by the frame period for each frame (the acquire period, or the load generator
+	    //rate), and the frames in a batch are also spaced by the frame period.
+	    elapsedTime = m_virtualElapsed + virtualOffset(row, updatePeriod, batchStart);
+	    nowTime = startTime;
+	    epicsTimeAddSeconds(&nowTime, elapsedTime);
+	    p_NDArray->uniqueId = arrayCounter;
+	    p_NDArray->timeStamp = nowTime.secPastEpoch + nowTime.nsec / 1.e9;
+	    p_NDArray->epicsTS = nowTime;
+	  } else if (m_clock != NULL) {
+	    //Use the tick number and time, which are the same for all the drivers on this clock
+	    p_NDArray->uniqueId = clockTick;
+	    p_NDArray->timeStamp = clockTime.secPastEpoch + clockTime.nsec / 1.e9;
+	    p_NDArray->epicsTS = clockTime;
+	  } else {
+	    //Use the time the frame was rendered (for a batch, the time of each row)
+	    epicsTimeGetCurrent(&nowTime);
+	    elapsedTime = epicsTimeDiffInSeconds(&nowTime, &startTime);
+	    p_NDArray->uniqueId = arrayCounter;
+	    p_NDArray->timeStamp = nowTime.secPastEpoch + nowTime.nsec / 1.e9;
+	    updateTimeStamp(&p_NDArray->epicsTS);
+	  }
+
+	  if (batchSize > 1) {
+	    //Copy the frame into its row of the batch, and record the ID, time,
+	    //configuration generation and cosmic ray events of the row
+	    char buffer[32] = {0};
+	    if (p_NDArrayBatch != NULL) {
+	      p_NDArray->getInfo(&arrayInfo);
+	      memcpy(static_cast<char*>(p_NDArrayBatch->pData) + row*arrayInfo.totalBytes,
+		     p_NDArray->pData, arrayInfo.totalBytes);
+	    }
+	    snprintf(buffer, sizeof(buffer), "%s%d", (row > 0) ? " " : "", p_NDArray->uniqueId);
+	    batchIds.append(buffer);
+	    snprintf(buffer, sizeof(buffer), "%s%u.%09u", (row > 0) ? " " : "",
+		     p_NDArray->epicsTS.secPastEpoch, p_NDArray->epicsTS.nsec);
+	    batchTimes.append(buffer);
+	    snprintf(buffer, sizeof(buffer), "%s%u", (row > 0) ? " " : "", m_plan.generation);
+	    batchGenerations.append(buffer);
+	    snprintf(buffer, sizeof(buffer), "%s%u", (row > 0) ? " " : "", m_cosmicCount);
+	    batchCosmicCounts.append(buffer);
+	    if (row > 0) {
+	      batchCosmicEvents.append("|");
+	    }
+	    batchCosmicEvents.append(m_cosmic.describe());
+	    if (row == 0) {
+	      publishArray = p_NDArrayBatch;
+	      if (p_NDArrayBatch != NULL) {
+		p_NDArrayBatch->uniqueId = p_NDArray->uniqueId;
+		p_NDArrayBatch->timeStamp = p_NDArray->timeStamp;
+		p_NDArrayBatch->epicsTS = p_NDArray->epicsTS;
+	      }
+	    }
+	  } else {
+	    publishArray = p_NDArray;
+	  }
+	}
 	setDoubleParam(NDTimeStamp, p_NDArray->timeStamp);
 	setDoubleParam(ADSPElapsedTimeParam, elapsedTime);
+	setDoubleParam(ADSPFrameScaleParam, m_plan.scale);
 	
 	p_NDArray->getInfo(&arrayInfo);
-	setIntegerParam(NDArraySize, arrayInfo.totalBytes);
+	//NDArraySize is an Int32, so it is clamped for arrays over 2 GB. The full size is in ADSPArrayBytes.
+	const size_t arrayBytes = arrayInfo.totalBytes * batchSize;
+	setIntegerParam(NDArraySize, static_cast<epicsInt32>(std::min(arrayBytes,
+								       static_cast<size_t>(std::numeric_limits<epicsInt32>::max()))));
+	setDoubleParam(ADSPArrayBytesParam, static_cast<epicsFloat64>(arrayBytes));
 	setIntegerParam(NDArraySizeX, dims[0]);
-	setIntegerParam(NDArraySizeY, dims[1]);
+	setIntegerParam(NDArraySizeY, (batchSize > 1) ? batchSize : dims[1]);
 	setIntegerParam(NDArrayCounter, arrayCounter);
 	setIntegerParam(ADNumImagesCounter, imagesCounter);
 	
-	this->getAttributes(p_NDArray->pAttributeList);
+	if (publishArray != NULL) {
+	  this->getAttributes(publishArray->pAttributeList);
+	  publishArray->pAttributeList->add("ADSPConfigGeneration", "Configuration generation used for this frame",
+						NDAttrUInt32, &m_plan.generation);
+	  publishArray->pAttributeList->add("ADSPCosmicCount", "Number of cosmic ray events in this frame",
+						NDAttrUInt32, &m_cosmicCount);
+	  publishArray->pAttributeList->add("ADSPCosmicEvents", "Cosmic ray events (type x0 y0 x1 y1 amplitude pixels;...)",
+						NDAttrString, const_cast<char*>(m_cosmic.describe().c_str()));
+	  if (batchSize > 1) {
+	    epicsUInt32 rows = static_cast<epicsUInt32>(batchSize);
+	    publishArray->pAttributeList->add("ADSPBatchSize", "Number of frames (rows) in this batch",
+						  NDAttrUInt32, &rows);
+	    publishArray->pAttributeList->add("ADSPBatchIds", "Unique ID of each row in this batch",
+						  NDAttrString, const_cast<char*>(batchIds.c_str()));
+	    publishArray->pAttributeList->add("ADSPBatchTimes", "EPICS time stamp (sec.nsec) of each row in this batch",
+						  NDAttrString, const_cast<char*>(batchTimes.c_str()));
+	    publishArray->pAttributeList->add("ADSPBatchConfigGenerations", "Configuration generation of each row in this batch",
+						  NDAttrString, const_cast<char*>(batchGenerations.c_str()));
+	    publishArray->pAttributeList->add("ADSPBatchCosmicCounts", "Number of cosmic ray events in each row in this batch",
+						  NDAttrString, const_cast<char*>(batchCosmicCounts.c_str()));
+	    publishArray->pAttributeList->add("ADSPBatchCosmicEvents", "Cosmic ray events of each row in this batch, separated by |",
+						  NDAttrString, const_cast<char*>(batchCosmicEvents.c_str()));
+	  }
+	}
 	
-	if (arrayCallbacks) {	  
+	if ((arrayCallbacks) && (p_NDArrayBatch != NULL)) {
+	  //The batch is already a separate NDArray, so it can go straight to the plugins.
+	  m_counters.begin();
+	  epicsUInt64 traceStart = m_trace.now();
+	  ADSP_PROBE2(callback__start, this->portName, imagesCounter);
+	  doCallbacksGenericPointer(p_NDArrayBatch, NDArrayData, 0);
+	  ADSP_PROBE2(callback__end, this->portName, imagesCounter);
+	  m_counters.end(ADSimPeaksCounters::e_stage::callbacks);
+	  m_trace.complete("callbacks", traceStart);
+	  p_NDArrayBatch->release();
+	  p_NDArrayBatch = NULL;
+	  if (m_load.active()) {
+	    for (int row = 0; row < batchSize; ++row) {
+	      m_load.countFrame(arrayInfo.totalBytes);
+	    }
+	  }
+	} else if ((arrayCallbacks) && (batchSize == 1)) {	  
 	  // Copy the data to a new NDArray (p_NDArrayPlugins) for use
 	  // by the plugins, as we need to hold to our NDArray (p_NDArray)
 	  // for integrating data.
+	  m_counters.begin();
+	  epicsUInt64 traceStart = m_trace.now();
+	  ADSP_PROBE2(stage__start, this->portName, "copy");
 	  p_NDArrayPlugins = this->pNDArrayPool->copy(p_NDArray, NULL, true);
-	  doCallbacksGenericPointer(p_NDArrayPlugins, NDArrayData, 0);
-	  p_NDArrayPlugins->release();
+	  ADSP_PROBE2(stage__end, this->portName, "copy");
+	  ADSP_PROBE2(pool__copy, this->portName, p_NDArrayPlugins);
+	  m_counters.end(ADSimPeaksCounters::e_stage::copy);
+	  m_trace.complete("copy", traceStart);
+	  if (p_NDArrayPlugins != NULL) {
+	    traceStart = m_trace.now();
+	    ADSP_PROBE2(callback__start, this->portName, imagesCounter);
+	    doCallbacksGenericPointer(p_NDArrayPlugins, NDArrayData, 0);
+	    ADSP_PROBE2(callback__end, this->portName, imagesCounter);
+	    m_counters.end(ADSimPeaksCounters::e_stage::callbacks);
+	    m_trace.complete("callbacks", traceStart);
+	    p_NDArrayPlugins->release();
+	    if (m_load.active()) {
+	      m_load.countFrame(arrayInfo.totalBytes);
+	    }
+	  } else {
+	    asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s failed to copy NDArray\n", functionName.c_str());
+	    countDropped(1);
+	    --imagesCounter;
+	    setIntegerParam(ADNumImagesCounter, imagesCounter);
+	  }
+	} else if ((!arrayCallbacks) && (m_load.active())) {
+	  for (int row = 0; row < batchSize; ++row) {
+	    m_load.countFrame(arrayInfo.totalBytes);
+	  }
+	}
+	m_trace.complete("frame", frameStart, imagesCounter);
+	ADSP_PROBE3(frame__end, this->portName, imagesCounter, arrayInfo.totalBytes * batchSize);
+	updateLatency(arrayCounter);
+	if (m_counters.isOpen()) {
+	  publishCounters();
+	}
+	if (m_placement.configured()) {
+	  m_placement.sample(s_taskName);
+	}
+	if ((m_clock != NULL) && (!m_virtualTime)) {
+	  //How long after the clock tick the frame was published
+	  epicsFloat64 lateness = 0.0;
+	  epicsFloat64 maxLateness = 0.0;
+	  epicsTimeGetCurrent(&nowTime);
+	  lateness = epicsTimeDiffInSeconds(&nowTime, &clockTime);
+	  getDoubleParam(ADSPClockMaxLatenessParam, &maxLateness);
+	  setDoubleParam(ADSPClockLatenessParam, lateness);
+	  setDoubleParam(ADSPClockMaxLatenessParam, std::max(lateness, maxLateness));
 	}
 	callParamCallbacks();
       }
@@ -654,11 +1349,46 @@ void ADSimPeaks::ADSimPeaksTask(void)
         setIntegerParam(ADAcquire, 0);
         asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
 		    "%s completed simulation.\n", functionName.c_str());
-      } else {
-	//Wait for a stop event
+      } else if ((m_clock == NULL) || (m_virtualTime)) {
+	//Wait for a stop event (with a frame clock we wait for the next tick instead,
+	//and in virtual time mode we just check for a stop event and carry on).
+	//The load generator sets the frame rate when it is sweeping the rate.
+	//A batch of frames covers the acquire period for each of the frames.
+	//In virtual time mode the virtual clock is moved on instead.
+	if (m_virtualTime) {
+	  m_virtualElapsed += virtualOffset(batchSize, updatePeriod, batchStart);
+	} else {
+	  epicsTimeGetCurrent(&nowTime);
+	  epicsFloat64 loadDelay = -1.0;
+	  for (int row = 0; row < batchSize; ++row) {
+	    loadDelay = m_load.frameDelay(nowTime);
+	  }
+	  if (loadDelay >= 0.0) {
+	    updatePeriod = loadDelay;
+	  } else {
+	    updatePeriod *= batchSize;
+	  }
+	}
+	epicsUInt64 traceStart = m_trace.now();
 	this->unlock();
-	eventStatus = epicsEventWaitWithTimeout(m_stopEvent, updatePeriod);
+	if (m_virtualTime) {
+	  //Don't wait between frames, but let the other threads (eg. the port thread) take 
+	  //the lock. A yield doesn't let lower priority threads run if this thread has a 
+	  //real-time priority, so we also block for a short time every s_virtualBlockTime.
+	  epicsTimeStamp realTime;
+	  epicsTimeGetCurrent(&realTime);
+	  if (epicsTimeDiffInSeconds(&realTime, &m_virtualBlock) >= s_virtualBlockTime) {
+	    eventStatus = epicsEventWaitWithTimeout(m_stopEvent, epicsThreadSleepQuantum());
+	    epicsTimeGetCurrent(&m_virtualBlock);
+	  } else {
+	    epicsThreadSleep(0.0);
+	    eventStatus = epicsEventTryWait(m_stopEvent);
+	  }
+	} else {
+	  eventStatus = epicsEventWaitWithTimeout(m_stopEvent, updatePeriod + m_bpDelay);
+	}
 	this->lock();
+	m_trace.complete("wait", traceStart);
 	if (eventStatus == epicsEventWaitOK) {
 	  asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
 		    "%s stopping simulation.\n", functionName.c_str());
@@ -716,30 +1446,25 @@ asynStatus ADSimPeaks::computeData(NDDataType_t dataType)
 }
 
 /**
- * Templated version of ADSimPeaks::computeData. This does the actual work and 
- * populates the NDArray object. The background profile is first calculated, 
- * then we add in the desired peaks, then we modify the resulting profile 
- * with optional noise.
+ * Build the plan for a frame. This reads the parameters and the peak storage,
+ * applies the per-frame jitter, and builds the background and peaks plan (m_render)
+ * that is used by computeDataT.
+ * If the cached model can be reused, only the global scale is calculated.
+ *
+ * /arg /c frame The frame number (used as the counter for the jitter random numbers)
  *
  * /return /c asynStatus 
  */
-template <typename T> asynStatus ADSimPeaks::computeDataT()
+asynStatus ADSimPeaks::planFrame(epicsUInt32 frame)
 {
-  asynStatus status = asynSuccess;
-  NDArrayInfo_t arrayInfo;
-  epicsUInt32 size = 0;
   epicsInt32 sizeX = 0;
   epicsInt32 sizeY = 0;
   epicsInt32 peak_type = 0;
-  epicsInt32 intParam = 0.0;
-  epicsFloat64 floatParam = 0.0;
+  epicsInt32 intParam = 0;
   epicsUInt32 minX = 0;
   epicsUInt32 minY = 0;
   epicsUInt32 maxX = 0;
   epicsUInt32 maxY = 0;
-  epicsFloat64 result = 0.0;
-  epicsFloat64 result_max = 0.0;
-  epicsFloat64 scale_factor = 0.0;
   epicsInt32 bg_typex = 0;
   epicsFloat64 bg_c0x = 0.0;
   epicsFloat64 bg_c1x = 0.0;
@@ -752,50 +1477,88 @@ template <typename T> asynStatus ADSimPeaks::computeDataT()
   epicsFloat64 bg_c2y = 0.0;
   epicsFloat64 bg_c3y = 0.0;
   epicsFloat64 bg_shy = 0.0;
-  epicsInt32 noise_type = 0;
-  epicsFloat64 noise_level = 0.0;
-  epicsInt32 noise_clamp = 0;
-  epicsFloat64 noise_lower = 0.0;
-  epicsFloat64 noise_upper = 0.0;
-  epicsFloat64 noise = 0.0;
+  epicsFloat64 scale = 0.0;
+  epicsFloat64 jitter_scale = 0.0;
+  epicsFloat64 jitter_amp = 0.0;
+  epicsFloat64 jitter_pos = 0.0;
+  epicsFloat64 jitter_fwhm = 0.0;
   ADSimPeaksData peak_data;
-  ADSimPeaksPeak::e_status peak_status;
-  ADSimPeaksPeak::e_type_1d peak_type_1d = m_peaks.e_type_1d::none;
-  ADSimPeaksPeak::e_type_2d peak_type_2d = m_peaks.e_type_2d::none;
-  
+
   string functionName(s_className + "::" + __func__);
-  
-  if (p_NDArray == NULL) {
-    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
-	      "%s invalid NDArray pointer.\n", functionName.c_str());
-    return asynError;
-  }
-  
-  p_NDArray->getInfo(&arrayInfo);
-  T *pData = static_cast<T*>(p_NDArray->pData);
-  size = arrayInfo.nElements;
+
+  //Apply the parameter changes for this frame from the sequence table
+  applySequence(frame);
+  m_plan.generation = m_configGen;
 
   getIntegerParam(ADSizeX, &sizeX);
   getIntegerParam(ADSizeY, &sizeY);
   sizeY = std::max(1, sizeY);
-  
-  //Reset the array data if we need to
+  if (sizeX <= 0) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+	      "%s invalid sizeX %d.\n", functionName.c_str(), sizeX);
+    return asynError;
+  }
+  const epicsUInt32 cols = static_cast<epicsUInt32>(sizeX);
+  const epicsUInt32 rows = static_cast<epicsUInt32>(sizeY);
+  m_plan.frame = frame;
+  m_plan.sizeX = cols;
+  m_plan.sizeY = rows;
+
+  //Check if we need to reset the array data
   int integrate = 0;
   getIntegerParam(ADSPIntegrateParam, &integrate);
-  if ((integrate == 0) || (m_needReset)) {
-    for (epicsUInt32 i=0; i<arrayInfo.nElements; i++) {
-      pData[i] = 0;
+  m_plan.reset = ((integrate == 0) || (m_needReset));
+  m_needReset = false;
+
+  //The global scale (eg. the beam intensity) for this frame
+  getDoubleParam(ADSPScaleParam, &scale);
+  getDoubleParam(ADSPJitterScaleParam, &jitter_scale);
+  m_plan.scale = scale * std::max(0.0, 1.0 + jitter(0, e_jitter::scale, jitter_scale));
+
+  //Decide if the cached model can be used. The model can't be reused
+  //if the peaks are jittered, because they change every frame.
+  int model_cache = 0;
+  getIntegerParam(ADSPModelCacheParam, &model_cache);
+  getDoubleParam(ADSPJitterAmpParam, &jitter_amp);
+  getDoubleParam(ADSPJitterPosParam, &jitter_pos);
+  getDoubleParam(ADSPJitterFWHMParam, &jitter_fwhm);
+  bool jitter_peaks = ((jitter_amp > 0.0) || (jitter_pos > 0.0) || (jitter_fwhm > 0.0));
+  m_plan.useModel = (model_cache != 0);
+  if (m_plan.useModel) {
+    size_t model_size = static_cast<size_t>(cols)*static_cast<size_t>(rows);
+    if (m_model.size() != model_size) {
+      m_modelValid = false;
+      try {
+	m_model.assign(model_size, 0.0);
+      } catch (std::bad_alloc &) {
+	asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+		  "%s unable to allocate the model cache.\n", functionName.c_str());
+	std::vector<epicsFloat64>().swap(m_model);
+	m_plan.useModel = false;
+      }
     }
-    m_needReset = false;
+  } else if (!m_model.empty()) {
+    std::vector<epicsFloat64>().swap(m_model);
+    m_modelValid = false;
   }
-
-  //Calculate the background profile
+  m_plan.modelValid = ((m_plan.useModel) && (m_modelValid) && (!jitter_peaks));
+  m_plan.keepModel = ((m_plan.useModel) && (!jitter_peaks));
+  if (m_plan.modelValid) {
+    return asynSuccess;
+  }
+  
+  //Calculate the background profiles in X and Y
+  int antialias = 0;
+  getIntegerParam(ADSPAntialiasParam, &antialias);
+  m_render.begin(cols, rows, m_2d, (antialias != 0));
   getIntegerParam(ADSPBGTypeXParam, &bg_typex);
   getDoubleParam(ADSPBGC0XParam, &bg_c0x);
   getDoubleParam(ADSPBGC1XParam, &bg_c1x);
   getDoubleParam(ADSPBGC2XParam, &bg_c2x);
   getDoubleParam(ADSPBGC3XParam, &bg_c3x);
   getDoubleParam(ADSPBGSHXParam, &bg_shx);
+  m_render.setBackground(ADSimPeaksPlan::e_axis::x, static_cast<ADSimPeaksPlan::e_bg_type>(bg_typex),
+			 bg_c0x, bg_c1x, bg_c2x, bg_c3x, bg_shx);
   if (m_2d) {
     getIntegerParam(ADSPBGTypeYParam, &bg_typey);
     getDoubleParam(ADSPBGC0YParam, &bg_c0y);
@@ -803,219 +1566,1588 @@ template <typename T> asynStatus ADSimPeaks::computeDataT()
     getDoubleParam(ADSPBGC2YParam, &bg_c2y);
     getDoubleParam(ADSPBGC3YParam, &bg_c3y);
     getDoubleParam(ADSPBGSHYParam, &bg_shy);
-  }
-  epicsFloat64 bg_x = 0.0;
-  epicsFloat64 bg_y = 0.0;
-  epicsUInt32 bin_x = 0;
-  epicsUInt32 bin_y = 0;
-  for (epicsInt32 bin=0; bin<static_cast<epicsInt32>(size); bin++) {
-    bin_x = bin % sizeX;
-    if (bg_typex == static_cast<epicsUInt32>(e_bg_type::polynomial)) {
-      bg_x = bg_c0x + (bin_x-bg_shx)*bg_c1x + pow((bin_x-bg_shx),2)*bg_c2x + pow((bin_x-bg_shx),3)*bg_c3x;
-    } else if (bg_typex == static_cast<epicsUInt32>(e_bg_type::exponential)) {
-      bg_x = bg_c0x + bg_c1x*(pow(exp(1.0), (bin_x-bg_shx)*bg_c2x));
-    }
-    if (m_2d) {
-      bin_y = floor(bin/sizeX);
-      if (bg_typey == static_cast<epicsUInt32>(e_bg_type::polynomial)) {
-	bg_y = bg_c0y + (bin_y-bg_shy)*bg_c1y + pow((bin_y-bg_shy),2)*bg_c2y + pow((bin_y-bg_shy),3)*bg_c3y;
-      } else if (bg_typey == static_cast<epicsUInt32>(e_bg_type::exponential)) {
-	bg_y  = bg_c0y + bg_c1y*(pow(exp(1.0), (bin_y-bg_shy)*bg_c2y));
-      }
-    }
-    pData[bin] += bg_x + bg_y;
+    m_render.setBackground(ADSimPeaksPlan::e_axis::y, static_cast<ADSimPeaksPlan::e_bg_type>(bg_typey),
+			   bg_c0y, bg_c1y, bg_c2y, bg_c3y, bg_shy);
   }
   
-  //Calculate the peak profile and scale it to the desired height
+  //Add the peaks to the plan. They are scaled to the desired height, and the
+  //piecewise peak shapes are added to the difference array (see ADSimPeaksPlan).
   for (epicsUInt32 peak=0; peak<m_maxPeaks; peak++) {
 
-    bool no_peak = false;
     if (!m_2d) {
-      getIntegerParam(peak, ADSPPeakType1DParam, &peak_type);
-      peak_type_1d = static_cast<ADSimPeaksPeak::e_type_1d>(peak_type);
-      if (peak_type_1d == m_peaks.e_type_1d::none) {
-	no_peak = true;
+      m_store.getInteger(peak, ADSimPeaksStore::e_field::type_1d, peak_type);
+      if (static_cast<ADSimPeaksPeak::e_type_1d>(peak_type) == m_peaks.e_type_1d::none) {
+	continue;
       }
     } else {
-      getIntegerParam(peak, ADSPPeakType2DParam, &peak_type);
-      peak_type_2d = static_cast<ADSimPeaksPeak::e_type_2d>(peak_type);
-      if (peak_type_2d == m_peaks.e_type_2d::none) {
-	no_peak = true;
+      m_store.getInteger(peak, ADSimPeaksStore::e_field::type_2d, peak_type);
+      if (static_cast<ADSimPeaksPeak::e_type_2d>(peak_type) == m_peaks.e_type_2d::none) {
+	continue;
       }
     }
 
-    if (!no_peak) {
-    
-      // Get the peak parameters and initialize our peak data object
-      peak_data.clear();
-      getDoubleParam(peak, ADSPPeakPosXParam, &floatParam);
-      peak_data.setPositionX(floatParam);
-      getDoubleParam(peak, ADSPPeakPosYParam, &floatParam);
-      peak_data.setPositionY(floatParam);
-      getDoubleParam(peak, ADSPPeakFWHMXParam, &floatParam);
-      peak_data.setFWHMX(floatParam);    
-      getDoubleParam(peak, ADSPPeakFWHMYParam, &floatParam);
-      peak_data.setFWHMY(floatParam);    
-      getDoubleParam(peak, ADSPPeakAmpParam, &floatParam);
-      peak_data.setAmplitude(floatParam);
-      getDoubleParam(peak, ADSPPeakCorParam, &floatParam);
-      peak_data.setCorrelation(floatParam);
-      getDoubleParam(peak, ADSPPeakP1Param, &floatParam);
-      peak_data.setParam1(floatParam);
-      getDoubleParam(peak, ADSPPeakP2Param, &floatParam);
-      peak_data.setParam2(floatParam);
-
-      // Read the peak min and max boundaries (and convert to unsigned ints)
-      getIntegerParam(ADSPPeakMinXParam, &intParam);
-      minX = static_cast<epicsUInt32>(intParam);
-      getIntegerParam(ADSPPeakMinYParam, &intParam);
-      minY = static_cast<epicsUInt32>(intParam);
-      getIntegerParam(ADSPPeakMaxXParam, &intParam);
-      maxX = static_cast<epicsUInt32>(intParam);
-      getIntegerParam(ADSPPeakMaxYParam, &intParam);
-      maxY = static_cast<epicsUInt32>(intParam);
-      if (maxX == 0) {
-	maxX = sizeX;
-      }
-      if (maxY == 0) {
-	maxY = sizeY;
-      }
-      
-      if (!m_2d) {
-	// Compute 1D peak data
-	peak_data.setBinX(peak_data.getPositionX());	
-	peak_status = m_peaks.compute1D(peak_data, peak_type_1d, result_max);
-	if (peak_status == m_peaks.e_status::success) {
-	  scale_factor = peak_data.getAmplitude() / zeroCheck(result_max);
-	}
-	for (epicsUInt32 bin=0; bin<size; bin++) {
-	  if ((bin >= minX) && (bin <= maxX)) {
-	    peak_data.setBinX(bin);
-	    peak_status = m_peaks.compute1D(peak_data, peak_type_1d, result);
-	    if (peak_status == m_peaks.e_status::success) {
-	      result = (result*scale_factor);
-	      pData[bin] += static_cast<T>(result);
-	    }
-	  }
-	}
-      } else {
-	// Compute 2D peak data
-	peak_data.setBinX(peak_data.getPositionX());
-	peak_data.setBinY(peak_data.getPositionY());
-	peak_status = m_peaks.compute2D(peak_data, peak_type_2d, result_max);
-	if (peak_status == m_peaks.e_status::success) {
-	  scale_factor = peak_data.getAmplitude() / zeroCheck(result_max);
-	}
-	for (epicsUInt32 bin=0; bin<size; bin++) {
-	  bin_x = bin % sizeX;
-	  bin_y = floor(bin/sizeX);
-	  if ((bin_x >= minX) && (bin_x <= maxX) && (bin_y >= minY) && (bin_y <= maxY)) {
-	    peak_data.setBinX(bin_x);
-	    peak_data.setBinY(bin_y);
-	    peak_status = m_peaks.compute2D(peak_data, peak_type_2d, result);
-	    if (peak_status == m_peaks.e_status::success) {
-	      result = (result*scale_factor);
-	      pData[bin] += static_cast<T>(result);
-	    }
-	  }
-	} 
-      } // end of if (!m_2d)
-      
-    } // end of if (!no_peak)
-    
-  } // end of peak loop
-	  
-  //Generate noise
-  getIntegerParam(ADSPNoiseTypeParam, &noise_type);
-  getDoubleParam(ADSPNoiseLevelParam, &noise_level);
-  getIntegerParam(ADSPNoiseClampParam, &noise_clamp);
-  getDoubleParam(ADSPNoiseLowerParam, &noise_lower);
-  getDoubleParam(ADSPNoiseUpperParam, &noise_upper);
-  if (noise_type == static_cast<epicsUInt32>(e_noise_type::uniform)) {
-    std::uniform_real_distribution<double> dist(-1.0,1.0);
-    for (epicsUInt32 bin=0; bin<size; bin++) {
-      noise = dist(m_rand_gen);
-      noise = noise_level * noise;
-      if (noise_clamp != 0) {
-	noise = std::max(noise_lower, std::min(noise_upper, noise));
+    // Get the peak parameters and initialize our peak data object
+    m_store.getData(peak, peak_data);
+
+    // Apply the per-frame jitter
+    if (jitter_amp > 0.0) {
+      peak_data.setAmplitude(peak_data.getAmplitude() *
+			     std::max(0.0, 1.0 + jitter(peak, e_jitter::amplitude, jitter_amp)));
+    }
+    if (jitter_pos > 0.0) {
+      peak_data.setPositionX(peak_data.getPositionX() + jitter(peak, e_jitter::position_x, jitter_pos));
+      if (m_2d) {
+	peak_data.setPositionY(peak_data.getPositionY() + jitter(peak, e_jitter::position_y, jitter_pos));
       }
-      pData[bin] += static_cast<T>(noise);
     }
-  } else if (noise_type == static_cast<epicsUInt32>(e_noise_type::gaussian)) {
-    std::normal_distribution<double> dist(0.0,1.0);
-    for (epicsUInt32 bin=0; bin<size; bin++) {
-      noise = dist(m_rand_gen);
-      noise = noise_level * noise;
-      if (noise_clamp != 0) {
-	noise = std::max(noise_lower, std::min(noise_upper, noise));
-      } 
-      pData[bin] += static_cast<T>(noise);
+    if (jitter_fwhm > 0.0) {
+      epicsFloat64 fwhm_factor = std::max(0.0, 1.0 + jitter(peak, e_jitter::fwhm, jitter_fwhm));
+      peak_data.setFWHMX(std::max(1.0, peak_data.getFWHMX() * fwhm_factor));
+      peak_data.setFWHMY(std::max(1.0, peak_data.getFWHMY() * fwhm_factor));
     }
-  }
-  
-  return status;
+
+    // Read the peak min and max boundaries (and convert to unsigned ints)
+    m_store.getInteger(peak, ADSimPeaksStore::e_field::min_x, intParam);
+    minX = static_cast<epicsUInt32>(intParam);
+    m_store.getInteger(peak, ADSimPeaksStore::e_field::min_y, intParam);
+    minY = static_cast<epicsUInt32>(intParam);
+    m_store.getInteger(peak, ADSimPeaksStore::e_field::max_x, intParam);
+    maxX = static_cast<epicsUInt32>(intParam);
+    m_store.getInteger(peak, ADSimPeaksStore::e_field::max_y, intParam);
+    maxY = static_cast<epicsUInt32>(intParam);
+
+    m_render.addPeak(peak_type, peak_data, minX, maxX, minY, maxY);
+    
+  } // end of peak loop
+
+  return asynSuccess;
 }
 
 /**
- * Utility function to check if a floating point number is close to zero.
+ * Calculate the jitter for a peak parameter in the current frame. The random 
+ * numbers only depend on the seed, the frame number, the peak and the 
+ * parameter, so a frame can be reproduced for a given seed.
  *
- * /arg /c value The value to check 
+ * /arg /c peak The peak index (0 for the global scale)
+ * /arg /c type The parameter that is being jittered
+ * /arg /c sigma The standard deviation of the jitter
  *
- * /return The original input value or 1.0 (if it was too close to zero)
+ * /return The jitter (a normally distributed random number times sigma)
  */
-epicsFloat64 ADSimPeaks::zeroCheck(epicsFloat64 value)
+epicsFloat64 ADSimPeaks::jitter(epicsUInt32 peak, e_jitter type, epicsFloat64 sigma)
 {
-  if ((value > -s_zeroCheck) && (value < s_zeroCheck)) {
-    return 1.0;
-  } else {
-    return value;
+  if (sigma <= 0.0) {
+    return 0.0;
   }
+  epicsUInt64 stream = (static_cast<epicsUInt64>(peak) << 8) | static_cast<epicsUInt64>(type);
+  return sigma * m_random.gaussian(stream, m_plan.frame);
 }
- 
 
 /**
- * C function to tie into EPICS
+ * Calculate the row and column offsets (banding) for the current frame.
+ * There is one normally distributed random number for each row and each 
+ * column, so this is O(sizeX + sizeY). If ADSP_BAND_FIXED is set, the 
+ * offsets do not change between frames (a fixed pattern).
+ *
+ * /return /c true if there is any banding
  */
-static void ADSimPeaksTaskC(void *drvPvt)
+bool ADSimPeaks::planBanding(void)
 {
-    ADSimPeaks *pPvt = (ADSimPeaks *)drvPvt;
+  epicsFloat64 rowSigma = 0.0;
+  epicsFloat64 colSigma = 0.0;
+  epicsInt32 fixed = 0;
+  getDoubleParam(ADSPBandRowParam, &rowSigma);
+  getDoubleParam(ADSPBandColParam, &colSigma);
+  getIntegerParam(ADSPBandFixedParam, &fixed);
+  if ((rowSigma <= 0.0) && (colSigma <= 0.0)) {
+    return false;
+  }
 
-    pPvt->ADSimPeaksTask();
+  const epicsUInt64 frame = (fixed != 0) ? 0 : m_plan.frame;
+  m_bandRow.assign(m_plan.sizeY, 0.0);
+  m_bandCol.assign(m_plan.sizeX, 0.0);
+  if (rowSigma > 0.0) {
+    for (epicsUInt32 bin_y=0; bin_y<m_plan.sizeY; bin_y++) {
+      m_bandRow[bin_y] = rowSigma * m_random.gaussian(s_bandRowStream ^ bin_y, frame);
+    }
+  }
+  if (colSigma > 0.0) {
+    for (epicsUInt32 bin_x=0; bin_x<m_plan.sizeX; bin_x++) {
+      m_bandCol[bin_x] = colSigma * m_random.gaussian(s_bandColStream ^ bin_x, frame);
+    }
+  }
+  return true;
 }
 
 /**
- * C linkage functions to define the shell commands
+ * Check if a parameter is used to calculate the peak and background
+ * model. Writing to one of these parameters means the cached 
+ * model needs to be recalculated.
+ *
+ * /arg /c function The parameter index (pasynUser->reason)
+ *
+ * /return /c true if the parameter is used for the model
  */
-extern "C" {
+bool ADSimPeaks::modelInput(int function)
+{
+  ADSimPeaksStore::e_field field;
+  if (findPeakField(function, field)) {
+    return true;
+  }
+  return ((function == ADSizeX) || (function == ADSizeY) || (function == ADSPAntialiasParam) ||
+	  (function == ADSPBGTypeXParam) || (function == ADSPBGC0XParam) || (function == ADSPBGC1XParam) ||
+	  (function == ADSPBGC2XParam) || (function == ADSPBGC3XParam) || (function == ADSPBGSHXParam) ||
+	  (function == ADSPBGTypeYParam) || (function == ADSPBGC0YParam) || (function == ADSPBGC1YParam) ||
+	  (function == ADSPBGC2YParam) || (function == ADSPBGC3YParam) || (function == ADSPBGSHYParam));
+}
 
-  asynStatus ADSimPeaksConfig(const char *portName, int maxSizeX, int maxSizeY, int maxPeaks,
-			      int dataType, int maxBuffers, size_t maxMemory,
-			      int priority, int stackSize)
-  {
-    asynStatus status = asynSuccess;
-    
-    // Instantiate class
-    try {
-      ADSimPeaks *adsp = new ADSimPeaks(portName, maxSizeX, maxSizeY, maxPeaks,
-				       static_cast<NDDataType_t>(dataType), maxBuffers, maxMemory,
-				       priority, stackSize);
-      if (adsp->getInitialized()) {
-	cerr << "Created ADSimPeaks OK." << endl;	
-      } else {
-	cerr << "Problem creating ADSimPeaks" << endl;
-	status = asynError;
-      }
-    } catch (...) {
-      cerr << __func__ << " exception caught when trying to construct ADSimPeaks." << endl;
-      status = asynError;
-    }
-    
-    return(status);
-    
+/**
+ * Check if a parameter changes the frames that are rendered. This is 
+ * every model input, plus the parameters that are applied to each frame 
+ * (the integration, scale, jitter, noise, banding, sensor and cosmic 
+ * ray parameters, the data type and the exposure time). Writing to one 
+ * of these parameters increments the configuration generation.
+ *
+ * /arg /c function The parameter index (pasynUser->reason)
+ *
+ * /return /c true if the parameter changes the rendered frames
+ */
+bool ADSimPeaks::renderInput(int function)
+{
+  if (modelInput(function)) {
+    return true;
   }
+  return ((function == ADSPIntegrateParam) || (function == ADSPScaleParam) || (function == NDDataType) ||
+	  (function == ADAcquireTime) || (function == ADSPJitterScaleParam) || (function == ADSPJitterAmpParam) ||
+	  (function == ADSPJitterPosParam) || (function == ADSPJitterFWHMParam) ||
+	  (function == ADSPNoiseTypeParam) || (function == ADSPNoiseLevelParam) || (function == ADSPNoiseClampParam) ||
+	  (function == ADSPNoiseLowerParam) || (function == ADSPNoiseUpperParam) || (function == ADSPNoiseCorrLengthParam) ||
+	  (function == ADSPNoiseTauParam) || (function == ADSPBandRowParam) || (function == ADSPBandColParam) ||
+	  (function == ADSPBandFixedParam) || (function == ADSPSensorDarkParam) || (function == ADSPSensorReadParam) ||
+	  (function == ADSPSensorGainParam) || (function == ADSPSensorBiasParam) || (function == ADSPSensorBitsParam) ||
+	  (function == ADSPCosmicRateParam) || (function == ADSPCosmicTracksParam) ||
+	  (function == ADSPCosmicLengthParam) || (function == ADSPCosmicAmpParam));
+}
+
+/**
+ * Templated version of ADSimPeaks::computeData. This does the actual work and 
+ * populates the NDArray object, using the plan made by ADSimPeaks::planFrame. 
+ * The model (the background profile plus the desired peaks) is first calculated, 
+ * then it is multiplied by the global scale and converted to the NDArray data type, 
+ * then we modify the resulting profile with optional noise.
+ *
+ * The NDArray is rendered in chunks of s_chunkBytes of model and noise data (a few
+ * rows, or part of a row for very large rows), so that the model, noise and conversion 
+ * are all done for a chunk while it is still in the cache. The model and noise for a 
+ * chunk are combined in a single pass when they are converted, so each element 
+ * of the NDArray is only written once. All the indexing into the NDArray uses 
+ * size_t, so arrays with more than 2^31 elements are supported.
+ *
+ * If the model cache is enabled, the model is kept for the next frame. If only
+ * the global scale has changed, the cached model is reused and only the conversion
+ * (and noise) is done.
+ *
+ * The correlated noise is not generated per chunk, because the filter needs the 
+ * neighbouring pixels. The whole noise field is generated (using the worker threads) 
+ * before the chunks are rendered, and each chunk reads its part of the field.
+ *
+ * The sensor noise type replaces the conversion. The model is treated as the
+ * mean number of photoelectrons, and the shot noise, dark current, read noise,
+ * gain, bias and ADC are applied in one pass for each chunk (see ADSimPeaksSensor).
+ *
+ * The temporal noise type keeps a state for each pixel, which is updated
+ * once per frame (see ADSimPeaksTemporal).
+ *
+ * The row and column offsets (banding) are calculated once per frame, and
+ * added in the conversion pass.
+ *
+ * The cosmic ray tracks and zingers are added after the frame is rendered,
+ * only visiting the pixels that they hit.
+ *
+ * /return /c asynStatus 
+ */
+template <typename T> asynStatus ADSimPeaks::computeDataT()
+{
+  asynStatus status = asynSuccess;
+  NDArrayInfo_t arrayInfo;
+  epicsInt32 noise_type = 0;
+  epicsFloat64 noise_level = 0.0;
+  epicsInt32 noise_clamp = 0;
+  epicsFloat64 noise_lower = 0.0;
+  epicsFloat64 noise_upper = 0.0;
+  epicsFloat64 noise = 0.0;
   
-  // Code for iocsh registration
-  static const iocshArg ADSimPeaksConfigArg0 = {"Port Name", iocshArgString};
+  string functionName(s_className + "::" + __func__);
+  
+  if (p_NDArray == NULL) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+	      "%s invalid NDArray pointer.\n", functionName.c_str());
+    return asynError;
+  }
+  
+  p_NDArray->getInfo(&arrayInfo);
+  T *pData = static_cast<T*>(p_NDArray->pData);
+
+  const epicsUInt32 cols = m_plan.sizeX;
+  const epicsUInt32 rows = m_plan.sizeY;
+  if (arrayInfo.nElements < static_cast<size_t>(cols)*static_cast<size_t>(rows)) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+	      "%s NDArray size does not match sizeX and sizeY.\n", functionName.c_str());
+    return asynError;
+  }
+  
+  //Read the noise parameters
+  getIntegerParam(ADSPNoiseTypeParam, &noise_type);
+  getDoubleParam(ADSPNoiseLevelParam, &noise_level);
+  getIntegerParam(ADSPNoiseClampParam, &noise_clamp);
+  getDoubleParam(ADSPNoiseLowerParam, &noise_lower);
+  getDoubleParam(ADSPNoiseUpperParam, &noise_upper);
+  std::uniform_real_distribution<double> uniform_dist(-1.0,1.0);
+  std::normal_distribution<double> gaussian_dist(0.0,1.0);
+
+  bool uniform = (noise_type == static_cast<epicsUInt32>(e_noise_type::uniform));
+  bool gaussian = (noise_type == static_cast<epicsUInt32>(e_noise_type::gaussian));
+  bool correlated = (noise_type == static_cast<epicsUInt32>(e_noise_type::correlated));
+  bool sensor = (noise_type == static_cast<epicsUInt32>(e_noise_type::sensor));
+  bool temporal = (noise_type == static_cast<epicsUInt32>(e_noise_type::temporal));
+  bool noisy = (uniform || gaussian || sensor || temporal);
+
+  //The temporal noise state is only reallocated if the frame size changes
+  if (temporal) {
+    epicsFloat64 noise_tau = 0.0;
+    getDoubleParam(ADSPNoiseTauParam, &noise_tau);
+    m_temporal.setSize(cols, rows);
+    m_temporal.setTimeConstant(noise_tau);
+  }
+  bool banded = planBanding();
+
+  //Set up the sensor model for this frame. The dark current depends on the exposure time.
+  if (sensor) {
+    epicsFloat64 exposure = 0.0;
+    epicsFloat64 sensor_dark = 0.0;
+    epicsFloat64 sensor_read = 0.0;
+    epicsFloat64 sensor_gain = 0.0;
+    epicsFloat64 sensor_bias = 0.0;
+    epicsInt32 sensor_bits = 0;
+    getDoubleParam(ADAcquireTime, &exposure);
+    getDoubleParam(ADSPSensorDarkParam, &sensor_dark);
+    getDoubleParam(ADSPSensorReadParam, &sensor_read);
+    getDoubleParam(ADSPSensorGainParam, &sensor_gain);
+    getDoubleParam(ADSPSensorBiasParam, &sensor_bias);
+    getIntegerParam(ADSPSensorBitsParam, &sensor_bits);
+    m_sensor.configure(exposure, sensor_dark, sensor_read, sensor_gain, sensor_bias, sensor_bits);
+  }
+
+  //Generate the correlated noise field for the whole frame
+  if (correlated) {
+    epicsInt32 threads = 1;
+    epicsFloat64 corr_length = 0.0;
+    getIntegerParam(ADSPThreadsParam, &threads);
+    getDoubleParam(ADSPNoiseCorrLengthParam, &corr_length);
+    m_workers.setThreads(static_cast<epicsUInt32>(threads));
+    m_noiseField.setLength(corr_length);
+    setIntegerParam(ADSPNoiseCorrMethodParam, static_cast<epicsInt32>(m_noiseField.getMethod()));
+    ADSP_PROBE2(stage__start, this->portName, "noise field");
+    m_counters.begin();
+    epicsUInt64 traceStart = m_trace.now();
+    m_noiseField.generate(m_random, m_plan.frame, cols, rows, noise_level,
+			  (noise_clamp != 0), noise_lower, noise_upper, m_workers);
+    m_counters.end(ADSimPeaksCounters::e_stage::noise);
+    m_trace.complete("noise field", traceStart, m_plan.frame);
+    ADSP_PROBE2(stage__end, this->portName, "noise field");
+  }
+
+  //Render the NDArray in chunks. A chunk is either a block of complete rows, or
+  //part of a single row, so the chunks (and the noise) are always in array order.
+  //The chunk size includes the model and the noise buffers.
+  const size_t chunkSize = std::max(static_cast<size_t>(1), s_chunkBytes/(sizeof(epicsFloat64)*(noisy ? 2 : 1)));
+  epicsUInt32 chunkCols = 0;
+  epicsUInt32 chunkRows = 0;
+  ADSimPeaksPlan::chunkSize(chunkSize, cols, rows, chunkCols, chunkRows);
+  if (!m_plan.useModel) {
+    m_chunk.resize(static_cast<size_t>(chunkRows)*chunkCols);
+  }
+  if (noisy) {
+    m_noiseChunk.resize(static_cast<size_t>(chunkRows)*chunkCols);
+  }
+  for (epicsUInt32 r0=0; r0<rows; r0+=chunkRows) {
+    epicsUInt32 r1 = ADSimPeaksPlan::chunkEnd(r0, chunkRows, rows);
+    for (epicsUInt32 c0=0; c0<cols; c0+=chunkCols) {
+      epicsUInt32 c1 = ADSimPeaksPlan::chunkEnd(c0, chunkCols, cols);
+      epicsUInt32 width = c1 - c0 + 1;
+
+      //Calculate the model for this chunk, unless we can reuse the cached model
+      m_counters.begin();
+      epicsUInt64 traceStart = m_trace.now();
+      if (!m_plan.modelValid) {
+	ADSP_PROBE2(stage__start, this->portName, "model");
+
+	//Background profile
+	for (epicsUInt32 bin_y=r0; bin_y<=r1; bin_y++) {
+	  m_render.background(bin_y, c0, c1, modelRow(bin_y, r0, c0, width));
+	}
+	m_counters.end(ADSimPeaksCounters::e_stage::background);
+
+	//Add the peaks (including the piecewise peak shapes from the difference array)
+	for (epicsUInt32 bin_y=r0; bin_y<=r1; bin_y++) {
+	  m_render.peaks(bin_y, c0, c1, modelRow(bin_y, r0, c0, width));
+	}
+	m_counters.end(ADSimPeaksCounters::e_stage::peaks);
+	m_trace.complete("model", traceStart, r0);
+	ADSP_PROBE2(stage__end, this->portName, "model");
+	traceStart = m_trace.now();
+	
+      } // end of if (!m_plan.modelValid)
+	  
+      //Generate the noise for this chunk (in array order)
+      ADSP_PROBE2(stage__start, this->portName, "noise");
+      if (sensor) {
+	for (epicsUInt32 bin_y=r0; bin_y<=r1; bin_y++) {
+	  m_sensor.convert(m_random, m_plan.frame, ADSimPeaksPlan::index(c0, bin_y, cols),
+			   modelRow(bin_y, r0, c0, width), m_plan.scale,
+			   &m_noiseChunk[static_cast<size_t>(bin_y-r0)*width], width);
+	}
+      } else if (temporal) {
+	for (epicsUInt32 bin_y=r0; bin_y<=r1; bin_y++) {
+	  m_temporal.generate(m_random, m_plan.frame, ADSimPeaksPlan::index(c0, bin_y, cols),
+			      noise_level, (noise_clamp != 0), noise_lower, noise_upper,
+			      &m_noiseChunk[static_cast<size_t>(bin_y-r0)*width], width);
+	}
+      } else if (noisy) {
+	const size_t chunkElements = static_cast<size_t>(r1-r0+1)*width;
+	for (size_t i=0; i<chunkElements; i++) {
+	  if (uniform) {
+	    noise = uniform_dist(m_rand_gen);
+	  } else {
+	    noise = gaussian_dist(m_rand_gen);
+	  }
+	  noise = noise_level * noise;
+	  if (noise_clamp != 0) {
+	    noise = std::max(noise_lower, std::min(noise_upper, noise));
+	  }
+	  m_noiseChunk[i] = noise;
+	}
+      }
+      m_counters.end(ADSimPeaksCounters::e_stage::noise);
+      m_trace.complete("noise", traceStart, r0);
+      ADSP_PROBE2(stage__end, this->portName, "noise");
+      ADSP_PROBE2(stage__start, this->portName, "conversion");
+      traceStart = m_trace.now();
+
+      //Convert the model to the NDArray data type (applying the global scale), and add the noise.
+      //Each element of the NDArray is written once.
+      for (epicsUInt32 bin_y=r0; bin_y<=r1; bin_y++) {
+	T *pRow = pData + ADSimPeaksPlan::index(0, bin_y, cols);
+	const epicsFloat64 *pModel = modelRow(bin_y, r0, c0, width) - c0;
+	if (banded) {
+	  //The model (unless it is already in the sensor output), the noise and the row and column offsets
+	  const epicsFloat64 *pNoise = NULL;
+	  if (correlated) {
+	    pNoise = m_noiseField.row(bin_y);
+	  } else if (noisy) {
+	    pNoise = &m_noiseChunk[static_cast<size_t>(bin_y-r0)*width] - c0;
+	  }
+	  const epicsFloat64 rowOffset = m_bandRow[bin_y];
+	  for (epicsUInt32 bin_x=c0; bin_x<=c1; bin_x++) {
+	    T value = m_plan.reset ? static_cast<T>(0) : pRow[bin_x];
+	    if (!sensor) {
+	      value += static_cast<T>(m_plan.scale*pModel[bin_x]);
+	    }
+	    if (pNoise != NULL) {
+	      value += static_cast<T>(pNoise[bin_x]);
+	    }
+	    value += static_cast<T>(rowOffset + m_bandCol[bin_x]);
+	    pRow[bin_x] = value;
+	  }
+	} else if (sensor) {
+	  //The sensor output already includes the signal
+	  const epicsFloat64 *pNoise = &m_noiseChunk[static_cast<size_t>(bin_y-r0)*width] - c0;
+	  for (epicsUInt32 bin_x=c0; bin_x<=c1; bin_x++) {
+	    T value = m_plan.reset ? static_cast<T>(0) : pRow[bin_x];
+	    value += static_cast<T>(pNoise[bin_x]);
+	    pRow[bin_x] = value;
+	  }
+	} else if (noisy || correlated) {
+	  const epicsFloat64 *pNoise = correlated ? m_noiseField.row(bin_y) :
+	    &m_noiseChunk[static_cast<size_t>(bin_y-r0)*width] - c0;
+	  for (epicsUInt32 bin_x=c0; bin_x<=c1; bin_x++) {
+	    T value = m_plan.reset ? static_cast<T>(0) : pRow[bin_x];
+	    value += static_cast<T>(m_plan.scale*pModel[bin_x]);
+	    value += static_cast<T>(pNoise[bin_x]);
+	    pRow[bin_x] = value;
+	  }
+	} else {
+	  for (epicsUInt32 bin_x=c0; bin_x<=c1; bin_x++) {
+	    T value = m_plan.reset ? static_cast<T>(0) : pRow[bin_x];
+	    value += static_cast<T>(m_plan.scale*pModel[bin_x]);
+	    pRow[bin_x] = value;
+	  }
+	}
+      }
+      m_counters.end(ADSimPeaksCounters::e_stage::conversion);
+      m_trace.complete("conversion", traceStart, r0);
+      ADSP_PROBE2(stage__end, this->portName, "conversion");
+
+    } // end of chunk column loop
+  } // end of chunk row loop
+
+  if (temporal) {
+    m_temporal.endFrame();
+  }
+
+  //Add the cosmic ray tracks and zingers directly to the NDArray. Only the pixels
+  //that are hit are visited.
+  epicsFloat64 cosmic_rate = 0.0;
+  getDoubleParam(ADSPCosmicRateParam, &cosmic_rate);
+  if (cosmic_rate > 0.0) {
+    epicsFloat64 cosmic_tracks = 0.0;
+    epicsFloat64 cosmic_length = 0.0;
+    epicsFloat64 cosmic_amp = 0.0;
+    getDoubleParam(ADSPCosmicTracksParam, &cosmic_tracks);
+    getDoubleParam(ADSPCosmicLengthParam, &cosmic_length);
+    getDoubleParam(ADSPCosmicAmpParam, &cosmic_amp);
+    ADSP_PROBE2(stage__start, this->portName, "cosmic");
+    m_counters.begin();
+    epicsUInt64 traceStart = m_trace.now();
+    m_cosmic.generate(m_random, m_plan.frame, cols, rows, cosmic_rate,
+		      cosmic_tracks, cosmic_length, cosmic_amp);
+    const std::vector<ADSimPeaksCosmic::s_hit> &hits = m_cosmic.hits();
+    for (size_t i=0; i<hits.size(); i++) {
+      pData[hits[i].index] += static_cast<T>(hits[i].value);
+    }
+    m_counters.end(ADSimPeaksCounters::e_stage::noise);
+    m_trace.complete("cosmic", traceStart, static_cast<epicsFloat64>(hits.size()));
+    ADSP_PROBE2(stage__end, this->portName, "cosmic");
+  } else {
+    m_cosmic.clear();
+  }
+  m_cosmicCount = static_cast<epicsUInt32>(m_cosmic.events().size());
+  setIntegerParam(ADSPCosmicCountParam, static_cast<epicsInt32>(m_cosmicCount));
+
+  if (m_plan.useModel) {
+    m_modelValid = m_plan.keepModel;
+  }
+  
+  return status;
+}
+
+/**
+ * Find the model data for part of a row. This is either in the cached
+ * model (which holds the whole frame), or in the buffer for the current chunk.
+ *
+ * /arg /c bin_y The row
+ * /arg /c r0 The first row of the chunk
+ * /arg /c c0 The first column of the chunk
+ * /arg /c width The number of columns in the chunk
+ *
+ * /return Pointer to the model data for column c0 of the row
+ */
+epicsFloat64* ADSimPeaks::modelRow(epicsUInt32 bin_y, epicsUInt32 r0, epicsUInt32 c0, epicsUInt32 width)
+{
+  if (m_plan.useModel) {
+    return &m_model[ADSimPeaksPlan::index(c0, bin_y, m_plan.sizeX)];
+  } else {
+    return &m_chunk[static_cast<size_t>(bin_y-r0)*width];
+  }
+}
+
+/**
+ * Find the peak storage field that is used for a per-peak driver parameter.
+ *
+ * /arg /c function The parameter index (pasynUser->reason)
+ * /arg /c field This will be used to return the ADSimPeaksStore field
+ *
+ * /return /c true if the parameter is a per-peak parameter
+ */
+bool ADSimPeaks::findPeakField(int function, ADSimPeaksStore::e_field &field)
+{
+  if (function == ADSPPeakType1DParam) {
+    field = ADSimPeaksStore::e_field::type_1d;
+  } else if (function == ADSPPeakType2DParam) {
+    field = ADSimPeaksStore::e_field::type_2d;
+  } else if (function == ADSPPeakPosXParam) {
+    field = ADSimPeaksStore::e_field::pos_x;
+  } else if (function == ADSPPeakPosYParam) {
+    field = ADSimPeaksStore::e_field::pos_y;
+  } else if (function == ADSPPeakFWHMXParam) {
+    field = ADSimPeaksStore::e_field::fwhm_x;
+  } else if (function == ADSPPeakFWHMYParam) {
+    field = ADSimPeaksStore::e_field::fwhm_y;
+  } else if (function == ADSPPeakAmpParam) {
+    field = ADSimPeaksStore::e_field::amplitude;
+  } else if (function == ADSPPeakCorParam) {
+    field = ADSimPeaksStore::e_field::correlation;
+  } else if (function == ADSPPeakP1Param) {
+    field = ADSimPeaksStore::e_field::param1;
+  } else if (function == ADSPPeakP2Param) {
+    field = ADSimPeaksStore::e_field::param2;
+  } else if (function == ADSPPeakMinXParam) {
+    field = ADSimPeaksStore::e_field::min_x;
+  } else if (function == ADSPPeakMinYParam) {
+    field = ADSimPeaksStore::e_field::min_y;
+  } else if (function == ADSPPeakMaxXParam) {
+    field = ADSimPeaksStore::e_field::max_x;
+  } else if (function == ADSPPeakMaxYParam) {
+    field = ADSimPeaksStore::e_field::max_y;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Copy the peaks in the editable window from m_store into the parameter 
+ * library, so that the Asyn addresses show the peaks they now refer to. 
+ * Addresses past the end of the store show a disabled peak. 
+ * This should be called with the driver locked.
+ */
+void ADSimPeaks::refreshPeakWindow(void)
+{
+  ADSimPeaksStore::e_field field;
+  epicsInt32 intValue = 0;
+  epicsFloat64 floatValue = 0.0;
+  const int params[] = {ADSPPeakType1DParam, ADSPPeakType2DParam, ADSPPeakPosXParam, ADSPPeakPosYParam,
+			ADSPPeakFWHMXParam, ADSPPeakFWHMYParam, ADSPPeakAmpParam, ADSPPeakCorParam,
+			ADSPPeakP1Param, ADSPPeakP2Param, ADSPPeakMinXParam, ADSPPeakMinYParam,
+			ADSPPeakMaxXParam, ADSPPeakMaxYParam};
+
+  for (epicsUInt32 addr=0; addr<m_maxEditable; addr++) {
+    for (size_t i=0; i<sizeof(params)/sizeof(params[0]); i++) {
+      findPeakField(params[i], field);
+      if (m_store.isInteger(field)) {
+	intValue = 0;
+	m_store.getInteger(m_peakWindow + addr, field, intValue);
+	setIntegerParam(addr, params[i], intValue);
+      } else {
+	floatValue = 0.0;
+	m_store.getDouble(m_peakWindow + addr, field, floatValue);
+	setDoubleParam(addr, params[i], floatValue);
+      }
+    }
+    callParamCallbacks(addr);
+  }
+}
+
+/**
+ * Define a peak directly in the peak storage. This can be used for peaks
+ * outside of the editable window. The other peak fields (correlation, 
+ * extra parameters and boundaries) are not modified.
+ *
+ * /arg /c peak The peak index (0 based)
+ * /arg /c type The peak type (ADSimPeaksPeak::e_type_1d or e_type_2d, depending on the driver)
+ * /arg /c posX The peak X position
+ * /arg /c posY The peak Y position
+ * /arg /c fwhmX The peak X FWHM
+ * /arg /c fwhmY The peak Y FWHM
+ * /arg /c amplitude The peak amplitude
+ *
+ * /return /c asynStatus
+ */
+asynStatus ADSimPeaks::setPeak(epicsUInt32 peak, epicsInt32 type, epicsFloat64 posX, epicsFloat64 posY,
+			      epicsFloat64 fwhmX, epicsFloat64 fwhmY, epicsFloat64 amplitude)
+{
+  string functionName(s_className + "::" + __func__);
+
+  if (peak >= m_maxPeaks) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+	      "%s invalid peak %d (maxPeaks: %d).\n", functionName.c_str(), peak, m_maxPeaks);
+    return asynError;
+  }
+
+  this->lock();
+  m_store.setInteger(peak, m_2d ? ADSimPeaksStore::e_field::type_2d : ADSimPeaksStore::e_field::type_1d, type);
+  m_store.setDouble(peak, ADSimPeaksStore::e_field::pos_x, posX);
+  m_store.setDouble(peak, ADSimPeaksStore::e_field::pos_y, posY);
+  m_store.setDouble(peak, ADSimPeaksStore::e_field::fwhm_x, std::max(1.0, fwhmX));
+  m_store.setDouble(peak, ADSimPeaksStore::e_field::fwhm_y, std::max(1.0, fwhmY));
+  m_store.setDouble(peak, ADSimPeaksStore::e_field::amplitude, amplitude);
+  m_modelValid = false;
+  configChanged(true);
+  if ((peak >= m_peakWindow) && (peak < m_peakWindow + m_maxEditable)) {
+    refreshPeakWindow();
+  }
+  this->unlock();
+
+  return asynSuccess;
+}
+
+/**
+ * Load peak definitions from a text file into the peak storage. 
+ * Each line defines one peak, using the columns:
+ *
+ *   peak type posX posY fwhmX fwhmY amplitude [correlation param1 param2 minX minY maxX maxY]
+ *
+ * The columns in brackets are optional and take the same defaults as the
+ * per-peak parameters. Blank lines and lines starting with '#' are ignored.
+ *
+ * /arg /c fileName The name of the file
+ *
+ * /return /c asynStatus
+ */
+asynStatus ADSimPeaks::loadPeaks(const char *fileName)
+{
+  asynStatus status = asynSuccess;
+  epicsUInt32 loaded = 0;
+  epicsUInt32 lineNumber = 0;
+  string line;
+
+  string functionName(s_className + "::" + __func__);
+
+  std::ifstream file(fileName);
+  if (!file.is_open()) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+	      "%s unable to open %s.\n", functionName.c_str(), fileName);
+    return asynError;
+  }
+
+  this->lock();
+  while (std::getline(file, line)) {
+    lineNumber++;
+    size_t start = line.find_first_not_of(" \t\r");
+    if ((start == string::npos) || (line[start] == '#')) {
+      continue;
+    }
+    std::istringstream columns(line);
+    epicsFloat64 value[14] = {0.0, 0.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    int count = 0;
+    while ((count < 14) && (columns >> value[count])) {
+      count++;
+    }
+    if ((count < 7) || (value[0] < 0) || (value[0] >= m_maxPeaks)) {
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+		"%s invalid peak definition on line %d of %s.\n", functionName.c_str(), lineNumber, fileName);
+      status = asynError;
+      continue;
+    }
+    epicsUInt32 peak = static_cast<epicsUInt32>(value[0]);
+    m_store.clear(peak);
+    m_store.setInteger(peak, m_2d ? ADSimPeaksStore::e_field::type_2d : ADSimPeaksStore::e_field::type_1d,
+		       static_cast<epicsInt32>(value[1]));
+    m_store.setDouble(peak, ADSimPeaksStore::e_field::pos_x, value[2]);
+    m_store.setDouble(peak, ADSimPeaksStore::e_field::pos_y, value[3]);
+    m_store.setDouble(peak, ADSimPeaksStore::e_field::fwhm_x, std::max(1.0, value[4]));
+    m_store.setDouble(peak, ADSimPeaksStore::e_field::fwhm_y, std::max(1.0, value[5]));
+    m_store.setDouble(peak, ADSimPeaksStore::e_field::amplitude, value[6]);
+    m_store.setDouble(peak, ADSimPeaksStore::e_field::correlation, std::min(1.0, std::max(-1.0, value[7])));
+    m_store.setDouble(peak, ADSimPeaksStore::e_field::param1, value[8]);
+    m_store.setDouble(peak, ADSimPeaksStore::e_field::param2, value[9]);
+    m_store.setInteger(peak, ADSimPeaksStore::e_field::min_x, static_cast<epicsInt32>(value[10]));
+    m_store.setInteger(peak, ADSimPeaksStore::e_field::min_y, static_cast<epicsInt32>(value[11]));
+    m_store.setInteger(peak, ADSimPeaksStore::e_field::max_x, static_cast<epicsInt32>(value[12]));
+    m_store.setInteger(peak, ADSimPeaksStore::e_field::max_y, static_cast<epicsInt32>(value[13]));
+    loaded++;
+  }
+  m_modelValid = false;
+  configChanged(true);
+  refreshPeakWindow();
+  this->unlock();
+
+  cout << functionName << " loaded " << loaded << " peaks from " << fileName << endl;
+
+  return status;
+}
+
+/**
+ * Load a sequence table from a text file. Each line is a row of the table,
+ * and row k holds the parameter changes for frame k of an acquisition 
+ * (the first frame uses the first row). A row is a list of changes:
+ *
+ *   PARAM=value PARAM:peak=value ...
+ *
+ * where PARAM is the drvInfo string of a driver parameter (for example
+ * ADSP_BG_C0X or ADSP_SCALE) and the per-peak parameters (for example 
+ * ADSP_PEAK_POSX) also give the peak index. A row with no changes is 
+ * written as '-'. Blank lines and lines starting with '#' are ignored.
+ *
+ * The whole table is checked before it is used. If there are any errors,
+ * the existing table is kept and the error is reported in ADSP_SEQ_STATUS.
+ *
+ * /arg /c fileName The name of the file
+ *
+ * /return /c asynStatus
+ */
+asynStatus ADSimPeaks::loadSequence(const char *fileName)
+{
+  asynStatus status = asynSuccess;
+  ADSimPeaksSequence sequence;
+  ADSimPeaksSequence::s_entry entry;
+  epicsUInt32 lineNumber = 0;
+  string line;
+  string token;
+  string error;
+
+  string functionName(s_className + "::" + __func__);
+
+  std::ifstream file(fileName);
+  if (!file.is_open()) {
+    error = "Unable to open " + string(fileName);
+    status = asynError;
+  }
+
+  this->lock();
+  while ((status == asynSuccess) && (std::getline(file, line))) {
+    lineNumber++;
+    size_t start = line.find_first_not_of(" \t\r");
+    if ((start == string::npos) || (line[start] == '#')) {
+      continue;
+    }
+    sequence.addRow();
+    std::istringstream tokens(line);
+    while ((status == asynSuccess) && (tokens >> token)) {
+      if (token == "-") {
+	continue;
+      }
+      if (!parseSequenceEntry(token, entry, error)) {
+	error = "Line " + std::to_string(lineNumber) + ": " + error;
+	status = asynError;
+      } else {
+	sequence.addEntry(entry);
+      }
+    }
+  }
+
+  if (status == asynSuccess) {
+    m_sequence.swap(sequence);
+    setIntegerParam(ADSPSeqRowsParam, m_sequence.size());
+    setIntegerParam(ADSPSeqRowParam, 0);
+    setStringParam(ADSPSeqStatusParam, ("Loaded " + std::to_string(m_sequence.size()) + " rows").c_str());
+    cout << functionName << " loaded " << m_sequence.size() << " rows from " << fileName << endl;
+  } else {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+	      "%s %s (%s).\n", functionName.c_str(), error.c_str(), fileName);
+    setStringParam(ADSPSeqStatusParam, error.c_str());
+  }
+  callParamCallbacks();
+  this->unlock();
+
+  return status;
+}
+
+/**
+ * Check if a parameter can be changed by the sequence table. These are the
+ * per-peak parameters, the background parameters, the global scale and 
+ * jitter, and the noise parameters. 
+ *
+ * /arg /c function The parameter index (pasynUser->reason)
+ *
+ * /return /c true if the parameter can be used in the sequence table
+ */
+bool ADSimPeaks::sequenceParam(int function)
+{
+  ADSimPeaksStore::e_field field;
+  if (findPeakField(function, field)) {
+    return true;
+  }
+  return ((function == ADSPBGTypeXParam) || (function == ADSPBGC0XParam) || (function == ADSPBGC1XParam) ||
+	  (function == ADSPBGC2XParam) || (function == ADSPBGC3XParam) || (function == ADSPBGSHXParam) ||
+	  (function == ADSPBGTypeYParam) || (function == ADSPBGC0YParam) || (function == ADSPBGC1YParam) ||
+	  (function == ADSPBGC2YParam) || (function == ADSPBGC3YParam) || (function == ADSPBGSHYParam) ||
+	  (function == ADSPScaleParam) || (function == ADSPJitterScaleParam) || (function == ADSPJitterAmpParam) ||
+	  (function == ADSPJitterPosParam) || (function == ADSPJitterFWHMParam) ||
+	  (function == ADSPNoiseTypeParam) || (function == ADSPNoiseLevelParam) || (function == ADSPNoiseClampParam) ||
+	  (function == ADSPNoiseLowerParam) || (function == ADSPNoiseUpperParam) || (function == ADSPNoiseCorrLengthParam));
+}
+
+/**
+ * Parse and check a single sequence table change (PARAM=value or 
+ * PARAM:peak=value). The value is limited to the same range that
+ * is used when writing the parameter.
+ *
+ * /arg /c token The text for the change
+ * /arg /c entry This will be used to return the change
+ * /arg /c error This will be used to return the error message
+ *
+ * /return /c true if the change is valid
+ */
+bool ADSimPeaks::parseSequenceEntry(const string &token, ADSimPeaksSequence::s_entry &entry, string &error)
+{
+  size_t equals = token.find('=');
+  if ((equals == string::npos) || (equals == 0) || (equals == token.size()-1)) {
+    error = "expected PARAM=value, found " + token;
+    return false;
+  }
+  string name = token.substr(0, equals);
+  string value = token.substr(equals+1);
+  epicsInt32 peak = -1;
+  size_t colon = name.find(':');
+  if (colon != string::npos) {
+    char *end = NULL;
+    long peakValue = strtol(name.c_str()+colon+1, &end, 10);
+    if ((end == name.c_str()+colon+1) || (*end != '\0') || (peakValue < 0) || (peakValue >= static_cast<long>(m_maxPeaks))) {
+      error = "invalid peak in " + token;
+      return false;
+    }
+    peak = static_cast<epicsInt32>(peakValue);
+    name = name.substr(0, colon);
+  }
+
+  int function = 0;
+  if ((findParam(name.c_str(), &function) != asynSuccess) || (!sequenceParam(function))) {
+    error = "invalid parameter " + name;
+    return false;
+  }
+  
+  char *end = NULL;
+  epicsFloat64 number = strtod(value.c_str(), &end);
+  if ((end == value.c_str()) || (*end != '\0') || (!std::isfinite(number))) {
+    error = "invalid value in " + token;
+    return false;
+  }
+
+  entry.peak = peak;
+  entry.param = function;
+  entry.field = ADSimPeaksStore::e_field::type_1d;
+  entry.model = modelInput(function);
+  if (findPeakField(function, entry.field)) {
+    if (peak < 0) {
+      error = "no peak given for " + name;
+      return false;
+    }
+    entry.integer = m_store.isInteger(entry.field);
+  } else {
+    if (peak >= 0) {
+      error = name + " is not a peak parameter";
+      return false;
+    }
+    entry.integer = ((function == ADSPBGTypeXParam) || (function == ADSPBGTypeYParam) ||
+		     (function == ADSPNoiseTypeParam) || (function == ADSPNoiseClampParam));
+  }
+
+  //Limit the values in the same way as writeInt32 and writeFloat64
+  if ((function == ADSPPeakFWHMXParam) || (function == ADSPPeakFWHMYParam)) {
+    number = std::max(1.0, number);
+  } else if (function == ADSPPeakCorParam) {
+    number = std::min(1.0, std::max(-1.0, number));
+  } else if ((function == ADSPPeakMinXParam) || (function == ADSPPeakMaxXParam)) {
+    number = std::max(0.0, std::min(number, static_cast<epicsFloat64>(m_maxSizeX-1)));
+  } else if ((function == ADSPPeakMinYParam) || (function == ADSPPeakMaxYParam)) {
+    number = std::max(0.0, std::min(number, static_cast<epicsFloat64>(m_maxSizeY-1)));
+  } else if ((function == ADSPScaleParam) || (function == ADSPJitterScaleParam) ||
+	     (function == ADSPJitterAmpParam) || (function == ADSPJitterPosParam) ||
+	     (function == ADSPJitterFWHMParam) || (function == ADSPNoiseCorrLengthParam)) {
+    number = std::max(0.0, number);
+  }
+  if (entry.integer) {
+    number = static_cast<epicsFloat64>(static_cast<epicsInt32>(number));
+  }
+  entry.value = number;
+  
+  return true;
+}
+
+/**
+ * Apply the sequence table row for a frame, if the sequence table is
+ * enabled. After the last row the parameters are left as they are, 
+ * unless ADSP_SEQ_LOOP is set, in which case we go back to the first row.
+ * The changes are written to the peak storage and the parameter library, 
+ * so the readback records follow the sequence.
+ *
+ * /arg /c frame The frame number (starting at 1 for each acquisition)
+ */
+void ADSimPeaks::applySequence(epicsUInt32 frame)
+{
+  int enable = 0;
+  int loop = 0;
+  int addr = 0;
+  bool window = false;
+
+  getIntegerParam(ADSPSeqEnableParam, &enable);
+  if ((enable == 0) || (m_sequence.empty()) || (frame == 0)) {
+    return;
+  }
+  
+  epicsUInt32 row = frame - 1;
+  if (row >= m_sequence.size()) {
+    getIntegerParam(ADSPSeqLoopParam, &loop);
+    if (loop == 0) {
+      return;
+    }
+    row = row % m_sequence.size();
+  }
+
+  const ADSimPeaksSequence::s_entry *pEntry = m_sequence.rowEntries(row);
+  epicsUInt32 count = m_sequence.rowSize(row);
+  for (epicsUInt32 i=0; i<count; i++) {
+    const ADSimPeaksSequence::s_entry &entry = pEntry[i];
+    addr = 0;
+    if (entry.peak >= 0) {
+      epicsUInt32 peak = static_cast<epicsUInt32>(entry.peak);
+      if (entry.integer) {
+	m_store.setInteger(peak, entry.field, static_cast<epicsInt32>(entry.value));
+      } else {
+	m_store.setDouble(peak, entry.field, entry.value);
+      }
+      if ((peak < m_peakWindow) || (peak >= m_peakWindow + m_maxEditable)) {
+	continue;
+      }
+      addr = peak - m_peakWindow;
+      window = true;
+    }
+    if (entry.integer) {
+      setIntegerParam(addr, entry.param, static_cast<epicsInt32>(entry.value));
+    } else {
+      setDoubleParam(addr, entry.param, entry.value);
+    }
+  }
+  
+  if (m_sequence.rowModel(row)) {
+    m_modelValid = false;
+  }
+  //All the sequence table parameters change the frame (see sequenceParam)
+  if (count > 0) {
+    configChanged(false);
+  }
+  if (window) {
+    for (epicsUInt32 a=1; a<m_maxEditable; a++) {
+      callParamCallbacks(a);
+    }
+  }
+  setIntegerParam(ADSPSeqRowParam, row);
+}
+
+/**
+ * Check the state of the NDArray pool, to see if there is room for the 
+ * copy of the next frame that is passed to the plugins. The buffers that 
+ * are in use are mostly held in the plugin queues, so the pool usage 
+ * also shows if the plugin queues are filling up. This should be called 
+ * with the driver locked.
+ *
+ * /return ADSimPeaks::e_pool_state
+ */
+ADSimPeaks::e_pool_state ADSimPeaks::poolState(void)
+{
+  NDArrayInfo_t arrayInfo;
+  epicsFloat64 threshold = 0.0;
+
+  int maxBuffers = this->pNDArrayPool->getMaxBuffers();
+  int numBuffers = this->pNDArrayPool->getNumBuffers();
+  int numFree = this->pNDArrayPool->getNumFree();
+  size_t maxMemory = this->pNDArrayPool->getMaxMemory();
+  size_t memorySize = this->pNDArrayPool->getMemorySize();
+  p_NDArray->getInfo(&arrayInfo);
+
+  //A copy either reuses a free buffer, or allocates a new one if we are within the limits
+  if (numFree == 0) {
+    if ((maxBuffers > 0) && (numBuffers >= maxBuffers)) {
+      return e_pool_state::exhausted;
+    }
+    if ((maxMemory > 0) && (memorySize + arrayInfo.totalBytes > maxMemory)) {
+      return e_pool_state::exhausted;
+    }
+  }
+
+  //Check the number of buffers in use (the zero limits mean unlimited)
+  getDoubleParam(ADSPBPThresholdParam, &threshold);
+  int used = numBuffers - numFree;
+  if ((maxBuffers > 0) && (threshold > 0.0) && (used >= threshold * maxBuffers)) {
+    return e_pool_state::saturated;
+  }
+  if ((maxMemory > 0) && (numBuffers > 0) && (threshold > 0.0) &&
+      ((static_cast<epicsFloat64>(memorySize) * used / numBuffers) >= threshold * maxMemory)) {
+    return e_pool_state::saturated;
+  }
+
+  return e_pool_state::ok;
+}
+
+/**
+ * Check for backpressure from the plugins before a frame is rendered, and
+ * apply the backpressure policy. With the drop policy the frame is skipped 
+ * if the pool is saturated. With the block policy we wait until the pool 
+ * is no longer saturated (or the acquisition is stopped). With the slow 
+ * policy the time between frames is increased while the pool is saturated 
+ * (and reduced again when it is not), and the frame is only skipped if there 
+ * is no buffer available. This should be called with the driver locked.
+ *
+ * /arg /c callbacks Set to true if the frame will be passed to the plugins
+ * /arg /c frames The number of frames that are rendered together (the batch size)
+ *
+ * /return /c true if the frame should be rendered
+ */
+bool ADSimPeaks::checkBackpressure(bool callbacks, int frames)
+{
+  int policy = 0;
+  bool render = true;
+  
+  string functionName(s_className + "::" + __func__);
+
+  if (!callbacks) {
+    setIntegerParam(ADSPBPSaturatedParam, 0);
+    return true;
+  }
+
+  e_pool_state state = poolState();
+  getIntegerParam(ADSPBPPolicyParam, &policy);
+  
+  if (policy == static_cast<int>(e_bp_policy::block)) {
+    if (state != e_pool_state::ok) {
+      int stalls = 0;
+      epicsFloat64 stallTime = 0.0;
+      epicsTimeStamp startTime;
+      epicsTimeStamp endTime;
+      getIntegerParam(ADSPBPStallsParam, &stalls);
+      setIntegerParam(ADSPBPStallsParam, stalls + 1);
+      setIntegerParam(ADSPBPSaturatedParam, 1);
+      callParamCallbacks();
+      epicsTimeGetCurrent(&startTime);
+      epicsUInt64 traceStart = m_trace.now();
+      while (state != e_pool_state::ok) {
+	this->unlock();
+	epicsEventWaitStatus eventStatus = epicsEventWaitWithTimeout(m_stopEvent, s_bpPollTime);
+	this->lock();
+	if (eventStatus == epicsEventWaitOK) {
+	  //Put the stop event back so the simulation task sees it
+	  epicsEventSignal(m_stopEvent);
+	  render = false;
+	  break;
+	}
+	state = poolState();
+      }
+      m_trace.complete("backpressure", traceStart);
+      epicsTimeGetCurrent(&endTime);
+      getDoubleParam(ADSPBPStallTimeParam, &stallTime);
+      setDoubleParam(ADSPBPStallTimeParam, stallTime + epicsTimeDiffInSeconds(&endTime, &startTime));
+    }
+  } else if (policy == static_cast<int>(e_bp_policy::slow)) {
+    if (state != e_pool_state::ok) {
+      m_bpDelay = std::min(s_bpMaxDelay, std::max(s_bpMinDelay, 2.0*m_bpDelay));
+    } else {
+      m_bpDelay = 0.5*m_bpDelay;
+      if (m_bpDelay < s_bpMinDelay) {
+	m_bpDelay = 0.0;
+      }
+    }
+    setDoubleParam(ADSPBPDelayParam, m_bpDelay);
+    render = (state != e_pool_state::exhausted);
+  } else {
+    render = (state == e_pool_state::ok);
+  }
+
+  setIntegerParam(ADSPBPSaturatedParam, (state != e_pool_state::ok));
+  if (!render) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s skipping frame (NDArray pool is full)\n", functionName.c_str());
+    countDropped(frames);
+  }
+  
+  return render;
+}
+
+/**
+ * Get the current simulation time. In virtual time mode this is the
+ * virtual time of the current frame, otherwise it is the real time. 
+ * Anything that measures time (eg. the load generator and the latency 
+ * statistics) should use this.
+ *
+ * /arg /c pTime This will be used to return the time
+ */
+void ADSimPeaks::simTime(epicsTimeStamp *pTime)
+{
+  if (m_virtualTime) {
+    *pTime = m_virtualStart;
+    epicsTimeAddSeconds(pTime, m_virtualElapsed);
+  } else {
+    epicsTimeGetCurrent(pTime);
+  }
+}
+
+/**
+ * Get the virtual time from the start of a batch to one of its frames. This is
+ * the frame period (the acquire period, or the load generator rate) for each frame.
+ * If there is no frame period (eg. AcquirePeriod is 0) the real time since the
+ * start of the batch is used instead, so that the virtual clock still moves on
+ * by the time it takes to render the frames.
+ *
+ * /arg /c frames The number of frames since the start of the batch
+ * /arg /c period The acquire period
+ * /arg /c batchStart The real time at the start of the batch
+ *
+ * /return The virtual time (seconds)
+ */
+epicsFloat64 ADSimPeaks::virtualOffset(int frames, epicsFloat64 period, const epicsTimeStamp &batchStart)
+{
+  epicsFloat64 framePeriod = m_load.framePeriod(period);
+  if (framePeriod > 0.0) {
+    return frames * framePeriod;
+  }
+  epicsTimeStamp realTime;
+  epicsTimeGetCurrent(&realTime);
+  return std::max(0.0, epicsTimeDiffInSeconds(&realTime, &batchStart));
+}
+
+/**
+ * Add to the dropped frame counter.
+ *
+ * /arg /c count The number of frames that were dropped
+ */
+void ADSimPeaks::countDropped(int count)
+{
+  int dropped = 0;
+  getIntegerParam(ADSPBPDroppedParam, &dropped);
+  setIntegerParam(ADSPBPDroppedParam, dropped + count);
+}
+
+/**
+ * Allocate the render buffers for a new frame size, and touch every page,
+ * so that the page faults happen now rather than in the first frame. This 
+ * is used for the 'Prefault' memory mode. The chunk buffers are sized for 
+ * the largest chunk, and the correlated noise field is sized for the frame 
+ * if that noise type is selected. The model cache is allocated by the first 
+ * frame that uses it. This should be called with the driver locked.
+ *
+ * /arg /c cols The number of columns in the frame
+ * /arg /c rows The number of rows in the frame
+ */
+void ADSimPeaks::prefaultBuffers(epicsUInt32 cols, epicsUInt32 rows)
+{
+  int noise_type = 0;
+  const size_t chunkSize = std::max(static_cast<size_t>(1), s_chunkBytes/sizeof(epicsFloat64));
+
+  m_chunk.resize(std::max(m_chunk.size(), chunkSize));
+  ADSimPeaksPlacement::prefault(m_chunk.data(), m_chunk.size()*sizeof(epicsFloat64));
+  m_noiseChunk.resize(std::max(m_noiseChunk.size(), chunkSize));
+  ADSimPeaksPlacement::prefault(m_noiseChunk.data(), m_noiseChunk.size()*sizeof(epicsFloat64));
+  getIntegerParam(ADSPNoiseTypeParam, &noise_type);
+  if (noise_type == static_cast<int>(e_noise_type::correlated)) {
+    m_noiseField.reserve(cols, rows);
+  }
+}
+
+/**
+ * Start a load generator sweep using the current load generator 
+ * parameters. The results table is cleared. This should be called 
+ * with the driver locked.
+ */
+void ADSimPeaks::startLoad(void)
+{
+  int mode = 0;
+  int steps = 0;
+  int sizeStart = 0;
+  int sizeStop = 0;
+  epicsFloat64 rateStart = 0.0;
+  epicsFloat64 rateStop = 0.0;
+  epicsFloat64 hold = 0.0;
+  
+  getIntegerParam(ADSPLoadModeParam, &mode);
+  getIntegerParam(ADSPLoadStepsParam, &steps);
+  getDoubleParam(ADSPLoadRateStartParam, &rateStart);
+  getDoubleParam(ADSPLoadRateStopParam, &rateStop);
+  getIntegerParam(ADSPLoadSizeStartParam, &sizeStart);
+  getIntegerParam(ADSPLoadSizeStopParam, &sizeStop);
+  getDoubleParam(ADSPLoadHoldParam, &hold);
+  //A frame size sweep changes the frame size, so save it to restore at the end
+  if (static_cast<ADSimPeaksLoad::e_mode>(mode) != ADSimPeaksLoad::e_mode::rate) {
+    getIntegerParam(ADSizeX, &m_loadSizeX);
+    getIntegerParam(ADSizeY, &m_loadSizeY);
+    m_loadSizeSaved = true;
+  }
+  m_load.start(static_cast<ADSimPeaksLoad::e_mode>(mode), std::max(1, steps), rateStart, rateStop,
+	       std::max(1, sizeStart), std::max(1, sizeStop), hold);
+  publishLoad();
+}
+
+/**
+ * Move the load generator on to the next step if the hold time for the 
+ * current step is over, and set the frame size for a new step. This
+ * should be called before each frame, with the driver locked.
+ *
+ * /return /c false if the sweep is complete
+ */
+bool ADSimPeaks::stepLoad(void)
+{
+  epicsTimeStamp nowTime;
+  int dropped = 0;
+  int stalls = 0;
+
+  simTime(&nowTime);
+  getIntegerParam(ADSPBPDroppedParam, &dropped);
+  getIntegerParam(ADSPBPStallsParam, &stalls);
+
+  if (m_load.stepDone(nowTime)) {
+    m_load.endStep(nowTime, dropped, stalls);
+    publishLoad();
+    if (!m_load.active()) {
+      return false;
+    }
+  }
+
+  if (!m_load.started()) {
+    epicsUInt32 size = m_load.stepSize();
+    if (size > 0) {
+      epicsInt32 sizeY = 0;
+      getIntegerParam(ADSizeY, &sizeY);
+      if (m_2d) {
+	sizeY = static_cast<epicsInt32>(std::min(size, m_maxSizeY));
+      }
+      setLoadSize(static_cast<epicsInt32>(std::min(size, m_maxSizeX)), sizeY);
+    }
+    m_load.beginStep(nowTime, dropped, stalls);
+    setIntegerParam(ADSPLoadStepParam, m_load.step());
+  }
+
+  return true;
+}
+
+/**
+ * Set the frame size for a load generator step. This is a configuration
+ * change made by the simulation itself, so it is not included in the
+ * latency statistics (the same as the sequence table). This should be 
+ * called with the driver locked.
+ *
+ * /arg /c sizeX The X size
+ * /arg /c sizeY The Y size
+ */
+void ADSimPeaks::setLoadSize(epicsInt32 sizeX, epicsInt32 sizeY)
+{
+  int currentSizeX = 0;
+  int currentSizeY = 0;
+  
+  getIntegerParam(ADSizeX, &currentSizeX);
+  getIntegerParam(ADSizeY, &currentSizeY);
+  if ((sizeX == currentSizeX) && (sizeY == currentSizeY)) {
+    return;
+  }
+  setIntegerParam(ADSizeX, sizeX);
+  setIntegerParam(ADSizeY, sizeY);
+  m_needNewArray = true;
+  m_modelValid = false;
+  configChanged(false);
+}
+
+/**
+ * Restore the frame size that was saved at the start of a frame size
+ * sweep. This is called when the acquisition has finished (the sweep
+ * is complete, or it was stopped). This should be called with the 
+ * driver locked.
+ */
+void ADSimPeaks::restoreLoadSize(void)
+{
+  if (!m_loadSizeSaved) {
+    return;
+  }
+  m_loadSizeSaved = false;
+  setLoadSize(m_loadSizeX, m_loadSizeY);
+  callParamCallbacks();
+}
+
+/**
+ * Publish the load generator results table and the saturation step.
+ */
+void ADSimPeaks::publishLoad(void)
+{
+  const int params[] = {ADSPLoadTargetRateParam, ADSPLoadRateParam, ADSPLoadThroughputParam,
+			ADSPLoadFrameBytesParam, ADSPLoadDroppedParam, ADSPLoadStallsParam};
+  ADSimPeaksLoad::e_column column;
+
+  setIntegerParam(ADSPLoadStepParam, m_load.step());
+  setIntegerParam(ADSPLoadSatStepParam, m_load.saturationStep());
+  for (size_t i=0; i<sizeof(params)/sizeof(params[0]); i++) {
+    findLoadColumn(params[i], column);
+    std::vector<epicsFloat64> data(m_load.column(column));
+    if (!data.empty()) {
+      doCallbacksFloat64Array(&data[0], data.size(), params[i], 0);
+    }
+  }
+}
+
+/**
+ * Find the load generator results table column for a parameter.
+ *
+ * /arg /c function The parameter index (pasynUser->reason)
+ * /arg /c column This will be used to return the column
+ *
+ * /return /c true if the parameter is a results table column
+ */
+bool ADSimPeaks::findLoadColumn(int function, ADSimPeaksLoad::e_column &column)
+{
+  if (function == ADSPLoadTargetRateParam) {
+    column = ADSimPeaksLoad::e_column::target_rate;
+  } else if (function == ADSPLoadRateParam) {
+    column = ADSimPeaksLoad::e_column::rate;
+  } else if (function == ADSPLoadThroughputParam) {
+    column = ADSimPeaksLoad::e_column::throughput;
+  } else if (function == ADSPLoadFrameBytesParam) {
+    column = ADSimPeaksLoad::e_column::frame_bytes;
+  } else if (function == ADSPLoadDroppedParam) {
+    column = ADSimPeaksLoad::e_column::dropped;
+  } else if (function == ADSPLoadStallsParam) {
+    column = ADSimPeaksLoad::e_column::stalls;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Open or close the hardware performance counters for the simulation
+ * thread if the enable parameter has changed, and clear the counts for
+ * a new frame (or batch). This should be called from the simulation thread, with
+ * the driver locked.
+ */
+void ADSimPeaks::checkCounters(void)
+{
+  int enable = 0;
+  string error;
+  string functionName(s_className + "::" + __func__);
+
+  getIntegerParam(ADSPPerfEnableParam, &enable);
+  if ((enable != 0) && (!m_counters.isOpen())) {
+    if (m_counters.open(error)) {
+      setStringParam(ADSPPerfStatusParam, "Running");
+    } else {
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s %s\n", functionName.c_str(), error.c_str());
+      setStringParam(ADSPPerfStatusParam, error.c_str());
+      setIntegerParam(ADSPPerfEnableParam, 0);
+    }
+  } else if ((enable == 0) && (m_counters.isOpen())) {
+    m_counters.close();
+    setStringParam(ADSPPerfStatusParam, "Disabled");
+  }
+  m_counters.startFrame();
+}
+
+/**
+ * Publish the performance counters for the last frame.
+ */
+void ADSimPeaks::publishCounters(void)
+{
+  const int params[] = {ADSPPerfCyclesParam, ADSPPerfInstructionsParam, ADSPPerfCacheMissesParam,
+			ADSPPerfBranchMissesParam, ADSPPerfIPCParam};
+
+  m_counters.endFrame();
+  for (size_t i=0; i<sizeof(params)/sizeof(params[0]); i++) {
+    std::vector<epicsFloat64> data(*findCounterValues(params[i]));
+    doCallbacksFloat64Array(&data[0], data.size(), params[i], 0);
+  }
+}
+
+/**
+ * Find the performance counter results for a parameter.
+ *
+ * /arg /c function The parameter index (pasynUser->reason)
+ *
+ * /return Pointer to the results (one element per stage), or NULL if the parameter is not a counter
+ */
+const std::vector<epicsFloat64>* ADSimPeaks::findCounterValues(int function) const
+{
+  if (function == ADSPPerfCyclesParam) {
+    return &m_counters.values(ADSimPeaksCounters::e_counter::cycles);
+  } else if (function == ADSPPerfInstructionsParam) {
+    return &m_counters.values(ADSimPeaksCounters::e_counter::instructions);
+  } else if (function == ADSPPerfCacheMissesParam) {
+    return &m_counters.values(ADSimPeaksCounters::e_counter::cache_misses);
+  } else if (function == ADSPPerfBranchMissesParam) {
+    return &m_counters.values(ADSimPeaksCounters::e_counter::branch_misses);
+  } else if (function == ADSPPerfIPCParam) {
+    return &m_counters.ipc();
+  }
+  return NULL;
+}
+
+/**
+ * Record a configuration change. This increments the configuration
+ * generation, and if we are acquiring and there is no earlier change 
+ * waiting to be seen in a frame, it starts a latency measurement. 
+ * This should be called with the driver locked.
+ *
+ * /arg /c latency Set to false for changes made by the simulation itself 
+ * (the sequence table), which are not included in the latency statistics.
+ */
+void ADSimPeaks::configChanged(bool latency)
+{
+  m_configGen++;
+  setIntegerParam(ADSPConfigGenParam, static_cast<epicsInt32>(m_configGen));
+  if ((latency) && (m_acquiring) && (!m_latencyPending)) {
+    m_latencyPending = true;
+    m_latencyGen = m_configGen;
+    simTime(&m_latencyTime);
+    getIntegerParam(NDArrayCounter, &m_latencyCounter);
+  }
+}
+
+/**
+ * Update the latency statistics after a frame has been published. If the
+ * frame was rendered from a configuration that includes the pending change,
+ * then we measure the time (and number of frames) since the change. 
+ * This should be called with the driver locked.
+ *
+ * /arg /c arrayCounter The array counter of the frame
+ */
+void ADSimPeaks::updateLatency(epicsInt32 arrayCounter)
+{
+  epicsTimeStamp nowTime;
+  epicsFloat64 latency = 0.0;
+  epicsFloat64 minLatency = 0.0;
+  epicsFloat64 maxLatency = 0.0;
+  epicsInt32 count = 0;
+
+  if ((!m_latencyPending) || (m_plan.generation < m_latencyGen)) {
+    return;
+  }
+  m_latencyPending = false;
+  
+  simTime(&nowTime);
+  latency = epicsTimeDiffInSeconds(&nowTime, &m_latencyTime);
+  getIntegerParam(ADSPLatencyCountParam, &count);
+  getDoubleParam(ADSPLatencyMinParam, &minLatency);
+  getDoubleParam(ADSPLatencyMaxParam, &maxLatency);
+  count++;
+  m_latencySum += latency;
+  setDoubleParam(ADSPLatencyParam, latency);
+  setDoubleParam(ADSPLatencyMinParam, (count == 1) ? latency : std::min(minLatency, latency));
+  setDoubleParam(ADSPLatencyMaxParam, std::max(maxLatency, latency));
+  setDoubleParam(ADSPLatencyMeanParam, m_latencySum / count);
+  setIntegerParam(ADSPLatencyFramesParam, arrayCounter - m_latencyCounter);
+  setIntegerParam(ADSPLatencyCountParam, count);
+}
+
+/**
+ * Reset the latency statistics.
+ */
+void ADSimPeaks::resetLatency(void)
+{
+  m_latencyPending = false;
+  m_latencySum = 0.0;
+  setDoubleParam(ADSPLatencyParam, 0.0);
+  setDoubleParam(ADSPLatencyMinParam, 0.0);
+  setDoubleParam(ADSPLatencyMaxParam, 0.0);
+  setDoubleParam(ADSPLatencyMeanParam, 0.0);
+  setIntegerParam(ADSPLatencyFramesParam, 0);
+  setIntegerParam(ADSPLatencyCountParam, 0);
+}
+
+/**
+ * Attach the driver to a common frame clock. Each frame is then
+ * produced on a tick of the clock (instead of using the acquire period), 
+ * and the NDArray uniqueId and timestamp are taken from the clock.
+ *
+ * /arg /c clockName The name of the clock (see ADSimPeaksClockConfig)
+ *
+ * /return /c asynStatus
+ */
+asynStatus ADSimPeaks::attachClock(const char *clockName)
+{
+  string functionName(s_className + "::" + __func__);
+
+  ADSimPeaksClock *clock = ADSimPeaksClock::find(clockName);
+  if (clock == NULL) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+	      "%s unable to find clock %s.\n", functionName.c_str(), clockName ? clockName : "");
+    return asynError;
+  }
+
+  this->lock();
+  if (m_clock != NULL) {
+    m_clock->detach(m_tickEvent);
+  }
+  m_clock = clock;
+  m_clock->attach(m_tickEvent);
+  this->unlock();
+
+  cout << functionName << " attached to clock " << clock->getName() << endl;
+
+  return asynSuccess;
+}
+
+/**
+ * Set the placement configuration for the driver threads (CPU affinity,
+ * SCHED_FIFO priority and memory locking). This is applied by the 
+ * simulation thread when the next acquisition is started.
+ *
+ * /arg /c cpuList The list of CPUs (for example "0-3,6"), or an empty string for any CPU
+ * /arg /c priority The SCHED_FIFO priority (1 to 99), or 0 to keep the EPICS priority
+ * /arg /c memory The memory mode (0=None, 1=Prefault, 2=Lock)
+ *
+ * /return asynStatus
+ */
+asynStatus ADSimPeaks::setPlacement(const char *cpuList, epicsInt32 priority, epicsInt32 memory)
+{
+  string error;
+  string functionName(s_className + "::" + __func__);
+
+  this->lock();
+  bool status = m_placement.configure(cpuList, priority, memory, error);
+  if (status) {
+    m_placementPending = true;
+  }
+  this->unlock();
+
+  if (!status) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+	      "%s %s\n", functionName.c_str(), error.c_str());
+    return asynError;
+  }
+
+  return asynSuccess;
+}
+
+/**
+ * Save the trace of the frame pipeline to a Chrome trace event JSON file.
+ *
+ * /arg /c fileName The name of the file
+ *
+ * /return asynStatus
+ */
+asynStatus ADSimPeaks::dumpTrace(const char *fileName)
+{
+  string error;
+  string functionName(s_className + "::" + __func__);
+
+  if (m_trace.dump(fileName, error) != ADSimPeaksTrace::e_status::success) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+	      "%s %s\n", functionName.c_str(), error.c_str());
+    return asynError;
+  }
+
+  cout << functionName << " saved trace to " << fileName << endl;
+
+  return asynSuccess;
+}
+
+ 
+
+/**
+ * C function to tie into EPICS
+ */
+static void ADSimPeaksTaskC(void *drvPvt)
+{
+    ADSimPeaks *pPvt = (ADSimPeaks *)drvPvt;
+
+    pPvt->ADSimPeaksTask();
+}
+
+/**
+ * C linkage functions to define the shell commands
+ */
+extern "C" {
+
+  asynStatus ADSimPeaksConfig(const char *portName, int maxSizeX, int maxSizeY, int maxPeaks,
+			      int dataType, int maxBuffers, size_t maxMemory,
+			      int priority, int stackSize, int maxEditable)
+  {
+    asynStatus status = asynSuccess;
+    
+    // Instantiate class
+    try {
+      ADSimPeaks *adsp = new ADSimPeaks(portName, maxSizeX, maxSizeY, maxPeaks,
+				       static_cast<NDDataType_t>(dataType), maxBuffers, maxMemory,
+				       priority, stackSize, maxEditable);
+      if (adsp->getInitialized()) {
+	cerr << "Created ADSimPeaks OK." << endl;	
+      } else {
+	cerr << "Problem creating ADSimPeaks" << endl;
+	status = asynError;
+      }
+    } catch (...) {
+      cerr << __func__ << " exception caught when trying to construct ADSimPeaks." << endl;
+      status = asynError;
+    }
+    
+    return(status);
+    
+  }
+  
+  // Code for iocsh registration
+  static const iocshArg ADSimPeaksConfigArg0 = {"Port Name", iocshArgString};
   static const iocshArg ADSimPeaksConfigArg1 = {"Max Size X", iocshArgInt};
   static const iocshArg ADSimPeaksConfigArg2 = {"Max Size Y", iocshArgInt};
   static const iocshArg ADSimPeaksConfigArg3 = {"Max Peaks", iocshArgInt};
@@ -1024,6 +3156,7 @@ extern "C" {
   static const iocshArg ADSimPeaksConfigArg6 = {"maxMemory", iocshArgInt};
   static const iocshArg ADSimPeaksConfigArg7 = {"priority", iocshArgInt};
   static const iocshArg ADSimPeaksConfigArg8 = {"stackSize", iocshArgInt};
+  static const iocshArg ADSimPeaksConfigArg9 = {"Max Editable Peaks", iocshArgInt};
   static const iocshArg * const ADSimPeaksConfigArgs[] =  {&ADSimPeaksConfigArg0,
 							   &ADSimPeaksConfigArg1,
 							   &ADSimPeaksConfigArg2,
@@ -1032,18 +3165,196 @@ extern "C" {
 							   &ADSimPeaksConfigArg5,
 							   &ADSimPeaksConfigArg6,
 							   &ADSimPeaksConfigArg7,
-  							   &ADSimPeaksConfigArg8};
-  static const iocshFuncDef configADSimPeaks = {"ADSimPeaksConfig", 9, ADSimPeaksConfigArgs};
+							   &ADSimPeaksConfigArg8,
+							   &ADSimPeaksConfigArg9};
+  static const iocshFuncDef configADSimPeaks = {"ADSimPeaksConfig", 10, ADSimPeaksConfigArgs};
   static void configADSimPeaksCallFunc(const iocshArgBuf *args)
   {
     ADSimPeaksConfig(args[0].sval, args[1].ival, args[2].ival, args[3].ival,
-		     args[4].ival, args[5].ival, args[6].ival, args[7].ival, args[8].ival);
+		     args[4].ival, args[5].ival, args[6].ival, args[7].ival, args[8].ival,
+		     args[9].ival);
+  }
+
+  /**
+   * Find the ADSimPeaks driver object for an Asyn port.
+   */
+  static ADSimPeaks* findADSimPeaks(const char *portName)
+  {
+    asynPortDriver *pPort = static_cast<asynPortDriver*>(findAsynPortDriver(portName));
+    if (pPort == NULL) {
+      cerr << "ADSimPeaks: unable to find port " << (portName ? portName : "") << endl;
+      return NULL;
+    }
+    ADSimPeaks *adsp = dynamic_cast<ADSimPeaks*>(pPort);
+    if (adsp == NULL) {
+      cerr << "ADSimPeaks: port " << portName << " is not an ADSimPeaks driver" << endl;
+    }
+    return adsp;
+  }
+
+  asynStatus ADSimPeaksSetPeak(const char *portName, int peak, int type, double posX, double posY,
+			       double fwhmX, double fwhmY, double amplitude)
+  {
+    ADSimPeaks *adsp = findADSimPeaks(portName);
+    if ((adsp == NULL) || (peak < 0)) {
+      return asynError;
+    }
+    return adsp->setPeak(peak, type, posX, posY, fwhmX, fwhmY, amplitude);
+  }
+
+  asynStatus ADSimPeaksLoadPeaks(const char *portName, const char *fileName)
+  {
+    ADSimPeaks *adsp = findADSimPeaks(portName);
+    if ((adsp == NULL) || (fileName == NULL)) {
+      return asynError;
+    }
+    return adsp->loadPeaks(fileName);
+  }
+
+  static const iocshArg ADSimPeaksSetPeakArg0 = {"Port Name", iocshArgString};
+  static const iocshArg ADSimPeaksSetPeakArg1 = {"Peak", iocshArgInt};
+  static const iocshArg ADSimPeaksSetPeakArg2 = {"Type", iocshArgInt};
+  static const iocshArg ADSimPeaksSetPeakArg3 = {"Position X", iocshArgDouble};
+  static const iocshArg ADSimPeaksSetPeakArg4 = {"Position Y", iocshArgDouble};
+  static const iocshArg ADSimPeaksSetPeakArg5 = {"FWHM X", iocshArgDouble};
+  static const iocshArg ADSimPeaksSetPeakArg6 = {"FWHM Y", iocshArgDouble};
+  static const iocshArg ADSimPeaksSetPeakArg7 = {"Amplitude", iocshArgDouble};
+  static const iocshArg * const ADSimPeaksSetPeakArgs[] =  {&ADSimPeaksSetPeakArg0,
+							    &ADSimPeaksSetPeakArg1,
+							    &ADSimPeaksSetPeakArg2,
+							    &ADSimPeaksSetPeakArg3,
+							    &ADSimPeaksSetPeakArg4,
+							    &ADSimPeaksSetPeakArg5,
+							    &ADSimPeaksSetPeakArg6,
+							    &ADSimPeaksSetPeakArg7};
+  static const iocshFuncDef setPeakADSimPeaks = {"ADSimPeaksSetPeak", 8, ADSimPeaksSetPeakArgs};
+  static void setPeakADSimPeaksCallFunc(const iocshArgBuf *args)
+  {
+    ADSimPeaksSetPeak(args[0].sval, args[1].ival, args[2].ival, args[3].dval,
+		      args[4].dval, args[5].dval, args[6].dval, args[7].dval);
+  }
+
+  static const iocshArg ADSimPeaksLoadPeaksArg0 = {"Port Name", iocshArgString};
+  static const iocshArg ADSimPeaksLoadPeaksArg1 = {"File Name", iocshArgString};
+  static const iocshArg * const ADSimPeaksLoadPeaksArgs[] =  {&ADSimPeaksLoadPeaksArg0,
+							      &ADSimPeaksLoadPeaksArg1};
+  static const iocshFuncDef loadPeaksADSimPeaks = {"ADSimPeaksLoadPeaks", 2, ADSimPeaksLoadPeaksArgs};
+  static void loadPeaksADSimPeaksCallFunc(const iocshArgBuf *args)
+  {
+    ADSimPeaksLoadPeaks(args[0].sval, args[1].sval);
+  }
+
+  asynStatus ADSimPeaksLoadSequence(const char *portName, const char *fileName)
+  {
+    ADSimPeaks *adsp = findADSimPeaks(portName);
+    if ((adsp == NULL) || (fileName == NULL)) {
+      return asynError;
+    }
+    return adsp->loadSequence(fileName);
+  }
+
+  static const iocshArg ADSimPeaksLoadSequenceArg0 = {"Port Name", iocshArgString};
+  static const iocshArg ADSimPeaksLoadSequenceArg1 = {"File Name", iocshArgString};
+  static const iocshArg * const ADSimPeaksLoadSequenceArgs[] =  {&ADSimPeaksLoadSequenceArg0,
+								 &ADSimPeaksLoadSequenceArg1};
+  static const iocshFuncDef loadSequenceADSimPeaks = {"ADSimPeaksLoadSequence", 2, ADSimPeaksLoadSequenceArgs};
+  static void loadSequenceADSimPeaksCallFunc(const iocshArgBuf *args)
+  {
+    ADSimPeaksLoadSequence(args[0].sval, args[1].sval);
+  }
+
+  asynStatus ADSimPeaksClockConfig(const char *clockName, double period)
+  {
+    if (ADSimPeaksClock::create(clockName, period) == NULL) {
+      cerr << "ADSimPeaks: unable to create clock " << (clockName ? clockName : "")
+	   << " (the name must be unique and the period must be greater than zero)" << endl;
+      return asynError;
+    }
+    return asynSuccess;
+  }
+
+  asynStatus ADSimPeaksClockAttach(const char *portName, const char *clockName)
+  {
+    ADSimPeaks *adsp = findADSimPeaks(portName);
+    if (adsp == NULL) {
+      return asynError;
+    }
+    return adsp->attachClock(clockName);
+  }
+
+  asynStatus ADSimPeaksThreadConfig(const char *portName, const char *cpuList, int priority, int memory)
+  {
+    ADSimPeaks *adsp = findADSimPeaks(portName);
+    if (adsp == NULL) {
+      return asynError;
+    }
+    return adsp->setPlacement(cpuList, priority, memory);
+  }
+
+  asynStatus ADSimPeaksTraceDump(const char *portName, const char *fileName)
+  {
+    ADSimPeaks *adsp = findADSimPeaks(portName);
+    if (adsp == NULL) {
+      return asynError;
+    }
+    return adsp->dumpTrace(fileName);
+  }
+
+  static const iocshArg ADSimPeaksClockConfigArg0 = {"Clock Name", iocshArgString};
+  static const iocshArg ADSimPeaksClockConfigArg1 = {"Period", iocshArgDouble};
+  static const iocshArg * const ADSimPeaksClockConfigArgs[] =  {&ADSimPeaksClockConfigArg0,
+								&ADSimPeaksClockConfigArg1};
+  static const iocshFuncDef clockConfigADSimPeaks = {"ADSimPeaksClockConfig", 2, ADSimPeaksClockConfigArgs};
+  static void clockConfigADSimPeaksCallFunc(const iocshArgBuf *args)
+  {
+    ADSimPeaksClockConfig(args[0].sval, args[1].dval);
+  }
+
+  static const iocshArg ADSimPeaksClockAttachArg0 = {"Port Name", iocshArgString};
+  static const iocshArg ADSimPeaksClockAttachArg1 = {"Clock Name", iocshArgString};
+  static const iocshArg * const ADSimPeaksClockAttachArgs[] =  {&ADSimPeaksClockAttachArg0,
+								&ADSimPeaksClockAttachArg1};
+  static const iocshFuncDef clockAttachADSimPeaks = {"ADSimPeaksClockAttach", 2, ADSimPeaksClockAttachArgs};
+  static void clockAttachADSimPeaksCallFunc(const iocshArgBuf *args)
+  {
+    ADSimPeaksClockAttach(args[0].sval, args[1].sval);
+  }
+
+  static const iocshArg ADSimPeaksThreadConfigArg0 = {"Port Name", iocshArgString};
+  static const iocshArg ADSimPeaksThreadConfigArg1 = {"CPU List", iocshArgString};
+  static const iocshArg ADSimPeaksThreadConfigArg2 = {"SCHED_FIFO Priority", iocshArgInt};
+  static const iocshArg ADSimPeaksThreadConfigArg3 = {"Memory Mode", iocshArgInt};
+  static const iocshArg * const ADSimPeaksThreadConfigArgs[] =  {&ADSimPeaksThreadConfigArg0,
+								 &ADSimPeaksThreadConfigArg1,
+								 &ADSimPeaksThreadConfigArg2,
+								 &ADSimPeaksThreadConfigArg3};
+  static const iocshFuncDef threadConfigADSimPeaks = {"ADSimPeaksThreadConfig", 4, ADSimPeaksThreadConfigArgs};
+  static void threadConfigADSimPeaksCallFunc(const iocshArgBuf *args)
+  {
+    ADSimPeaksThreadConfig(args[0].sval, args[1].sval, args[2].ival, args[3].ival);
+  }
+
+  static const iocshArg ADSimPeaksTraceDumpArg0 = {"Port Name", iocshArgString};
+  static const iocshArg ADSimPeaksTraceDumpArg1 = {"File Name", iocshArgString};
+  static const iocshArg * const ADSimPeaksTraceDumpArgs[] =  {&ADSimPeaksTraceDumpArg0,
+							      &ADSimPeaksTraceDumpArg1};
+  static const iocshFuncDef traceDumpADSimPeaks = {"ADSimPeaksTraceDump", 2, ADSimPeaksTraceDumpArgs};
+  static void traceDumpADSimPeaksCallFunc(const iocshArgBuf *args)
+  {
+    ADSimPeaksTraceDump(args[0].sval, args[1].sval);
   }
   
   static void ADSimPeaksRegister(void)
   {
     
     iocshRegister(&configADSimPeaks, configADSimPeaksCallFunc);
+    iocshRegister(&setPeakADSimPeaks, setPeakADSimPeaksCallFunc);
+    iocshRegister(&loadPeaksADSimPeaks, loadPeaksADSimPeaksCallFunc);
+    iocshRegister(&loadSequenceADSimPeaks, loadSequenceADSimPeaksCallFunc);
+    iocshRegister(&clockConfigADSimPeaks, clockConfigADSimPeaksCallFunc);
+    iocshRegister(&clockAttachADSimPeaks, clockAttachADSimPeaksCallFunc);
+    iocshRegister(&threadConfigADSimPeaks, threadConfigADSimPeaksCallFunc);
+    iocshRegister(&traceDumpADSimPeaks, traceDumpADSimPeaksCallFunc);
   }
   
     epicsExportRegistrar(ADSimPeaksRegister);
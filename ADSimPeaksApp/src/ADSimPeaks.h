@@ -13,12 +13,27 @@
 #define ADSIMPEAKS_H
 
 #include <string>
+#include <vector>
 #include <random>
 
 #include <epicsEvent.h>
 #include "ADDriver.h"
 #include "ADSimPeaksData.h"
 #include "ADSimPeaksPeak.h"
+#include "ADSimPeaksPlan.h"
+#include "ADSimPeaksStore.h"
+#include "ADSimPeaksRandom.h"
+#include "ADSimPeaksSequence.h"
+#include "ADSimPeaksClock.h"
+#include "ADSimPeaksLoad.h"
+#include "ADSimPeaksPlacement.h"
+#include "ADSimPeaksCounters.h"
+#include "ADSimPeaksTrace.h"
+#include "ADSimPeaksWorkers.h"
+#include "ADSimPeaksNoiseField.h"
+#include "ADSimPeaksCosmic.h"
+#include "ADSimPeaksSensor.h"
+#include "ADSimPeaksTemporal.h"
 
 /* These are the drvInfo strings that are used to identify the parameters.
  * They are used by asyn clients, including standard asyn device support */
@@ -29,7 +44,99 @@
 #define ADSPNoiseClampParamString  "ADSP_NOISE_CLAMP"
 #define ADSPNoiseLowerParamString  "ADSP_NOISE_LOWER"
 #define ADSPNoiseUpperParamString  "ADSP_NOISE_UPPER"
+#define ADSPNoiseCorrLengthParamString "ADSP_NOISE_CORR_LENGTH"
+#define ADSPNoiseCorrMethodParamString "ADSP_NOISE_CORR_METHOD"
+#define ADSPNoiseTauParamString        "ADSP_NOISE_TAU"
+// Banding Params
+#define ADSPBandRowParamString      "ADSP_BAND_ROW"
+#define ADSPBandColParamString      "ADSP_BAND_COL"
+#define ADSPBandFixedParamString    "ADSP_BAND_FIXED"
+// Sensor Model Params
+#define ADSPSensorDarkParamString   "ADSP_SENSOR_DARK"
+#define ADSPSensorReadParamString   "ADSP_SENSOR_READ"
+#define ADSPSensorGainParamString   "ADSP_SENSOR_GAIN"
+#define ADSPSensorBiasParamString   "ADSP_SENSOR_BIAS"
+#define ADSPSensorBitsParamString   "ADSP_SENSOR_BITS"
+// Cosmic Ray Params
+#define ADSPCosmicRateParamString   "ADSP_COSMIC_RATE"
+#define ADSPCosmicTracksParamString "ADSP_COSMIC_TRACKS"
+#define ADSPCosmicLengthParamString "ADSP_COSMIC_LENGTH"
+#define ADSPCosmicAmpParamString    "ADSP_COSMIC_AMP"
+#define ADSPCosmicCountParamString  "ADSP_COSMIC_COUNT"
 #define ADSPElapsedTimeParamString "ADSP_ELAPSEDTIME"
+#define ADSPAntialiasParamString   "ADSP_ANTIALIAS"
+#define ADSPPeakWindowParamString  "ADSP_PEAK_WINDOW"
+#define ADSPSeedParamString        "ADSP_SEED"
+#define ADSPScaleParamString       "ADSP_SCALE"
+#define ADSPFrameScaleParamString  "ADSP_FRAME_SCALE"
+#define ADSPArrayBytesParamString  "ADSP_ARRAY_BYTES"
+#define ADSPModelCacheParamString  "ADSP_MODEL_CACHE"
+#define ADSPVirtualTimeParamString "ADSP_VIRTUAL_TIME"
+// Jitter Params
+#define ADSPJitterScaleParamString "ADSP_JITTER_SCALE"
+#define ADSPJitterAmpParamString   "ADSP_JITTER_AMP"
+#define ADSPJitterPosParamString   "ADSP_JITTER_POS"
+#define ADSPJitterFWHMParamString  "ADSP_JITTER_FWHM"
+// Sequence Table Params
+#define ADSPSeqEnableParamString   "ADSP_SEQ_ENABLE"
+#define ADSPSeqLoopParamString     "ADSP_SEQ_LOOP"
+#define ADSPSeqFileParamString     "ADSP_SEQ_FILE"
+#define ADSPSeqLoadParamString     "ADSP_SEQ_LOAD"
+#define ADSPSeqRowsParamString     "ADSP_SEQ_ROWS"
+#define ADSPSeqRowParamString      "ADSP_SEQ_ROW"
+#define ADSPSeqStatusParamString   "ADSP_SEQ_STATUS"
+// Frame Clock Params
+#define ADSPClockLatenessParamString    "ADSP_CLOCK_LATENESS"
+#define ADSPClockMaxLatenessParamString "ADSP_CLOCK_MAX_LATENESS"
+#define ADSPClockMissedParamString      "ADSP_CLOCK_MISSED"
+// Configuration Latency Params
+#define ADSPConfigGenParamString     "ADSP_CONFIG_GEN"
+#define ADSPLatencyParamString       "ADSP_LATENCY"
+#define ADSPLatencyMinParamString    "ADSP_LATENCY_MIN"
+#define ADSPLatencyMaxParamString    "ADSP_LATENCY_MAX"
+#define ADSPLatencyMeanParamString   "ADSP_LATENCY_MEAN"
+#define ADSPLatencyFramesParamString "ADSP_LATENCY_FRAMES"
+#define ADSPLatencyCountParamString  "ADSP_LATENCY_COUNT"
+#define ADSPLatencyResetParamString  "ADSP_LATENCY_RESET"
+// Backpressure Params
+#define ADSPBPPolicyParamString     "ADSP_BP_POLICY"
+#define ADSPBPThresholdParamString  "ADSP_BP_THRESHOLD"
+#define ADSPBPSaturatedParamString  "ADSP_BP_SATURATED"
+#define ADSPBPDroppedParamString    "ADSP_BP_DROPPED"
+#define ADSPBPStallsParamString     "ADSP_BP_STALLS"
+#define ADSPBPStallTimeParamString  "ADSP_BP_STALL_TIME"
+#define ADSPBPDelayParamString      "ADSP_BP_DELAY"
+// Load Generator Params
+#define ADSPLoadEnableParamString     "ADSP_LOAD_ENABLE"
+#define ADSPLoadModeParamString       "ADSP_LOAD_MODE"
+#define ADSPLoadStepsParamString      "ADSP_LOAD_STEPS"
+#define ADSPLoadRateStartParamString  "ADSP_LOAD_RATE_START"
+#define ADSPLoadRateStopParamString   "ADSP_LOAD_RATE_STOP"
+#define ADSPLoadSizeStartParamString  "ADSP_LOAD_SIZE_START"
+#define ADSPLoadSizeStopParamString   "ADSP_LOAD_SIZE_STOP"
+#define ADSPLoadHoldParamString       "ADSP_LOAD_HOLD"
+#define ADSPLoadStepParamString       "ADSP_LOAD_STEP"
+#define ADSPLoadSatStepParamString    "ADSP_LOAD_SAT_STEP"
+#define ADSPLoadTargetRateParamString "ADSP_LOAD_TARGET_RATE"
+#define ADSPLoadRateParamString       "ADSP_LOAD_RATE"
+#define ADSPLoadThroughputParamString "ADSP_LOAD_THROUGHPUT"
+#define ADSPLoadFrameBytesParamString "ADSP_LOAD_FRAME_BYTES"
+#define ADSPLoadDroppedParamString    "ADSP_LOAD_DROPPED"
+#define ADSPLoadStallsParamString     "ADSP_LOAD_STALLS"
+// Performance Counter Params
+#define ADSPPerfEnableParamString       "ADSP_PERF_ENABLE"
+#define ADSPPerfStatusParamString       "ADSP_PERF_STATUS"
+#define ADSPPerfCyclesParamString       "ADSP_PERF_CYCLES"
+#define ADSPPerfInstructionsParamString "ADSP_PERF_INSTRUCTIONS"
+#define ADSPPerfCacheMissesParamString  "ADSP_PERF_CACHE_MISSES"
+#define ADSPPerfBranchMissesParamString "ADSP_PERF_BRANCH_MISSES"
+#define ADSPPerfIPCParamString          "ADSP_PERF_IPC"
+// Trace Params
+#define ADSPTraceEnableParamString      "ADSP_TRACE_ENABLE"
+// Worker Thread Params
+#define ADSPThreadsParamString          "ADSP_THREADS"
+// Batching Params
+#define ADSPBatchSizeParamString        "ADSP_BATCH_SIZE"
 // Peak Information Params
 #define ADSPPeakType1DParamString  "ADSP_PEAK_TYPE1D"
 #define ADSPPeakType2DParamString  "ADSP_PEAK_TYPE2D"
@@ -66,18 +173,28 @@ class ADSimPeaks : public ADDriver {
 
 public:
   ADSimPeaks(const char *portName, int maxSizeX, int maxSizeY, int maxPeaks, NDDataType_t dataType,
-	     int maxBuffers, size_t maxMemory, int priority, int stackSize);
+	     int maxBuffers, size_t maxMemory, int priority, int stackSize, int maxEditable);
 
   virtual ~ADSimPeaks();
 
   virtual asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
   virtual asynStatus writeFloat64(asynUser *pasynUser, epicsFloat64 value);
+  virtual asynStatus readFloat64Array(asynUser *pasynUser, epicsFloat64 *value,
+				      size_t nElements, size_t *nIn);
   virtual void report(FILE *fp, int details);
 
   void ADSimPeaksTask(void);
 
   bool getInitialized(void);
 
+  asynStatus setPeak(epicsUInt32 peak, epicsInt32 type, epicsFloat64 posX, epicsFloat64 posY,
+		     epicsFloat64 fwhmX, epicsFloat64 fwhmY, epicsFloat64 amplitude);
+  asynStatus loadPeaks(const char *fileName);
+  asynStatus loadSequence(const char *fileName);
+  asynStatus attachClock(const char *clockName);
+  asynStatus setPlacement(const char *cpuList, epicsInt32 priority, epicsInt32 memory);
+  asynStatus dumpTrace(const char *fileName);
+
 private:
 
   //Values used for pasynUser->reason, and indexes into the parameter library.
@@ -87,7 +204,86 @@ private:
   int ADSPNoiseClampParam;
   int ADSPNoiseLowerParam;
   int ADSPNoiseUpperParam;
+  int ADSPNoiseCorrLengthParam;
+  int ADSPNoiseCorrMethodParam;
+  int ADSPNoiseTauParam;
+  int ADSPBandRowParam;
+  int ADSPBandColParam;
+  int ADSPBandFixedParam;
+  int ADSPSensorDarkParam;
+  int ADSPSensorReadParam;
+  int ADSPSensorGainParam;
+  int ADSPSensorBiasParam;
+  int ADSPSensorBitsParam;
+  int ADSPCosmicRateParam;
+  int ADSPCosmicTracksParam;
+  int ADSPCosmicLengthParam;
+  int ADSPCosmicAmpParam;
+  int ADSPCosmicCountParam;
   int ADSPElapsedTimeParam;
+  int ADSPAntialiasParam;
+  int ADSPPeakWindowParam;
+  int ADSPSeedParam;
+  int ADSPScaleParam;
+  int ADSPFrameScaleParam;
+  int ADSPArrayBytesParam;
+  int ADSPModelCacheParam;
+  int ADSPVirtualTimeParam;
+  int ADSPJitterScaleParam;
+  int ADSPJitterAmpParam;
+  int ADSPJitterPosParam;
+  int ADSPJitterFWHMParam;
+  int ADSPSeqEnableParam;
+  int ADSPSeqLoopParam;
+  int ADSPSeqFileParam;
+  int ADSPSeqLoadParam;
+  int ADSPSeqRowsParam;
+  int ADSPSeqRowParam;
+  int ADSPSeqStatusParam;
+  int ADSPClockLatenessParam;
+  int ADSPClockMaxLatenessParam;
+  int ADSPClockMissedParam;
+  int ADSPConfigGenParam;
+  int ADSPLatencyParam;
+  int ADSPLatencyMinParam;
+  int ADSPLatencyMaxParam;
+  int ADSPLatencyMeanParam;
+  int ADSPLatencyFramesParam;
+  int ADSPLatencyCountParam;
+  int ADSPLatencyResetParam;
+  int ADSPBPPolicyParam;
+  int ADSPBPThresholdParam;
+  int ADSPBPSaturatedParam;
+  int ADSPBPDroppedParam;
+  int ADSPBPStallsParam;
+  int ADSPBPStallTimeParam;
+  int ADSPBPDelayParam;
+  int ADSPLoadEnableParam;
+  int ADSPLoadModeParam;
+  int ADSPLoadStepsParam;
+  int ADSPLoadRateStartParam;
+  int ADSPLoadRateStopParam;
+  int ADSPLoadSizeStartParam;
+  int ADSPLoadSizeStopParam;
+  int ADSPLoadHoldParam;
+  int ADSPLoadStepParam;
+  int ADSPLoadSatStepParam;
+  int ADSPLoadTargetRateParam;
+  int ADSPLoadRateParam;
+  int ADSPLoadThroughputParam;
+  int ADSPLoadFrameBytesParam;
+  int ADSPLoadDroppedParam;
+  int ADSPLoadStallsParam;
+  int ADSPPerfEnableParam;
+  int ADSPPerfStatusParam;
+  int ADSPPerfCyclesParam;
+  int ADSPPerfInstructionsParam;
+  int ADSPPerfCacheMissesParam;
+  int ADSPPerfBranchMissesParam;
+  int ADSPPerfIPCParam;
+  int ADSPTraceEnableParam;
+  int ADSPThreadsParam;
+  int ADSPBatchSizeParam;
   int ADSPPeakType1DParam;
   int ADSPPeakType2DParam;
   int ADSPPeakPosXParam;
@@ -119,25 +315,141 @@ private:
   epicsUInt32 m_maxSizeX;
   epicsUInt32 m_maxSizeY;
   epicsUInt32 m_maxPeaks;
+  epicsUInt32 m_maxEditable;
+  epicsUInt32 m_peakWindow;
   bool m_2d;
   bool m_acquiring;
+  bool m_virtualTime;
+  // The last time the task blocked in virtual time mode
+  epicsTimeStamp m_virtualBlock;
+  // The start of the acquisition, and the virtual time of the current frame since the start
+  epicsTimeStamp m_virtualStart;
+  epicsFloat64 m_virtualElapsed;
   epicsUInt32 m_uniqueId;
   
   epicsEventId m_startEvent;
   epicsEventId m_stopEvent;
 
+  // Common frame clock (if attached), the event that it signals
+  // and the last tick that we used.
+  ADSimPeaksClock *m_clock;
+  epicsEventId m_tickEvent;
+  epicsUInt32 m_clockTick;
+
   bool m_initialized;
 
   NDArray *p_NDArray;
   NDArray *p_NDArrayPlugins;
+  NDArray *p_NDArrayBatch;
   bool m_needNewArray;
   bool m_needReset;
 
   std::default_random_engine m_rand_gen;
 
+  // Counter based random numbers, used for the per-frame jitter
+  ADSimPeaksRandom m_random;
+
   // Create object used to access the various probability
   // distributions and other types of peaks.
   ADSimPeaksPeak m_peaks;
+
+  // Storage for the peak definitions. Only a window of these
+  // peaks (m_maxEditable) are mapped to Asyn addresses.
+  ADSimPeaksStore m_store;
+
+  // The background and peaks plan for a frame, which
+  // renders the model for each part of a row.
+  ADSimPeaksPlan m_render;
+
+  /**
+   * The plan for a single frame. This is built by ADSimPeaks::planFrame 
+   * from the parameters before each frame is rendered (along with 
+   * m_render).
+   */
+  struct s_plan {
+    epicsUInt32 frame;
+    epicsUInt32 generation;
+    epicsUInt32 sizeX;
+    epicsUInt32 sizeY;
+    bool reset;
+    epicsFloat64 scale;
+    bool useModel;
+    bool modelValid;
+    bool keepModel;
+  };
+  s_plan m_plan;
+
+  // The peak and background model, which is cached (if enabled) so that
+  // frames that only differ by the global scale don't need to be recalculated.
+  std::vector<epicsFloat64> m_model;
+  bool m_modelValid;
+  // Buffer for the model of a single chunk, if the model is not cached
+  std::vector<epicsFloat64> m_chunk;
+  // Buffer for the noise of a single chunk
+  std::vector<epicsFloat64> m_noiseChunk;
+  // The row and column offsets (banding) for the current frame
+  std::vector<epicsFloat64> m_bandRow;
+  std::vector<epicsFloat64> m_bandCol;
+
+  // The per-frame parameter changes (the sequence table)
+  ADSimPeaksSequence m_sequence;
+
+  // The configuration generation (incremented on every parameter write),
+  // and the first write that has not yet been seen in a frame.
+  epicsUInt32 m_configGen;
+  bool m_latencyPending;
+  epicsUInt32 m_latencyGen;
+  epicsTimeStamp m_latencyTime;
+  epicsInt32 m_latencyCounter;
+  epicsFloat64 m_latencySum;
+
+  // The extra delay between frames used by the slow down backpressure policy
+  epicsFloat64 m_bpDelay;
+
+  // The load generator sweep and results
+  ADSimPeaksLoad m_load;
+  // The frame size to restore at the end of a frame size sweep
+  bool m_loadSizeSaved;
+  epicsInt32 m_loadSizeX;
+  epicsInt32 m_loadSizeY;
+
+  // The thread placement configuration, and a flag to apply it at the next acquisition
+  ADSimPeaksPlacement m_placement;
+  bool m_placementPending;
+
+  // The hardware performance counters for each stage of the frame
+  ADSimPeaksCounters m_counters;
+
+  // The trace of the frame pipeline
+  ADSimPeaksTrace m_trace;
+
+  // The worker threads used to split up the rendering
+  ADSimPeaksWorkers m_workers;
+
+  // The spatially correlated noise for the current frame
+  ADSimPeaksNoiseField m_noiseField;
+
+  // The CCD/CMOS sensor noise model
+  ADSimPeaksSensor m_sensor;
+
+  // The per-pixel state for the temporally correlated noise
+  ADSimPeaksTemporal m_temporal;
+
+  // The cosmic ray tracks and zingers for the current frame
+  ADSimPeaksCosmic m_cosmic;
+  epicsUInt32 m_cosmicCount;
+
+  /**
+   * The random number streams used for the jitter. 
+   * These are combined with the peak number.
+   */
+  enum class e_jitter {
+    scale = 0,
+    amplitude,
+    position_x,
+    position_y,
+    fwhm
+  };
   
   /**
    * The enum for the type of noise. This needs to match
@@ -146,7 +458,10 @@ private:
   enum class e_noise_type {
     none = 0,
     uniform,
-    gaussian  
+    gaussian,
+    correlated,
+    sensor,
+    temporal
   };
 
   /**
@@ -158,16 +473,86 @@ private:
     polynomial,
     exponential  
   };
+
+  /**
+   * The enum for the backpressure policy. This needs to match
+   * the list order presented to the user in the database.
+   */
+  enum class e_bp_policy {
+    drop = 0,
+    block,
+    slow
+  };
+
+  /**
+   * The state of the NDArray pool. Saturated means the pool usage 
+   * is above the threshold, and exhausted means there is no buffer 
+   * available for the next frame.
+   */
+  enum class e_pool_state {
+    ok = 0,
+    saturated,
+    exhausted
+  };
   
   // Static Data
   static const std::string s_className;
-  static const epicsFloat64 s_zeroCheck;
+  static const std::string s_taskName;
+  static const std::string s_workerName;
+  static const size_t s_chunkBytes;
+  static const epicsFloat64 s_bpPollTime;
+  static const epicsFloat64 s_bpMinDelay;
+  static const epicsFloat64 s_bpMaxDelay;
+  static const epicsUInt64 s_bandRowStream;
+  static const epicsUInt64 s_bandColStream;
+  static const epicsInt32 s_maxBatch;
+  static const epicsFloat64 s_virtualBlockTime;
 
+  asynStatus planFrame(epicsUInt32 frame);
+  epicsFloat64 jitter(epicsUInt32 peak, e_jitter type, epicsFloat64 sigma);
+  bool planBanding(void);
+  bool modelInput(int function);
+  bool renderInput(int function);
   asynStatus computeData(NDDataType_t dataType);
   template <typename T> asynStatus computeDataT();
+  epicsFloat64* modelRow(epicsUInt32 bin_y, epicsUInt32 r0, epicsUInt32 c0, epicsUInt32 width);
   
+  // Peak Storage Functions
+  bool findPeakField(int function, ADSimPeaksStore::e_field &field);
+  void refreshPeakWindow(void);
+
+  // Sequence Table Functions
+  bool sequenceParam(int function);
+  bool parseSequenceEntry(const std::string &token, ADSimPeaksSequence::s_entry &entry, std::string &error);
+  void applySequence(epicsUInt32 frame);
+
+  // Backpressure Functions
+  e_pool_state poolState(void);
+  bool checkBackpressure(bool callbacks, int frames);
+  void countDropped(int count);
+  void prefaultBuffers(epicsUInt32 cols, epicsUInt32 rows);
+  void simTime(epicsTimeStamp *pTime);
+  epicsFloat64 virtualOffset(int frames, epicsFloat64 period, const epicsTimeStamp &batchStart);
+
+  // Load Generator Functions
+  void startLoad(void);
+  bool stepLoad(void);
+  void setLoadSize(epicsInt32 sizeX, epicsInt32 sizeY);
+  void restoreLoadSize(void);
+  void publishLoad(void);
+  bool findLoadColumn(int function, ADSimPeaksLoad::e_column &column);
+
+  // Performance Counter Functions
+  void checkCounters(void);
+  void publishCounters(void);
+  const std::vector<epicsFloat64>* findCounterValues(int function) const;
+
+  // Configuration Latency Functions
+  void configChanged(bool latency);
+  void updateLatency(epicsInt32 arrayCounter);
+  void resetLatency(void);
+
   // Utilty Functions
-  epicsFloat64 zeroCheck(epicsFloat64 value);
   
 };
 
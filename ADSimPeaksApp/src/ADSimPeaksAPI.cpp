@@ -0,0 +1,258 @@
+/**
+ * \brief C API for the ADSimPeaks simulation engine, so that other
+ *        detector drivers can render simulated peaks directly into
+ *        their own buffers.
+ *
+ * Each function is a thin wrapper around ADSimPeaksEngine, which does
+ * the locking. A context is just an ADSimPeaksEngine object.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#include <new>
+
+#include "ADSimPeaksEngine.h"
+
+#include <epicsExport.h>
+#include "ADSimPeaksAPI.h"
+
+/**
+ * The context is the engine itself.
+ */
+struct ADSimPeaksContext {
+  ADSimPeaksEngine engine;
+  ADSimPeaksContext(epicsUInt32 sizeX, epicsUInt32 sizeY) : engine(sizeX, sizeY) {}
+};
+
+/**
+ * Convert an engine status to the API return value.
+ */
+static int toStatus(ADSimPeaksEngine::e_status status)
+{
+  return (status == ADSimPeaksEngine::e_status::success) ? 0 : -1;
+}
+
+/**
+ * Get the API version.
+ *
+ * /return ADSIMPEAKS_API_VERSION
+ */
+int ADSimPeaksAPIVersion(void)
+{
+  return ADSIMPEAKS_API_VERSION;
+}
+
+/**
+ * Create a simulation context.
+ *
+ * /arg /c sizeX The number of bins in the X dimension
+ * /arg /c sizeY The number of bins in the Y dimension (0 or 1 for 1D data)
+ *
+ * /return The context, or NULL on error
+ */
+ADSimPeaksContext* ADSimPeaksCreate(int sizeX, int sizeY)
+{
+  if ((sizeX <= 0) || (sizeY < 0)) {
+    return NULL;
+  }
+  return new (std::nothrow) ADSimPeaksContext(static_cast<epicsUInt32>(sizeX), static_cast<epicsUInt32>(sizeY));
+}
+
+/**
+ * Destroy a simulation context. This must not be called while
+ * another thread is using the context.
+ *
+ * /arg /c context The context (this can be NULL)
+ */
+void ADSimPeaksDestroy(ADSimPeaksContext *context)
+{
+  delete context;
+}
+
+/**
+ * Set the frame size.
+ *
+ * /arg /c context The context
+ * /arg /c sizeX The number of bins in the X dimension
+ * /arg /c sizeY The number of bins in the Y dimension (0 or 1 for 1D data)
+ */
+int ADSimPeaksSetSize(ADSimPeaksContext *context, int sizeX, int sizeY)
+{
+  if ((context == NULL) || (sizeX <= 0) || (sizeY < 0)) {
+    return -1;
+  }
+  return toStatus(context->engine.setSize(static_cast<epicsUInt32>(sizeX), static_cast<epicsUInt32>(sizeY)));
+}
+
+/**
+ * Set a peak. The parameters are the same as the ADSimPeaks peak records.
+ * A type of 0 removes the peak.
+ *
+ * /arg /c context The context
+ * /arg /c peak The peak index
+ * /arg /c type The peak type (PeakType1D for 1D data and PeakType2D for 2D data)
+ * /arg /c posX, posY The position
+ * /arg /c fwhmX, fwhmY The full width at half maximum
+ * /arg /c amplitude The height of the peak
+ * /arg /c correlation The X/Y correlation (2D only)
+ * /arg /c p1, p2 The shape parameters
+ */
+int ADSimPeaksSetPeak(ADSimPeaksContext *context, int peak, int type,
+		      double posX, double posY, double fwhmX, double fwhmY,
+		      double amplitude, double correlation, double p1, double p2)
+{
+  ADSimPeaksData data;
+
+  if ((context == NULL) || (peak < 0)) {
+    return -1;
+  }
+  data.setPositionX(posX);
+  data.setPositionY(posY);
+  data.setFWHMX(fwhmX);
+  data.setFWHMY(fwhmY);
+  data.setAmplitude(amplitude);
+  data.setCorrelation(correlation);
+  data.setParam1(p1);
+  data.setParam2(p2);
+  return toStatus(context->engine.setPeak(static_cast<epicsUInt32>(peak), type, data));
+}
+
+/**
+ * Limit the range of bins for a peak (a maximum of 0 means the end of the frame).
+ *
+ * /arg /c context The context
+ * /arg /c peak The peak index
+ * /arg /c minX, maxX The X range
+ * /arg /c minY, maxY The Y range
+ */
+int ADSimPeaksSetPeakBounds(ADSimPeaksContext *context, int peak,
+			    int minX, int maxX, int minY, int maxY)
+{
+  if ((context == NULL) || (peak < 0) || (minX < 0) || (maxX < 0) || (minY < 0) || (maxY < 0)) {
+    return -1;
+  }
+  return toStatus(context->engine.setPeakBounds(static_cast<epicsUInt32>(peak),
+						static_cast<epicsUInt32>(minX), static_cast<epicsUInt32>(maxX),
+						static_cast<epicsUInt32>(minY), static_cast<epicsUInt32>(maxY)));
+}
+
+/**
+ * Remove all the peaks.
+ *
+ * /arg /c context The context
+ */
+int ADSimPeaksClearPeaks(ADSimPeaksContext *context)
+{
+  if (context == NULL) {
+    return -1;
+  }
+  context->engine.clearPeaks();
+  return 0;
+}
+
+/**
+ * Set the background profile for one axis.
+ *
+ * /arg /c context The context
+ * /arg /c axis The axis
+ * /arg /c type The background type
+ * /arg /c c0, c1, c2, c3 The coefficients
+ * /arg /c shift The shift
+ */
+int ADSimPeaksSetBackground(ADSimPeaksContext *context, ADSimPeaksAxis_t axis,
+			    ADSimPeaksBGType_t type, double c0, double c1,
+			    double c2, double c3, double shift)
+{
+  if (context == NULL) {
+    return -1;
+  }
+  return toStatus(context->engine.setBackground((axis == ADSimPeaksAxisY) ? ADSimPeaksEngine::e_axis::y : ADSimPeaksEngine::e_axis::x,
+						static_cast<ADSimPeaksEngine::e_bg_type>(type), c0, c1, c2, c3, shift));
+}
+
+/**
+ * Set the noise.
+ *
+ * /arg /c context The context
+ * /arg /c type The noise type
+ * /arg /c level The noise level
+ * /arg /c clamp Non-zero to clamp the noise to the range [lower, upper]
+ * /arg /c lower The lower clamp value
+ * /arg /c upper The upper clamp value
+ */
+int ADSimPeaksSetNoise(ADSimPeaksContext *context, ADSimPeaksNoiseType_t type,
+		       double level, int clamp, double lower, double upper)
+{
+  if (context == NULL) {
+    return -1;
+  }
+  return toStatus(context->engine.setNoise(static_cast<ADSimPeaksEngine::e_noise_type>(type),
+					   level, (clamp != 0), lower, upper));
+}
+
+/**
+ * Set the random number seed.
+ *
+ * /arg /c context The context
+ * /arg /c seed The seed (64 bits, the same as the driver)
+ */
+int ADSimPeaksSetSeed(ADSimPeaksContext *context, unsigned long long seed)
+{
+  if (context == NULL) {
+    return -1;
+  }
+  context->engine.setSeed(seed);
+  return 0;
+}
+
+/**
+ * Set the global scale.
+ *
+ * /arg /c context The context
+ * /arg /c scale The scale
+ */
+int ADSimPeaksSetScale(ADSimPeaksContext *context, double scale)
+{
+  if (context == NULL) {
+    return -1;
+  }
+  context->engine.setScale(scale);
+  return 0;
+}
+
+/**
+ * Enable antialiasing of the hard edged 2D shapes.
+ *
+ * /arg /c context The context
+ * /arg /c antialias Non-zero to enable antialiasing
+ */
+int ADSimPeaksSetAntialias(ADSimPeaksContext *context, int antialias)
+{
+  if (context == NULL) {
+    return -1;
+  }
+  context->engine.setAntialias(antialias != 0);
+  return 0;
+}
+
+/**
+ * Render a frame into a caller buffer (sizeX*sizeY elements, in array order).
+ *
+ * /arg /c context The context
+ * /arg /c frame The frame number (the noise depends on the seed and the frame number)
+ * /arg /c dataType The data type of the buffer (an NDDataType_t value)
+ * /arg /c buffer The buffer
+ * /arg /c bytes The size of the buffer in bytes
+ * /arg /c accumulate Non-zero to add the frame to the buffer contents
+ */
+int ADSimPeaksRender(ADSimPeaksContext *context, unsigned int frame, int dataType,
+		     void *buffer, size_t bytes, int accumulate)
+{
+  if ((context == NULL) || (dataType < NDInt8) || (dataType > NDFloat64)) {
+    return -1;
+  }
+  return toStatus(context->engine.render(frame, static_cast<NDDataType_t>(dataType),
+					 buffer, bytes, (accumulate != 0)));
+}
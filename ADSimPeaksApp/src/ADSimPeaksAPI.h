@@ -0,0 +1,97 @@
+/**
+ * \brief C API for the ADSimPeaks simulation engine, so that other
+ *        detector drivers can render simulated peaks directly into
+ *        their own buffers.
+ *
+ * A typical simulation mode in another driver looks like:
+ *
+ * ADSimPeaksContext *sim = ADSimPeaksCreate(1024, 1024); <br>
+ * ADSimPeaksSetPeak(sim, 0, 4, 512, 512, 20, 20, 1000, 0, 0, 0); <br>
+ * ADSimPeaksSetBackground(sim, ADSimPeaksAxisX, ADSimPeaksBGPolynomial, 10, 0, 0, 0, 0); <br>
+ * ADSimPeaksSetNoise(sim, ADSimPeaksNoiseGaussian, 5, 0, 0, 0); <br>
+ * ADSimPeaksRender(sim, frame, NDUInt16, pArray->pData, pArray->dataSize, 0); <br>
+ * ADSimPeaksDestroy(sim); <br>
+ *
+ * The peak type is the same as the ADSimPeaks PeakType1D or PeakType2D records
+ * (for example, 3 is a 1D Gaussian and 4 is a 2D Gaussian), and the data type is
+ * an NDDataType_t value. The functions return 0 on success and -1 on error.
+ *
+ * All the functions can be called from any thread. Each context has its own lock,
+ * and contexts don't share any state, so several threads can render with their
+ * own contexts at the same time.
+ *
+ * The API is versioned with ADSIMPEAKS_API_VERSION. Functions are only added to
+ * it, and existing functions are not changed.
+ *
+ * More detailed documentation can be found in the source file.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#ifndef ADSIMPEAKSAPI_H
+#define ADSIMPEAKSAPI_H
+
+#include <stddef.h>
+
+#include <shareLib.h>
+
+#define ADSIMPEAKS_API_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The simulation context. This is opaque to the caller. */
+typedef struct ADSimPeaksContext ADSimPeaksContext;
+
+/** The background axis. */
+typedef enum {
+  ADSimPeaksAxisX = 0,
+  ADSimPeaksAxisY = 1
+} ADSimPeaksAxis_t;
+
+/** The background type (the same as the BGTypeX and BGTypeY records). */
+typedef enum {
+  ADSimPeaksBGNone = 0,
+  ADSimPeaksBGPolynomial = 1,
+  ADSimPeaksBGExponential = 2
+} ADSimPeaksBGType_t;
+
+/** The noise type (the same as the first NoiseType record values). */
+typedef enum {
+  ADSimPeaksNoiseNone = 0,
+  ADSimPeaksNoiseUniform = 1,
+  ADSimPeaksNoiseGaussian = 2
+} ADSimPeaksNoiseType_t;
+
+epicsShareFunc int ADSimPeaksAPIVersion(void);
+
+epicsShareFunc ADSimPeaksContext* ADSimPeaksCreate(int sizeX, int sizeY);
+epicsShareFunc void ADSimPeaksDestroy(ADSimPeaksContext *context);
+
+epicsShareFunc int ADSimPeaksSetSize(ADSimPeaksContext *context, int sizeX, int sizeY);
+epicsShareFunc int ADSimPeaksSetPeak(ADSimPeaksContext *context, int peak, int type,
+				     double posX, double posY, double fwhmX, double fwhmY,
+				     double amplitude, double correlation, double p1, double p2);
+epicsShareFunc int ADSimPeaksSetPeakBounds(ADSimPeaksContext *context, int peak,
+					   int minX, int maxX, int minY, int maxY);
+epicsShareFunc int ADSimPeaksClearPeaks(ADSimPeaksContext *context);
+epicsShareFunc int ADSimPeaksSetBackground(ADSimPeaksContext *context, ADSimPeaksAxis_t axis,
+					   ADSimPeaksBGType_t type, double c0, double c1,
+					   double c2, double c3, double shift);
+epicsShareFunc int ADSimPeaksSetNoise(ADSimPeaksContext *context, ADSimPeaksNoiseType_t type,
+				      double level, int clamp, double lower, double upper);
+epicsShareFunc int ADSimPeaksSetSeed(ADSimPeaksContext *context, unsigned long long seed);
+epicsShareFunc int ADSimPeaksSetScale(ADSimPeaksContext *context, double scale);
+epicsShareFunc int ADSimPeaksSetAntialias(ADSimPeaksContext *context, int antialias);
+
+epicsShareFunc int ADSimPeaksRender(ADSimPeaksContext *context, unsigned int frame, int dataType,
+				    void *buffer, size_t bytes, int accumulate);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ADSIMPEAKSAPI_H */
@@ -0,0 +1,185 @@
+/**
+ * \brief Frame clock that can be shared by several ADSimPeaks
+ *        areaDetector drivers.
+ *
+ * Each clock has a name and a period, and runs its own thread. On every 
+ * tick the clock increments the tick number, records the time of the tick,
+ * and signals all the attached drivers at the same time. The drivers use 
+ * the tick number and tick time for the NDArray uniqueId and timestamp,
+ * so frames from different drivers can be matched up.
+ *
+ * The ticks are scheduled from the time the clock was started (rather 
+ * than from the previous tick) so the clock does not drift, and the tick
+ * time is the scheduled time rather than the time the thread woke up.
+ *
+ * The clocks are created from the IOC shell and are never destroyed, so 
+ * the drivers can hold on to the pointers.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#include <algorithm>
+
+#include <epicsThread.h>
+
+#include <ADSimPeaksClock.h>
+
+std::map<std::string, ADSimPeaksClock*> ADSimPeaksClock::s_clocks;
+
+/**
+ * C function to run the clock thread
+ */
+static void ADSimPeaksClockTaskC(void *drvPvt)
+{
+  ADSimPeaksClock *pPvt = (ADSimPeaksClock *)drvPvt;
+  pPvt->clockTask();
+}
+
+/**
+ * Constructor. Use ADSimPeaksClock::create to make a new clock.
+ *
+ * /arg /c name The name of the clock
+ * /arg /c period The time between ticks (seconds)
+ */
+ADSimPeaksClock::ADSimPeaksClock(const char *name, epicsFloat64 period)
+  : m_name(name),
+    m_period(period),
+    m_tick(0)
+{
+  m_lock = epicsMutexMustCreate();
+  epicsTimeGetCurrent(&m_tickTime);
+}
+
+/**
+ * Destructor
+ */
+ADSimPeaksClock::~ADSimPeaksClock(void) {
+  epicsMutexDestroy(m_lock);
+}
+
+/**
+ * Create a new clock and start the clock thread. 
+ *
+ * /arg /c name The name of the clock (this must be unique)
+ * /arg /c period The time between ticks (seconds, this must be greater than zero)
+ *
+ * /return Pointer to the clock, or NULL if the clock could not be created
+ */
+ADSimPeaksClock* ADSimPeaksClock::create(const char *name, epicsFloat64 period) {
+  if ((name == NULL) || (period <= 0.0) || (find(name) != NULL)) {
+    return NULL;
+  }
+  ADSimPeaksClock *clock = new ADSimPeaksClock(name, period);
+  s_clocks[clock->m_name] = clock;
+  epicsThreadId threadId = epicsThreadCreate(("ADSimPeaksClock_" + clock->m_name).c_str(),
+					     epicsThreadPriorityHigh,
+					     epicsThreadGetStackSize(epicsThreadStackMedium),
+					     (EPICSTHREADFUNC)ADSimPeaksClockTaskC,
+					     clock);
+  if (threadId == NULL) {
+    s_clocks.erase(clock->m_name);
+    delete clock;
+    return NULL;
+  }
+  return clock;
+}
+
+/**
+ * Find a clock by name.
+ *
+ * /arg /c name The name of the clock
+ *
+ * /return Pointer to the clock, or NULL if there is no clock with that name
+ */
+ADSimPeaksClock* ADSimPeaksClock::find(const char *name) {
+  if (name == NULL) {
+    return NULL;
+  }
+  std::map<std::string, ADSimPeaksClock*>::iterator it = s_clocks.find(name);
+  if (it == s_clocks.end()) {
+    return NULL;
+  }
+  return it->second;
+}
+
+/**
+ * Get the name of the clock.
+ */
+const std::string& ADSimPeaksClock::getName(void) const {
+  return m_name;
+}
+
+/**
+ * Get the time between ticks (seconds).
+ */
+epicsFloat64 ADSimPeaksClock::getPeriod(void) const {
+  return m_period;
+}
+
+/**
+ * Attach an event, which will be signaled on every tick.
+ *
+ * /arg /c event The event to signal
+ */
+void ADSimPeaksClock::attach(epicsEventId event) {
+  epicsMutexLock(m_lock);
+  if (std::find(m_events.begin(), m_events.end(), event) == m_events.end()) {
+    m_events.push_back(event);
+  }
+  epicsMutexUnlock(m_lock);
+}
+
+/**
+ * Detach an event, so that it is no longer signaled.
+ *
+ * /arg /c event The event
+ */
+void ADSimPeaksClock::detach(epicsEventId event) {
+  epicsMutexLock(m_lock);
+  m_events.erase(std::remove(m_events.begin(), m_events.end(), event), m_events.end());
+  epicsMutexUnlock(m_lock);
+}
+
+/**
+ * Get the latest tick.
+ *
+ * /arg /c tick This will be used to return the tick number (starting at 1)
+ * /arg /c tickTime This will be used to return the time of the tick
+ */
+void ADSimPeaksClock::getTick(epicsUInt32 &tick, epicsTimeStamp &tickTime) {
+  epicsMutexLock(m_lock);
+  tick = m_tick;
+  tickTime = m_tickTime;
+  epicsMutexUnlock(m_lock);
+}
+
+/**
+ * The clock thread which runs forever. 
+ */
+void ADSimPeaksClock::clockTask(void) {
+  epicsTimeStamp startTime;
+  epicsTimeStamp nextTime;
+  epicsTimeStamp nowTime;
+  epicsUInt32 tick = 0;
+
+  epicsTimeGetCurrent(&startTime);
+  while (true) {
+    tick++;
+    nextTime = startTime;
+    epicsTimeAddSeconds(&nextTime, tick*m_period);
+    epicsTimeGetCurrent(&nowTime);
+    epicsFloat64 delay = epicsTimeDiffInSeconds(&nextTime, &nowTime);
+    if (delay > 0.0) {
+      epicsThreadSleep(delay);
+    }
+    epicsMutexLock(m_lock);
+    m_tick = tick;
+    m_tickTime = nextTime;
+    for (size_t i=0; i<m_events.size(); i++) {
+      epicsEventSignal(m_events[i]);
+    }
+    epicsMutexUnlock(m_lock);
+  }
+}
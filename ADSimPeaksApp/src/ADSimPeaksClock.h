@@ -0,0 +1,55 @@
+/**
+ * \brief Frame clock that can be shared by several ADSimPeaks
+ *        areaDetector drivers.
+ *
+ * More detailed documentation can be found in the source file.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#ifndef ADSIMPEAKSCLOCK_H
+#define ADSIMPEAKSCLOCK_H
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <epicsTypes.h>
+#include <epicsTime.h>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+
+class ADSimPeaksClock
+{
+ public:
+  virtual ~ADSimPeaksClock(void);
+
+  static ADSimPeaksClock* create(const char *name, epicsFloat64 period);
+  static ADSimPeaksClock* find(const char *name);
+
+  const std::string& getName(void) const;
+  epicsFloat64 getPeriod(void) const;
+
+  void attach(epicsEventId event);
+  void detach(epicsEventId event);
+  void getTick(epicsUInt32 &tick, epicsTimeStamp &tickTime);
+
+  void clockTask(void);
+
+ private:
+  ADSimPeaksClock(const char *name, epicsFloat64 period);
+
+  std::string m_name;
+  epicsFloat64 m_period;
+  epicsMutexId m_lock;
+  std::vector<epicsEventId> m_events;
+  epicsUInt32 m_tick;
+  epicsTimeStamp m_tickTime;
+
+  static std::map<std::string, ADSimPeaksClock*> s_clocks;
+
+};
+
+#endif //ADSIMPEAKSCLOCK_H
@@ -0,0 +1,220 @@
+/**
+ * \brief Cosmic ray tracks and zingers used by the ADSimPeaks
+ *        areaDetector driver.
+ *
+ * The number of events in each frame is drawn from a Poisson distribution
+ * with the given rate (the mean number of events per frame). Each event is
+ * either a zinger (a single bright pixel) or a track (a straight line of 
+ * pixels at a random angle, with an exponentially distributed length). 
+ * The random numbers come from the counter based random number generator,
+ * using the frame number as the counter, so the events are reproducible 
+ * for a given seed.
+ *
+ * Only the pixels that are hit are stored (a track is walked one pixel 
+ * at a time along its major axis), so the cost is proportional to the total
+ * length of the events, and not to the size of the frame. The driver adds 
+ * the hits directly to the NDArray. The track amplitude is the value 
+ * deposited per pixel of path length, so a diagonal track deposits more 
+ * in each pixel than a horizontal one.
+ *
+ * The event list can be described as a string, which is attached 
+ * to the NDArray so that the events can be checked by a plugin.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+
+#include <ADSimPeaksCosmic.h>
+
+const epicsUInt32 ADSimPeaksCosmic::s_maxEvents = 10000;
+const epicsUInt64 ADSimPeaksCosmic::s_stream = 0x4000000000000000ULL;
+
+/**
+ * Constructor.
+ */
+ADSimPeaksCosmic::ADSimPeaksCosmic(void)
+  : m_textValid(true)
+{
+}
+
+/**
+ * Destructor
+ */
+ADSimPeaksCosmic::~ADSimPeaksCosmic(void) {
+}
+
+/**
+ * Generate the events for a frame.
+ *
+ * /arg /c random The random number generator
+ * /arg /c frame The frame number
+ * /arg /c sizeX The number of columns
+ * /arg /c sizeY The number of rows (1 for a 1D frame, in which case the tracks are horizontal)
+ * /arg /c rate The mean number of events per frame
+ * /arg /c trackFraction The fraction of the events that are tracks (the rest are zingers)
+ * /arg /c length The mean track length in pixels
+ * /arg /c amplitude The amplitude of a zinger, or the amplitude per pixel of a track
+ */
+void ADSimPeaksCosmic::generate(const ADSimPeaksRandom &random, epicsUInt64 frame,
+				epicsUInt32 sizeX, epicsUInt32 sizeY, epicsFloat64 rate,
+				epicsFloat64 trackFraction, epicsFloat64 length, epicsFloat64 amplitude)
+{
+  clear();
+  if ((rate <= 0.0) || (sizeX == 0) || (sizeY == 0)) {
+    return;
+  }
+
+  epicsUInt32 count = std::min(poisson(random, frame, rate), s_maxEvents);
+  m_events.reserve(count);
+  for (epicsUInt32 i=0; i<count; i++) {
+    s_event event;
+    event.x0 = static_cast<epicsInt32>(random.uniform(stream(i, e_field::position_x), frame) * sizeX);
+    event.y0 = static_cast<epicsInt32>(random.uniform(stream(i, e_field::position_y), frame) * sizeY);
+    // Zingers have a random amplitude between 0.5 and 1.5 times the amplitude
+    event.amplitude = amplitude * (0.5 + random.uniform(stream(i, e_field::amplitude), frame));
+    event.x1 = event.x0;
+    event.y1 = event.y0;
+    event.pixels = 0;
+    if (random.uniform(stream(i, e_field::type), frame) < trackFraction) {
+      event.type = e_type::track;
+      event.amplitude = amplitude;
+      epicsFloat64 trackLength = -length * log(1.0 - random.uniform(stream(i, e_field::length), frame));
+      epicsFloat64 angle = 2.0 * ADSimPeaksRandom::s_pi * random.uniform(stream(i, e_field::angle), frame);
+      if (sizeY == 1) {
+	angle = (angle < ADSimPeaksRandom::s_pi) ? 0.0 : ADSimPeaksRandom::s_pi;
+      }
+      addTrack(event, trackLength*cos(angle), trackLength*sin(angle), sizeX, sizeY);
+    } else {
+      event.type = e_type::zinger;
+      event.pixels = 1;
+      s_hit hit = {static_cast<size_t>(event.y0)*sizeX + event.x0, event.amplitude};
+      m_hits.push_back(hit);
+    }
+    m_events.push_back(event);
+  }
+}
+
+/**
+ * Clear the events.
+ */
+void ADSimPeaksCosmic::clear(void) {
+  m_events.clear();
+  m_hits.clear();
+  m_textValid = false;
+}
+
+/**
+ * Read the events for the last frame.
+ */
+const std::vector<ADSimPeaksCosmic::s_event>& ADSimPeaksCosmic::events(void) const {
+  return m_events;
+}
+
+/**
+ * Read the pixels that are changed by the events for the last frame.
+ */
+const std::vector<ADSimPeaksCosmic::s_hit>& ADSimPeaksCosmic::hits(void) const {
+  return m_hits;
+}
+
+/**
+ * Describe the events for the last frame as a string. Each event is
+ * 'type x0 y0 x1 y1 amplitude pixels', where type is Z (zinger) or T (track),
+ * and the events are separated by a semicolon. The pixels is the number
+ * of pixels in the event.
+ *
+ * /return The description (empty if there were no events)
+ */
+const std::string& ADSimPeaksCosmic::describe(void) {
+  if (!m_textValid) {
+    char buffer[128] = {0};
+    m_text.clear();
+    for (size_t i=0; i<m_events.size(); i++) {
+      const s_event &event = m_events[i];
+      snprintf(buffer, sizeof(buffer), "%s%c %d %d %d %d %g %u", (i == 0) ? "" : ";",
+	       (event.type == e_type::track) ? 'T' : 'Z',
+	       event.x0, event.y0, event.x1, event.y1, event.amplitude, event.pixels);
+      m_text += buffer;
+    }
+    m_textValid = true;
+  }
+  return m_text;
+}
+
+/**
+ * The random number stream for an event and one of its random numbers.
+ *
+ * /arg /c index The event number (or the iteration for the event count)
+ * /arg /c field Which random number
+ */
+epicsUInt64 ADSimPeaksCosmic::stream(epicsUInt64 index, e_field field) {
+  return s_stream | (index << 4) | static_cast<epicsUInt64>(field);
+}
+
+/**
+ * Draw the number of events from a Poisson distribution. For large
+ * rates this uses the normal approximation.
+ *
+ * /arg /c random The random number generator
+ * /arg /c frame The frame number
+ * /arg /c rate The mean number of events
+ *
+ * /return The number of events
+ */
+epicsUInt32 ADSimPeaksCosmic::poisson(const ADSimPeaksRandom &random, epicsUInt64 frame, epicsFloat64 rate) {
+  if (rate > 30.0) {
+    epicsFloat64 count = round(rate + sqrt(rate)*random.gaussian(stream(0, e_field::count), frame));
+    return static_cast<epicsUInt32>(std::max(0.0, std::min(count, static_cast<epicsFloat64>(s_maxEvents))));
+  }
+  const epicsFloat64 limit = exp(-rate);
+  epicsFloat64 product = 1.0;
+  epicsUInt32 count = 0;
+  while (true) {
+    product *= random.uniform(stream(count + 1, e_field::count), frame);
+    if (product <= limit) {
+      break;
+    }
+    count++;
+  }
+  return count;
+}
+
+/**
+ * Walk along a track one pixel at a time (along the major axis),
+ * and add the pixels until the track leaves the frame. The end
+ * of the event is set to the last pixel inside the frame.
+ *
+ * /arg /c event The event, which has the start position
+ * /arg /c dx The length of the track in X
+ * /arg /c dy The length of the track in Y
+ * /arg /c sizeX The number of columns
+ * /arg /c sizeY The number of rows
+ */
+void ADSimPeaksCosmic::addTrack(s_event &event, epicsFloat64 dx, epicsFloat64 dy, epicsUInt32 sizeX, epicsUInt32 sizeY)
+{
+  epicsUInt32 steps = static_cast<epicsUInt32>(ceil(std::max(fabs(dx), fabs(dy))));
+  steps = std::max(steps, static_cast<epicsUInt32>(1));
+  const epicsFloat64 stepX = dx/steps;
+  const epicsFloat64 stepY = dy/steps;
+  const epicsFloat64 value = event.amplitude * sqrt(stepX*stepX + stepY*stepY);
+  const epicsFloat64 x0 = event.x0 + 0.5;
+  const epicsFloat64 y0 = event.y0 + 0.5;
+  for (epicsUInt32 i=0; i<=steps; i++) {
+    epicsInt32 x = static_cast<epicsInt32>(floor(x0 + i*stepX));
+    epicsInt32 y = static_cast<epicsInt32>(floor(y0 + i*stepY));
+    if ((x < 0) || (y < 0) || (x >= static_cast<epicsInt32>(sizeX)) || (y >= static_cast<epicsInt32>(sizeY))) {
+      // The track starts inside the frame, so once it leaves it does not come back
+      break;
+    }
+    event.x1 = x;
+    event.y1 = y;
+    s_hit hit = {static_cast<size_t>(y)*sizeX + x, value};
+    m_hits.push_back(hit);
+    event.pixels++;
+  }
+}
@@ -0,0 +1,95 @@
+/**
+ * \brief Cosmic ray tracks and zingers used by the ADSimPeaks
+ *        areaDetector driver.
+ *
+ * More detailed documentation can be found in the source file.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#ifndef ADSIMPEAKSCOSMIC_H
+#define ADSIMPEAKSCOSMIC_H
+
+#include <string>
+#include <vector>
+
+#include <epicsTypes.h>
+
+#include "ADSimPeaksRandom.h"
+
+class ADSimPeaksCosmic
+{
+ public:
+  ADSimPeaksCosmic(void);
+  virtual ~ADSimPeaksCosmic(void);
+
+  /**
+   * The enum for the type of event.
+   */
+  enum class e_type {
+    zinger = 0,
+    track
+  };
+
+  /**
+   * An event. The positions are the first and last pixel (the same pixel for a zinger).
+   */
+  struct s_event {
+    e_type type;
+    epicsInt32 x0;
+    epicsInt32 y0;
+    epicsInt32 x1;
+    epicsInt32 y1;
+    epicsFloat64 amplitude;
+    epicsUInt32 pixels;
+  };
+
+  /**
+   * A pixel that is changed by an event (the index into the frame, and the value to add).
+   */
+  struct s_hit {
+    size_t index;
+    epicsFloat64 value;
+  };
+
+  static const epicsUInt32 s_maxEvents;
+  static const epicsUInt64 s_stream;
+
+  void generate(const ADSimPeaksRandom &random, epicsUInt64 frame,
+		epicsUInt32 sizeX, epicsUInt32 sizeY, epicsFloat64 rate,
+		epicsFloat64 trackFraction, epicsFloat64 length, epicsFloat64 amplitude);
+  void clear(void);
+
+  const std::vector<s_event>& events(void) const;
+  const std::vector<s_hit>& hits(void) const;
+  const std::string& describe(void);
+
+ private:
+
+  /**
+   * The random numbers used for each event.
+   */
+  enum class e_field {
+    count = 0,
+    type,
+    position_x,
+    position_y,
+    angle,
+    length,
+    amplitude
+  };
+
+  static epicsUInt64 stream(epicsUInt64 index, e_field field);
+  static epicsUInt32 poisson(const ADSimPeaksRandom &random, epicsUInt64 frame, epicsFloat64 rate);
+  void addTrack(s_event &event, epicsFloat64 dx, epicsFloat64 dy, epicsUInt32 sizeX, epicsUInt32 sizeY);
+
+  std::vector<s_event> m_events;
+  std::vector<s_hit> m_hits;
+  std::string m_text;
+  bool m_textValid;
+
+};
+
+#endif //ADSIMPEAKSCOSMIC_H
@@ -0,0 +1,229 @@
+/**
+ * \brief Hardware performance counters for each stage of the
+ *        ADSimPeaks areaDetector driver frame pipeline.
+ *
+ * A wall clock timer can show that a stage is slow, but not why. This
+ * class uses the Linux perf_event_open interface to count the CPU cycles,
+ * instructions, cache misses and branch misses of the simulation thread,
+ * and adds them up for each stage of the frame (the background, the peaks,
+ * the noise, the conversion to the NDArray data type, the copy for the
+ * plugins and the plugin callbacks). A low number of instructions per
+ * cycle together with a high number of cache misses means a stage is
+ * limited by memory rather than by computation.
+ *
+ * The counters are opened as a single group for the calling thread, so
+ * they are always scheduled together, and only user space is counted
+ * (this is allowed by the default perf_event_paranoid setting). The
+ * counters are read at the start and end of each stage, so the stages
+ * do not need to be contiguous. Each read is a system call, so the
+ * stages are measured for each chunk of the frame rather than for each row.
+ *
+ * Work done by the render worker threads (see ADSimPeaksWorkers) is not
+ * counted, because the counters do not follow other threads. The trace
+ * shows the time spent by the workers.
+ *
+ * The counters are only supported on Linux. On other systems open
+ * returns an error.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include <ADSimPeaksCounters.h>
+
+const epicsUInt32 ADSimPeaksCounters::s_numStages = 6;
+const epicsUInt32 ADSimPeaksCounters::s_numCounters = 4;
+
+/**
+ * Constructor
+ */
+ADSimPeaksCounters::ADSimPeaksCounters(void)
+  : m_last(s_numCounters, 0),
+    m_now(s_numCounters, 0),
+    m_frame(s_numCounters*s_numStages, 0),
+    m_values(s_numCounters, std::vector<epicsFloat64>(s_numStages, 0.0)),
+    m_ipc(s_numStages, 0.0)
+{
+}
+
+/**
+ * Destructor
+ */
+ADSimPeaksCounters::~ADSimPeaksCounters(void) {
+  close();
+}
+
+/**
+ * Open and enable the counters for the calling thread.
+ *
+ * /arg /c error This will be used to return an error message
+ *
+ * /return false if the counters could not be opened
+ */
+bool ADSimPeaksCounters::open(std::string &error) {
+  close();
+
+#ifdef __linux__
+  static const epicsUInt64 configs[] = {PERF_COUNT_HW_CPU_CYCLES,
+					PERF_COUNT_HW_INSTRUCTIONS,
+					PERF_COUNT_HW_CACHE_MISSES,
+					PERF_COUNT_HW_BRANCH_MISSES};
+  static const char *names[] = {"cycles", "instructions", "cache misses", "branch misses"};
+
+  for (epicsUInt32 i=0; i<s_numCounters; i++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = configs[i];
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.disabled = (i == 0) ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    int groupFd = m_fds.empty() ? -1 : m_fds[0];
+    int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0));
+    if (fd < 0) {
+      error = std::string("unable to open ") + names[i] + " counter: " + strerror(errno);
+      close();
+      return false;
+    }
+    m_fds.push_back(fd);
+  }
+
+  ioctl(m_fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(m_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  if (!read(m_last)) {
+    error = "unable to read counters";
+    close();
+    return false;
+  }
+  return true;
+#else
+  error = "performance counters are not supported on this system";
+  return false;
+#endif
+}
+
+/**
+ * Close the counters.
+ */
+void ADSimPeaksCounters::close(void) {
+#ifdef __linux__
+  for (std::vector<int>::reverse_iterator it = m_fds.rbegin(); it != m_fds.rend(); ++it) {
+    ::close(*it);
+  }
+#endif
+  m_fds.clear();
+}
+
+/**
+ * Check if the counters are open.
+ */
+bool ADSimPeaksCounters::isOpen(void) const {
+  return !m_fds.empty();
+}
+
+/**
+ * Clear the counts for a new frame.
+ */
+void ADSimPeaksCounters::startFrame(void) {
+  std::fill(m_frame.begin(), m_frame.end(), 0);
+}
+
+/**
+ * Read the counters at the start of a stage.
+ */
+void ADSimPeaksCounters::begin(void) {
+  if (!m_fds.empty()) {
+    read(m_last);
+  }
+}
+
+/**
+ * Read the counters at the end of a stage, and add the counts since
+ * the last call to begin (or end) to the stage. Consecutive stages
+ * can use end without calling begin again.
+ *
+ * /arg /c stage The stage
+ */
+void ADSimPeaksCounters::end(e_stage stage) {
+  if ((m_fds.empty()) || (!read(m_now))) {
+    return;
+  }
+  epicsUInt64 *pFrame = &m_frame[static_cast<epicsUInt32>(stage)*s_numCounters];
+  for (epicsUInt32 i=0; i<s_numCounters; i++) {
+    pFrame[i] += m_now[i] - m_last[i];
+  }
+  m_last.swap(m_now);
+}
+
+/**
+ * Copy the counts for the frame to the results, and calculate
+ * the instructions per cycle for each stage.
+ */
+void ADSimPeaksCounters::endFrame(void) {
+  const epicsUInt32 cycles = static_cast<epicsUInt32>(e_counter::cycles);
+  const epicsUInt32 instructions = static_cast<epicsUInt32>(e_counter::instructions);
+  for (epicsUInt32 stage=0; stage<s_numStages; stage++) {
+    for (epicsUInt32 i=0; i<s_numCounters; i++) {
+      m_values[i][stage] = static_cast<epicsFloat64>(m_frame[stage*s_numCounters + i]);
+    }
+    m_ipc[stage] = (m_values[cycles][stage] > 0.0) ? (m_values[instructions][stage] / m_values[cycles][stage]) : 0.0;
+  }
+}
+
+/**
+ * Get the results for the last frame for one of the counters.
+ * There is one element for each stage (see ADSimPeaksCounters::e_stage).
+ *
+ * /arg /c counter The counter
+ *
+ * /return Reference to the results
+ */
+const std::vector<epicsFloat64>& ADSimPeaksCounters::values(e_counter counter) const {
+  return m_values[static_cast<epicsUInt32>(counter)];
+}
+
+/**
+ * Get the instructions per cycle for each stage for the last frame.
+ *
+ * /return Reference to the results
+ */
+const std::vector<epicsFloat64>& ADSimPeaksCounters::ipc(void) const {
+  return m_ipc;
+}
+
+/**
+ * Read the current value of all the counters.
+ *
+ * /arg /c counts This will be used to return the counts
+ *
+ * /return false if the counters could not be read
+ */
+bool ADSimPeaksCounters::read(std::vector<epicsUInt64> &counts) {
+#ifdef __linux__
+  //With PERF_FORMAT_GROUP the leader returns the number of counters, then the values
+  epicsUInt64 buffer[1 + s_numCounters];
+  if (::read(m_fds[0], buffer, sizeof(buffer)) < static_cast<ssize_t>(sizeof(epicsUInt64)*(1 + s_numCounters))) {
+    return false;
+  }
+  for (epicsUInt32 i=0; i<s_numCounters; i++) {
+    counts[i] = buffer[1 + i];
+  }
+  return true;
+#else
+  return false;
+#endif
+}
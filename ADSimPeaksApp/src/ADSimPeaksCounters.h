@@ -0,0 +1,76 @@
+/**
+ * \brief Hardware performance counters for each stage of the
+ *        ADSimPeaks areaDetector driver frame pipeline.
+ *
+ * More detailed documentation can be found in the source file.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#ifndef ADSIMPEAKSCOUNTERS_H
+#define ADSIMPEAKSCOUNTERS_H
+
+#include <string>
+#include <vector>
+
+#include <epicsTypes.h>
+
+class ADSimPeaksCounters
+{
+ public:
+  ADSimPeaksCounters(void);
+  virtual ~ADSimPeaksCounters(void);
+
+  /**
+   * The stages of the frame pipeline. This is the order of the
+   * elements in the results arrays.
+   */
+  enum class e_stage {
+    background = 0,
+    peaks,
+    noise,
+    conversion,
+    copy,
+    callbacks
+  };
+
+  /**
+   * The hardware counters.
+   */
+  enum class e_counter {
+    cycles = 0,
+    instructions,
+    cache_misses,
+    branch_misses
+  };
+
+  static const epicsUInt32 s_numStages;
+  static const epicsUInt32 s_numCounters;
+
+  bool open(std::string &error);
+  void close(void);
+  bool isOpen(void) const;
+
+  void startFrame(void);
+  void begin(void);
+  void end(e_stage stage);
+  void endFrame(void);
+
+  const std::vector<epicsFloat64>& values(e_counter counter) const;
+  const std::vector<epicsFloat64>& ipc(void) const;
+
+ private:
+  bool read(std::vector<epicsUInt64> &counts);
+
+  std::vector<int> m_fds;
+  std::vector<epicsUInt64> m_last;
+  std::vector<epicsUInt64> m_now;
+  std::vector<epicsUInt64> m_frame;
+  std::vector<std::vector<epicsFloat64> > m_values;
+  std::vector<epicsFloat64> m_ipc;
+
+};
+
+#endif //ADSIMPEAKSCOUNTERS_H
@@ -0,0 +1,297 @@
+/**
+ * \brief Difference array accumulator used to render piecewise constant
+ *        and piecewise linear peak shapes for the ADSimPeaks areaDetector driver.
+ *
+ * Shapes like the square, triangle and pyramid are made of flat or linear
+ * pieces, so there is no need to evaluate them bin by bin. Instead each
+ * piece is recorded as a small number of entries in a set of difference
+ * arrays, and the final profile is recovered by prefix sums in a single
+ * pass over the array (one row at a time).
+ *
+ * Two kinds of entries are supported:
+ *
+ *   Box - a constant value over a rectangle. This is a standard 2D
+ *         difference array, so it costs 4 entries regardless of size.
+ *   Segment - a linear function (offset + slope*x) over a range of bins
+ *         in a single row. This costs 2 entries per row, so a shape
+ *         with sloped edges costs O(perimeter) entries.
+ *
+ * The entries are stored sparsely (sorted by row when first used) so that
+ * the memory needed is proportional to the number of entries plus one row.
+ * A row can also be recovered in several chunks (in increasing X order), 
+ * so the caller only needs a buffer for part of a row.
+ *
+ * This class can be used for both 1D and 2D applications. In the
+ * case of 1D the Y size is set to 1.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#include <algorithm>
+
+#include <ADSimPeaksDiff.h>
+
+/**
+ * Constructor.
+ */
+ADSimPeaksDiff::ADSimPeaksDiff(void) {
+  reset(0, 0);
+}
+
+/**
+ * Destructor
+ */
+ADSimPeaksDiff::~ADSimPeaksDiff(void) {
+}
+
+/**
+ * Clear all the entries and set the size of the array.
+ *
+ * /arg /c sizeX The number of bins in the X dimension
+ * /arg /c sizeY The number of bins in the Y dimension (1 for 1D data)
+ */
+void ADSimPeaksDiff::reset(epicsUInt32 sizeX, epicsUInt32 sizeY)
+{
+  m_sizeX = sizeX;
+  m_sizeY = sizeY;
+  m_boxRow = 0;
+  m_sorted = false;
+  m_entries.clear();
+  m_sortedEntries.clear();
+  m_box.assign(m_sizeX+1, 0.0);
+  m_offset.assign(m_sizeX+1, 0.0);
+  m_slope.assign(m_sizeX+1, 0.0);
+  m_runActive = false;
+  m_runSegments = false;
+  m_runRow = 0;
+  m_runX = 0;
+  m_runBox = 0.0;
+  m_runOffset = 0.0;
+  m_runSlope = 0.0;
+}
+
+/**
+ * Check if there is anything to render.
+ *
+ * /return true if no entries have been added since the last reset
+ */
+bool ADSimPeaksDiff::empty(void) const
+{
+  return m_entries.empty();
+}
+
+/**
+ * Add a constant value over a rectangle of bins. The rectangle
+ * is inclusive and is clipped to the array size.
+ *
+ * /arg /c x0 The first X bin
+ * /arg /c x1 The last X bin
+ * /arg /c y0 The first Y bin
+ * /arg /c y1 The last Y bin
+ * /arg /c value The value to add to each bin
+ */
+void ADSimPeaksDiff::addBox(epicsInt64 x0, epicsInt64 x1, epicsInt64 y0, epicsInt64 y1, epicsFloat64 value)
+{
+  x0 = std::max(x0, static_cast<epicsInt64>(0));
+  y0 = std::max(y0, static_cast<epicsInt64>(0));
+  x1 = std::min(x1, static_cast<epicsInt64>(m_sizeX)-1);
+  y1 = std::min(y1, static_cast<epicsInt64>(m_sizeY)-1);
+  if ((x0 > x1) || (y0 > y1) || (value == 0.0)) {
+    return;
+  }
+
+  s_entry entry = {0, 0, 0.0, 0.0, 0.0};
+  entry.y = static_cast<epicsUInt32>(y0);
+  entry.x = static_cast<epicsUInt32>(x0);
+  entry.box = value;
+  m_entries.push_back(entry);
+  entry.x = static_cast<epicsUInt32>(x1+1);
+  entry.box = -value;
+  m_entries.push_back(entry);
+  // Close the box, unless it extends to the last row
+  if (y1+1 < static_cast<epicsInt64>(m_sizeY)) {
+    entry.y = static_cast<epicsUInt32>(y1+1);
+    entry.x = static_cast<epicsUInt32>(x0);
+    entry.box = -value;
+    m_entries.push_back(entry);
+    entry.x = static_cast<epicsUInt32>(x1+1);
+    entry.box = value;
+    m_entries.push_back(entry);
+  }
+  m_sorted = false;
+}
+
+/**
+ * Add a linear function (offset + slope*x) over a range of bins in a
+ * single row. The range is inclusive and is clipped to the array size.
+ *
+ * /arg /c y The Y bin (row)
+ * /arg /c x0 The first X bin
+ * /arg /c x1 The last X bin
+ * /arg /c offset The value of the function at x=0
+ * /arg /c slope The change in the function per X bin
+ */
+void ADSimPeaksDiff::addSegment(epicsInt64 y, epicsInt64 x0, epicsInt64 x1, epicsFloat64 offset, epicsFloat64 slope)
+{
+  x0 = std::max(x0, static_cast<epicsInt64>(0));
+  x1 = std::min(x1, static_cast<epicsInt64>(m_sizeX)-1);
+  if ((x0 > x1) || (y < 0) || (y >= static_cast<epicsInt64>(m_sizeY))) {
+    return;
+  }
+
+  s_entry entry = {0, 0, 0.0, 0.0, 0.0};
+  entry.y = static_cast<epicsUInt32>(y);
+  entry.x = static_cast<epicsUInt32>(x0);
+  entry.offset = offset;
+  entry.slope = slope;
+  m_entries.push_back(entry);
+  entry.x = static_cast<epicsUInt32>(x1+1);
+  entry.offset = -offset;
+  entry.slope = -slope;
+  m_entries.push_back(entry);
+  m_sorted = false;
+}
+
+/**
+ * Sort the entries by row (counting sort) so that each row
+ * can find its entries directly.
+ */
+void ADSimPeaksDiff::sortEntries(void)
+{
+  m_rowStart.assign(m_sizeY+1, 0);
+  for (size_t i=0; i<m_entries.size(); i++) {
+    m_rowStart[m_entries[i].y+1]++;
+  }
+  for (epicsUInt32 row=0; row<m_sizeY; row++) {
+    m_rowStart[row+1] += m_rowStart[row];
+  }
+  std::vector<size_t> next(m_rowStart.begin(), m_rowStart.end()-1);
+  m_sortedEntries.resize(m_entries.size());
+  for (size_t i=0; i<m_entries.size(); i++) {
+    m_sortedEntries[next[m_entries[i].y]++] = m_entries[i];
+  }
+  // Start the box accumulation again
+  m_box.assign(m_sizeX+1, 0.0);
+  m_offset.assign(m_sizeX+1, 0.0);
+  m_slope.assign(m_sizeX+1, 0.0);
+  m_boxRow = 0;
+  m_runActive = false;
+  m_sorted = true;
+}
+
+/**
+ * Prepare the prefix sums for a new row. This brings the box column
+ * sums up to date for the row, and loads the segments for the row.
+ *
+ * /arg /c y The Y bin (row)
+ */
+void ADSimPeaksDiff::startRow(epicsUInt32 y)
+{
+  // Remove any segments left over from a row that was not finished
+  if (m_runActive) {
+    for (epicsUInt32 x=m_runX; x<=m_sizeX; x++) {
+      m_offset[x] = 0.0;
+      m_slope[x] = 0.0;
+    }
+  }
+
+  // Bring the box column sums up to date for this row
+  if (y+1 < m_boxRow) {
+    m_box.assign(m_sizeX+1, 0.0);
+    m_boxRow = 0;
+  }
+  for (epicsUInt32 row=m_boxRow; row<=y; row++) {
+    for (size_t i=m_rowStart[row]; i<m_rowStart[row+1]; i++) {
+      m_box[m_sortedEntries[i].x] += m_sortedEntries[i].box;
+    }
+  }
+  m_boxRow = std::max(m_boxRow, y+1);
+
+  // Segments only apply to this row
+  m_runSegments = false;
+  for (size_t i=m_rowStart[y]; i<m_rowStart[y+1]; i++) {
+    if ((m_sortedEntries[i].offset != 0.0) || (m_sortedEntries[i].slope != 0.0)) {
+      m_offset[m_sortedEntries[i].x] += m_sortedEntries[i].offset;
+      m_slope[m_sortedEntries[i].x] += m_sortedEntries[i].slope;
+      m_runSegments = true;
+    }
+  }
+
+  m_runActive = true;
+  m_runRow = y;
+  m_runX = 0;
+  m_runBox = 0.0;
+  m_runOffset = 0.0;
+  m_runSlope = 0.0;
+}
+
+/**
+ * Recover the profile for one row using prefix sums, and add it into the
+ * row buffer. This is most efficient when called for rows in increasing order.
+ *
+ * /arg /c y The Y bin (row)
+ * /arg /c pRow Pointer to a buffer of sizeX elements to add the profile into
+ */
+void ADSimPeaksDiff::applyRow(epicsUInt32 y, epicsFloat64 *pRow)
+{
+  if (m_sizeX > 0) {
+    applyRow(y, 0, m_sizeX-1, pRow);
+  }
+}
+
+/**
+ * Recover the profile for part of one row using prefix sums, and add it into
+ * the row buffer. A row can be recovered in several chunks, which is most 
+ * efficient when the chunks are contiguous and in increasing X order.
+ *
+ * /arg /c y The Y bin (row)
+ * /arg /c x0 The first X bin
+ * /arg /c x1 The last X bin
+ * /arg /c pRow Pointer to a buffer of (x1-x0+1) elements to add the profile into
+ */
+void ADSimPeaksDiff::applyRow(epicsUInt32 y, epicsUInt32 x0, epicsUInt32 x1, epicsFloat64 *pRow)
+{
+  if ((m_entries.empty()) || (y >= m_sizeY) || (x0 > x1) || (x1 >= m_sizeX)) {
+    return;
+  }
+  if (!m_sorted) {
+    sortEntries();
+  }
+  if ((!m_runActive) || (y != m_runRow) || (x0 < m_runX)) {
+    startRow(y);
+  }
+
+  epicsFloat64 box = m_runBox;
+  epicsFloat64 offset = m_runOffset;
+  epicsFloat64 slope = m_runSlope;
+  // Catch up to the start of the chunk (only needed if a chunk was skipped)
+  for (epicsUInt32 x=m_runX; x<x0; x++) {
+    box += m_box[x];
+    offset += m_offset[x];
+    slope += m_slope[x];
+    m_offset[x] = 0.0;
+    m_slope[x] = 0.0;
+  }
+  if (m_runSegments) {
+    for (epicsUInt32 x=x0; x<=x1; x++) {
+      box += m_box[x];
+      offset += m_offset[x];
+      slope += m_slope[x];
+      m_offset[x] = 0.0;
+      m_slope[x] = 0.0;
+      pRow[x-x0] += box + offset + slope*x;
+    }
+  } else {
+    for (epicsUInt32 x=x0; x<=x1; x++) {
+      box += m_box[x];
+      pRow[x-x0] += box;
+    }
+  }
+  m_runBox = box;
+  m_runOffset = offset;
+  m_runSlope = slope;
+  m_runX = x1+1;
+}
+
@@ -0,0 +1,74 @@
+/**
+ * \brief Difference array accumulator used to render piecewise constant
+ *        and piecewise linear peak shapes for the ADSimPeaks areaDetector driver.
+ *
+ * More detailed documentation can be found in the source file.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#ifndef ADSIMPEAKSDIFF_H
+#define ADSIMPEAKSDIFF_H
+
+#include <vector>
+
+#include <epicsTypes.h>
+
+class ADSimPeaksDiff
+{
+ public:
+  ADSimPeaksDiff(void);
+  virtual ~ADSimPeaksDiff(void);
+
+  void reset(epicsUInt32 sizeX, epicsUInt32 sizeY);
+  bool empty(void) const;
+
+  void addBox(epicsInt64 x0, epicsInt64 x1, epicsInt64 y0, epicsInt64 y1, epicsFloat64 value);
+  void addSegment(epicsInt64 y, epicsInt64 x0, epicsInt64 x1, epicsFloat64 offset, epicsFloat64 slope);
+
+  void applyRow(epicsUInt32 y, epicsFloat64 *pRow);
+  void applyRow(epicsUInt32 y, epicsUInt32 x0, epicsUInt32 x1, epicsFloat64 *pRow);
+
+ private:
+
+  /**
+   * A single entry in the difference arrays. Box entries persist
+   * from their row onwards, segment entries only apply to their row.
+   */
+  struct s_entry {
+    epicsUInt32 y;
+    epicsUInt32 x;
+    epicsFloat64 box;
+    epicsFloat64 offset;
+    epicsFloat64 slope;
+  };
+
+  void sortEntries(void);
+  void startRow(epicsUInt32 y);
+
+  epicsUInt32 m_sizeX;
+  epicsUInt32 m_sizeY;
+  epicsUInt32 m_boxRow;
+  bool m_sorted;
+  std::vector<s_entry> m_entries;
+  std::vector<s_entry> m_sortedEntries;
+  std::vector<size_t> m_rowStart;
+  std::vector<epicsFloat64> m_box;
+  std::vector<epicsFloat64> m_offset;
+  std::vector<epicsFloat64> m_slope;
+
+  // State of the prefix sums for the current row, so that
+  // a row can be applied in several chunks.
+  bool m_runActive;
+  bool m_runSegments;
+  epicsUInt32 m_runRow;
+  epicsUInt32 m_runX;
+  epicsFloat64 m_runBox;
+  epicsFloat64 m_runOffset;
+  epicsFloat64 m_runSlope;
+
+};
+
+#endif //ADSIMPEAKSDIFF_H
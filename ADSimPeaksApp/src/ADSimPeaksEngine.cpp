@@ -0,0 +1,387 @@
+/**
+ * \brief Standalone simulation engine, which renders the ADSimPeaks
+ *        background, peaks and noise into a caller buffer.
+ *
+ * This is used by the C API (see ADSimPeaksAPI.h) so that other detector
+ * drivers can have a simulation mode, without an ADSimPeaks driver or an
+ * extra NDArray. It uses the same background and peaks plan as the driver
+ * (ADSimPeaksPlan), so the model is calculated in the same way. The peak
+ * types and the background and noise types have the same values as the
+ * driver records.
+ *
+ * The peaks, background and frame size are turned into a plan, which is only
+ * rebuilt when the configuration is changed. The frame is rendered one row at
+ * a time, and each element of the caller buffer is written once.
+ *
+ * The noise uses the counter based random number generator, with the frame
+ * number and the element index, so a frame can be reproduced for a given seed
+ * regardless of which thread renders it.
+ *
+ * Each engine has its own lock, so an engine can be used from several threads.
+ * Separate engines do not share any state.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#include <cmath>
+#include <algorithm>
+
+#include <ADSimPeaksEngine.h>
+
+const epicsUInt32 ADSimPeaksEngine::s_maxPeaks = 10000;
+const epicsUInt64 ADSimPeaksEngine::s_stream = 0x0400000000000000ULL;
+
+/**
+ * Constructor. There are no peaks, no background and no noise to begin with.
+ *
+ * /arg /c sizeX The number of bins in the X dimension
+ * /arg /c sizeY The number of bins in the Y dimension (0 or 1 for 1D data)
+ */
+ADSimPeaksEngine::ADSimPeaksEngine(epicsUInt32 sizeX, epicsUInt32 sizeY)
+  : m_sizeX(0),
+    m_sizeY(1),
+    m_2d(false),
+    m_noiseType(e_noise_type::none),
+    m_noiseLevel(0.0),
+    m_noiseClamp(false),
+    m_noiseLower(0.0),
+    m_noiseUpper(0.0),
+    m_scale(1.0),
+    m_antialias(false),
+    m_planValid(false)
+{
+  m_lock = epicsMutexMustCreate();
+  m_bgX = {e_bg_type::none, 0.0, 0.0, 0.0, 0.0, 0.0};
+  m_bgY = m_bgX;
+  setSize(sizeX, sizeY);
+}
+
+/**
+ * Destructor
+ */
+ADSimPeaksEngine::~ADSimPeaksEngine(void) {
+  epicsMutexDestroy(m_lock);
+}
+
+/**
+ * Set the frame size.
+ *
+ * /arg /c sizeX The number of bins in the X dimension
+ * /arg /c sizeY The number of bins in the Y dimension (0 or 1 for 1D data)
+ *
+ * /return e_status
+ */
+ADSimPeaksEngine::e_status ADSimPeaksEngine::setSize(epicsUInt32 sizeX, epicsUInt32 sizeY) {
+  if (sizeX == 0) {
+    return e_status::error;
+  }
+  epicsMutexLock(m_lock);
+  m_sizeX = sizeX;
+  m_sizeY = std::max(static_cast<epicsUInt32>(1), sizeY);
+  m_2d = (sizeY > 1);
+  m_planValid = false;
+  epicsMutexUnlock(m_lock);
+  return e_status::success;
+}
+
+/**
+ * Set a peak. The peak list grows as needed. The type is an
+ * ADSimPeaksPeak::e_type_1d value for 1D data, and an ADSimPeaksPeak::e_type_2d
+ * value for 2D data (0 removes the peak). The peak is scaled so that its
+ * maximum is the amplitude.
+ *
+ * /arg /c peak The peak index (0 to s_maxPeaks-1)
+ * /arg /c type The peak type
+ * /arg /c data The peak parameters
+ *
+ * /return e_status
+ */
+ADSimPeaksEngine::e_status ADSimPeaksEngine::setPeak(epicsUInt32 peak, epicsInt32 type, const ADSimPeaksData &data) {
+  if ((peak >= s_maxPeaks) || (type < 0)) {
+    return e_status::error;
+  }
+  epicsMutexLock(m_lock);
+  if (m_peaks.size() <= peak) {
+    s_peak empty = {0, ADSimPeaksData(), 0, 0, 0, 0};
+    m_peaks.resize(peak+1, empty);
+  }
+  m_peaks[peak].type = type;
+  m_peaks[peak].data = data;
+  m_planValid = false;
+  epicsMutexUnlock(m_lock);
+  return e_status::success;
+}
+
+/**
+ * Limit the range of bins that a peak is calculated for. A maximum of 0
+ * means the end of the frame. By default the peak covers the whole frame.
+ *
+ * /arg /c peak The peak index (which must have been set already)
+ * /arg /c minX The first X bin
+ * /arg /c maxX The last X bin
+ * /arg /c minY The first Y bin
+ * /arg /c maxY The last Y bin
+ *
+ * /return e_status
+ */
+ADSimPeaksEngine::e_status ADSimPeaksEngine::setPeakBounds(epicsUInt32 peak, epicsUInt32 minX, epicsUInt32 maxX,
+							     epicsUInt32 minY, epicsUInt32 maxY) {
+  e_status status = e_status::error;
+  epicsMutexLock(m_lock);
+  if (peak < m_peaks.size()) {
+    m_peaks[peak].minX = minX;
+    m_peaks[peak].maxX = maxX;
+    m_peaks[peak].minY = minY;
+    m_peaks[peak].maxY = maxY;
+    m_planValid = false;
+    status = e_status::success;
+  }
+  epicsMutexUnlock(m_lock);
+  return status;
+}
+
+/**
+ * Remove all the peaks.
+ */
+void ADSimPeaksEngine::clearPeaks(void) {
+  epicsMutexLock(m_lock);
+  m_peaks.clear();
+  m_planValid = false;
+  epicsMutexUnlock(m_lock);
+}
+
+/**
+ * Set the background profile for one axis. The background is the sum of
+ * the X and Y profiles (the Y profile is not used for 1D data).
+ *
+ * polynomial: c0 + c1*(x-shift) + c2*(x-shift)^2 + c3*(x-shift)^3 <br>
+ * exponential: c0 + c1*exp(c2*(x-shift)) <br>
+ *
+ * /arg /c axis The axis
+ * /arg /c type The background type
+ * /arg /c c0, c1, c2, c3 The coefficients
+ * /arg /c shift The shift
+ *
+ * /return e_status
+ */
+ADSimPeaksEngine::e_status ADSimPeaksEngine::setBackground(e_axis axis, e_bg_type type, epicsFloat64 c0, epicsFloat64 c1,
+							     epicsFloat64 c2, epicsFloat64 c3, epicsFloat64 shift) {
+  if ((type != e_bg_type::none) && (type != e_bg_type::polynomial) && (type != e_bg_type::exponential)) {
+    return e_status::error;
+  }
+  epicsMutexLock(m_lock);
+  s_background &background = (axis == e_axis::y) ? m_bgY : m_bgX;
+  background.type = type;
+  background.c0 = c0;
+  background.c1 = c1;
+  background.c2 = c2;
+  background.c3 = c3;
+  background.shift = shift;
+  m_planValid = false;
+  epicsMutexUnlock(m_lock);
+  return e_status::success;
+}
+
+/**
+ * Set the noise, which is added to each element after the global scale.
+ *
+ * /arg /c type The noise type
+ * /arg /c level For uniform noise this is the range, and for gaussian
+ * noise this is the standard deviation.
+ * /arg /c clamp If true, clamp the noise to the range [lower, upper]
+ * /arg /c lower The lower clamp value
+ * /arg /c upper The upper clamp value
+ *
+ * /return e_status
+ */
+ADSimPeaksEngine::e_status ADSimPeaksEngine::setNoise(e_noise_type type, epicsFloat64 level, bool clamp,
+							epicsFloat64 lower, epicsFloat64 upper) {
+  if ((type != e_noise_type::none) && (type != e_noise_type::uniform) && (type != e_noise_type::gaussian)) {
+    return e_status::error;
+  }
+  epicsMutexLock(m_lock);
+  m_noiseType = type;
+  m_noiseLevel = level;
+  m_noiseClamp = clamp;
+  m_noiseLower = lower;
+  m_noiseUpper = upper;
+  epicsMutexUnlock(m_lock);
+  return e_status::success;
+}
+
+/**
+ * Set the random number seed.
+ *
+ * /arg /c seed The seed
+ */
+void ADSimPeaksEngine::setSeed(epicsUInt64 seed) {
+  epicsMutexLock(m_lock);
+  m_random.setSeed(seed);
+  epicsMutexUnlock(m_lock);
+}
+
+/**
+ * Set the global scale (eg. the beam intensity), which multiplies
+ * the background and the peaks.
+ *
+ * /arg /c scale The scale
+ */
+void ADSimPeaksEngine::setScale(epicsFloat64 scale) {
+  epicsMutexLock(m_lock);
+  m_scale = scale;
+  epicsMutexUnlock(m_lock);
+}
+
+/**
+ * Enable the pixel area coverage (antialiasing) of the hard
+ * edged 2D shapes (square, pyramid and cone).
+ *
+ * /arg /c antialias Set to true to enable antialiasing
+ */
+void ADSimPeaksEngine::setAntialias(bool antialias) {
+  epicsMutexLock(m_lock);
+  m_antialias = antialias;
+  m_planValid = false;
+  epicsMutexUnlock(m_lock);
+}
+
+/**
+ * Render a frame into the caller buffer. The buffer is in array order
+ * (X is the fastest changing dimension), with sizeX*sizeY elements.
+ *
+ * /arg /c frame The frame number (used as the counter for the noise)
+ * /arg /c dataType The data type of the buffer
+ * /arg /c buffer The buffer
+ * /arg /c bytes The size of the buffer in bytes
+ * /arg /c accumulate If true, the frame is added to the buffer contents
+ *
+ * /return e_status
+ */
+ADSimPeaksEngine::e_status ADSimPeaksEngine::render(epicsUInt32 frame, NDDataType_t dataType, void *buffer,
+						      size_t bytes, bool accumulate) {
+  e_status status = e_status::success;
+
+  if (buffer == NULL) {
+    return e_status::error;
+  }
+
+  epicsMutexLock(m_lock);
+  size_t elements = static_cast<size_t>(m_sizeX)*m_sizeY;
+  size_t elementSize = 0;
+  switch (dataType) {
+  case NDInt8: case NDUInt8: elementSize = 1; break;
+  case NDInt16: case NDUInt16: elementSize = 2; break;
+  case NDInt32: case NDUInt32: case NDFloat32: elementSize = 4; break;
+  case NDInt64: case NDUInt64: case NDFloat64: elementSize = 8; break;
+  default: elementSize = 0; break;
+  }
+  if ((elementSize == 0) || (bytes < elements*elementSize)) {
+    status = e_status::error;
+  } else {
+    plan();
+    if (dataType == NDInt8) {
+      renderT<epicsInt8>(frame, static_cast<epicsInt8*>(buffer), accumulate);
+    } else if (dataType == NDUInt8) {
+      renderT<epicsUInt8>(frame, static_cast<epicsUInt8*>(buffer), accumulate);
+    } else if (dataType == NDInt16) {
+      renderT<epicsInt16>(frame, static_cast<epicsInt16*>(buffer), accumulate);
+    } else if (dataType == NDUInt16) {
+      renderT<epicsUInt16>(frame, static_cast<epicsUInt16*>(buffer), accumulate);
+    } else if (dataType == NDInt32) {
+      renderT<epicsInt32>(frame, static_cast<epicsInt32*>(buffer), accumulate);
+    } else if (dataType == NDUInt32) {
+      renderT<epicsUInt32>(frame, static_cast<epicsUInt32*>(buffer), accumulate);
+    } else if (dataType == NDInt64) {
+      renderT<epicsInt64>(frame, static_cast<epicsInt64*>(buffer), accumulate);
+    } else if (dataType == NDUInt64) {
+      renderT<epicsUInt64>(frame, static_cast<epicsUInt64*>(buffer), accumulate);
+    } else if (dataType == NDFloat32) {
+      renderT<epicsFloat32>(frame, static_cast<epicsFloat32*>(buffer), accumulate);
+    } else {
+      renderT<epicsFloat64>(frame, static_cast<epicsFloat64*>(buffer), accumulate);
+    }
+  }
+  epicsMutexUnlock(m_lock);
+
+  return status;
+}
+
+/**
+ * Build the plan for the current configuration, if it has changed. This
+ * is the same as ADSimPeaks::planFrame, without the jitter.
+ */
+void ADSimPeaksEngine::plan(void)
+{
+  if (m_planValid) {
+    return;
+  }
+
+  m_render.begin(m_sizeX, m_sizeY, m_2d, m_antialias);
+  planBackground(ADSimPeaksPlan::e_axis::x, m_bgX);
+  if (m_2d) {
+    planBackground(ADSimPeaksPlan::e_axis::y, m_bgY);
+  }
+  for (size_t peak=0; peak<m_peaks.size(); peak++) {
+    m_render.addPeak(m_peaks[peak].type, m_peaks[peak].data, m_peaks[peak].minX, m_peaks[peak].maxX,
+		     m_peaks[peak].minY, m_peaks[peak].maxY);
+  }
+  m_row.resize(m_sizeX);
+
+  m_planValid = true;
+}
+
+/**
+ * Add a background profile to the plan.
+ *
+ * /arg /c axis The axis
+ * /arg /c background The background
+ */
+void ADSimPeaksEngine::planBackground(ADSimPeaksPlan::e_axis axis, const s_background &background)
+{
+  m_render.setBackground(axis, static_cast<ADSimPeaksPlan::e_bg_type>(background.type),
+			 background.c0, background.c1, background.c2, background.c3, background.shift);
+}
+
+/**
+ * Render a frame into a buffer of type T. The model for each row is
+ * calculated, then converted (with the scale and the noise) into the buffer.
+ *
+ * /arg /c frame The frame number
+ * /arg /c pData The buffer
+ * /arg /c accumulate If true, the frame is added to the buffer contents
+ */
+template <typename T> void ADSimPeaksEngine::renderT(epicsUInt32 frame, T *pData, bool accumulate)
+{
+  const epicsUInt64 stream = s_stream ^ frame;
+  const bool uniform = (m_noiseType == e_noise_type::uniform);
+  const bool noisy = ((uniform) || (m_noiseType == e_noise_type::gaussian));
+  epicsFloat64 *pModel = &m_row[0];
+
+  for (epicsUInt32 bin_y=0; bin_y<m_sizeY; bin_y++) {
+    m_render.background(bin_y, 0, m_sizeX-1, pModel);
+    m_render.peaks(bin_y, 0, m_sizeX-1, pModel);
+    T *pRow = pData + static_cast<size_t>(bin_y)*m_sizeX;
+    if (noisy) {
+      const size_t index = static_cast<size_t>(bin_y)*m_sizeX;
+      for (epicsUInt32 bin_x=0; bin_x<m_sizeX; bin_x++) {
+	epicsFloat64 noise = uniform ? (2.0*m_random.uniform(stream, index + bin_x) - 1.0) :
+	  m_random.gaussian(stream, index + bin_x);
+	noise = m_noiseLevel * noise;
+	if (m_noiseClamp) {
+	  noise = std::max(m_noiseLower, std::min(m_noiseUpper, noise));
+	}
+	T value = accumulate ? pRow[bin_x] : static_cast<T>(0);
+	value += static_cast<T>(m_scale*pModel[bin_x] + noise);
+	pRow[bin_x] = value;
+      }
+    } else {
+      for (epicsUInt32 bin_x=0; bin_x<m_sizeX; bin_x++) {
+	T value = accumulate ? pRow[bin_x] : static_cast<T>(0);
+	value += static_cast<T>(m_scale*pModel[bin_x]);
+	pRow[bin_x] = value;
+      }
+    }
+  }
+}
@@ -0,0 +1,133 @@
+/**
+ * \brief Standalone simulation engine, which renders the ADSimPeaks
+ *        background, peaks and noise into a caller buffer.
+ *
+ * More detailed documentation can be found in the source file.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#ifndef ADSIMPEAKSENGINE_H
+#define ADSIMPEAKSENGINE_H
+
+#include <vector>
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+#include <NDArray.h>
+
+#include "ADSimPeaksData.h"
+#include "ADSimPeaksPlan.h"
+#include "ADSimPeaksRandom.h"
+
+class ADSimPeaksEngine
+{
+ public:
+  ADSimPeaksEngine(epicsUInt32 sizeX, epicsUInt32 sizeY);
+  virtual ~ADSimPeaksEngine(void);
+
+  enum class e_status {
+    success = 0,
+    error
+  };
+
+  /**
+   * The enum for the noise type. This uses the same values as the driver.
+   */
+  enum class e_noise_type {
+    none = 0,
+    uniform,
+    gaussian
+  };
+
+  /**
+   * The enum for the background type. This uses the same values as the driver.
+   */
+  enum class e_bg_type {
+    none = 0,
+    polynomial,
+    exponential
+  };
+
+  /**
+   * The enum for the background axis.
+   */
+  enum class e_axis {
+    x = 0,
+    y
+  };
+
+  static const epicsUInt32 s_maxPeaks;
+  static const epicsUInt64 s_stream;
+
+  e_status setSize(epicsUInt32 sizeX, epicsUInt32 sizeY);
+  e_status setPeak(epicsUInt32 peak, epicsInt32 type, const ADSimPeaksData &data);
+  e_status setPeakBounds(epicsUInt32 peak, epicsUInt32 minX, epicsUInt32 maxX,
+			 epicsUInt32 minY, epicsUInt32 maxY);
+  void clearPeaks(void);
+  e_status setBackground(e_axis axis, e_bg_type type, epicsFloat64 c0, epicsFloat64 c1,
+			 epicsFloat64 c2, epicsFloat64 c3, epicsFloat64 shift);
+  e_status setNoise(e_noise_type type, epicsFloat64 level, bool clamp,
+		    epicsFloat64 lower, epicsFloat64 upper);
+  void setSeed(epicsUInt64 seed);
+  void setScale(epicsFloat64 scale);
+  void setAntialias(bool antialias);
+
+  e_status render(epicsUInt32 frame, NDDataType_t dataType, void *buffer, size_t bytes, bool accumulate);
+
+ private:
+
+  /**
+   * A peak, as set by the caller.
+   */
+  struct s_peak {
+    epicsInt32 type;
+    ADSimPeaksData data;
+    epicsUInt32 minX;
+    epicsUInt32 maxX;
+    epicsUInt32 minY;
+    epicsUInt32 maxY;
+  };
+
+  /**
+   * A background profile.
+   */
+  struct s_background {
+    e_bg_type type;
+    epicsFloat64 c0;
+    epicsFloat64 c1;
+    epicsFloat64 c2;
+    epicsFloat64 c3;
+    epicsFloat64 shift;
+  };
+
+  void plan(void);
+  void planBackground(ADSimPeaksPlan::e_axis axis, const s_background &background);
+  template <typename T> void renderT(epicsUInt32 frame, T *pData, bool accumulate);
+
+  epicsMutexId m_lock;
+  epicsUInt32 m_sizeX;
+  epicsUInt32 m_sizeY;
+  bool m_2d;
+  std::vector<s_peak> m_peaks;
+  s_background m_bgX;
+  s_background m_bgY;
+  e_noise_type m_noiseType;
+  epicsFloat64 m_noiseLevel;
+  bool m_noiseClamp;
+  epicsFloat64 m_noiseLower;
+  epicsFloat64 m_noiseUpper;
+  epicsFloat64 m_scale;
+  bool m_antialias;
+
+  // The plan is rebuilt when the configuration is changed
+  bool m_planValid;
+  ADSimPeaksPlan m_render;
+  ADSimPeaksRandom m_random;
+  std::vector<epicsFloat64> m_row;
+
+};
+
+#endif //ADSIMPEAKSENGINE_H
@@ -0,0 +1,302 @@
+/**
+ * \brief Load generator schedule and results used by the 
+ *        ADSimPeaks areaDetector driver.
+ *
+ * The load generator sweeps the frame rate and/or the frame size through 
+ * a number of steps, holding each step for a fixed time. The rate and size
+ * for each step are interpolated linearly between the start and stop values.
+ *
+ * For each step we record the target rate, the rate that was achieved, 
+ * the throughput (MB/s), the frame size and the number of dropped frames 
+ * and stalls (from the driver backpressure counters). A step is saturated 
+ * if any frames were dropped, if the driver had to wait for the plugins, 
+ * or if the achieved rate was less than 90% of the target rate. The first
+ * saturated step is the saturation point of the plugin chain.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#include <algorithm>
+
+#include <ADSimPeaksLoad.h>
+
+// Maximum number of steps (the size of the results table)
+const epicsUInt32 ADSimPeaksLoad::s_maxSteps = 100;
+
+/**
+ * Constructor.
+ */
+ADSimPeaksLoad::ADSimPeaksLoad(void)
+  : m_mode(e_mode::rate),
+    m_steps(0),
+    m_rateStart(0.0),
+    m_rateStop(0.0),
+    m_sizeStart(0),
+    m_sizeStop(0),
+    m_hold(0.0),
+    m_active(false),
+    m_started(false),
+    m_step(0),
+    m_startDropped(0),
+    m_startStalls(0),
+    m_frames(0),
+    m_bytes(0.0),
+    m_saturationStep(-1)
+{
+  epicsTimeGetCurrent(&m_stepStart);
+  m_nextFrame = m_stepStart;
+}
+
+/**
+ * Destructor
+ */
+ADSimPeaksLoad::~ADSimPeaksLoad(void) {
+}
+
+/**
+ * Start a new sweep, and clear the results table.
+ *
+ * /arg /c mode Sweep the rate, the size or both
+ * /arg /c steps The number of steps (limited to s_maxSteps)
+ * /arg /c rateStart The frame rate for the first step (Hz)
+ * /arg /c rateStop The frame rate for the last step (Hz)
+ * /arg /c sizeStart The frame size (in X) for the first step
+ * /arg /c sizeStop The frame size (in X) for the last step
+ * /arg /c hold The time to hold each step (seconds)
+ */
+void ADSimPeaksLoad::start(e_mode mode, epicsUInt32 steps, epicsFloat64 rateStart, epicsFloat64 rateStop,
+			   epicsUInt32 sizeStart, epicsUInt32 sizeStop, epicsFloat64 hold) {
+  m_mode = mode;
+  m_steps = std::max(static_cast<epicsUInt32>(1), std::min(steps, s_maxSteps));
+  m_rateStart = rateStart;
+  m_rateStop = rateStop;
+  m_sizeStart = sizeStart;
+  m_sizeStop = sizeStop;
+  m_hold = hold;
+  m_active = true;
+  m_started = false;
+  m_step = 0;
+  m_saturationStep = -1;
+  m_targetRate.assign(m_steps, 0.0);
+  m_rate.assign(m_steps, 0.0);
+  m_throughput.assign(m_steps, 0.0);
+  m_frameBytes.assign(m_steps, 0.0);
+  m_dropped.assign(m_steps, 0.0);
+  m_stalls.assign(m_steps, 0.0);
+}
+
+/**
+ * Stop the sweep. The results for the completed steps are kept.
+ */
+void ADSimPeaksLoad::stop(void) {
+  m_active = false;
+  m_started = false;
+}
+
+/**
+ * Check if a sweep is in progress.
+ */
+bool ADSimPeaksLoad::active(void) const {
+  return m_active;
+}
+
+/**
+ * Check if the current step has been started.
+ */
+bool ADSimPeaksLoad::started(void) const {
+  return m_started;
+}
+
+/**
+ * Get the current step number (starting at 0).
+ */
+epicsUInt32 ADSimPeaksLoad::step(void) const {
+  return m_step;
+}
+
+/**
+ * Get the number of steps.
+ */
+epicsUInt32 ADSimPeaksLoad::steps(void) const {
+  return m_steps;
+}
+
+/**
+ * Get the target frame rate for the current step.
+ *
+ * /return The rate (Hz), or 0 if the rate is not being swept
+ */
+epicsFloat64 ADSimPeaksLoad::stepRate(void) const {
+  if (m_mode == e_mode::size) {
+    return 0.0;
+  }
+  return std::max(0.0, interpolate(m_rateStart, m_rateStop, m_step));
+}
+
+/**
+ * Get the frame size (in X) for the current step.
+ *
+ * /return The size, or 0 if the size is not being swept
+ */
+epicsUInt32 ADSimPeaksLoad::stepSize(void) const {
+  if (m_mode == e_mode::rate) {
+    return 0;
+  }
+  return static_cast<epicsUInt32>(std::max(1.0, interpolate(m_sizeStart, m_sizeStop, m_step) + 0.5));
+}
+
+/**
+ * Start the current step.
+ *
+ * /arg /c now The current time
+ * /arg /c dropped The driver dropped frame counter
+ * /arg /c stalls The driver stall counter
+ */
+void ADSimPeaksLoad::beginStep(const epicsTimeStamp &now, epicsInt32 dropped, epicsInt32 stalls) {
+  m_started = true;
+  m_stepStart = now;
+  m_nextFrame = now;
+  m_startDropped = dropped;
+  m_startStalls = stalls;
+  m_frames = 0;
+  m_bytes = 0.0;
+}
+
+/**
+ * Count a frame that was published during the current step.
+ *
+ * /arg /c bytes The size of the frame
+ */
+void ADSimPeaksLoad::countFrame(size_t bytes) {
+  m_frames++;
+  m_bytes += static_cast<epicsFloat64>(bytes);
+}
+
+/**
+ * Check if the hold time for the current step is over.
+ *
+ * /arg /c now The current time
+ */
+bool ADSimPeaksLoad::stepDone(const epicsTimeStamp &now) const {
+  return (m_started && (epicsTimeDiffInSeconds(&now, &m_stepStart) >= m_hold));
+}
+
+/**
+ * Finish the current step, record the results and move to the next step.
+ * The sweep is no longer active after the last step.
+ *
+ * /arg /c now The current time
+ * /arg /c dropped The driver dropped frame counter
+ * /arg /c stalls The driver stall counter
+ */
+void ADSimPeaksLoad::endStep(const epicsTimeStamp &now, epicsInt32 dropped, epicsInt32 stalls) {
+  if ((!m_active) || (!m_started)) {
+    return;
+  }
+  epicsFloat64 elapsed = std::max(1e-9, epicsTimeDiffInSeconds(&now, &m_stepStart));
+  epicsFloat64 target = stepRate();
+  m_targetRate[m_step] = target;
+  m_rate[m_step] = m_frames / elapsed;
+  m_throughput[m_step] = m_bytes / elapsed / 1.0e6;
+  m_frameBytes[m_step] = (m_frames > 0) ? (m_bytes / m_frames) : 0.0;
+  m_dropped[m_step] = dropped - m_startDropped;
+  m_stalls[m_step] = stalls - m_startStalls;
+  
+  bool saturated = ((m_dropped[m_step] > 0) || (m_stalls[m_step] > 0) ||
+		    ((target > 0.0) && (m_rate[m_step] < 0.9*target)));
+  if ((saturated) && (m_saturationStep < 0)) {
+    m_saturationStep = static_cast<epicsInt32>(m_step);
+  }
+
+  m_started = false;
+  m_step++;
+  if (m_step >= m_steps) {
+    m_active = false;
+  }
+}
+
+/**
+ * Work out how long to wait before the next frame, to run at the target 
+ * rate for the current step. The frames are scheduled from the start of 
+ * the step, so the time taken to calculate each frame is taken into account.
+ * If we fall behind, the schedule is restarted from the current time.
+ *
+ * /arg /c now The current time
+ *
+ * /return The delay (seconds), or a negative number if the rate is not being swept
+ */
+epicsFloat64 ADSimPeaksLoad::frameDelay(const epicsTimeStamp &now) {
+  epicsFloat64 rate = stepRate();
+  if ((!m_active) || (m_mode == e_mode::size)) {
+    return -1.0;
+  }
+  if (rate <= 0.0) {
+    return 0.0;
+  }
+  epicsTimeAddSeconds(&m_nextFrame, 1.0/rate);
+  epicsFloat64 delay = epicsTimeDiffInSeconds(&m_nextFrame, &now);
+  if (delay < 0.0) {
+    m_nextFrame = now;
+    delay = 0.0;
+  }
+  return delay;
+}
+
+/**
+ * Get the time between frames for the current step. This is used in 
+ * virtual time mode, where the frames are not scheduled in real time.
+ *
+ * /arg /c period The period to use if the rate is not being swept
+ *
+ * /return The period (seconds)
+ */
+epicsFloat64 ADSimPeaksLoad::framePeriod(epicsFloat64 period) const {
+  epicsFloat64 rate = stepRate();
+  if ((!m_active) || (m_mode == e_mode::size) || (rate <= 0.0)) {
+    return period;
+  }
+  return 1.0/rate;
+}
+
+/**
+ * Get the first saturated step.
+ *
+ * /return The step number, or -1 if no step was saturated
+ */
+epicsInt32 ADSimPeaksLoad::saturationStep(void) const {
+  return m_saturationStep;
+}
+
+/**
+ * Get a column of the results table. There is one value per step.
+ *
+ * /arg /c column The column
+ */
+const std::vector<epicsFloat64>& ADSimPeaksLoad::column(e_column column) const {
+  switch (column) {
+  case e_column::target_rate:
+    return m_targetRate;
+  case e_column::rate:
+    return m_rate;
+  case e_column::throughput:
+    return m_throughput;
+  case e_column::frame_bytes:
+    return m_frameBytes;
+  case e_column::dropped:
+    return m_dropped;
+  default:
+    return m_stalls;
+  }
+}
+
+/**
+ * Linear interpolation between the start and stop values for a step.
+ */
+epicsFloat64 ADSimPeaksLoad::interpolate(epicsFloat64 start, epicsFloat64 stop, epicsUInt32 step) const {
+  if (m_steps <= 1) {
+    return start;
+  }
+  return start + (stop - start) * step / (m_steps - 1);
+}
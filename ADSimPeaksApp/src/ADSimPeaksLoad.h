@@ -0,0 +1,102 @@
+/**
+ * \brief Load generator schedule and results used by the 
+ *        ADSimPeaks areaDetector driver.
+ *
+ * More detailed documentation can be found in the source file.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#ifndef ADSIMPEAKSLOAD_H
+#define ADSIMPEAKSLOAD_H
+
+#include <vector>
+
+#include <epicsTypes.h>
+#include <epicsTime.h>
+
+class ADSimPeaksLoad
+{
+ public:
+  ADSimPeaksLoad(void);
+  virtual ~ADSimPeaksLoad(void);
+
+  /**
+   * The enum for the sweep mode. This needs to match
+   * the list order presented to the user in the database.
+   */
+  enum class e_mode {
+    rate = 0,
+    size,
+    both
+  };
+
+  /**
+   * The columns of the results table.
+   */
+  enum class e_column {
+    target_rate = 0,
+    rate,
+    throughput,
+    frame_bytes,
+    dropped,
+    stalls
+  };
+
+  static const epicsUInt32 s_maxSteps;
+
+  void start(e_mode mode, epicsUInt32 steps, epicsFloat64 rateStart, epicsFloat64 rateStop,
+	     epicsUInt32 sizeStart, epicsUInt32 sizeStop, epicsFloat64 hold);
+  void stop(void);
+  bool active(void) const;
+  bool started(void) const;
+  epicsUInt32 step(void) const;
+  epicsUInt32 steps(void) const;
+  epicsFloat64 stepRate(void) const;
+  epicsUInt32 stepSize(void) const;
+
+  void beginStep(const epicsTimeStamp &now, epicsInt32 dropped, epicsInt32 stalls);
+  void countFrame(size_t bytes);
+  bool stepDone(const epicsTimeStamp &now) const;
+  void endStep(const epicsTimeStamp &now, epicsInt32 dropped, epicsInt32 stalls);
+
+  epicsFloat64 frameDelay(const epicsTimeStamp &now);
+  epicsFloat64 framePeriod(epicsFloat64 period) const;
+
+  epicsInt32 saturationStep(void) const;
+  const std::vector<epicsFloat64>& column(e_column column) const;
+
+ private:
+  epicsFloat64 interpolate(epicsFloat64 start, epicsFloat64 stop, epicsUInt32 step) const;
+
+  e_mode m_mode;
+  epicsUInt32 m_steps;
+  epicsFloat64 m_rateStart;
+  epicsFloat64 m_rateStop;
+  epicsUInt32 m_sizeStart;
+  epicsUInt32 m_sizeStop;
+  epicsFloat64 m_hold;
+
+  bool m_active;
+  bool m_started;
+  epicsUInt32 m_step;
+  epicsTimeStamp m_stepStart;
+  epicsTimeStamp m_nextFrame;
+  epicsInt32 m_startDropped;
+  epicsInt32 m_startStalls;
+  epicsUInt32 m_frames;
+  epicsFloat64 m_bytes;
+  epicsInt32 m_saturationStep;
+
+  std::vector<epicsFloat64> m_targetRate;
+  std::vector<epicsFloat64> m_rate;
+  std::vector<epicsFloat64> m_throughput;
+  std::vector<epicsFloat64> m_frameBytes;
+  std::vector<epicsFloat64> m_dropped;
+  std::vector<epicsFloat64> m_stalls;
+
+};
+
+#endif //ADSIMPEAKSLOAD_H
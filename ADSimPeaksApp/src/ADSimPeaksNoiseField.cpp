@@ -0,0 +1,310 @@
+/**
+ * \brief Spatially correlated noise used by the ADSimPeaks
+ *        areaDetector driver.
+ *
+ * The noise field is white Gaussian noise (from the counter based random
+ * number generator, so it is reproducible for a given seed and frame number)
+ * that is smoothed by a separable Gaussian filter, first along the rows and
+ * then along the columns. The correlation length is the standard deviation
+ * (in pixels) of the Gaussian filter. The field is scaled so that each pixel
+ * has a standard deviation of 1, before it is multiplied by the noise level.
+ *
+ * The filter method is chosen from the correlation length:
+ *
+ * white - no filtering (a correlation length of 0) <br>
+ * kernel - direct convolution with the Gaussian kernel, used for short 
+ *          correlation lengths (a kernel up to s_maxKernelWidth pixels wide) <br>
+ * box - three box filters in a row, which approximate the Gaussian filter. 
+ *       Each box filter is a running sum, so the cost does not depend on 
+ *       the correlation length. This is used for long correlation lengths. <br>
+ *
+ * The boundaries are periodic (the field wraps around), so the noise is 
+ * correlated across the edges of the frame. The rows, and then blocks of 
+ * s_columnBlock columns, are split up between the worker threads. 
+ *
+ * The whole field is generated before the frame is rendered, so it 
+ * uses one epicsFloat64 per pixel.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#include <cmath>
+#include <algorithm>
+
+#include <ADSimPeaksNoiseField.h>
+
+const epicsUInt32 ADSimPeaksNoiseField::s_maxKernelWidth = 15;
+const epicsUInt32 ADSimPeaksNoiseField::s_boxes = 3;
+const epicsUInt64 ADSimPeaksNoiseField::s_stream = 0x8000000000000000ULL;
+const epicsUInt32 ADSimPeaksNoiseField::s_columnBlock = 8;
+
+/**
+ * Constructor.
+ */
+ADSimPeaksNoiseField::ADSimPeaksNoiseField(void)
+  : m_length(0.0),
+    m_method(e_method::white),
+    m_norm(1.0),
+    m_sizeX(0),
+    m_sizeY(0)
+{
+}
+
+/**
+ * Destructor
+ */
+ADSimPeaksNoiseField::~ADSimPeaksNoiseField(void) {
+}
+
+/**
+ * Set the correlation length, and choose the filter method. The filter
+ * (the kernel or the box sizes) is only recalculated if the length changes.
+ *
+ * /arg /c length The correlation length in pixels (the standard deviation of the filter)
+ */
+void ADSimPeaksNoiseField::setLength(epicsFloat64 length) {
+  length = std::max(0.0, length);
+  if ((length == m_length) && (m_method != e_method::white || length == 0.0)) {
+    return;
+  }
+  m_length = length;
+  m_kernel.clear();
+  m_boxRadius.clear();
+  m_norm = 1.0;
+
+  if (length <= 0.0) {
+    m_method = e_method::white;
+    return;
+  }
+
+  epicsUInt32 radius = static_cast<epicsUInt32>(ceil(3.0*length));
+  std::vector<epicsFloat64> effective;
+  if ((2*radius + 1) <= s_maxKernelWidth) {
+    m_method = e_method::kernel;
+    for (epicsInt32 k=-static_cast<epicsInt32>(radius); k<=static_cast<epicsInt32>(radius); k++) {
+      m_kernel.push_back(exp(-(k*k)/(2.0*length*length)));
+    }
+    effective = m_kernel;
+  } else {
+    // Box widths that give the same variance as the Gaussian (W. Kovesi, 'Fast Almost-Gaussian Filtering')
+    m_method = e_method::box;
+    const epicsFloat64 n = static_cast<epicsFloat64>(s_boxes);
+    epicsInt32 lower = static_cast<epicsInt32>(floor(sqrt(12.0*length*length/n + 1.0)));
+    if (lower % 2 == 0) {
+      lower--;
+    }
+    epicsInt32 upper = lower + 2;
+    epicsInt32 m = static_cast<epicsInt32>(round((12.0*length*length - n*lower*lower - 4.0*n*lower - 3.0*n)/(-4.0*lower - 4.0)));
+    effective.assign(1, 1.0);
+    for (epicsUInt32 i=0; i<s_boxes; i++) {
+      epicsInt32 width = (static_cast<epicsInt32>(i) < m) ? lower : upper;
+      m_boxRadius.push_back(static_cast<epicsUInt32>((width - 1)/2));
+      // Convolve the effective kernel with this box, so we can calculate the normalization
+      std::vector<epicsFloat64> next(effective.size() + width - 1, 0.0);
+      for (size_t j=0; j<effective.size(); j++) {
+	for (epicsInt32 k=0; k<width; k++) {
+	  next[j+k] += effective[j];
+	}
+      }
+      effective.swap(next);
+    }
+  }
+
+  // The normalization for one dimension, so that the filtered noise has unit variance
+  epicsFloat64 sum = 0.0;
+  for (size_t i=0; i<effective.size(); i++) {
+    sum += effective[i]*effective[i];
+  }
+  m_norm = 1.0/sqrt(sum);
+}
+
+/**
+ * Read the correlation length.
+ */
+epicsFloat64 ADSimPeaksNoiseField::getLength(void) const {
+  return m_length;
+}
+
+/**
+ * Read the filter method.
+ */
+ADSimPeaksNoiseField::e_method ADSimPeaksNoiseField::getMethod(void) const {
+  return m_method;
+}
+
+/**
+ * Generate the noise field for a frame. For a 1D frame (sizeY=1) only the rows are filtered.
+ *
+ * /arg /c random The random number generator
+ * /arg /c frame The frame number
+ * /arg /c sizeX The number of columns
+ * /arg /c sizeY The number of rows
+ * /arg /c level The noise level (the standard deviation of the noise)
+ * /arg /c clamp If true, clamp the noise to the range [lower, upper]
+ * /arg /c lower The lower clamp value
+ * /arg /c upper The upper clamp value
+ * /arg /c workers The worker threads
+ */
+void ADSimPeaksNoiseField::generate(const ADSimPeaksRandom &random, epicsUInt64 frame,
+				    epicsUInt32 sizeX, epicsUInt32 sizeY, epicsFloat64 level,
+				    bool clamp, epicsFloat64 lower, epicsFloat64 upper,
+				    ADSimPeaksWorkers &workers)
+{
+  m_sizeX = sizeX;
+  m_sizeY = sizeY;
+  m_field.resize(static_cast<size_t>(sizeX)*sizeY);
+  if (m_field.empty()) {
+    return;
+  }
+
+  const epicsUInt64 stream = s_stream ^ frame;
+  const bool filter = (m_method != e_method::white);
+  const bool filterY = (filter && (sizeY > 1));
+  const epicsFloat64 scale = level * (filterY ? m_norm*m_norm : m_norm);
+  epicsFloat64 *pField = m_field.data();
+
+  auto finish = [=](epicsFloat64 value) {
+    value *= scale;
+    if (clamp) {
+      value = std::max(lower, std::min(upper, value));
+    }
+    return value;
+  };
+
+  // White noise, filtered along the rows
+  workers.run(sizeY, [&](size_t begin, size_t end) {
+      std::vector<epicsFloat64> scratch;
+      for (size_t bin_y=begin; bin_y<end; bin_y++) {
+	epicsFloat64 *pRow = pField + bin_y*sizeX;
+	const epicsUInt64 counter = static_cast<epicsUInt64>(bin_y)*sizeX;
+	for (epicsUInt32 bin_x=0; bin_x<sizeX; bin_x++) {
+	  pRow[bin_x] = random.gaussian(stream, counter + bin_x);
+	}
+	if (filter) {
+	  filterLine(pRow, sizeX, scratch);
+	}
+	if (!filterY) {
+	  for (epicsUInt32 bin_x=0; bin_x<sizeX; bin_x++) {
+	    pRow[bin_x] = finish(pRow[bin_x]);
+	  }
+	}
+      }
+    });
+
+  if (!filterY) {
+    return;
+  }
+
+  // Filter along the columns, a block of columns at a time. The block is copied
+  // into a buffer so that each column is contiguous.
+  const size_t blocks = (sizeX + s_columnBlock - 1)/s_columnBlock;
+  workers.run(blocks, [&](size_t begin, size_t end) {
+      std::vector<epicsFloat64> scratch;
+      std::vector<epicsFloat64> columns(static_cast<size_t>(s_columnBlock)*sizeY);
+      for (size_t block=begin; block<end; block++) {
+	const size_t x0 = block*s_columnBlock;
+	const size_t width = std::min(static_cast<size_t>(s_columnBlock), sizeX - x0);
+	for (size_t bin_y=0; bin_y<sizeY; bin_y++) {
+	  const epicsFloat64 *pRow = pField + bin_y*sizeX + x0;
+	  for (size_t i=0; i<width; i++) {
+	    columns[i*sizeY + bin_y] = pRow[i];
+	  }
+	}
+	for (size_t i=0; i<width; i++) {
+	  filterLine(&columns[i*sizeY], sizeY, scratch);
+	}
+	for (size_t bin_y=0; bin_y<sizeY; bin_y++) {
+	  epicsFloat64 *pRow = pField + bin_y*sizeX + x0;
+	  for (size_t i=0; i<width; i++) {
+	    pRow[i] = finish(columns[i*sizeY + bin_y]);
+	  }
+	}
+      }
+    });
+}
+
+/**
+ * Allocate the field for a frame size before it is generated. The new
+ * part of the field is set to zero, so its pages are touched now rather
+ * than in the first frame.
+ *
+ * /arg /c sizeX The number of bins in the X dimension
+ * /arg /c sizeY The number of bins in the Y dimension
+ */
+void ADSimPeaksNoiseField::reserve(epicsUInt32 sizeX, epicsUInt32 sizeY)
+{
+  m_field.resize(static_cast<size_t>(sizeX)*sizeY);
+}
+
+/**
+ * Find the noise for a row of the last generated field.
+ *
+ * /arg /c bin_y The row
+ *
+ * /return Pointer to the noise for the first column of the row
+ */
+const epicsFloat64* ADSimPeaksNoiseField::row(epicsUInt32 bin_y) const {
+  return &m_field[static_cast<size_t>(bin_y)*m_sizeX];
+}
+
+/**
+ * Filter a line (a row or a column) in place, with periodic boundaries.
+ *
+ * /arg /c line The line
+ * /arg /c size The number of elements in the line
+ * /arg /c scratch Buffer for the extended line (resized as needed)
+ */
+void ADSimPeaksNoiseField::filterLine(epicsFloat64 *line, size_t size, std::vector<epicsFloat64> &scratch) const
+{
+  if (m_method == e_method::kernel) {
+    const size_t radius = (m_kernel.size() - 1)/2;
+    scratch.resize(size + 2*radius);
+    extendLine(line, size, radius, scratch.data());
+    for (size_t i=0; i<size; i++) {
+      const epicsFloat64 *pExt = &scratch[i];
+      epicsFloat64 sum = 0.0;
+      for (size_t k=0; k<m_kernel.size(); k++) {
+	sum += m_kernel[k]*pExt[k];
+      }
+      line[i] = sum;
+    }
+  } else if (m_method == e_method::box) {
+    for (size_t b=0; b<m_boxRadius.size(); b++) {
+      const size_t radius = m_boxRadius[b];
+      scratch.resize(size + 2*radius);
+      extendLine(line, size, radius, scratch.data());
+      // Running sum over the box
+      epicsFloat64 sum = 0.0;
+      for (size_t k=0; k<=2*radius; k++) {
+	sum += scratch[k];
+      }
+      line[0] = sum;
+      for (size_t i=1; i<size; i++) {
+	sum += scratch[i + 2*radius] - scratch[i - 1];
+	line[i] = sum;
+      }
+    }
+  }
+}
+
+/**
+ * Copy a line into a buffer that is extended by the radius on both sides,
+ * wrapping around at the ends (the radius can be larger than the line).
+ *
+ * /arg /c line The line
+ * /arg /c size The number of elements in the line
+ * /arg /c radius The number of elements to add on each side
+ * /arg /c extended The extended line (size + 2*radius elements)
+ */
+void ADSimPeaksNoiseField::extendLine(const epicsFloat64 *line, size_t size, size_t radius, epicsFloat64 *extended)
+{
+  size_t index = (size - (radius % size)) % size;
+  for (size_t k=0; k<size + 2*radius; k++) {
+    extended[k] = line[index];
+    if (++index == size) {
+      index = 0;
+    }
+  }
+}
@@ -0,0 +1,70 @@
+/**
+ * \brief Spatially correlated noise used by the ADSimPeaks
+ *        areaDetector driver.
+ *
+ * More detailed documentation can be found in the source file.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#ifndef ADSIMPEAKSNOISEFIELD_H
+#define ADSIMPEAKSNOISEFIELD_H
+
+#include <vector>
+
+#include <epicsTypes.h>
+
+#include "ADSimPeaksRandom.h"
+#include "ADSimPeaksWorkers.h"
+
+class ADSimPeaksNoiseField
+{
+ public:
+  ADSimPeaksNoiseField(void);
+  virtual ~ADSimPeaksNoiseField(void);
+
+  /**
+   * The enum for the filter method, which is chosen from the correlation length.
+   */
+  enum class e_method {
+    white = 0,
+    kernel,
+    box
+  };
+
+  static const epicsUInt32 s_maxKernelWidth;
+  static const epicsUInt32 s_boxes;
+  static const epicsUInt64 s_stream;
+  static const epicsUInt32 s_columnBlock;
+
+  void setLength(epicsFloat64 length);
+  epicsFloat64 getLength(void) const;
+  e_method getMethod(void) const;
+
+  void generate(const ADSimPeaksRandom &random, epicsUInt64 frame,
+		epicsUInt32 sizeX, epicsUInt32 sizeY, epicsFloat64 level,
+		bool clamp, epicsFloat64 lower, epicsFloat64 upper,
+		ADSimPeaksWorkers &workers);
+
+  const epicsFloat64* row(epicsUInt32 bin_y) const;
+  void reserve(epicsUInt32 sizeX, epicsUInt32 sizeY);
+
+ private:
+
+  void filterLine(epicsFloat64 *line, size_t size, std::vector<epicsFloat64> &scratch) const;
+  static void extendLine(const epicsFloat64 *line, size_t size, size_t radius, epicsFloat64 *extended);
+
+  epicsFloat64 m_length;
+  e_method m_method;
+  std::vector<epicsFloat64> m_kernel;
+  std::vector<epicsUInt32> m_boxRadius;
+  epicsFloat64 m_norm;
+  epicsUInt32 m_sizeX;
+  epicsUInt32 m_sizeY;
+  std::vector<epicsFloat64> m_field;
+
+};
+
+#endif //ADSIMPEAKSNOISEFIELD_H
@@ -14,6 +14,7 @@
  * 6) Laplace
  * 7) Moffat
  * 8) Smooth Step
+ * 9) Back-to-back exponential convolved with a Gaussian (time-of-flight peak)
  *
  * Supported 2D peak shapes are:
  * 1) Square
@@ -32,6 +33,7 @@
  */
 
 #include <cmath>
+#include <algorithm>
 
 #include <ADSimPeaksPeak.h>
 
@@ -52,6 +54,9 @@ const epicsFloat64 ADSimPeaksPeak::s_pv_p4 = 0.07842;
 const epicsFloat64 ADSimPeaksPeak::s_pv_e1 = 1.36603;
 const epicsFloat64 ADSimPeaksPeak::s_pv_e2 = 0.47719;
 const epicsFloat64 ADSimPeaksPeak::s_pv_e3 = 0.11116;
+// Chebyshev coefficients for the complementary error function (Numerical Recipes erfcc)
+const epicsFloat64 ADSimPeaksPeak::s_erfc[10] = {-1.26551223, 1.00002368, 0.37409196, 0.09678418, -0.18628806,
+                                                 0.27886807, -1.13520398, 1.48851587, -0.82215223, 0.17087277};
 
 /**
  * Constructor.  
@@ -96,6 +101,9 @@ ADSimPeaksPeak::e_status ADSimPeaksPeak::compute1D(const ADSimPeaksData &data, e
     
   case e_type_1d::smoothstep:
     return computeSmoothStep(data, result);
+
+  case e_type_1d::backtoback:
+    return computeBackToBack(data, result);
   }
     
   return e_status::error;
@@ -130,6 +138,9 @@ std::string ADSimPeaksPeak::getType1DName(e_type_1d type)
 
   case e_type_1d::smoothstep:
     return "SmoothStep";
+
+  case e_type_1d::backtoback:
+    return "BackToBack";
   }
 
   return "None";   
@@ -453,6 +464,39 @@ ADSimPeaksPeak::e_status ADSimPeaksPeak::computeSmoothStep(const ADSimPeaksData&
   return e_status::success;
 }
 
+/**
+ * Implementation of a back-to-back exponential convolved with a Gaussian, 
+ * which is used for the peaks in neutron time-of-flight diffraction. The
+ * peak has an exponential rise (with rate alpha) and an exponential decay
+ * (with rate beta), which are convolved with a Gaussian (the FWHM is the 
+ * FWHM of the Gaussian). The function is normalized to an area of 1.
+ *
+ * f(d) = N * [exp(u)*erfc(y) + exp(v)*erfc(z)] <br>
+ *
+ * where d = bin - pos, N = alpha*beta/(2*(alpha+beta)), 
+ * u = alpha*(alpha*sigma^2 + 2d)/2, y = (alpha*sigma^2 + d)/(sqrt(2)*sigma), 
+ * v = beta*(beta*sigma^2 - 2d)/2 and z = (beta*sigma^2 - d)/(sqrt(2)*sigma).
+ *
+ * The exp and erfc terms can overflow and underflow on their own, so they 
+ * are calculated together (see ADSimPeaksPeak::expErfc).
+ *
+ * The parameter P1 is alpha and P2 is beta (in units of 1/bins). 
+ *
+ * For more information on this see:
+ * https://docs.mantidproject.org/nightly/fitting/fitfunctions/BackToBackExponential.html
+ *
+ * /arg /c ADSimPeaksData object defining the peak position, shape and the array bin
+ * /arg /c result This will be used to return the result of the calculation
+ *
+ * /return ADSimPeaksPeak::e_status
+ */
+ADSimPeaksPeak::e_status ADSimPeaksPeak::computeBackToBack(const ADSimPeaksData& data, epicsFloat64 &result)
+{
+  epicsInt32 bin = data.getBinX();
+  result = 0.0;
+  return spanBackToBack(data, 1.0, bin, bin, &result);
+}
+
 
 /**
  * Implementation of a bivariate Gaussian function.
@@ -824,6 +868,753 @@ ADSimPeaksPeak::e_status ADSimPeaksPeak::computeSmoothStep2D(const ADSimPeaksDat
 }
 
 
+/*******************************************************************************************/
+/* Difference array rendering for the piecewise constant and piecewise linear peak shapes  */
+
+/**
+ * Check if a 1D peak type can be rendered using a difference array.
+ *
+ * /arg /c type The 1D peak type
+ *
+ * /return true if ADSimPeaksPeak::diff1D supports this type
+ */
+bool ADSimPeaksPeak::hasDiff1D(e_type_1d type)
+{
+  return ((type == e_type_1d::square) || (type == e_type_1d::triangle));
+}
+
+/**
+ * Check if a 1D peak type is calculated for a span of bins at once.
+ *
+ * /arg /c type The 1D peak type
+ *
+ * /return true if ADSimPeaksPeak::span1D supports this type
+ */
+bool ADSimPeaksPeak::hasSpan1D(e_type_1d type)
+{
+  return (type == e_type_1d::backtoback);
+}
+
+/**
+ * Add a 1D peak to a span of bins. This is faster than calling compute1D
+ * for each bin, because the parts of the calculation that only depend on
+ * the peak are done once.
+ *
+ * /arg /c data ADSimPeaksData object defining the peak position and shape
+ * /arg /c type The 1D peak type
+ * /arg /c scale The scale factor applied to the peak
+ * /arg /c minX The first bin
+ * /arg /c maxX The last bin
+ * /arg /c output The data for bin minX (maxX-minX+1 values are added)
+ *
+ * /return ADSimPeaksPeak::e_status
+ */
+ADSimPeaksPeak::e_status ADSimPeaksPeak::span1D(const ADSimPeaksData &data, e_type_1d type, epicsFloat64 scale,
+                                                epicsInt32 minX, epicsInt32 maxX, epicsFloat64 *output)
+{
+  switch (type) {
+  case e_type_1d::backtoback:
+    return spanBackToBack(data, scale, minX, maxX, output);
+
+  default:
+    break;
+  }
+
+  return e_status::error;
+}
+
+/**
+ * Add a back-to-back exponential convolved with a Gaussian to a span 
+ * of bins (see ADSimPeaksPeak::computeBackToBack).
+ *
+ * /arg /c data ADSimPeaksData object defining the peak position and shape
+ * /arg /c scale The scale factor applied to the peak
+ * /arg /c minX The first bin
+ * /arg /c maxX The last bin
+ * /arg /c output The data for bin minX (maxX-minX+1 values are added)
+ *
+ * /return ADSimPeaksPeak::e_status
+ */
+ADSimPeaksPeak::e_status ADSimPeaksPeak::spanBackToBack(const ADSimPeaksData &data, epicsFloat64 scale,
+                                                        epicsInt32 minX, epicsInt32 maxX, epicsFloat64 *output)
+{
+  epicsFloat64 pos = data.getPositionX();
+  epicsFloat64 fwhm = data.getFWHMX();
+  epicsFloat64 alpha = fabs(zeroCheck(data.getParam1()));
+  epicsFloat64 beta = fabs(zeroCheck(data.getParam2()));
+
+  fwhm = std::max(1.0, fwhm);
+
+  // These only depend on the peak, so are calculated once for the span
+  const epicsFloat64 sigma = fwhm / s_2s2l2;
+  const epicsFloat64 sigma2 = sigma*sigma;
+  const epicsFloat64 norm = scale * alpha*beta / (2.0*(alpha + beta));
+  const epicsFloat64 inv_s2s = 1.0 / (M_SQRT2*sigma);
+  const epicsFloat64 inv_2s2 = 1.0 / (2.0*sigma2);
+  const epicsFloat64 alpha_s2 = alpha*sigma2;
+  const epicsFloat64 beta_s2 = beta*sigma2;
+
+  for (epicsInt32 bin=minX; bin<=maxX; bin++) {
+    epicsFloat64 d = bin - pos;
+    epicsFloat64 g = -d*d*inv_2s2;
+    epicsFloat64 rise = expErfc(0.5*alpha*(alpha_s2 + 2.0*d), (alpha_s2 + d)*inv_s2s, g);
+    epicsFloat64 decay = expErfc(0.5*beta*(beta_s2 - 2.0*d), (beta_s2 - d)*inv_s2s, g);
+    output[bin-minX] += norm*(rise + decay);
+  }
+
+  return e_status::success;
+}
+
+/**
+ * Check if a 2D peak type can be rendered using a difference array.
+ *
+ * /arg /c type The 2D peak type
+ *
+ * /return true if ADSimPeaksPeak::diff2D supports this type
+ */
+bool ADSimPeaksPeak::hasDiff2D(e_type_2d type)
+{
+  return ((type == e_type_2d::square) || (type == e_type_2d::pyramid));
+}
+
+/**
+ * Add a 1D peak to a difference array instead of computing it bin by bin.
+ * The result is the same as calling ADSimPeaksPeak::compute1D for each bin
+ * in the range [minX, maxX] and multiplying by the scale factor.
+ *
+ * /arg /c ADSimPeaksData object defining the peak position and shape
+ * /arg /c type The 1D peak type (see ADSimPeaksPeak::hasDiff1D)
+ * /arg /c scale The scale factor to apply to the peak
+ * /arg /c minX The lowest bin to render
+ * /arg /c maxX The highest bin to render
+ * /arg /c diff The difference array to add the peak to
+ *
+ * /return ADSimPeaksPeak::e_status
+ */
+ADSimPeaksPeak::e_status ADSimPeaksPeak::diff1D(const ADSimPeaksData &data, e_type_1d type, epicsFloat64 scale,
+                                                epicsInt32 minX, epicsInt32 maxX, ADSimPeaksDiff &diff)
+{
+  switch (type) {
+  case e_type_1d::square:
+    return diffSquare(data, scale, minX, maxX, diff);
+
+  case e_type_1d::triangle:
+    return diffTriangle(data, scale, minX, maxX, diff);
+
+  default:
+    break;
+  }
+
+  return e_status::error;
+}
+
+/**
+ * Add a 2D peak to a difference array instead of computing it bin by bin.
+ * The result is the same as calling ADSimPeaksPeak::compute2D for each bin
+ * in the range [minX, maxX], [minY, maxY] and multiplying by the scale factor.
+ *
+ * /arg /c ADSimPeaksData object defining the peak position and shape
+ * /arg /c type The 2D peak type (see ADSimPeaksPeak::hasDiff2D)
+ * /arg /c scale The scale factor to apply to the peak
+ * /arg /c antialias Use the pixel area coverage rather than sampling at the bin center
+ * /arg /c minX The lowest X bin to render
+ * /arg /c maxX The highest X bin to render
+ * /arg /c minY The lowest Y bin to render
+ * /arg /c maxY The highest Y bin to render
+ * /arg /c diff The difference array to add the peak to
+ *
+ * /return ADSimPeaksPeak::e_status
+ */
+ADSimPeaksPeak::e_status ADSimPeaksPeak::diff2D(const ADSimPeaksData &data, e_type_2d type, epicsFloat64 scale,
+                                                bool antialias, epicsInt32 minX, epicsInt32 maxX,
+                                                epicsInt32 minY, epicsInt32 maxY, ADSimPeaksDiff &diff)
+{
+  switch (type) {
+  case e_type_2d::square:
+    if (antialias) {
+      return diffSquare2DCoverage(data, scale, minX, maxX, minY, maxY, diff);
+    }
+    return diffSquare2D(data, scale, minX, maxX, minY, maxY, diff);
+
+  case e_type_2d::pyramid:
+    if (antialias) {
+      return diffPyramid2DCoverage(data, scale, minX, maxX, minY, maxY, diff);
+    }
+    return diffPyramid2D(data, scale, minX, maxX, minY, maxY, diff);
+
+  default:
+    break;
+  }
+
+  return e_status::error;
+}
+
+/**
+ * Difference array version of ADSimPeaksPeak::computeSquare. 
+ * This costs a single box entry.
+ *
+ * /arg /c ADSimPeaksData object defining the peak position and shape
+ * /arg /c scale The scale factor to apply to the peak
+ * /arg /c minX The lowest bin to render
+ * /arg /c maxX The highest bin to render
+ * /arg /c diff The difference array to add the peak to
+ *
+ * /return ADSimPeaksPeak::e_status
+ */
+ADSimPeaksPeak::e_status ADSimPeaksPeak::diffSquare(const ADSimPeaksData& data, epicsFloat64 scale,
+                                                    epicsInt32 minX, epicsInt32 maxX, ADSimPeaksDiff &diff)
+{
+  epicsFloat64 pos = data.getPositionX();
+  epicsFloat64 fwhm = data.getFWHMX();
+
+  fwhm = std::max(1.0, fwhm);
+
+  epicsFloat64 peak = 1.0;
+
+  // Same edges as computeSquare
+  epicsInt64 lo = static_cast<epicsInt64>(static_cast<epicsInt32>(pos - fwhm/2.0)) + 1;
+  epicsInt64 hi = static_cast<epicsInt32>(pos + fwhm/2.0);
+  lo = std::max(lo, static_cast<epicsInt64>(minX));
+  hi = std::min(hi, static_cast<epicsInt64>(maxX));
+
+  diff.addBox(lo, hi, 0, 0, peak*scale);
+  
+  return e_status::success;
+}
+
+/**
+ * Difference array version of ADSimPeaksPeak::computeTriangle. 
+ * This costs one linear segment for each side of the triangle.
+ *
+ * /arg /c ADSimPeaksData object defining the peak position and shape
+ * /arg /c scale The scale factor to apply to the peak
+ * /arg /c minX The lowest bin to render
+ * /arg /c maxX The highest bin to render
+ * /arg /c diff The difference array to add the peak to
+ *
+ * /return ADSimPeaksPeak::e_status
+ */
+ADSimPeaksPeak::e_status ADSimPeaksPeak::diffTriangle(const ADSimPeaksData& data, epicsFloat64 scale,
+                                                      epicsInt32 minX, epicsInt32 maxX, ADSimPeaksDiff &diff)
+{
+  epicsFloat64 pos = data.getPositionX();
+  epicsFloat64 fwhm = data.getFWHMX();
+
+  fwhm = std::max(1.0, fwhm);
+
+  epicsFloat64 peak = 1.0;
+  epicsFloat64 b = peak/fwhm;
+  epicsFloat64 pivot = static_cast<epicsInt32>(pos);
+
+  // Rising edge: peak + b*(bin-pos) for bins up to the pivot, while >= 0
+  epicsFloat64 lo = std::max(ceil(pos - fwhm), static_cast<epicsFloat64>(minX));
+  epicsFloat64 hi = std::min(pivot, static_cast<epicsFloat64>(maxX));
+  if (lo <= hi) {
+    diff.addSegment(0, static_cast<epicsInt64>(lo), static_cast<epicsInt64>(hi),
+                    scale*(peak - b*pos), scale*b);
+  }
+
+  // Falling edge: peak - b*(bin-pos) for bins after the pivot, while >= 0
+  lo = std::max(pivot + 1.0, static_cast<epicsFloat64>(minX));
+  hi = std::min(floor(pos + fwhm), static_cast<epicsFloat64>(maxX));
+  if (lo <= hi) {
+    diff.addSegment(0, static_cast<epicsInt64>(lo), static_cast<epicsInt64>(hi),
+                    scale*(peak + b*pos), -scale*b);
+  }
+
+  return e_status::success;
+}
+
+/**
+ * Difference array version of ADSimPeaksPeak::computeSquare2D. 
+ * This costs a single box entry.
+ *
+ * /arg /c ADSimPeaksData object defining the peak position and shape
+ * /arg /c scale The scale factor to apply to the peak
+ * /arg /c minX The lowest X bin to render
+ * /arg /c maxX The highest X bin to render
+ * /arg /c minY The lowest Y bin to render
+ * /arg /c maxY The highest Y bin to render
+ * /arg /c diff The difference array to add the peak to
+ *
+ * /return ADSimPeaksPeak::e_status
+ */
+ADSimPeaksPeak::e_status ADSimPeaksPeak::diffSquare2D(const ADSimPeaksData& data, epicsFloat64 scale,
+                                                      epicsInt32 minX, epicsInt32 maxX, epicsInt32 minY, epicsInt32 maxY,
+                                                      ADSimPeaksDiff &diff)
+{
+  epicsFloat64 x_pos = data.getPositionX();
+  epicsFloat64 y_pos = data.getPositionY();
+  epicsFloat64 x_fwhm = data.getFWHMX();
+  epicsFloat64 y_fwhm = data.getFWHMY();
+  
+  x_fwhm = std::max(1.0, x_fwhm);
+  y_fwhm = std::max(1.0, y_fwhm);
+
+  epicsFloat64 peak = 1.0;
+
+  // Same edges as computeSquare2D
+  epicsInt64 x_lo = static_cast<epicsInt64>(static_cast<epicsInt32>(x_pos - x_fwhm/2.0)) + 1;
+  epicsInt64 x_hi = static_cast<epicsInt32>(x_pos + x_fwhm/2.0);
+  epicsInt64 y_lo = static_cast<epicsInt64>(static_cast<epicsInt32>(y_pos - y_fwhm/2.0)) + 1;
+  epicsInt64 y_hi = static_cast<epicsInt32>(y_pos + y_fwhm/2.0);
+  x_lo = std::max(x_lo, static_cast<epicsInt64>(minX));
+  x_hi = std::min(x_hi, static_cast<epicsInt64>(maxX));
+  y_lo = std::max(y_lo, static_cast<epicsInt64>(minY));
+  y_hi = std::min(y_hi, static_cast<epicsInt64>(maxY));
+
+  diff.addBox(x_lo, x_hi, y_lo, y_hi, peak*scale);
+  
+  return e_status::success;
+}
+
+/**
+ * Difference array version of ADSimPeaksPeak::computePyramid2D. 
+ * Each row of the pyramid is made of two linear segments, so
+ * this costs O(height) entries.
+ *
+ * /arg /c ADSimPeaksData object defining the peak position and shape
+ * /arg /c scale The scale factor to apply to the peak
+ * /arg /c minX The lowest X bin to render
+ * /arg /c maxX The highest X bin to render
+ * /arg /c minY The lowest Y bin to render
+ * /arg /c maxY The highest Y bin to render
+ * /arg /c diff The difference array to add the peak to
+ *
+ * /return ADSimPeaksPeak::e_status
+ */
+ADSimPeaksPeak::e_status ADSimPeaksPeak::diffPyramid2D(const ADSimPeaksData& data, epicsFloat64 scale,
+                                                       epicsInt32 minX, epicsInt32 maxX, epicsInt32 minY, epicsInt32 maxY,
+                                                       ADSimPeaksDiff &diff)
+{
+  epicsFloat64 x_pos = data.getPositionX();
+  epicsFloat64 y_pos = data.getPositionY();
+  epicsFloat64 x_fwhm = data.getFWHMX();
+  epicsFloat64 y_fwhm = data.getFWHMY();
+    
+  x_fwhm = std::max(1.0, x_fwhm);
+  y_fwhm = std::max(1.0, y_fwhm);
+
+  epicsFloat64 peak = 1.0;
+  epicsFloat64 b = peak/x_fwhm;
+  epicsFloat64 c = peak/y_fwhm;
+  epicsFloat64 x_pivot = static_cast<epicsInt32>(x_pos);
+  epicsFloat64 y_pivot = static_cast<epicsInt32>(y_pos);
+
+  // The pyramid can't extend more than 2 FWHM from the center in Y
+  epicsFloat64 y_lo = std::max(floor(y_pos - 2.0*y_fwhm) - 1.0, static_cast<epicsFloat64>(minY));
+  epicsFloat64 y_hi = std::min(ceil(y_pos + 2.0*y_fwhm) + 1.0, static_cast<epicsFloat64>(maxY));
+  
+  for (epicsFloat64 y_bin = y_lo; y_bin <= y_hi; y_bin += 1.0) {
+    // Height of the pyramid along this row at x=x_pos
+    epicsFloat64 row = peak;
+    if (y_bin <= y_pivot) {
+      row += c*(y_bin-y_pos);
+    } else {
+      row -= c*(y_bin-y_pos);
+    }
+    epicsInt64 y = static_cast<epicsInt64>(y_bin);
+    
+    // Rising edge: row + b*(x_bin-x_pos) for bins up to the pivot, while >= 0
+    epicsFloat64 lo = std::max(ceil(x_pos - row*x_fwhm), static_cast<epicsFloat64>(minX));
+    epicsFloat64 hi = std::min(x_pivot, static_cast<epicsFloat64>(maxX));
+    if (lo <= hi) {
+      diff.addSegment(y, static_cast<epicsInt64>(lo), static_cast<epicsInt64>(hi),
+                      scale*(row - b*x_pos), scale*b);
+    }
+
+    // Falling edge: row - b*(x_bin-x_pos) for bins after the pivot, while >= 0
+    lo = std::max(x_pivot + 1.0, static_cast<epicsFloat64>(minX));
+    hi = std::min(floor(x_pos + row*x_fwhm), static_cast<epicsFloat64>(maxX));
+    if (lo <= hi) {
+      diff.addSegment(y, static_cast<epicsInt64>(lo), static_cast<epicsInt64>(hi),
+                      scale*(row + b*x_pos), -scale*b);
+    }
+  }
+  
+  return e_status::success;
+}
+
+/*******************************************************************************************/
+/* Pixel area coverage (antialiasing) for the hard edged 2D peak shapes                    */
+/*                                                                                         */
+/* Normally each bin is sampled at its center. For antialiasing each bin is treated as a   */
+/* square pixel covering +/- 0.5 around the bin center, and the result is the average of   */
+/* the shape over that area. This is only needed for pixels on an edge (or a ridge) of the */
+/* shape. Inside a flat or linear part of the shape the average is the same as the value   */
+/* at the center, so interior pixels are computed as normal.                               */
+
+/**
+ * Pixel area coverage version of ADSimPeaksPeak::diffSquare2D. The square has
+ * edges at position +/- FWHM/2, and the edge pixels are scaled by the fraction
+ * of their area that is inside the square. The coverage is separable in X and Y,
+ * so this costs at most 9 box entries.
+ *
+ * /arg /c ADSimPeaksData object defining the peak position and shape
+ * /arg /c scale The scale factor to apply to the peak
+ * /arg /c minX The lowest X bin to render
+ * /arg /c maxX The highest X bin to render
+ * /arg /c minY The lowest Y bin to render
+ * /arg /c maxY The highest Y bin to render
+ * /arg /c diff The difference array to add the peak to
+ *
+ * /return ADSimPeaksPeak::e_status
+ */
+ADSimPeaksPeak::e_status ADSimPeaksPeak::diffSquare2DCoverage(const ADSimPeaksData& data, epicsFloat64 scale,
+                                                              epicsInt32 minX, epicsInt32 maxX,
+                                                              epicsInt32 minY, epicsInt32 maxY,
+                                                              ADSimPeaksDiff &diff)
+{
+  epicsFloat64 pos[2] = {data.getPositionX(), data.getPositionY()};
+  epicsFloat64 fwhm[2] = {data.getFWHMX(), data.getFWHMY()};
+  epicsFloat64 bound_lo[2] = {static_cast<epicsFloat64>(minX), static_cast<epicsFloat64>(minY)};
+  epicsFloat64 bound_hi[2] = {static_cast<epicsFloat64>(maxX), static_cast<epicsFloat64>(maxY)};
+
+  epicsFloat64 peak = 1.0;
+
+  // For each axis split the bins into the lower edge pixel, the fully
+  // covered pixels and the upper edge pixel. 
+  epicsFloat64 range_lo[2][3];
+  epicsFloat64 range_hi[2][3];
+  epicsFloat64 range_cov[2][3];
+  int ranges[2] = {0, 0};
+  for (int axis=0; axis<2; axis++) {
+    fwhm[axis] = std::max(1.0, fwhm[axis]);
+    epicsFloat64 lo = pos[axis] - fwhm[axis]/2.0;
+    epicsFloat64 hi = pos[axis] + fwhm[axis]/2.0;
+    epicsFloat64 first = floor(lo + 0.5);
+    epicsFloat64 last = ceil(hi - 0.5);
+    epicsFloat64 bins[3][2] = {{first, first}, {first+1.0, last-1.0}, {last, last}};
+    for (int i=0; i<3; i++) {
+      if ((i == 2) && (last == first)) {
+	break;
+      }
+      epicsFloat64 bin_lo = std::max(bins[i][0], bound_lo[axis]);
+      epicsFloat64 bin_hi = std::min(bins[i][1], bound_hi[axis]);
+      if (bin_lo > bin_hi) {
+	continue;
+      }
+      range_lo[axis][ranges[axis]] = bin_lo;
+      range_hi[axis][ranges[axis]] = bin_hi;
+      range_cov[axis][ranges[axis]] = (i == 1) ? 1.0 : coverage(lo, hi, bins[i][0]);
+      ranges[axis]++;
+    }
+  }
+
+  for (int i=0; i<ranges[0]; i++) {
+    for (int j=0; j<ranges[1]; j++) {
+      diff.addBox(static_cast<epicsInt64>(range_lo[0][i]), static_cast<epicsInt64>(range_hi[0][i]),
+                  static_cast<epicsInt64>(range_lo[1][j]), static_cast<epicsInt64>(range_hi[1][j]),
+                  peak*scale*range_cov[0][i]*range_cov[1][j]);
+    }
+  }
+  
+  return e_status::success;
+}
+
+/**
+ * Pixel area coverage version of ADSimPeaksPeak::diffPyramid2D. The pyramid is 
+ * made of four flat faces, which meet at the peak position. Pixels that are 
+ * entirely inside a single face are added as linear segments in the same way
+ * as ADSimPeaksPeak::diffPyramid2D. The pixels that cross the base of the pyramid
+ * or one of the ridges are integrated exactly. This costs O(perimeter) entries.
+ *
+ * /arg /c ADSimPeaksData object defining the peak position and shape
+ * /arg /c scale The scale factor to apply to the peak
+ * /arg /c minX The lowest X bin to render
+ * /arg /c maxX The highest X bin to render
+ * /arg /c minY The lowest Y bin to render
+ * /arg /c maxY The highest Y bin to render
+ * /arg /c diff The difference array to add the peak to
+ *
+ * /return ADSimPeaksPeak::e_status
+ */
+ADSimPeaksPeak::e_status ADSimPeaksPeak::diffPyramid2DCoverage(const ADSimPeaksData& data, epicsFloat64 scale,
+                                                               epicsInt32 minX, epicsInt32 maxX,
+                                                               epicsInt32 minY, epicsInt32 maxY,
+                                                               ADSimPeaksDiff &diff)
+{
+  epicsFloat64 x_pos = data.getPositionX();
+  epicsFloat64 y_pos = data.getPositionY();
+  epicsFloat64 x_fwhm = data.getFWHMX();
+  epicsFloat64 y_fwhm = data.getFWHMY();
+    
+  x_fwhm = std::max(1.0, x_fwhm);
+  y_fwhm = std::max(1.0, y_fwhm);
+
+  epicsFloat64 peak = 1.0;
+  epicsFloat64 b = peak/x_fwhm;
+  epicsFloat64 c = peak/y_fwhm;
+
+  epicsFloat64 y_lo = std::max(ceil(y_pos - y_fwhm - 0.5), static_cast<epicsFloat64>(minY));
+  epicsFloat64 y_hi = std::min(floor(y_pos + y_fwhm + 0.5), static_cast<epicsFloat64>(maxY));
+
+  for (epicsFloat64 y_bin = y_lo; y_bin <= y_hi; y_bin += 1.0) {
+    epicsInt64 y = static_cast<epicsInt64>(y_bin);
+    epicsFloat64 dy = fabs(y_bin - y_pos);
+    epicsFloat64 dy_near = std::max(0.0, dy - 0.5);
+    epicsFloat64 dy_far = dy + 0.5;
+    if (dy_near >= y_fwhm) {
+      continue;
+    }
+    
+    // Half width of the base of the pyramid at the nearest and farthest edge of this row of pixels
+    epicsFloat64 hw_out = x_fwhm*(1.0 - dy_near*c);
+    epicsFloat64 hw_in = x_fwhm*(1.0 - dy_far*c);
+    epicsFloat64 out_lo = std::max(ceil(x_pos - hw_out - 0.5), static_cast<epicsFloat64>(minX));
+    epicsFloat64 out_hi = std::min(floor(x_pos + hw_out + 0.5), static_cast<epicsFloat64>(maxX));
+
+    // Pixels entirely inside a single face (none if this row crosses the X ridge)
+    epicsFloat64 left_lo = 1.0;
+    epicsFloat64 left_hi = 0.0;
+    epicsFloat64 right_lo = 1.0;
+    epicsFloat64 right_hi = 0.0;
+    if ((dy >= 0.5) && (hw_in > 0.0)) {
+      left_lo = std::max(ceil(x_pos - hw_in + 0.5), out_lo);
+      left_hi = std::min(floor(x_pos - 0.5), out_hi);
+      right_lo = std::max(ceil(x_pos + 0.5), out_lo);
+      right_hi = std::min(floor(x_pos + hw_in - 0.5), out_hi);
+      epicsFloat64 row = peak - c*dy;
+      if (left_lo <= left_hi) {
+	diff.addSegment(y, static_cast<epicsInt64>(left_lo), static_cast<epicsInt64>(left_hi),
+			scale*(row - b*x_pos), scale*b);
+      }
+      if (right_lo <= right_hi) {
+	diff.addSegment(y, static_cast<epicsInt64>(right_lo), static_cast<epicsInt64>(right_hi),
+			scale*(row + b*x_pos), -scale*b);
+      }
+    }
+
+    // The remaining pixels are on an edge or ridge
+    for (epicsFloat64 x_bin = out_lo; x_bin <= out_hi; x_bin += 1.0) {
+      if ((left_lo <= left_hi) && (x_bin >= left_lo) && (x_bin <= left_hi)) {
+	x_bin = left_hi;
+	continue;
+      }
+      if ((right_lo <= right_hi) && (x_bin >= right_lo) && (x_bin <= right_hi)) {
+	x_bin = right_hi;
+	continue;
+      }
+      epicsFloat64 value = integratePyramid2D(data, x_bin, y_bin);
+      if (value > 0.0) {
+	epicsInt64 x = static_cast<epicsInt64>(x_bin);
+	diff.addSegment(y, x, x, scale*value, 0.0);
+      }
+    }
+  }
+  
+  return e_status::success;
+}
+
+/**
+ * Find the range of X bins that are on the edge of the eliptical cone for the
+ * Y bin set in the ADSimPeaksData object. Pixels in the range [in_lo, in_hi] are
+ * entirely inside the cone and can be computed using ADSimPeaksPeak::computeCone2D. 
+ * The rest of the pixels in the range [out_lo, out_hi] cross the edge of the cone
+ * and should be computed using ADSimPeaksPeak::computeCone2DCoverage. Pixels outside
+ * [out_lo, out_hi] are zero. The ranges are empty if lo > hi.
+ *
+ * /arg /c ADSimPeaksData object defining the peak position, shape and the Y bin
+ * /arg /c in_lo The first X bin entirely inside the cone
+ * /arg /c in_hi The last X bin entirely inside the cone
+ * /arg /c out_lo The first X bin that is at least partly inside the cone
+ * /arg /c out_hi The last X bin that is at least partly inside the cone
+ *
+ * /return ADSimPeaksPeak::e_status
+ */
+ADSimPeaksPeak::e_status ADSimPeaksPeak::edgesCone2D(const ADSimPeaksData& data, epicsFloat64 &in_lo, epicsFloat64 &in_hi,
+                                                     epicsFloat64 &out_lo, epicsFloat64 &out_hi)
+{
+  epicsFloat64 x_pos = data.getPositionX();
+  epicsFloat64 y_pos = data.getPositionY();
+  epicsFloat64 x_fwhm = data.getFWHMX();
+  epicsFloat64 y_fwhm = data.getFWHMY();
+  epicsInt32 y_bin = data.getBinY();
+  
+  x_fwhm = std::max(1.0, x_fwhm);
+  y_fwhm = std::max(1.0, y_fwhm);
+
+  in_lo = 1.0;
+  in_hi = 0.0;
+  out_lo = 1.0;
+  out_hi = 0.0;
+
+  // Distance (in units of the ellipse radius) to the nearest and farthest edge of this row of pixels
+  epicsFloat64 dy = fabs(y_bin - y_pos);
+  epicsFloat64 dy_near = std::max(0.0, dy - 0.5) / y_fwhm;
+  epicsFloat64 dy_far = (dy + 0.5) / y_fwhm;
+  if (dy_near >= 1.0) {
+    return e_status::success;
+  }
+
+  // Half width of the ellipse at the nearest and farthest edge of this row of pixels
+  epicsFloat64 hw_out = x_fwhm * sqrt(1.0 - dy_near*dy_near);
+  out_lo = ceil(x_pos - hw_out - 0.5);
+  out_hi = floor(x_pos + hw_out + 0.5);
+  if (dy_far < 1.0) {
+    epicsFloat64 hw_in = x_fwhm * sqrt(1.0 - dy_far*dy_far);
+    in_lo = ceil(x_pos - hw_in + 0.5);
+    in_hi = floor(x_pos + hw_in - 0.5);
+  }
+  
+  return e_status::success;
+}
+
+/**
+ * Pixel area coverage version of ADSimPeaksPeak::computeCone2D, for pixels that cross the
+ * edge of the cone. Across a single pixel the surface of the cone is very close to flat, 
+ * so the surface is linearized at the bin center, and the area of the pixel that is 
+ * under that surface is integrated exactly.
+ *
+ * /arg /c ADSimPeaksData object defining the peak position, shape and the array bins (x,y)
+ * /arg /c result This will be used to return the result of the calculation
+ *
+ * /return ADSimPeaksPeak::e_status
+ */
+ADSimPeaksPeak::e_status ADSimPeaksPeak::computeCone2DCoverage(const ADSimPeaksData& data, epicsFloat64 &result)
+{
+  epicsFloat64 x_pos = data.getPositionX();
+  epicsFloat64 y_pos = data.getPositionY();
+  epicsFloat64 x_fwhm = data.getFWHMX();
+  epicsFloat64 y_fwhm = data.getFWHMY();
+  epicsInt32 x_bin = data.getBinX();
+  epicsInt32 y_bin = data.getBinY();
+  
+  x_fwhm = std::max(1.0, x_fwhm);
+  y_fwhm = std::max(1.0, y_fwhm);
+
+  epicsFloat64 peak = x_fwhm + y_fwhm;
+
+  // Distance from the center in units of the ellipse radius at this angle (r/d in computeCone2D)
+  epicsFloat64 u = (x_bin-x_pos) / x_fwhm;
+  epicsFloat64 v = (y_bin-y_pos) / y_fwhm;
+  epicsFloat64 rho = sqrt(u*u + v*v);
+  if (rho < s_zeroCheck) {
+    return computeCone2D(data, result);
+  }
+
+  // Height = peak*(1 - rho), linearized around the bin center
+  epicsFloat64 b = -peak * u / (x_fwhm * rho);
+  epicsFloat64 c = -peak * v / (y_fwhm * rho);
+  epicsFloat64 a = peak*(1.0 - rho) - b*x_bin - c*y_bin;
+  
+  result = integratePlane(x_bin-0.5, x_bin+0.5, y_bin-0.5, y_bin+0.5, a, b, c);
+  
+  return e_status::success;
+}
+
+/**
+ * Exact average of the pyramid over the pixel centered at (x_bin, y_bin). The
+ * pixel is split along the ridges of the pyramid so that each part is
+ * on a single flat face, and each part is integrated exactly.
+ *
+ * /arg /c ADSimPeaksData object defining the peak position and shape
+ * /arg /c x_bin The X bin
+ * /arg /c y_bin The Y bin
+ *
+ * /return The average height of the pyramid over the pixel
+ */
+epicsFloat64 ADSimPeaksPeak::integratePyramid2D(const ADSimPeaksData& data, epicsFloat64 x_bin, epicsFloat64 y_bin)
+{
+  epicsFloat64 x_pos = data.getPositionX();
+  epicsFloat64 y_pos = data.getPositionY();
+  epicsFloat64 x_fwhm = std::max(1.0, data.getFWHMX());
+  epicsFloat64 y_fwhm = std::max(1.0, data.getFWHMY());
+
+  epicsFloat64 peak = 1.0;
+  epicsFloat64 xs[3] = {x_bin-0.5, std::min(std::max(x_pos, x_bin-0.5), x_bin+0.5), x_bin+0.5};
+  epicsFloat64 ys[3] = {y_bin-0.5, std::min(std::max(y_pos, y_bin-0.5), y_bin+0.5), y_bin+0.5};
+  epicsFloat64 result = 0.0;
+  
+  for (int i=0; i<2; i++) {
+    for (int j=0; j<2; j++) {
+      if ((xs[i+1] <= xs[i]) || (ys[j+1] <= ys[j])) {
+	continue;
+      }
+      // Face: peak - sx*(x-x_pos)/x_fwhm - sy*(y-y_pos)/y_fwhm
+      epicsFloat64 sx = (i == 0) ? -1.0 : 1.0;
+      epicsFloat64 sy = (j == 0) ? -1.0 : 1.0;
+      epicsFloat64 b = -sx*peak/x_fwhm;
+      epicsFloat64 c = -sy*peak/y_fwhm;
+      epicsFloat64 a = peak - b*x_pos - c*y_pos;
+      result += integratePlane(xs[i], xs[i+1], ys[j], ys[j+1], a, b, c);
+    }
+  }
+
+  return result;
+}
+
+/**
+ * Utility function to calculate the length of the overlap between
+ * the range [lo, hi] and the pixel centered at bin.
+ *
+ * /arg /c lo The lower edge of the range
+ * /arg /c hi The upper edge of the range
+ * /arg /c bin The bin center
+ *
+ * /return The overlap, between 0.0 and 1.0
+ */
+epicsFloat64 ADSimPeaksPeak::coverage(epicsFloat64 lo, epicsFloat64 hi, epicsFloat64 bin)
+{
+  return std::max(0.0, std::min(hi, bin+0.5) - std::max(lo, bin-0.5));
+}
+
+/**
+ * Utility function to integrate max(0, a + b*x + c*y) over a rectangle. 
+ * The rectangle is clipped to the half plane where the function is positive
+ * and the linear function is integrated over the resulting polygon.
+ *
+ * /arg /c x0 The lower X edge of the rectangle
+ * /arg /c x1 The upper X edge of the rectangle
+ * /arg /c y0 The lower Y edge of the rectangle
+ * /arg /c y1 The upper Y edge of the rectangle
+ * /arg /c a The constant term
+ * /arg /c b The X coefficient
+ * /arg /c c The Y coefficient
+ *
+ * /return The integral
+ */
+epicsFloat64 ADSimPeaksPeak::integratePlane(epicsFloat64 x0, epicsFloat64 x1, epicsFloat64 y0, epicsFloat64 y1,
+                                            epicsFloat64 a, epicsFloat64 b, epicsFloat64 c)
+{
+  epicsFloat64 rect_x[4] = {x0, x1, x1, x0};
+  epicsFloat64 rect_y[4] = {y0, y0, y1, y1};
+  epicsFloat64 poly_x[5];
+  epicsFloat64 poly_y[5];
+  epicsFloat64 poly_f[5];
+  int n = 0;
+
+  // Clip the rectangle to the half plane (a rectangle clipped by a line has at most 5 vertices)
+  for (int i=0; i<4; i++) {
+    int j = (i+1) % 4;
+    epicsFloat64 fi = a + b*rect_x[i] + c*rect_y[i];
+    epicsFloat64 fj = a + b*rect_x[j] + c*rect_y[j];
+    if (fi >= 0.0) {
+      poly_x[n] = rect_x[i];
+      poly_y[n] = rect_y[i];
+      poly_f[n] = fi;
+      n++;
+    }
+    if (((fi >= 0.0) && (fj < 0.0)) || ((fi < 0.0) && (fj >= 0.0))) {
+      epicsFloat64 t = fi / (fi - fj);
+      poly_x[n] = rect_x[i] + t*(rect_x[j] - rect_x[i]);
+      poly_y[n] = rect_y[i] + t*(rect_y[j] - rect_y[i]);
+      poly_f[n] = 0.0;
+      n++;
+    }
+  }
+
+  // Integrate the linear function over the polygon as a fan of triangles
+  epicsFloat64 result = 0.0;
+  for (int i=1; i<n-1; i++) {
+    epicsFloat64 area = ((poly_x[i]-poly_x[0])*(poly_y[i+1]-poly_y[0]) -
+                         (poly_x[i+1]-poly_x[0])*(poly_y[i]-poly_y[0])) / 2.0;
+    result += area * (poly_f[0] + poly_f[i] + poly_f[i+1]) / 3.0;
+  }
+
+  return fabs(result);
+}
+
 /**
  * Utility function to check if a floating point number is close to zero.
  *
@@ -839,4 +1630,35 @@ epicsFloat64 ADSimPeaksPeak::zeroCheck(epicsFloat64 value)
     return value;
   }
 }
+
+/**
+ * Calculate exp(u)*erfc(y) without overflow or underflow in the
+ * separate terms, where g = u - y*y (which is passed in because the
+ * caller can calculate it more accurately).
+ *
+ * This uses the Chebyshev approximation for erfc (fractional error less
+ * than 1.2e-7), which has the form erfc(y) = t*exp(-y*y + P(t)) for y >= 0,
+ * with t = 1/(1+y/2), so for y >= 0 the result is t*exp(g + P(t)) 
+ * and only one exp is needed. For y < 0 we use erfc(y) = 2 - erfc(-y).
+ *
+ * /arg /c u The exponent
+ * /arg /c y The argument of erfc
+ * /arg /c g u - y*y
+ *
+ * /return exp(u)*erfc(y)
+ */
+epicsFloat64 ADSimPeaksPeak::expErfc(epicsFloat64 u, epicsFloat64 y, epicsFloat64 g)
+{
+  epicsFloat64 z = fabs(y);
+  epicsFloat64 t = 1.0 / (1.0 + 0.5*z);
+  epicsFloat64 poly = s_erfc[9];
+  for (epicsInt32 i=8; i>=0; i--) {
+    poly = s_erfc[i] + t*poly;
+  }
+  epicsFloat64 result = t*exp(g + poly);
+  if (y < 0.0) {
+    result = 2.0*exp(u) - result;
+  }
+  return result;
+}
  
@@ -16,6 +16,7 @@
 
 #include <epicsTypes.h>
 #include <ADSimPeaksData.h>
+#include <ADSimPeaksDiff.h>
 
 class ADSimPeaksPeak
 {
@@ -41,7 +42,8 @@ class ADSimPeaksPeak
     pseudovoigt,
     laplace,
     moffat,
-    smoothstep 
+    smoothstep,
+    backtoback
   };
 
   /**
@@ -73,6 +75,14 @@ class ADSimPeaksPeak
   e_status computeSquare(const ADSimPeaksData &data, epicsFloat64 &result); 
   e_status computeMoffat(const ADSimPeaksData &data, epicsFloat64 &result);
   e_status computeSmoothStep(const ADSimPeaksData &data, epicsFloat64 &result); 
+  e_status computeBackToBack(const ADSimPeaksData &data, epicsFloat64 &result);
+
+  // Span rendering (for shapes that are faster to calculate for a range of bins at once)
+  bool hasSpan1D(e_type_1d type);
+  e_status span1D(const ADSimPeaksData &data, e_type_1d type, epicsFloat64 scale,
+		  epicsInt32 minX, epicsInt32 maxX, epicsFloat64 *output);
+  e_status spanBackToBack(const ADSimPeaksData &data, epicsFloat64 scale,
+			  epicsInt32 minX, epicsInt32 maxX, epicsFloat64 *output);
 
   // 2D Profiles
   e_status computeGaussian2D(const ADSimPeaksData &data, epicsFloat64 &result); 
@@ -86,6 +96,31 @@ class ADSimPeaksPeak
   e_status computeMoffat2D(const ADSimPeaksData &data, epicsFloat64 &result);
   e_status computeSmoothStep2D(const ADSimPeaksData &data, epicsFloat64 &result); 
   
+  // Difference array rendering (for piecewise constant and linear shapes)
+  bool hasDiff1D(e_type_1d type);
+  bool hasDiff2D(e_type_2d type);
+  e_status diff1D(const ADSimPeaksData &data, e_type_1d type, epicsFloat64 scale,
+                  epicsInt32 minX, epicsInt32 maxX, ADSimPeaksDiff &diff);
+  e_status diff2D(const ADSimPeaksData &data, e_type_2d type, epicsFloat64 scale, bool antialias,
+                  epicsInt32 minX, epicsInt32 maxX, epicsInt32 minY, epicsInt32 maxY, ADSimPeaksDiff &diff);
+  e_status diffSquare(const ADSimPeaksData &data, epicsFloat64 scale,
+                      epicsInt32 minX, epicsInt32 maxX, ADSimPeaksDiff &diff);
+  e_status diffTriangle(const ADSimPeaksData &data, epicsFloat64 scale,
+                        epicsInt32 minX, epicsInt32 maxX, ADSimPeaksDiff &diff);
+  e_status diffSquare2D(const ADSimPeaksData &data, epicsFloat64 scale,
+                        epicsInt32 minX, epicsInt32 maxX, epicsInt32 minY, epicsInt32 maxY, ADSimPeaksDiff &diff);
+  e_status diffPyramid2D(const ADSimPeaksData &data, epicsFloat64 scale,
+                         epicsInt32 minX, epicsInt32 maxX, epicsInt32 minY, epicsInt32 maxY, ADSimPeaksDiff &diff);
+  e_status diffSquare2DCoverage(const ADSimPeaksData &data, epicsFloat64 scale,
+                                epicsInt32 minX, epicsInt32 maxX, epicsInt32 minY, epicsInt32 maxY, ADSimPeaksDiff &diff);
+  e_status diffPyramid2DCoverage(const ADSimPeaksData &data, epicsFloat64 scale,
+                                 epicsInt32 minX, epicsInt32 maxX, epicsInt32 minY, epicsInt32 maxY, ADSimPeaksDiff &diff);
+
+  // Pixel area coverage (antialiasing) for the hard edged shapes that are computed bin by bin
+  e_status edgesCone2D(const ADSimPeaksData &data, epicsFloat64 &in_lo, epicsFloat64 &in_hi,
+                       epicsFloat64 &out_lo, epicsFloat64 &out_hi);
+  e_status computeCone2DCoverage(const ADSimPeaksData &data, epicsFloat64 &result);
+  
   // Read the string names of the supported peak types
   std::string getType1DName(e_type_1d type);
   std::string getType2DName(e_type_2d type);
@@ -93,6 +128,11 @@ class ADSimPeaksPeak
  private:
 
   epicsFloat64 zeroCheck(epicsFloat64 value);
+  static epicsFloat64 expErfc(epicsFloat64 u, epicsFloat64 y, epicsFloat64 g);
+  epicsFloat64 coverage(epicsFloat64 lo, epicsFloat64 hi, epicsFloat64 bin);
+  epicsFloat64 integratePlane(epicsFloat64 x0, epicsFloat64 x1, epicsFloat64 y0, epicsFloat64 y1,
+                              epicsFloat64 a, epicsFloat64 b, epicsFloat64 c);
+  epicsFloat64 integratePyramid2D(const ADSimPeaksData &data, epicsFloat64 x_bin, epicsFloat64 y_bin);
   
   // Static Data
   static const epicsFloat64 s_zeroCheck;
@@ -106,6 +146,7 @@ class ADSimPeaksPeak
   static const epicsFloat64 s_pv_e1;
   static const epicsFloat64 s_pv_e2;
   static const epicsFloat64 s_pv_e3;
+  static const epicsFloat64 s_erfc[10];
 
 };
 
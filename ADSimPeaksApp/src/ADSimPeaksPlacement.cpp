@@ -0,0 +1,369 @@
+/**
+ * \brief Thread placement (CPU affinity, real-time priority and
+ *        memory locking) used by the ADSimPeaks areaDetector driver.
+ *
+ * On a shared IOC server the frame timing is disturbed when the
+ * simulation thread is migrated between cores, or when it takes a page
+ * fault on one of the frame buffers. This class holds the placement
+ * configuration for the driver threads:
+ *
+ * - A set of CPUs that the threads are allowed to run on (for example "2-3,6").
+ * - A SCHED_FIFO priority (1 to 99), or 0 to keep the EPICS thread priority.
+ * - The memory mode. 'Prefault' touches every page of the frame buffers when
+ *   they are allocated. 'Lock' locks all the current and future memory of
+ *   the process into RAM (this affects the whole IOC, not just the driver).
+ *
+ * The configuration is applied by each thread to itself (see apply), and
+ * the thread records the placement that it actually got (the scheduling
+ * policy, priority, CPU set and any error), so it can be printed in the
+ * driver report. The threads can also record the CPU they are running on
+ * (see sample), which counts how often they were migrated.
+ *
+ * The affinity and memory locking are only supported on Linux. On other
+ * systems the configuration is accepted but an error is recorded for each
+ * thread.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#include <cstring>
+#include <cerrno>
+#include <cctype>
+#include <sstream>
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include <ADSimPeaksPlacement.h>
+
+const epicsInt32 ADSimPeaksPlacement::s_maxPriority = 99;
+
+/**
+ * Constructor. By default the threads are not moved.
+ */
+ADSimPeaksPlacement::ADSimPeaksPlacement(void)
+  : m_configured(false),
+    m_generation(0),
+    m_priority(0),
+    m_memory(e_memory::none),
+    m_memoryLocked(false)
+{
+  m_lock = epicsMutexMustCreate();
+}
+
+/**
+ * Destructor
+ */
+ADSimPeaksPlacement::~ADSimPeaksPlacement(void) {
+  epicsMutexDestroy(m_lock);
+}
+
+/**
+ * Set the placement configuration. This does not move any threads,
+ * the threads need to call apply.
+ *
+ * /arg /c cpuList The list of CPUs (for example "0-3,6"), or an empty string for any CPU
+ * /arg /c priority The SCHED_FIFO priority (1 to 99), or 0 to keep the EPICS priority
+ * /arg /c memory The memory mode (see ADSimPeaksPlacement::e_memory)
+ * /arg /c error This will be used to return an error message
+ *
+ * /return false if the configuration was not valid (and was not used)
+ */
+bool ADSimPeaksPlacement::configure(const char *cpuList, epicsInt32 priority, epicsInt32 memory,
+				    std::string &error) {
+  std::vector<epicsUInt32> cpus;
+  std::string list((cpuList != NULL) ? cpuList : "");
+
+  if (!parseCPUs(list, cpus)) {
+    error = "invalid CPU list: " + list;
+    return false;
+  }
+  if ((priority < 0) || (priority > s_maxPriority)) {
+    error = "invalid priority: " + std::to_string(priority);
+    return false;
+  }
+  if ((memory < static_cast<epicsInt32>(e_memory::none)) ||
+      (memory > static_cast<epicsInt32>(e_memory::lock))) {
+    error = "invalid memory mode: " + std::to_string(memory);
+    return false;
+  }
+
+  epicsMutexLock(m_lock);
+  m_cpuList = list;
+  m_cpus = cpus;
+  m_priority = priority;
+  m_memory = static_cast<e_memory>(memory);
+  m_configured = true;
+  m_generation++;
+  epicsMutexUnlock(m_lock);
+
+  return true;
+}
+
+/**
+ * Check if a placement configuration has been set.
+ */
+bool ADSimPeaksPlacement::configured(void) const {
+  return m_configured;
+}
+
+/**
+ * Get the configuration generation. This is incremented each time the
+ * configuration is set, so a thread can tell if it needs to apply it again.
+ */
+epicsUInt32 ADSimPeaksPlacement::generation(void) const {
+  return m_generation;
+}
+
+/**
+ * Get the memory mode.
+ */
+ADSimPeaksPlacement::e_memory ADSimPeaksPlacement::getMemory(void) const {
+  return m_memory;
+}
+
+/**
+ * Apply the placement configuration to the calling thread, and record
+ * the placement the thread actually got. The first time this is called
+ * by a thread its original CPU set and scheduling policy are saved, and
+ * they are restored if the CPU list or the priority is later cleared.
+ * If the memory mode is 'Lock' the process memory is locked the first 
+ * time this is called.
+ *
+ * /arg /c name The name to use for this thread in the report
+ */
+void ADSimPeaksPlacement::apply(const std::string &name) {
+  epicsMutexLock(m_lock);
+  s_thread &thread = findThread(name);
+  thread.error.clear();
+
+#ifdef __linux__
+  int status = 0;
+  pthread_t self = pthread_self();
+  thread.tid = static_cast<long>(syscall(SYS_gettid));
+
+  if (!thread.saved) {
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    if (pthread_getaffinity_np(self, sizeof(cpuSet), &cpuSet) == 0) {
+      for (int cpu=0; cpu<CPU_SETSIZE; cpu++) {
+	if (CPU_ISSET(cpu, &cpuSet)) {
+	  thread.savedCpus.push_back(static_cast<epicsUInt32>(cpu));
+	}
+      }
+    }
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    if (pthread_getschedparam(self, &thread.savedPolicy, &param) == 0) {
+      thread.savedPriority = param.sched_priority;
+    }
+    thread.saved = true;
+  }
+
+  //Set the configured CPUs, or put back the original CPUs if the list has been cleared
+  const std::vector<epicsUInt32> &cpus = (!m_cpus.empty()) ? m_cpus : thread.savedCpus;
+  if ((!m_cpus.empty()) || ((thread.affinitySet) && (!cpus.empty()))) {
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for (std::vector<epicsUInt32>::const_iterator it = cpus.begin(); it != cpus.end(); ++it) {
+      if (*it < CPU_SETSIZE) {
+	CPU_SET(*it, &cpuSet);
+      }
+    }
+    if ((status = pthread_setaffinity_np(self, sizeof(cpuSet), &cpuSet)) != 0) {
+      thread.error += "affinity: " + std::string(strerror(status)) + ". ";
+    }
+    thread.affinitySet = (!m_cpus.empty());
+  }
+
+  //Set SCHED_FIFO, or put back the original policy if the priority has been set to 0
+  if ((m_priority > 0) || (thread.prioritySet)) {
+    int policy = thread.savedPolicy;
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = thread.savedPriority;
+    if (m_priority > 0) {
+      policy = SCHED_FIFO;
+      param.sched_priority = std::min(m_priority, static_cast<epicsInt32>(sched_get_priority_max(SCHED_FIFO)));
+    }
+    if ((status = pthread_setschedparam(self, policy, &param)) != 0) {
+      thread.error += ((m_priority > 0) ? "SCHED_FIFO: " : "restore policy: ") + std::string(strerror(status)) + ". ";
+    }
+    thread.prioritySet = (m_priority > 0);
+  }
+
+  if ((m_memory == e_memory::lock) && (!m_memoryLocked)) {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0) {
+      m_memoryLocked = true;
+      m_memoryError.clear();
+    } else {
+      m_memoryError = strerror(errno);
+    }
+  }
+
+  //Read back what we actually got
+  int policy = 0;
+  struct sched_param param;
+  if (pthread_getschedparam(self, &policy, &param) == 0) {
+    thread.policy = (policy == SCHED_FIFO) ? "SCHED_FIFO" : (policy == SCHED_RR) ? "SCHED_RR" : "SCHED_OTHER";
+    thread.priority = param.sched_priority;
+  }
+  cpu_set_t cpuSet;
+  CPU_ZERO(&cpuSet);
+  if (pthread_getaffinity_np(self, sizeof(cpuSet), &cpuSet) == 0) {
+    std::ostringstream affinity;
+    int count = 0;
+    for (int cpu=0; cpu<CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &cpuSet)) {
+	affinity << ((count++ > 0) ? "," : "") << cpu;
+      }
+    }
+    thread.affinity = affinity.str();
+  }
+  thread.cpu = sched_getcpu();
+#else
+  thread.error = "thread placement is not supported on this system.";
+#endif
+
+  epicsMutexUnlock(m_lock);
+}
+
+/**
+ * Record the CPU the calling thread is running on. This is cheap enough
+ * to call once per frame. If the CPU has changed since the last call
+ * the migration count is incremented.
+ *
+ * /arg /c name The name to use for this thread in the report
+ */
+void ADSimPeaksPlacement::sample(const std::string &name) {
+#ifdef __linux__
+  epicsInt32 cpu = sched_getcpu();
+  epicsMutexLock(m_lock);
+  s_thread &thread = findThread(name);
+  if ((thread.cpu >= 0) && (cpu != thread.cpu)) {
+    thread.migrations++;
+  }
+  thread.cpu = cpu;
+  epicsMutexUnlock(m_lock);
+#endif
+}
+
+/**
+ * Print the placement configuration and the placement of each thread.
+ *
+ * /arg /c fp The file pointer to print to
+ */
+void ADSimPeaksPlacement::report(FILE *fp) const {
+  static const char *memoryNames[] = {"none", "prefault", "lock"};
+
+  epicsMutexLock(m_lock);
+  fprintf(fp, "  placement CPUs: %s\n", m_cpuList.empty() ? "any" : m_cpuList.c_str());
+  fprintf(fp, "  placement priority: %d%s\n", m_priority, (m_priority > 0) ? " (SCHED_FIFO)" : " (EPICS)");
+  fprintf(fp, "  placement memory: %s (locked: %d)%s%s\n", memoryNames[static_cast<int>(m_memory)],
+	  m_memoryLocked, m_memoryError.empty() ? "" : " error: ", m_memoryError.c_str());
+  for (std::vector<s_thread>::const_iterator it = m_threads.begin(); it != m_threads.end(); ++it) {
+    fprintf(fp, "  thread %s: tid %ld, %s priority %d, CPUs %s, on CPU %d, migrations %u%s%s\n",
+	    it->name.c_str(), it->tid, it->policy.c_str(), it->priority, it->affinity.c_str(),
+	    it->cpu, it->migrations, it->error.empty() ? "" : ", error: ", it->error.c_str());
+  }
+  epicsMutexUnlock(m_lock);
+}
+
+/**
+ * Touch every page of a buffer, so that the page faults happen now
+ * rather than when the first frame is rendered. The contents of the
+ * buffer are not changed.
+ *
+ * /arg /c data Pointer to the buffer
+ * /arg /c bytes The size of the buffer in bytes
+ */
+void ADSimPeaksPlacement::prefault(void *data, size_t bytes) {
+  const size_t page = 4096;
+  volatile char *p = static_cast<volatile char*>(data);
+  if (p == NULL) {
+    return;
+  }
+  for (size_t i=0; i<bytes; i+=page) {
+    p[i] = p[i];
+  }
+  if (bytes > 0) {
+    p[bytes-1] = p[bytes-1];
+  }
+}
+
+/**
+ * Find the record for a thread, adding a new one if needed.
+ * This should be called with the lock held.
+ *
+ * /arg /c name The thread name
+ *
+ * /return Reference to the thread record
+ */
+ADSimPeaksPlacement::s_thread& ADSimPeaksPlacement::findThread(const std::string &name) {
+  for (std::vector<s_thread>::iterator it = m_threads.begin(); it != m_threads.end(); ++it) {
+    if (it->name == name) {
+      return *it;
+    }
+  }
+  s_thread thread;
+  thread.name = name;
+  thread.tid = 0;
+  thread.priority = 0;
+  thread.cpu = -1;
+  thread.migrations = 0;
+  thread.saved = false;
+  thread.savedPolicy = 0;
+  thread.savedPriority = 0;
+  thread.affinitySet = false;
+  thread.prioritySet = false;
+  m_threads.push_back(thread);
+  return m_threads.back();
+}
+
+/**
+ * Parse a list of CPUs. This is a comma separated list of CPU numbers
+ * or ranges (for example "0-3,6").
+ *
+ * /arg /c cpuList The list of CPUs (an empty list means any CPU)
+ * /arg /c cpus This will be used to return the CPU numbers
+ *
+ * /return false if the list could not be parsed
+ */
+bool ADSimPeaksPlacement::parseCPUs(const std::string &cpuList, std::vector<epicsUInt32> &cpus) {
+  std::istringstream list(cpuList);
+  std::string item;
+
+  cpus.clear();
+  while (std::getline(list, item, ',')) {
+    item.erase(std::remove_if(item.begin(), item.end(), ::isspace), item.end());
+    if (item.empty()) {
+      continue;
+    }
+    size_t dash = item.find('-');
+    try {
+      size_t end = 0;
+      unsigned long first = std::stoul(item.substr(0, dash), &end);
+      unsigned long last = first;
+      if (dash != std::string::npos) {
+	last = std::stoul(item.substr(dash+1), &end);
+      }
+      if ((item.find_first_not_of("0123456789-") != std::string::npos) || (last < first) || (last > 1023)) {
+	return false;
+      }
+      for (unsigned long cpu=first; cpu<=last; cpu++) {
+	cpus.push_back(static_cast<epicsUInt32>(cpu));
+      }
+    } catch (...) {
+      return false;
+    }
+  }
+  return true;
+}
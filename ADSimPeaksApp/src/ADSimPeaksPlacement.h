@@ -0,0 +1,90 @@
+/**
+ * \brief Thread placement (CPU affinity, real-time priority and
+ *        memory locking) used by the ADSimPeaks areaDetector driver.
+ *
+ * More detailed documentation can be found in the source file.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#ifndef ADSIMPEAKSPLACEMENT_H
+#define ADSIMPEAKSPLACEMENT_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+
+class ADSimPeaksPlacement
+{
+ public:
+  ADSimPeaksPlacement(void);
+  virtual ~ADSimPeaksPlacement(void);
+
+  /**
+   * The enum for the memory mode.
+   */
+  enum class e_memory {
+    none = 0,
+    prefault,
+    lock
+  };
+
+  static const epicsInt32 s_maxPriority;
+
+  bool configure(const char *cpuList, epicsInt32 priority, epicsInt32 memory, std::string &error);
+  bool configured(void) const;
+  epicsUInt32 generation(void) const;
+  e_memory getMemory(void) const;
+
+  void apply(const std::string &name);
+  void sample(const std::string &name);
+  void report(FILE *fp) const;
+
+  static void prefault(void *data, size_t bytes);
+
+ private:
+
+  /**
+   * The placement of a thread, recorded by the thread itself. The original
+   * CPU set and scheduling policy are saved the first time the placement is
+   * applied, so they can be restored if the configuration is cleared.
+   */
+  struct s_thread {
+    std::string name;
+    long tid;
+    std::string policy;
+    epicsInt32 priority;
+    std::string affinity;
+    epicsInt32 cpu;
+    epicsUInt32 migrations;
+    std::string error;
+    bool saved;
+    std::vector<epicsUInt32> savedCpus;
+    int savedPolicy;
+    epicsInt32 savedPriority;
+    bool affinitySet;
+    bool prioritySet;
+  };
+
+  s_thread& findThread(const std::string &name);
+  static bool parseCPUs(const std::string &cpuList, std::vector<epicsUInt32> &cpus);
+
+  epicsMutexId m_lock;
+  bool m_configured;
+  epicsUInt32 m_generation;
+  std::string m_cpuList;
+  std::vector<epicsUInt32> m_cpus;
+  epicsInt32 m_priority;
+  e_memory m_memory;
+  bool m_memoryLocked;
+  std::string m_memoryError;
+  std::vector<s_thread> m_threads;
+
+};
+
+#endif //ADSIMPEAKSPLACEMENT_H
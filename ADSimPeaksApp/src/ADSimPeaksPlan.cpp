@@ -0,0 +1,323 @@
+/**
+ * \brief Plan and row rendering of the background and peaks model,
+ *        shared by the ADSimPeaks driver and the standalone engine.
+ *
+ * The model is the sum of the X and Y background profiles and the peaks,
+ * before the global scale and the noise are applied. A plan is built for
+ * a frame by calling begin, then setBackground for each axis and addPeak
+ * for each peak. The background profiles are calculated once, the piecewise
+ * peak shapes are added to the difference array (see ADSimPeaksDiff), and
+ * the other peaks are saved with their scale factor and their boundaries
+ * (clipped to the frame) to be calculated bin by bin.
+ *
+ * The model is then rendered for any part of a row with background and
+ * peaks, so the caller can split the frame into chunks (the driver) or
+ * render one row at a time (the engine). The rows must be rendered in
+ * order for the difference array, but a row can be split into several
+ * parts, as long as they are also in order. The chunk geometry used by
+ * the driver is also worked out here (see ADSimPeaksPlan::chunkSize).
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#include <cmath>
+#include <algorithm>
+
+#include <ADSimPeaksPlan.h>
+
+const epicsFloat64 ADSimPeaksPlan::s_zeroCheck = 1e-12;
+
+/**
+ * Constructor
+ */
+ADSimPeaksPlan::ADSimPeaksPlan(void)
+  : m_sizeX(0),
+    m_sizeY(0),
+    m_2d(false),
+    m_antialias(false)
+{
+}
+
+/**
+ * Destructor
+ */
+ADSimPeaksPlan::~ADSimPeaksPlan(void) {
+}
+
+/**
+ * Start a new plan. This removes all the peaks and sets
+ * the background profiles to zero.
+ *
+ * /arg /c sizeX The number of bins in the X dimension
+ * /arg /c sizeY The number of bins in the Y dimension (1 for 1D data)
+ * /arg /c is2d Set to true for 2D peaks
+ * /arg /c antialias Set to true to use the pixel area coverage for the
+ * hard edged 2D shapes (square, pyramid and cone)
+ */
+void ADSimPeaksPlan::begin(epicsUInt32 sizeX, epicsUInt32 sizeY, bool is2d, bool antialias)
+{
+  m_sizeX = sizeX;
+  m_sizeY = std::max(static_cast<epicsUInt32>(1), sizeY);
+  m_2d = is2d;
+  m_antialias = antialias;
+  m_bgX.assign(m_sizeX, 0.0);
+  m_bgY.assign(m_sizeY, 0.0);
+  m_diff.reset(m_sizeX, m_sizeY);
+  m_renderPeaks.clear();
+}
+
+/**
+ * Calculate the background profile for one axis. The Y profile
+ * should only be set for 2D data.
+ *
+ * polynomial: c0 + c1*(x-shift) + c2*(x-shift)^2 + c3*(x-shift)^3 <br>
+ * exponential: c0 + c1*exp(c2*(x-shift)) <br>
+ *
+ * /arg /c axis The axis
+ * /arg /c type The background type
+ * /arg /c c0, c1, c2, c3 The coefficients
+ * /arg /c shift The shift
+ */
+void ADSimPeaksPlan::setBackground(e_axis axis, e_bg_type type, epicsFloat64 c0, epicsFloat64 c1,
+				     epicsFloat64 c2, epicsFloat64 c3, epicsFloat64 shift)
+{
+  std::vector<epicsFloat64> &profile = (axis == e_axis::y) ? m_bgY : m_bgX;
+  const epicsUInt32 size = static_cast<epicsUInt32>(profile.size());
+  for (epicsUInt32 bin=0; bin<size; bin++) {
+    epicsFloat64 value = 0.0;
+    if (type == e_bg_type::polynomial) {
+      value = c0 + (bin-shift)*c1 + pow((bin-shift),2)*c2 + pow((bin-shift),3)*c3;
+    } else if (type == e_bg_type::exponential) {
+      value = c0 + c1*(pow(exp(1.0), (bin-shift)*c2));
+    }
+    profile[bin] = value;
+  }
+}
+
+/**
+ * Add a peak to the plan. The type is an ADSimPeaksPeak::e_type_1d value for
+ * 1D data, and an ADSimPeaksPeak::e_type_2d value for 2D data (0 is ignored).
+ * The peak is scaled so that its maximum is the amplitude. A maximum boundary
+ * of 0 means the end of the frame. For 1D data the Y boundaries are not used.
+ *
+ * /arg /c type The peak type
+ * /arg /c data The peak parameters
+ * /arg /c minX The first X bin
+ * /arg /c maxX The last X bin
+ * /arg /c minY The first Y bin
+ * /arg /c maxY The last Y bin
+ */
+void ADSimPeaksPlan::addPeak(epicsInt32 type, const ADSimPeaksData &data, epicsUInt32 minX, epicsUInt32 maxX,
+			       epicsUInt32 minY, epicsUInt32 maxY)
+{
+  epicsFloat64 result_max = 0.0;
+  epicsFloat64 scale_factor = 0.0;
+  ADSimPeaksPeak::e_status peak_status;
+  ADSimPeaksPeak::e_type_2d peak_type_2d = ADSimPeaksPeak::e_type_2d::none;
+  ADSimPeaksData peak_data = data;
+
+  if ((maxX == 0) || (maxX > m_sizeX-1)) {
+    maxX = m_sizeX-1;
+  }
+  if ((maxY == 0) || (maxY > m_sizeY-1)) {
+    maxY = m_sizeY-1;
+  }
+
+  if (!m_2d) {
+    ADSimPeaksPeak::e_type_1d peak_type_1d = static_cast<ADSimPeaksPeak::e_type_1d>(type);
+    if (peak_type_1d == ADSimPeaksPeak::e_type_1d::none) {
+      return;
+    }
+    minY = 0;
+    maxY = 0;
+    peak_data.setBinX(peak_data.getPositionX());
+    peak_status = m_shapes.compute1D(peak_data, peak_type_1d, result_max);
+    if (peak_status == ADSimPeaksPeak::e_status::success) {
+      scale_factor = peak_data.getAmplitude() / zeroCheck(result_max);
+    }
+    if (m_shapes.hasDiff1D(peak_type_1d)) {
+      // Piecewise shapes are added to the difference array
+      m_shapes.diff1D(peak_data, peak_type_1d, scale_factor, minX, maxX, m_diff);
+      return;
+    }
+  } else {
+    peak_type_2d = static_cast<ADSimPeaksPeak::e_type_2d>(type);
+    if (peak_type_2d == ADSimPeaksPeak::e_type_2d::none) {
+      return;
+    }
+    peak_data.setBinX(peak_data.getPositionX());
+    peak_data.setBinY(peak_data.getPositionY());
+    peak_status = m_shapes.compute2D(peak_data, peak_type_2d, result_max);
+    if (peak_status == ADSimPeaksPeak::e_status::success) {
+      scale_factor = peak_data.getAmplitude() / zeroCheck(result_max);
+    }
+    if (m_shapes.hasDiff2D(peak_type_2d)) {
+      // Piecewise shapes are added to the difference array
+      m_shapes.diff2D(peak_data, peak_type_2d, scale_factor, m_antialias,
+		      minX, maxX, minY, maxY, m_diff);
+      return;
+    }
+  }
+
+  if ((minX > maxX) || (minY > maxY)) {
+    return;
+  }
+  s_render_peak render_peak;
+  render_peak.data = peak_data;
+  render_peak.type = type;
+  render_peak.scale = scale_factor;
+  render_peak.minX = minX;
+  render_peak.maxX = maxX;
+  render_peak.minY = minY;
+  render_peak.maxY = maxY;
+  render_peak.coverage = ((m_2d) && (m_antialias) && (peak_type_2d == ADSimPeaksPeak::e_type_2d::cone));
+  m_renderPeaks.push_back(render_peak);
+}
+
+/**
+ * Write the background for part of a row.
+ *
+ * /arg /c bin_y The row
+ * /arg /c c0 The first column
+ * /arg /c c1 The last column
+ * /arg /c pRow The model for column c0 of the row
+ */
+void ADSimPeaksPlan::background(epicsUInt32 bin_y, epicsUInt32 c0, epicsUInt32 c1, epicsFloat64 *pRow) const
+{
+  const epicsFloat64 bg_y = m_bgY[bin_y];
+  for (epicsUInt32 bin_x=c0; bin_x<=c1; bin_x++) {
+    pRow[bin_x-c0] = m_bgX[bin_x] + bg_y;
+  }
+}
+
+/**
+ * Add the peaks to part of a row (after the background has been written).
+ * The peaks that are calculated bin by bin are added first, then the
+ * piecewise peak shapes are recovered from the difference array.
+ *
+ * /arg /c bin_y The row
+ * /arg /c c0 The first column
+ * /arg /c c1 The last column
+ * /arg /c pRow The model for column c0 of the row
+ */
+void ADSimPeaksPlan::peaks(epicsUInt32 bin_y, epicsUInt32 c0, epicsUInt32 c1, epicsFloat64 *pRow)
+{
+  epicsFloat64 result = 0.0;
+  ADSimPeaksPeak::e_status peak_status;
+  epicsFloat64 *pModel = pRow - c0;
+
+  for (size_t i=0; i<m_renderPeaks.size(); i++) {
+    s_render_peak &render_peak = m_renderPeaks[i];
+    if ((bin_y < render_peak.minY) || (bin_y > render_peak.maxY)) {
+      continue;
+    }
+    const epicsUInt32 x0 = std::max(render_peak.minX, c0);
+    const epicsUInt32 x1 = std::min(render_peak.maxX, c1);
+    if (x0 > x1) {
+      continue;
+    }
+    if (!m_2d) {
+      // Compute 1D peak data (for a span of bins at once, if the peak type supports it)
+      ADSimPeaksPeak::e_type_1d peak_type_1d = static_cast<ADSimPeaksPeak::e_type_1d>(render_peak.type);
+      if (m_shapes.hasSpan1D(peak_type_1d)) {
+	m_shapes.span1D(render_peak.data, peak_type_1d, render_peak.scale, x0, x1, &pModel[x0]);
+	continue;
+      }
+      for (epicsUInt32 bin_x=x0; bin_x<=x1; bin_x++) {
+	render_peak.data.setBinX(bin_x);
+	peak_status = m_shapes.compute1D(render_peak.data, peak_type_1d, result);
+	if (peak_status == ADSimPeaksPeak::e_status::success) {
+	  pModel[bin_x] += result*render_peak.scale;
+	}
+      }
+    } else if (render_peak.coverage) {
+      // Only visit the bins inside the cone, and use the pixel area coverage for the edge bins
+      epicsFloat64 in_lo, in_hi, out_lo, out_hi;
+      render_peak.data.setBinY(bin_y);
+      m_shapes.edgesCone2D(render_peak.data, in_lo, in_hi, out_lo, out_hi);
+      out_lo = std::max(out_lo, static_cast<epicsFloat64>(x0));
+      out_hi = std::min(out_hi, static_cast<epicsFloat64>(x1));
+      for (epicsFloat64 x=out_lo; x<=out_hi; x+=1.0) {
+	epicsUInt32 bin_x = static_cast<epicsUInt32>(x);
+	render_peak.data.setBinX(bin_x);
+	if ((x >= in_lo) && (x <= in_hi)) {
+	  peak_status = m_shapes.computeCone2D(render_peak.data, result);
+	} else {
+	  peak_status = m_shapes.computeCone2DCoverage(render_peak.data, result);
+	}
+	if (peak_status == ADSimPeaksPeak::e_status::success) {
+	  pModel[bin_x] += result*render_peak.scale;
+	}
+      }
+    } else {
+      // Compute 2D peak data
+      ADSimPeaksPeak::e_type_2d peak_type_2d = static_cast<ADSimPeaksPeak::e_type_2d>(render_peak.type);
+      render_peak.data.setBinY(bin_y);
+      for (epicsUInt32 bin_x=x0; bin_x<=x1; bin_x++) {
+	render_peak.data.setBinX(bin_x);
+	peak_status = m_shapes.compute2D(render_peak.data, peak_type_2d, result);
+	if (peak_status == ADSimPeaksPeak::e_status::success) {
+	  pModel[bin_x] += result*render_peak.scale;
+	}
+      }
+    }
+  }
+
+  // Recover the piecewise peak shapes from the difference array
+  if (!m_diff.empty()) {
+    m_diff.applyRow(bin_y, c0, c1, pRow);
+  }
+}
+
+/**
+ * Avoid dividing by zero when scaling a peak.
+ *
+ * /arg /c value The value to check
+ *
+ * /return The value, or 1.0 if it is very close to zero
+ */
+epicsFloat64 ADSimPeaksPlan::zeroCheck(epicsFloat64 value)
+{
+  if ((value > -s_zeroCheck) && (value < s_zeroCheck)) {
+    return 1.0;
+  } else {
+    return value;
+  }
+}
+
+/**
+ * Work out the size of the chunks that a frame is rendered in. A chunk is
+ * either a block of complete rows, or part of a single row, so the chunks
+ * are always in array order.
+ *
+ * /arg /c elements The maximum number of elements in a chunk
+ * /arg /c sizeX The number of bins in the X dimension
+ * /arg /c sizeY The number of bins in the Y dimension
+ * /arg /c chunkCols This will be used to return the number of columns in a chunk
+ * /arg /c chunkRows This will be used to return the number of rows in a chunk
+ */
+void ADSimPeaksPlan::chunkSize(size_t elements, epicsUInt32 sizeX, epicsUInt32 sizeY,
+				 epicsUInt32 &chunkCols, epicsUInt32 &chunkRows)
+{
+  elements = std::max(static_cast<size_t>(1), elements);
+  chunkCols = static_cast<epicsUInt32>(std::min(static_cast<size_t>(sizeX), elements));
+  size_t rows = (chunkCols > 0) ? std::max(static_cast<size_t>(1), elements/chunkCols) : 1;
+  chunkRows = static_cast<epicsUInt32>(std::min(static_cast<size_t>(sizeY), rows));
+}
+
+/**
+ * Find the last row (or column) of a chunk. The last chunk is shortened
+ * to fit the frame. This does not overflow for sizes close to 2^32.
+ *
+ * /arg /c start The first row (or column) of the chunk
+ * /arg /c step The number of rows (or columns) in a chunk
+ * /arg /c size The number of rows (or columns) in the frame
+ *
+ * /return The last row (or column) of the chunk
+ */
+epicsUInt32 ADSimPeaksPlan::chunkEnd(epicsUInt32 start, epicsUInt32 step, epicsUInt32 size)
+{
+  return std::min(size-start, step) + start - 1;
+}
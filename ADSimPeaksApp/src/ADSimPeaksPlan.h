@@ -0,0 +1,101 @@
+/**
+ * \brief Plan and row rendering of the background and peaks model,
+ *        shared by the ADSimPeaks driver and the standalone engine.
+ *
+ * More detailed documentation can be found in the source file.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#ifndef ADSIMPEAKSPLAN_H
+#define ADSIMPEAKSPLAN_H
+
+#include <vector>
+
+#include <epicsTypes.h>
+
+#include "ADSimPeaksData.h"
+#include "ADSimPeaksPeak.h"
+#include "ADSimPeaksDiff.h"
+
+class ADSimPeaksPlan
+{
+ public:
+  ADSimPeaksPlan(void);
+  virtual ~ADSimPeaksPlan(void);
+
+  /**
+   * The enum for the background type. This uses the same values as the driver.
+   */
+  enum class e_bg_type {
+    none = 0,
+    polynomial,
+    exponential
+  };
+
+  /**
+   * The enum for the background axis.
+   */
+  enum class e_axis {
+    x = 0,
+    y
+  };
+
+  static const epicsFloat64 s_zeroCheck;
+
+  void begin(epicsUInt32 sizeX, epicsUInt32 sizeY, bool is2d, bool antialias);
+  void setBackground(e_axis axis, e_bg_type type, epicsFloat64 c0, epicsFloat64 c1,
+		     epicsFloat64 c2, epicsFloat64 c3, epicsFloat64 shift);
+  void addPeak(epicsInt32 type, const ADSimPeaksData &data, epicsUInt32 minX, epicsUInt32 maxX,
+	       epicsUInt32 minY, epicsUInt32 maxY);
+
+  void background(epicsUInt32 bin_y, epicsUInt32 c0, epicsUInt32 c1, epicsFloat64 *pRow) const;
+  void peaks(epicsUInt32 bin_y, epicsUInt32 c0, epicsUInt32 c1, epicsFloat64 *pRow);
+
+  static epicsFloat64 zeroCheck(epicsFloat64 value);
+
+  static void chunkSize(size_t elements, epicsUInt32 sizeX, epicsUInt32 sizeY,
+			epicsUInt32 &chunkCols, epicsUInt32 &chunkRows);
+  static epicsUInt32 chunkEnd(epicsUInt32 start, epicsUInt32 step, epicsUInt32 size);
+
+  /**
+   * The index of a bin in a frame. This uses size_t, so frames
+   * with more than 2^31 elements are supported.
+   */
+  static size_t index(epicsUInt32 bin_x, epicsUInt32 bin_y, epicsUInt32 sizeX) {
+    return static_cast<size_t>(bin_y)*sizeX + bin_x;
+  }
+
+ private:
+
+  /**
+   * A peak that is rendered bin by bin, with the scale factor
+   * and the boundaries (clipped to the array size) worked out
+   * once per plan.
+   */
+  struct s_render_peak {
+    ADSimPeaksData data;
+    epicsInt32 type;
+    epicsFloat64 scale;
+    epicsUInt32 minX;
+    epicsUInt32 maxX;
+    epicsUInt32 minY;
+    epicsUInt32 maxY;
+    bool coverage;
+  };
+
+  epicsUInt32 m_sizeX;
+  epicsUInt32 m_sizeY;
+  bool m_2d;
+  bool m_antialias;
+  ADSimPeaksPeak m_shapes;
+  ADSimPeaksDiff m_diff;
+  std::vector<s_render_peak> m_renderPeaks;
+  std::vector<epicsFloat64> m_bgX;
+  std::vector<epicsFloat64> m_bgY;
+
+};
+
+#endif //ADSIMPEAKSPLAN_H
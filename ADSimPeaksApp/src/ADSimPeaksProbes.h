@@ -0,0 +1,63 @@
+/**
+ * \brief USDT static tracepoints for the ADSimPeaks areaDetector driver.
+ *
+ * The probes are only built in if ADSP_USDT is defined (set ADSIMPEAKS_USDT=YES
+ * in configure/CONFIG_SITE), which needs sys/sdt.h from the SystemTap SDT
+ * development package. Otherwise the macros do nothing. A probe that is
+ * built in is a single nop instruction until a tracer (bpftrace, perf,
+ * SystemTap) attaches to it, so they can be left in production builds.
+ *
+ * The provider is 'adsimpeaks' and the first argument of every probe
+ * is the port name. The probes are:
+ *
+ * frame__start(port, frame) <br>
+ * frame__end(port, frame, bytes) <br>
+ * stage__start(port, stage) <br>
+ * stage__end(port, stage) <br>
+ * param__int(port, param, addr, value) <br>
+ * param__float(port, param, addr, value) <br>
+ * pool__alloc(port, bytes, array) <br>
+ * pool__copy(port, array) <br>
+ * callback__start(port, frame) <br>
+ * callback__end(port, frame) <br>
+ *
+ * where 'stage' and 'param' are strings (the stage name and the parameter name),
+ * 'array' is the NDArray pointer (NULL if the allocation or copy failed), and the
+ * param__float value is a double.
+ * For example, to print the time spent in each stage:
+ *
+ * bpftrace -e 'usdt:./bin/linux-x86_64/example:adsimpeaks:stage__start { @s[tid] = nsecs; }
+ *   usdt:./bin/linux-x86_64/example:adsimpeaks:stage__end { @us[str(arg1)] = hist((nsecs - @s[tid])/1000); }'
+ *
+ * ADSP_PROBES is 1 if the probes are built in, so any work needed only
+ * for the probe arguments can be skipped.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#ifndef ADSIMPEAKSPROBES_H
+#define ADSIMPEAKSPROBES_H
+
+#ifdef ADSP_USDT
+
+#include <sys/sdt.h>
+
+#define ADSP_PROBE1(name, a1) DTRACE_PROBE1(adsimpeaks, name, a1)
+#define ADSP_PROBE2(name, a1, a2) DTRACE_PROBE2(adsimpeaks, name, a1, a2)
+#define ADSP_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(adsimpeaks, name, a1, a2, a3)
+#define ADSP_PROBE4(name, a1, a2, a3, a4) DTRACE_PROBE4(adsimpeaks, name, a1, a2, a3, a4)
+#define ADSP_PROBES 1
+
+#else
+
+#define ADSP_PROBE1(name, a1) do {} while (0)
+#define ADSP_PROBE2(name, a1, a2) do {} while (0)
+#define ADSP_PROBE3(name, a1, a2, a3) do {} while (0)
+#define ADSP_PROBE4(name, a1, a2, a3, a4) do {} while (0)
+#define ADSP_PROBES 0
+
+#endif //ADSP_USDT
+
+#endif //ADSIMPEAKSPROBES_H
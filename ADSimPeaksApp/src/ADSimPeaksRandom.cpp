@@ -0,0 +1,114 @@
+/**
+ * \brief Counter based random number generator used by the 
+ *        ADSimPeaks areaDetector driver.
+ *
+ * Each random number is a pure function of (seed, stream, counter), 
+ * rather than the next value from a generator with internal state. 
+ * For example, the stream can identify a peak and one of its parameters, 
+ * and the counter can be the frame number. This means the random numbers 
+ * used for a frame are reproducible for a given seed, and do not depend 
+ * on how many random numbers were used for previous frames, or in which 
+ * order they are requested.
+ *
+ * The numbers are generated by hashing the inputs with the splitmix64 
+ * finalizer, which has good statistical properties for this purpose. 
+ * It is not suitable for cryptography.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#include <cmath>
+
+#include <ADSimPeaksRandom.h>
+
+// Constant pi (M_PI is not part of standard C++)
+const epicsFloat64 ADSimPeaksRandom::s_pi = 3.14159265358979323846;
+
+/**
+ * Constructor.
+ */
+ADSimPeaksRandom::ADSimPeaksRandom(void) {
+  setSeed(0);
+}
+
+/**
+ * Destructor
+ */
+ADSimPeaksRandom::~ADSimPeaksRandom(void) {
+}
+
+/**
+ * Set the seed. 
+ *
+ * /arg /c seed The seed (any value)
+ */
+void ADSimPeaksRandom::setSeed(epicsUInt64 seed) {
+  m_seed = seed;
+  m_key = mix(seed);
+}
+
+/**
+ * Read the seed.
+ */
+epicsUInt64 ADSimPeaksRandom::getSeed(void) const {
+  return m_seed;
+}
+
+/**
+ * The splitmix64 finalizer. 
+ *
+ * /arg /c value The input value
+ *
+ * /return The hashed value
+ */
+epicsUInt64 ADSimPeaksRandom::mix(epicsUInt64 value) {
+  value += 0x9E3779B97F4A7C15ULL;
+  value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+  return value ^ (value >> 31);
+}
+
+/**
+ * Generate 64 random bits.
+ *
+ * /arg /c stream The stream (eg. peak and parameter)
+ * /arg /c counter The counter (eg. frame number)
+ *
+ * /return 64 random bits
+ */
+epicsUInt64 ADSimPeaksRandom::bits(epicsUInt64 stream, epicsUInt64 counter) const {
+  return mix(mix(m_key ^ stream) ^ counter);
+}
+
+/**
+ * Generate a uniform random number.
+ *
+ * /arg /c stream The stream (eg. peak and parameter)
+ * /arg /c counter The counter (eg. frame number)
+ *
+ * /return A random number in the range [0,1)
+ */
+epicsFloat64 ADSimPeaksRandom::uniform(epicsUInt64 stream, epicsUInt64 counter) const {
+  // Use the top 53 bits, which is the precision of a double
+  return static_cast<epicsFloat64>(bits(stream, counter) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * Generate a random number from the standard normal distribution
+ * (mean 0, standard deviation 1), using the Box-Muller transform.
+ *
+ * /arg /c stream The stream (eg. peak and parameter)
+ * /arg /c counter The counter (eg. frame number)
+ *
+ * /return A normally distributed random number
+ */
+epicsFloat64 ADSimPeaksRandom::gaussian(epicsUInt64 stream, epicsUInt64 counter) const {
+  epicsUInt64 value = bits(stream, counter);
+  // Two independent uniform numbers, using 32 bits each (u1 is in the range (0,1])
+  epicsFloat64 u1 = (static_cast<epicsFloat64>(value >> 32) + 1.0) * (1.0 / 4294967296.0);
+  epicsFloat64 u2 = static_cast<epicsFloat64>(value & 0xFFFFFFFFULL) * (1.0 / 4294967296.0);
+  return sqrt(-2.0 * log(u1)) * cos(2.0 * s_pi * u2);
+}
+
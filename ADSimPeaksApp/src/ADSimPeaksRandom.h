@@ -0,0 +1,41 @@
+/**
+ * \brief Counter based random number generator used by the 
+ *        ADSimPeaks areaDetector driver.
+ *
+ * More detailed documentation can be found in the source file.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#ifndef ADSIMPEAKSRANDOM_H
+#define ADSIMPEAKSRANDOM_H
+
+#include <epicsTypes.h>
+
+class ADSimPeaksRandom
+{
+ public:
+  ADSimPeaksRandom(void);
+  virtual ~ADSimPeaksRandom(void);
+
+  static const epicsFloat64 s_pi;
+
+  void setSeed(epicsUInt64 seed);
+  epicsUInt64 getSeed(void) const;
+
+  epicsUInt64 bits(epicsUInt64 stream, epicsUInt64 counter) const;
+  epicsFloat64 uniform(epicsUInt64 stream, epicsUInt64 counter) const;
+  epicsFloat64 gaussian(epicsUInt64 stream, epicsUInt64 counter) const;
+
+ private:
+
+  static epicsUInt64 mix(epicsUInt64 value);
+
+  epicsUInt64 m_seed;
+  epicsUInt64 m_key;
+
+};
+
+#endif //ADSIMPEAKSRANDOM_H
@@ -0,0 +1,170 @@
+/**
+ * \brief CCD/CMOS sensor noise model used by the ADSimPeaks
+ *        areaDetector driver.
+ *
+ * This models the signal chain of a scientific camera for each pixel.
+ * The model value (after the global scale) is the mean number of
+ * photoelectrons in the pixel, and the output is in ADU:
+ *
+ * electrons = Poisson(signal + dark current * exposure time) <br>
+ * ADU = bias + gain * (electrons + read noise * N(0,1)) <br>
+ *
+ * and then the ADU is rounded and clamped to the range of the ADC (if the
+ * number of ADC bits is not zero). The shot noise uses the exact Poisson
+ * distribution for small means (less than s_poissonLimit electrons), and
+ * the normal approximation for larger means.
+ *
+ * The random numbers for each pixel come from one call to the counter based
+ * random number generator (using the frame number and the pixel index), 
+ * so the noise is reproducible for a given seed, and does not depend on
+ * how the frame is split into chunks. The 64 random bits give two normally 
+ * distributed numbers (using both outputs of the Box-Muller transform), one
+ * for the shot noise and one for the read noise. A second call is only
+ * needed for the exact Poisson distribution.
+ *
+ * The pixels are converted in blocks of s_block. The first pass over a
+ * block has no branches that depend on the data: it draws the normal
+ * numbers and uses the normal approximation for every pixel, and makes a
+ * list of the pixels with a small mean. The second pass replaces the
+ * shot noise of only those pixels with the exact Poisson distribution,
+ * and the last pass applies the gain, bias and ADC. The output is the
+ * same as converting each pixel on its own.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#include <cmath>
+#include <algorithm>
+
+#include <ADSimPeaksSensor.h>
+
+const epicsFloat64 ADSimPeaksSensor::s_poissonLimit = 20.0;
+const epicsInt32 ADSimPeaksSensor::s_maxBits = 32;
+const epicsUInt64 ADSimPeaksSensor::s_stream = 0x2000000000000000ULL;
+const size_t ADSimPeaksSensor::s_block = 256;
+
+/**
+ * Constructor.
+ */
+ADSimPeaksSensor::ADSimPeaksSensor(void)
+  : m_darkMean(0.0),
+    m_read(0.0),
+    m_gain(1.0),
+    m_bias(0.0),
+    m_quantize(false),
+    m_maxADU(0.0)
+{
+}
+
+/**
+ * Destructor
+ */
+ADSimPeaksSensor::~ADSimPeaksSensor(void) {
+}
+
+/**
+ * Set the sensor parameters for a frame.
+ *
+ * /arg /c exposure The exposure time in seconds
+ * /arg /c dark The dark current in electrons per pixel per second
+ * /arg /c read The read noise in electrons (RMS)
+ * /arg /c gain The gain in ADU per electron
+ * /arg /c bias The bias offset in ADU
+ * /arg /c bits The number of ADC bits (0 for no quantization)
+ */
+void ADSimPeaksSensor::configure(epicsFloat64 exposure, epicsFloat64 dark, epicsFloat64 read,
+				 epicsFloat64 gain, epicsFloat64 bias, epicsInt32 bits)
+{
+  m_darkMean = std::max(0.0, dark) * std::max(0.0, exposure);
+  m_read = std::max(0.0, read);
+  m_gain = gain;
+  m_bias = bias;
+  bits = std::max(0, std::min(bits, s_maxBits));
+  m_quantize = (bits > 0);
+  m_maxADU = ldexp(1.0, bits) - 1.0;
+}
+
+/**
+ * Convert part of a row of the model to ADU.
+ *
+ * /arg /c random The random number generator
+ * /arg /c frame The frame number
+ * /arg /c index The index of the first pixel in the frame
+ * /arg /c signal The model (the mean signal in electrons, before the scale)
+ * /arg /c scale The global scale
+ * /arg /c output The output in ADU
+ * /arg /c count The number of pixels
+ */
+void ADSimPeaksSensor::convert(const ADSimPeaksRandom &random, epicsUInt64 frame, size_t index,
+			       const epicsFloat64 *signal, epicsFloat64 scale,
+			       epicsFloat64 *output, size_t count) const
+{
+  const epicsUInt64 stream = s_stream ^ frame;
+  epicsFloat64 mean[s_block];
+  epicsFloat64 electrons[s_block];
+  epicsFloat64 noise[s_block];
+  epicsUInt32 small[s_block];
+
+  for (size_t b0=0; b0<count; b0+=s_block) {
+    const size_t n = std::min(count - b0, s_block);
+    const size_t i0 = index + b0;
+
+    // Shot noise (normal approximation) and read noise for every pixel, without branches
+    epicsUInt32 numSmall = 0;
+    for (size_t j=0; j<n; j++) {
+      epicsUInt64 value = random.bits(stream, i0 + j);
+      // Two normally distributed numbers from the Box-Muller transform (u1 is in the range (0,1])
+      epicsFloat64 u1 = (static_cast<epicsFloat64>(value >> 32) + 1.0) * (1.0 / 4294967296.0);
+      epicsFloat64 u2 = static_cast<epicsFloat64>(value & 0xFFFFFFFFULL) * (1.0 / 4294967296.0);
+      epicsFloat64 radius = sqrt(-2.0 * log(u1));
+      epicsFloat64 z1 = radius * cos(2.0 * ADSimPeaksRandom::s_pi * u2);
+      epicsFloat64 z2 = radius * sin(2.0 * ADSimPeaksRandom::s_pi * u2);
+
+      mean[j] = std::max(0.0, scale*signal[b0 + j]) + m_darkMean;
+      electrons[j] = std::max(0.0, floor(mean[j] + sqrt(mean[j])*z1 + 0.5));
+      noise[j] = m_read*z2;
+      small[numSmall] = static_cast<epicsUInt32>(j);
+      numSmall += (mean[j] < s_poissonLimit) ? 1 : 0;
+    }
+
+    // Exact Poisson distribution for the pixels with a small mean
+    for (epicsUInt32 k=0; k<numSmall; k++) {
+      const epicsUInt32 j = small[k];
+      electrons[j] = (mean[j] > 0.0) ? poisson(mean[j], random.uniform(~stream, i0 + j)) : 0.0;
+    }
+
+    // Gain, bias and the ADC
+    epicsFloat64 *pOut = output + b0;
+    if (m_quantize) {
+      for (size_t j=0; j<n; j++) {
+	pOut[j] = std::max(0.0, std::min(m_maxADU, floor(m_bias + m_gain*(electrons[j] + noise[j]) + 0.5)));
+      }
+    } else {
+      for (size_t j=0; j<n; j++) {
+	pOut[j] = m_bias + m_gain*(electrons[j] + noise[j]);
+      }
+    }
+  }
+}
+
+/**
+ * Draw from a Poisson distribution by inversion (for small means).
+ *
+ * /arg /c mean The mean
+ * /arg /c u A uniform random number in the range [0,1)
+ *
+ * /return The number of events
+ */
+epicsFloat64 ADSimPeaksSensor::poisson(epicsFloat64 mean, epicsFloat64 u) {
+  epicsFloat64 probability = exp(-mean);
+  epicsFloat64 cumulative = probability;
+  epicsFloat64 count = 0.0;
+  while ((u > cumulative) && (count < 10.0*s_poissonLimit)) {
+    count += 1.0;
+    probability *= mean/count;
+    cumulative += probability;
+  }
+  return count;
+}
@@ -0,0 +1,50 @@
+/**
+ * \brief CCD/CMOS sensor noise model used by the ADSimPeaks
+ *        areaDetector driver.
+ *
+ * More detailed documentation can be found in the source file.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#ifndef ADSIMPEAKSSENSOR_H
+#define ADSIMPEAKSSENSOR_H
+
+#include <epicsTypes.h>
+
+#include "ADSimPeaksRandom.h"
+
+class ADSimPeaksSensor
+{
+ public:
+  ADSimPeaksSensor(void);
+  virtual ~ADSimPeaksSensor(void);
+
+  static const epicsFloat64 s_poissonLimit;
+  static const epicsInt32 s_maxBits;
+  static const epicsUInt64 s_stream;
+  static const size_t s_block;
+
+  void configure(epicsFloat64 exposure, epicsFloat64 dark, epicsFloat64 read,
+		 epicsFloat64 gain, epicsFloat64 bias, epicsInt32 bits);
+
+  void convert(const ADSimPeaksRandom &random, epicsUInt64 frame, size_t index,
+	       const epicsFloat64 *signal, epicsFloat64 scale,
+	       epicsFloat64 *output, size_t count) const;
+
+ private:
+
+  static epicsFloat64 poisson(epicsFloat64 mean, epicsFloat64 u);
+
+  epicsFloat64 m_darkMean;
+  epicsFloat64 m_read;
+  epicsFloat64 m_gain;
+  epicsFloat64 m_bias;
+  bool m_quantize;
+  epicsFloat64 m_maxADU;
+
+};
+
+#endif //ADSIMPEAKSSENSOR_H
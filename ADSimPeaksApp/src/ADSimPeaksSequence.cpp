@@ -0,0 +1,131 @@
+/**
+ * \brief Table of per-frame configuration changes used by the 
+ *        ADSimPeaks areaDetector driver.
+ *
+ * Row k of the table holds the parameter changes (a full or partial
+ * configuration) for frame k of an acquisition. The table is built and 
+ * checked when it is uploaded, with each change resolved to a parameter 
+ * index (and peak storage field), so that stepping through the table 
+ * during the acquisition only needs to apply the values.
+ *
+ * Each row also records if it changes the peak and background model, 
+ * so the driver only needs to recalculate the model (see the ModelCache 
+ * record) for the rows that do.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#include <ADSimPeaksSequence.h>
+
+/**
+ * Constructor.
+ */
+ADSimPeaksSequence::ADSimPeaksSequence(void) {
+}
+
+/**
+ * Destructor
+ */
+ADSimPeaksSequence::~ADSimPeaksSequence(void) {
+}
+
+/**
+ * Remove all the rows.
+ */
+void ADSimPeaksSequence::clear(void) {
+  m_rows.clear();
+  m_entries.clear();
+}
+
+/**
+ * Start a new (empty) row. The following calls to 
+ * ADSimPeaksSequence::addEntry add changes to this row.
+ */
+void ADSimPeaksSequence::addRow(void) {
+  s_row row;
+  row.first = m_entries.size();
+  row.count = 0;
+  row.model = false;
+  m_rows.push_back(row);
+}
+
+/**
+ * Add a parameter change to the last row.
+ *
+ * /arg /c entry The parameter change
+ */
+void ADSimPeaksSequence::addEntry(const s_entry &entry) {
+  if (m_rows.empty()) {
+    addRow();
+  }
+  s_row &row = m_rows.back();
+  m_entries.push_back(entry);
+  row.count++;
+  row.model = (row.model || entry.model);
+}
+
+/**
+ * Swap the contents with another table. This is used to replace
+ * the table in one step once a new table has been checked.
+ *
+ * /arg /c other The other table
+ */
+void ADSimPeaksSequence::swap(ADSimPeaksSequence &other) {
+  m_rows.swap(other.m_rows);
+  m_entries.swap(other.m_entries);
+}
+
+/**
+ * Get the number of rows.
+ */
+epicsUInt32 ADSimPeaksSequence::size(void) const {
+  return static_cast<epicsUInt32>(m_rows.size());
+}
+
+/**
+ * Check if the table has no rows.
+ */
+bool ADSimPeaksSequence::empty(void) const {
+  return m_rows.empty();
+}
+
+/**
+ * Get the number of parameter changes in a row.
+ *
+ * /arg /c row The row index
+ */
+epicsUInt32 ADSimPeaksSequence::rowSize(epicsUInt32 row) const {
+  if (row >= m_rows.size()) {
+    return 0;
+  }
+  return static_cast<epicsUInt32>(m_rows[row].count);
+}
+
+/**
+ * Get the parameter changes for a row.
+ *
+ * /arg /c row The row index
+ *
+ * /return Pointer to the first change (ADSimPeaksSequence::rowSize gives the number), 
+ * or NULL if the row is empty.
+ */
+const ADSimPeaksSequence::s_entry* ADSimPeaksSequence::rowEntries(epicsUInt32 row) const {
+  if ((row >= m_rows.size()) || (m_rows[row].count == 0)) {
+    return NULL;
+  }
+  return &m_entries[m_rows[row].first];
+}
+
+/**
+ * Check if a row changes the peak and background model.
+ *
+ * /arg /c row The row index
+ */
+bool ADSimPeaksSequence::rowModel(epicsUInt32 row) const {
+  if (row >= m_rows.size()) {
+    return false;
+  }
+  return m_rows[row].model;
+}
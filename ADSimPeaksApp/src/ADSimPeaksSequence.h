@@ -0,0 +1,68 @@
+/**
+ * \brief Table of per-frame configuration changes used by the 
+ *        ADSimPeaks areaDetector driver.
+ *
+ * More detailed documentation can be found in the source file.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#ifndef ADSIMPEAKSSEQUENCE_H
+#define ADSIMPEAKSSEQUENCE_H
+
+#include <vector>
+
+#include <epicsTypes.h>
+#include <ADSimPeaksStore.h>
+
+class ADSimPeaksSequence
+{
+ public:
+  ADSimPeaksSequence(void);
+  virtual ~ADSimPeaksSequence(void);
+
+  /**
+   * A single parameter change. For per-peak parameters the peak
+   * is the index in the peak storage, otherwise it is -1.
+   */
+  struct s_entry {
+    epicsInt32 peak;
+    int param;
+    ADSimPeaksStore::e_field field;
+    bool integer;
+    bool model;
+    epicsFloat64 value;
+  };
+
+  void clear(void);
+  void addRow(void);
+  void addEntry(const s_entry &entry);
+  void swap(ADSimPeaksSequence &other);
+
+  epicsUInt32 size(void) const;
+  bool empty(void) const;
+  epicsUInt32 rowSize(epicsUInt32 row) const;
+  const s_entry* rowEntries(epicsUInt32 row) const;
+  bool rowModel(epicsUInt32 row) const;
+
+ private:
+
+  /**
+   * A row of the table (the changes for one frame). The entries
+   * for all the rows are held in one array, and the model flag is
+   * worked out when the table is built.
+   */
+  struct s_row {
+    size_t first;
+    size_t count;
+    bool model;
+  };
+
+  std::vector<s_row> m_rows;
+  std::vector<s_entry> m_entries;
+
+};
+
+#endif //ADSIMPEAKSSEQUENCE_H
@@ -0,0 +1,288 @@
+/**
+ * \brief Compact storage for the peak definitions used by the
+ *        ADSimPeaks areaDetector driver.
+ *
+ * The peak definitions (type, position, width, amplitude, etc.) are held
+ * in a single array of small structures, rather than as Asyn parameters.
+ * This means a very large number of peaks can be defined without
+ * needing an Asyn address (and a full copy of the parameter library)
+ * for each one. The driver exposes a small window of the peaks as
+ * Asyn addresses so they can be edited using records, and the rest
+ * can be accessed through this class.
+ *
+ * The default values for each peak match the default values of the
+ * per-peak driver parameters.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#include <ADSimPeaksStore.h>
+
+/**
+ * Constructor.
+ *
+ * /arg /c maxPeaks The number of peaks to store
+ */
+ADSimPeaksStore::ADSimPeaksStore(epicsUInt32 maxPeaks) {
+  m_peaks.resize(maxPeaks);
+  for (epicsUInt32 peak=0; peak<maxPeaks; peak++) {
+    clear(peak);
+  }
+}
+
+/**
+ * Destructor
+ */
+ADSimPeaksStore::~ADSimPeaksStore(void) {
+}
+
+/**
+ * Get the number of peaks that can be stored.
+ */
+epicsUInt32 ADSimPeaksStore::size(void) const {
+  return static_cast<epicsUInt32>(m_peaks.size());
+}
+
+/**
+ * Set a peak back to the default values (which disables the peak).
+ *
+ * /arg /c peak The peak index
+ */
+void ADSimPeaksStore::clear(epicsUInt32 peak) {
+  if (peak >= m_peaks.size()) {
+    return;
+  }
+  s_peak &p = m_peaks[peak];
+  p.type_1d = 0;
+  p.type_2d = 0;
+  p.pos_x = 1.0;
+  p.pos_y = 1.0;
+  p.fwhm_x = 1.0;
+  p.fwhm_y = 1.0;
+  p.amplitude = 1.0;
+  p.correlation = 1.0;
+  p.param1 = 0.0;
+  p.param2 = 0.0;
+  p.min_x = 0;
+  p.min_y = 0;
+  p.max_x = 0;
+  p.max_y = 0;
+}
+
+/**
+ * Check if a field holds an integer value.
+ *
+ * /arg /c field The field
+ *
+ * /return true for integer fields, false for double fields
+ */
+bool ADSimPeaksStore::isInteger(e_field field) const {
+  switch (field) {
+  case e_field::type_1d:
+  case e_field::type_2d:
+  case e_field::min_x:
+  case e_field::min_y:
+  case e_field::max_x:
+  case e_field::max_y:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/**
+ * Set an integer field for a peak.
+ *
+ * /arg /c peak The peak index
+ * /arg /c field The field (see ADSimPeaksStore::isInteger)
+ * /arg /c value The value to set
+ *
+ * /return ADSimPeaksStore::e_status
+ */
+ADSimPeaksStore::e_status ADSimPeaksStore::setInteger(epicsUInt32 peak, e_field field, epicsInt32 value) {
+  if (peak >= m_peaks.size()) {
+    return e_status::error;
+  }
+  s_peak &p = m_peaks[peak];
+  switch (field) {
+  case e_field::type_1d:
+    p.type_1d = value;
+    break;
+  case e_field::type_2d:
+    p.type_2d = value;
+    break;
+  case e_field::min_x:
+    p.min_x = value;
+    break;
+  case e_field::min_y:
+    p.min_y = value;
+    break;
+  case e_field::max_x:
+    p.max_x = value;
+    break;
+  case e_field::max_y:
+    p.max_y = value;
+    break;
+  default:
+    return e_status::error;
+  }
+  return e_status::success;
+}
+
+/**
+ * Set a double field for a peak.
+ *
+ * /arg /c peak The peak index
+ * /arg /c field The field (see ADSimPeaksStore::isInteger)
+ * /arg /c value The value to set
+ *
+ * /return ADSimPeaksStore::e_status
+ */
+ADSimPeaksStore::e_status ADSimPeaksStore::setDouble(epicsUInt32 peak, e_field field, epicsFloat64 value) {
+  if (peak >= m_peaks.size()) {
+    return e_status::error;
+  }
+  s_peak &p = m_peaks[peak];
+  switch (field) {
+  case e_field::pos_x:
+    p.pos_x = value;
+    break;
+  case e_field::pos_y:
+    p.pos_y = value;
+    break;
+  case e_field::fwhm_x:
+    p.fwhm_x = value;
+    break;
+  case e_field::fwhm_y:
+    p.fwhm_y = value;
+    break;
+  case e_field::amplitude:
+    p.amplitude = value;
+    break;
+  case e_field::correlation:
+    p.correlation = value;
+    break;
+  case e_field::param1:
+    p.param1 = value;
+    break;
+  case e_field::param2:
+    p.param2 = value;
+    break;
+  default:
+    return e_status::error;
+  }
+  return e_status::success;
+}
+
+/**
+ * Read an integer field for a peak.
+ *
+ * /arg /c peak The peak index
+ * /arg /c field The field (see ADSimPeaksStore::isInteger)
+ * /arg /c value This will be used to return the value
+ *
+ * /return ADSimPeaksStore::e_status
+ */
+ADSimPeaksStore::e_status ADSimPeaksStore::getInteger(epicsUInt32 peak, e_field field, epicsInt32 &value) const {
+  if (peak >= m_peaks.size()) {
+    return e_status::error;
+  }
+  const s_peak &p = m_peaks[peak];
+  switch (field) {
+  case e_field::type_1d:
+    value = p.type_1d;
+    break;
+  case e_field::type_2d:
+    value = p.type_2d;
+    break;
+  case e_field::min_x:
+    value = p.min_x;
+    break;
+  case e_field::min_y:
+    value = p.min_y;
+    break;
+  case e_field::max_x:
+    value = p.max_x;
+    break;
+  case e_field::max_y:
+    value = p.max_y;
+    break;
+  default:
+    return e_status::error;
+  }
+  return e_status::success;
+}
+
+/**
+ * Read a double field for a peak.
+ *
+ * /arg /c peak The peak index
+ * /arg /c field The field (see ADSimPeaksStore::isInteger)
+ * /arg /c value This will be used to return the value
+ *
+ * /return ADSimPeaksStore::e_status
+ */
+ADSimPeaksStore::e_status ADSimPeaksStore::getDouble(epicsUInt32 peak, e_field field, epicsFloat64 &value) const {
+  if (peak >= m_peaks.size()) {
+    return e_status::error;
+  }
+  const s_peak &p = m_peaks[peak];
+  switch (field) {
+  case e_field::pos_x:
+    value = p.pos_x;
+    break;
+  case e_field::pos_y:
+    value = p.pos_y;
+    break;
+  case e_field::fwhm_x:
+    value = p.fwhm_x;
+    break;
+  case e_field::fwhm_y:
+    value = p.fwhm_y;
+    break;
+  case e_field::amplitude:
+    value = p.amplitude;
+    break;
+  case e_field::correlation:
+    value = p.correlation;
+    break;
+  case e_field::param1:
+    value = p.param1;
+    break;
+  case e_field::param2:
+    value = p.param2;
+    break;
+  default:
+    return e_status::error;
+  }
+  return e_status::success;
+}
+
+/**
+ * Initialize a peak data object with the shape of a peak
+ * (position, FWHM, amplitude, correlation and extra parameters).
+ *
+ * /arg /c peak The peak index
+ * /arg /c data The ADSimPeaksData object to initialize
+ *
+ * /return ADSimPeaksStore::e_status
+ */
+ADSimPeaksStore::e_status ADSimPeaksStore::getData(epicsUInt32 peak, ADSimPeaksData &data) const {
+  if (peak >= m_peaks.size()) {
+    return e_status::error;
+  }
+  const s_peak &p = m_peaks[peak];
+  data.clear();
+  data.setPositionX(p.pos_x);
+  data.setPositionY(p.pos_y);
+  data.setFWHMX(p.fwhm_x);
+  data.setFWHMY(p.fwhm_y);
+  data.setAmplitude(p.amplitude);
+  data.setCorrelation(p.correlation);
+  data.setParam1(p.param1);
+  data.setParam2(p.param2);
+  return e_status::success;
+}
+
@@ -0,0 +1,90 @@
+/**
+ * \brief Compact storage for the peak definitions used by the
+ *        ADSimPeaks areaDetector driver.
+ *
+ * More detailed documentation can be found in the source file.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#ifndef ADSIMPEAKSSTORE_H
+#define ADSIMPEAKSSTORE_H
+
+#include <vector>
+
+#include <epicsTypes.h>
+#include <ADSimPeaksData.h>
+
+class ADSimPeaksStore
+{
+ public:
+  ADSimPeaksStore(epicsUInt32 maxPeaks);
+  virtual ~ADSimPeaksStore(void);
+
+  enum class e_status {
+    success = 0,
+    error
+  };
+
+  /**
+   * The enum for the peak fields. These match the per-peak
+   * driver parameters (ADSP_PEAK_*).
+   */
+  enum class e_field {
+    type_1d = 0,
+    type_2d,
+    pos_x,
+    pos_y,
+    fwhm_x,
+    fwhm_y,
+    amplitude,
+    correlation,
+    param1,
+    param2,
+    min_x,
+    min_y,
+    max_x,
+    max_y
+  };
+
+  epicsUInt32 size(void) const;
+  void clear(epicsUInt32 peak);
+
+  e_status setInteger(epicsUInt32 peak, e_field field, epicsInt32 value);
+  e_status setDouble(epicsUInt32 peak, e_field field, epicsFloat64 value);
+  e_status getInteger(epicsUInt32 peak, e_field field, epicsInt32 &value) const;
+  e_status getDouble(epicsUInt32 peak, e_field field, epicsFloat64 &value) const;
+  e_status getData(epicsUInt32 peak, ADSimPeaksData &data) const;
+
+  bool isInteger(e_field field) const;
+
+ private:
+
+  /**
+   * The definition of a single peak. This is kept small
+   * because there may be a very large number of peaks.
+   */
+  struct s_peak {
+    epicsInt32 type_1d;
+    epicsInt32 type_2d;
+    epicsFloat64 pos_x;
+    epicsFloat64 pos_y;
+    epicsFloat64 fwhm_x;
+    epicsFloat64 fwhm_y;
+    epicsFloat64 amplitude;
+    epicsFloat64 correlation;
+    epicsFloat64 param1;
+    epicsFloat64 param2;
+    epicsInt32 min_x;
+    epicsInt32 min_y;
+    epicsInt32 max_x;
+    epicsInt32 max_y;
+  };
+
+  std::vector<s_peak> m_peaks;
+
+};
+
+#endif //ADSIMPEAKSSTORE_H
@@ -0,0 +1,125 @@
+/**
+ * \brief Temporally correlated (AR(1)) per-pixel noise used by the
+ *        ADSimPeaks areaDetector driver.
+ *
+ * Each pixel has a state that is updated once per frame with the
+ * first order autoregressive recurrence:
+ *
+ * state = rho * state + sqrt(1 - rho^2) * N(0,1) <br>
+ *
+ * where rho = exp(-1/tau), and tau is the time constant in frames. The
+ * state has unit variance, and its autocorrelation decays as exp(-n/tau)
+ * after n frames. The noise is the state times the noise level. On the first
+ * frame (or after a reset) the state is drawn from the stationary distribution,
+ * so there is no settling time. A time constant of zero gives independent
+ * noise on each frame.
+ *
+ * The random numbers come from the counter based random number generator,
+ * using the frame number and the pixel index, so the noise is reproducible
+ * for a given seed (the state is reset when the acquisition is started).
+ *
+ * The state buffer uses one epicsFloat64 per pixel. It is only reallocated
+ * (and reset) if the frame size changes.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#include <cmath>
+#include <algorithm>
+
+#include <ADSimPeaksTemporal.h>
+
+const epicsUInt64 ADSimPeaksTemporal::s_stream = 0x0800000000000000ULL;
+
+/**
+ * Constructor.
+ */
+ADSimPeaksTemporal::ADSimPeaksTemporal(void)
+  : m_sizeX(0),
+    m_sizeY(0),
+    m_rho(0.0),
+    m_innovation(1.0),
+    m_valid(false)
+{
+}
+
+/**
+ * Destructor
+ */
+ADSimPeaksTemporal::~ADSimPeaksTemporal(void) {
+}
+
+/**
+ * Set the frame size. The state buffer is only reallocated (and reset)
+ * if the size has changed.
+ *
+ * /arg /c sizeX The number of columns
+ * /arg /c sizeY The number of rows
+ */
+void ADSimPeaksTemporal::setSize(epicsUInt32 sizeX, epicsUInt32 sizeY) {
+  if ((sizeX != m_sizeX) || (sizeY != m_sizeY)) {
+    m_sizeX = sizeX;
+    m_sizeY = sizeY;
+    m_state.assign(static_cast<size_t>(sizeX)*sizeY, 0.0);
+    m_valid = false;
+  }
+}
+
+/**
+ * Set the time constant.
+ *
+ * /arg /c frames The time constant in frames (0 for independent noise on each frame)
+ */
+void ADSimPeaksTemporal::setTimeConstant(epicsFloat64 frames) {
+  m_rho = (frames > 0.0) ? exp(-1.0/frames) : 0.0;
+  m_innovation = sqrt(1.0 - m_rho*m_rho);
+}
+
+/**
+ * Reset the state, so that the next frame starts from the stationary distribution.
+ */
+void ADSimPeaksTemporal::reset(void) {
+  m_valid = false;
+}
+
+/**
+ * Update the state for a range of pixels, and calculate the noise.
+ * The range must be inside a single row.
+ *
+ * /arg /c random The random number generator
+ * /arg /c frame The frame number
+ * /arg /c index The index of the first pixel in the frame
+ * /arg /c level The noise level (the standard deviation of the noise)
+ * /arg /c clamp If true, clamp the noise to the range [lower, upper]
+ * /arg /c lower The lower clamp value
+ * /arg /c upper The upper clamp value
+ * /arg /c output The noise
+ * /arg /c count The number of pixels
+ */
+void ADSimPeaksTemporal::generate(const ADSimPeaksRandom &random, epicsUInt64 frame, size_t index,
+				  epicsFloat64 level, bool clamp, epicsFloat64 lower, epicsFloat64 upper,
+				  epicsFloat64 *output, size_t count)
+{
+  const epicsUInt64 stream = s_stream ^ frame;
+  const epicsFloat64 rho = m_valid ? m_rho : 0.0;
+  const epicsFloat64 innovation = m_valid ? m_innovation : 1.0;
+  epicsFloat64 *pState = &m_state[index];
+  for (size_t i=0; i<count; i++) {
+    epicsFloat64 state = rho*pState[i] + innovation*random.gaussian(stream, index + i);
+    pState[i] = state;
+    epicsFloat64 noise = level*state;
+    if (clamp) {
+      noise = std::max(lower, std::min(upper, noise));
+    }
+    output[i] = noise;
+  }
+}
+
+/**
+ * Mark the end of a frame. The next frame continues from the current state.
+ */
+void ADSimPeaksTemporal::endFrame(void) {
+  m_valid = true;
+}
@@ -0,0 +1,49 @@
+/**
+ * \brief Temporally correlated (AR(1)) per-pixel noise used by the
+ *        ADSimPeaks areaDetector driver.
+ *
+ * More detailed documentation can be found in the source file.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#ifndef ADSIMPEAKSTEMPORAL_H
+#define ADSIMPEAKSTEMPORAL_H
+
+#include <vector>
+
+#include <epicsTypes.h>
+
+#include "ADSimPeaksRandom.h"
+
+class ADSimPeaksTemporal
+{
+ public:
+  ADSimPeaksTemporal(void);
+  virtual ~ADSimPeaksTemporal(void);
+
+  static const epicsUInt64 s_stream;
+
+  void setSize(epicsUInt32 sizeX, epicsUInt32 sizeY);
+  void setTimeConstant(epicsFloat64 frames);
+  void reset(void);
+
+  void generate(const ADSimPeaksRandom &random, epicsUInt64 frame, size_t index,
+		epicsFloat64 level, bool clamp, epicsFloat64 lower, epicsFloat64 upper,
+		epicsFloat64 *output, size_t count);
+  void endFrame(void);
+
+ private:
+
+  epicsUInt32 m_sizeX;
+  epicsUInt32 m_sizeY;
+  epicsFloat64 m_rho;
+  epicsFloat64 m_innovation;
+  bool m_valid;
+  std::vector<epicsFloat64> m_state;
+
+};
+
+#endif //ADSIMPEAKSTEMPORAL_H
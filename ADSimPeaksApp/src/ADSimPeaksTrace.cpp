@@ -0,0 +1,271 @@
+/**
+ * \brief In-memory trace of the frame pipeline used by the ADSimPeaks
+ *        areaDetector driver, which can be saved as a Chrome trace file.
+ *
+ * The trace records a span (start time and duration) for each stage of
+ * each frame (the planning, the model, conversion and noise for each
+ * render chunk, the plugin copy and callbacks, and the waits between
+ * frames), and an instant event for each parameter write. The trace can
+ * be saved as a Chrome trace event JSON file, which can be viewed in
+ * chrome://tracing or https://ui.perfetto.dev, to see the timeline of
+ * the frames across all the threads.
+ *
+ * Each thread that adds events has its own ring of events, which is
+ * created the first time the thread adds an event. After that, adding
+ * an event does not take a lock. The oldest events are overwritten when
+ * the ring is full. When the trace is disabled, adding an event only
+ * costs a check of the enable flag.
+ *
+ * The event names must be string constants (or strings that exist for
+ * the lifetime of the driver, like the parameter names), because only
+ * the pointer is stored.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+
+#include <ADSimPeaksTrace.h>
+
+const epicsUInt32 ADSimPeaksTrace::s_ringSize = 16384;
+
+/**
+ * Escape a string for use in the JSON file.
+ */
+static std::string jsonEscape(const std::string &in)
+{
+  std::string out;
+  for (std::string::const_iterator it = in.begin(); it != in.end(); ++it) {
+    if ((*it == '"') || (*it == '\\')) {
+      out += '\\';
+      out += *it;
+    } else if (static_cast<unsigned char>(*it) >= 0x20) {
+      out += *it;
+    }
+  }
+  return out;
+}
+
+/**
+ * Constructor
+ *
+ * /arg /c name The name of the trace (the driver port name)
+ */
+ADSimPeaksTrace::ADSimPeaksTrace(const char *name)
+  : m_name(name ? name : ""),
+    m_enabled(false),
+    m_epoch(0)
+{
+  m_lock = epicsMutexMustCreate();
+  m_epoch = now();
+}
+
+/**
+ * Destructor
+ */
+ADSimPeaksTrace::~ADSimPeaksTrace(void) {
+  for (std::vector<s_ring*>::iterator it = m_rings.begin(); it != m_rings.end(); ++it) {
+    delete *it;
+  }
+  epicsMutexDestroy(m_lock);
+}
+
+/**
+ * Enable or disable the trace. Disabling the trace keeps the
+ * events that have already been recorded.
+ *
+ * /arg /c enable true to enable the trace
+ */
+void ADSimPeaksTrace::enable(bool enable) {
+  m_enabled.store(enable, std::memory_order_relaxed);
+}
+
+/**
+ * Check if the trace is enabled.
+ */
+bool ADSimPeaksTrace::enabled(void) const {
+  return m_enabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * Remove all the events from the trace.
+ */
+void ADSimPeaksTrace::clear(void) {
+  epicsMutexLock(m_lock);
+  for (std::vector<s_ring*>::iterator it = m_rings.begin(); it != m_rings.end(); ++it) {
+    (*it)->tail.store((*it)->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+  }
+  epicsMutexUnlock(m_lock);
+}
+
+/**
+ * Get the current time to use as the start of a span.
+ *
+ * /return The time (ns), or zero if the trace is disabled
+ */
+epicsUInt64 ADSimPeaksTrace::now(void) const {
+  if ((m_epoch != 0) && (!enabled())) {
+    return 0;
+  }
+  return static_cast<epicsUInt64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+	   std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/**
+ * Add a span that started at the time given, and ends now.
+ *
+ * /arg /c name The name of the span
+ * /arg /c start The start time from ADSimPeaksTrace::now
+ * /arg /c arg A value to save with the span (for example the frame number)
+ */
+void ADSimPeaksTrace::complete(const char *name, epicsUInt64 start, epicsFloat64 arg) {
+  if ((!enabled()) || (start == 0)) {
+    return;
+  }
+  epicsUInt64 end = now();
+  add(name, start, (end > start) ? (end - start) : 0, arg, false);
+}
+
+/**
+ * Add an instant event.
+ *
+ * /arg /c name The name of the event
+ * /arg /c arg A value to save with the event (for example the parameter value)
+ */
+void ADSimPeaksTrace::instant(const char *name, epicsFloat64 arg) {
+  if (!enabled()) {
+    return;
+  }
+  add(name, now(), 0, arg, true);
+}
+
+/**
+ * Save the trace to a Chrome trace event JSON file.
+ *
+ * /arg /c fileName The name of the file
+ * /arg /c error This will be used to return an error message
+ *
+ * /return ADSimPeaksTrace::e_status
+ */
+ADSimPeaksTrace::e_status ADSimPeaksTrace::dump(const char *fileName, std::string &error) {
+  std::ofstream file;
+  if (fileName != NULL) {
+    file.open(fileName);
+  }
+  if (!file.is_open()) {
+    error = "unable to open file " + std::string(fileName ? fileName : "");
+    return e_status::error;
+  }
+
+  file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\""
+       << jsonEscape(m_name) << "\"}}";
+
+  epicsMutexLock(m_lock);
+  std::vector<s_event> events;
+  for (std::vector<s_ring*>::const_iterator it = m_rings.begin(); it != m_rings.end(); ++it) {
+    s_ring *ring = *it;
+    file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << ring->tid
+	 << ",\"args\":{\"name\":\"" << jsonEscape(ring->threadName) << "\"}}";
+
+    //Copy the events, then throw away any that were overwritten while we were copying
+    epicsUInt64 head = ring->head.load(std::memory_order_acquire);
+    epicsUInt64 first = std::max(ring->tail.load(std::memory_order_relaxed),
+				 (head > s_ringSize) ? (head - s_ringSize) : 0);
+    events.clear();
+    for (epicsUInt64 i=first; i<head; i++) {
+      events.push_back(ring->events[i % s_ringSize]);
+    }
+    //The writer may be part way through writing slot newHead, which holds event newHead-s_ringSize,
+    //so that event is thrown away as well.
+    epicsUInt64 newHead = ring->head.load(std::memory_order_acquire);
+    size_t skip = 0;
+    if (newHead + 1 > s_ringSize) {
+      skip = static_cast<size_t>(std::min(static_cast<epicsUInt64>(events.size()),
+					  (newHead + 1 - s_ringSize > first) ? (newHead + 1 - s_ringSize - first) : 0));
+    }
+
+    for (size_t i=skip; i<events.size(); i++) {
+      const s_event &event = events[i];
+      file.precision(15);
+      file << ",\n{\"name\":\"" << jsonEscape(event.name ? event.name : "") << "\",\"cat\":\"ADSimPeaks\""
+	   << ",\"ph\":\"" << (event.instant ? "i" : "X") << "\",\"pid\":1,\"tid\":" << ring->tid
+	   << ",\"ts\":" << static_cast<epicsFloat64>(event.start - m_epoch)/1000.0;
+      if (event.instant) {
+	file << ",\"s\":\"t\"";
+      } else {
+	file << ",\"dur\":" << static_cast<epicsFloat64>(event.duration)/1000.0;
+      }
+      file << ",\"args\":{\"value\":" << event.arg << "}}";
+    }
+  }
+  epicsMutexUnlock(m_lock);
+
+  file << "\n]}\n";
+  file.close();
+  if (file.fail()) {
+    error = "unable to write file " + std::string(fileName);
+    return e_status::error;
+  }
+
+  return e_status::success;
+}
+
+/**
+ * Find the ring of events for the calling thread, creating it if needed.
+ *
+ * /return Pointer to the ring
+ */
+ADSimPeaksTrace::s_ring* ADSimPeaksTrace::findRing(void) {
+  //Each thread remembers the last ring it used, so normally we don't need the lock
+  static thread_local const ADSimPeaksTrace *lastTrace = NULL;
+  static thread_local s_ring *lastRing = NULL;
+  if (lastTrace == this) {
+    return lastRing;
+  }
+
+  epicsThreadId thread = epicsThreadGetIdSelf();
+  s_ring *ring = NULL;
+  epicsMutexLock(m_lock);
+  for (std::vector<s_ring*>::iterator it = m_rings.begin(); it != m_rings.end(); ++it) {
+    if ((*it)->thread == thread) {
+      ring = *it;
+      break;
+    }
+  }
+  if (ring == NULL) {
+    ring = new s_ring;
+    ring->thread = thread;
+    ring->threadName = epicsThreadGetNameSelf();
+    ring->tid = static_cast<epicsUInt32>(m_rings.size() + 1);
+    ring->events.resize(s_ringSize);
+    ring->head.store(0, std::memory_order_relaxed);
+    ring->tail.store(0, std::memory_order_relaxed);
+    m_rings.push_back(ring);
+  }
+  epicsMutexUnlock(m_lock);
+
+  lastTrace = this;
+  lastRing = ring;
+  return ring;
+}
+
+/**
+ * Add an event to the ring for the calling thread.
+ */
+void ADSimPeaksTrace::add(const char *name, epicsUInt64 start, epicsUInt64 duration,
+			  epicsFloat64 arg, bool instant) {
+  s_ring *ring = findRing();
+  epicsUInt64 head = ring->head.load(std::memory_order_relaxed);
+  s_event &event = ring->events[head % s_ringSize];
+  event.name = name;
+  event.start = start;
+  event.duration = duration;
+  event.arg = arg;
+  event.instant = instant;
+  ring->head.store(head + 1, std::memory_order_release);
+}
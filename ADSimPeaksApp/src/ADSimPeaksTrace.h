@@ -0,0 +1,87 @@
+/**
+ * \brief In-memory trace of the frame pipeline used by the ADSimPeaks
+ *        areaDetector driver, which can be saved as a Chrome trace file.
+ *
+ * More detailed documentation can be found in the source file.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#ifndef ADSIMPEAKSTRACE_H
+#define ADSIMPEAKSTRACE_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+#include <epicsThread.h>
+
+class ADSimPeaksTrace
+{
+ public:
+  ADSimPeaksTrace(const char *name);
+  virtual ~ADSimPeaksTrace(void);
+
+  /**
+   * The status returned by the trace functions.
+   */
+  enum class e_status {
+    success = 0,
+    error
+  };
+
+  static const epicsUInt32 s_ringSize;
+
+  void enable(bool enable);
+  bool enabled(void) const;
+  void clear(void);
+
+  epicsUInt64 now(void) const;
+  void complete(const char *name, epicsUInt64 start, epicsFloat64 arg = 0.0);
+  void instant(const char *name, epicsFloat64 arg = 0.0);
+
+  e_status dump(const char *fileName, std::string &error);
+
+ private:
+
+  /**
+   * A trace event. Complete events have a duration,
+   * instant events have a duration of zero.
+   */
+  struct s_event {
+    const char *name;
+    epicsUInt64 start;
+    epicsUInt64 duration;
+    epicsFloat64 arg;
+    bool instant;
+  };
+
+  /**
+   * The ring of events for one thread. Only the owning thread writes
+   * to the ring, so no lock is needed to add an event.
+   */
+  struct s_ring {
+    epicsThreadId thread;
+    std::string threadName;
+    epicsUInt32 tid;
+    std::vector<s_event> events;
+    std::atomic<epicsUInt64> head;
+    std::atomic<epicsUInt64> tail;
+  };
+
+  s_ring* findRing(void);
+  void add(const char *name, epicsUInt64 start, epicsUInt64 duration, epicsFloat64 arg, bool instant);
+
+  std::string m_name;
+  std::atomic<bool> m_enabled;
+  epicsUInt64 m_epoch;
+  epicsMutexId m_lock;
+  std::vector<s_ring*> m_rings;
+
+};
+
+#endif //ADSIMPEAKSTRACE_H
@@ -0,0 +1,178 @@
+/**
+ * \brief Pool of worker threads used by the ADSimPeaks
+ *        areaDetector driver to split up the rendering.
+ *
+ * The work is a number of independent items (for example the rows of
+ * the frame), and run splits them into one contiguous range for each
+ * thread. The calling thread does the first range itself, and run
+ * returns when all the ranges are done.
+ *
+ * The worker threads are created when they are first needed, and are
+ * never destroyed. If the number of threads is reduced, the extra threads
+ * just wait. Each worker thread applies the driver thread placement
+ * (see ADSimPeaksPlacement) before it starts, and again if the placement
+ * is changed.
+ *
+ * Each range is added to the driver trace as a "worker" span (with the
+ * first work item as the argument), on the trace of the thread that
+ * did it, so the load balance between the threads can be seen.
+ *
+ * The hardware performance counters (see ADSimPeaksCounters) are opened
+ * for the simulation thread only, so they count the first range but
+ * not the ranges done by the worker threads.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#include <algorithm>
+
+#include <epicsThread.h>
+
+#include <ADSimPeaksWorkers.h>
+
+const epicsUInt32 ADSimPeaksWorkers::s_maxThreads = 64;
+
+/**
+ * C function to run a worker thread
+ */
+static void ADSimPeaksWorkerTaskC(void *drvPvt)
+{
+  ADSimPeaksWorkers::s_worker *pPvt = (ADSimPeaksWorkers::s_worker *)drvPvt;
+  pPvt->owner->workerTask(pPvt);
+}
+
+/**
+ * Constructor. By default there are no worker threads, and all
+ * the work is done by the calling thread.
+ *
+ * /arg /c name The base name for the threads
+ * /arg /c placement The thread placement configuration
+ * /arg /c trace The trace to add the worker ranges to
+ */
+ADSimPeaksWorkers::ADSimPeaksWorkers(const std::string &name, ADSimPeaksPlacement &placement,
+				     ADSimPeaksTrace &trace)
+  : m_name(name),
+    m_placement(placement),
+    m_trace(trace),
+    m_threads(1),
+    p_func(NULL),
+    m_count(0),
+    m_active(1),
+    m_remaining(0)
+{
+  m_done = epicsEventMustCreate(epicsEventEmpty);
+}
+
+/**
+ * Destructor. The worker threads are never stopped, because
+ * the driver is never destroyed.
+ */
+ADSimPeaksWorkers::~ADSimPeaksWorkers(void) {
+}
+
+/**
+ * Set the number of threads (including the calling thread).
+ * The extra threads are created if needed.
+ *
+ * /arg /c threads The number of threads (1 to s_maxThreads)
+ */
+void ADSimPeaksWorkers::setThreads(epicsUInt32 threads) {
+  m_threads = std::max(static_cast<epicsUInt32>(1), std::min(threads, s_maxThreads));
+  while (m_workers.size() < m_threads - 1) {
+    s_worker *worker = new s_worker;
+    worker->owner = this;
+    worker->index = static_cast<epicsUInt32>(m_workers.size() + 1);
+    worker->start = epicsEventMustCreate(epicsEventEmpty);
+    worker->name = m_name + "_" + std::to_string(worker->index);
+    m_workers.push_back(worker);
+    epicsThreadId threadId = epicsThreadCreate(worker->name.c_str(),
+					       epicsThreadPriorityHigh,
+					       epicsThreadGetStackSize(epicsThreadStackMedium),
+					       (EPICSTHREADFUNC)ADSimPeaksWorkerTaskC,
+					       worker);
+    if (threadId == NULL) {
+      m_workers.pop_back();
+      epicsEventDestroy(worker->start);
+      delete worker;
+      m_threads = static_cast<epicsUInt32>(m_workers.size() + 1);
+      break;
+    }
+  }
+}
+
+/**
+ * Get the number of threads (including the calling thread).
+ */
+epicsUInt32 ADSimPeaksWorkers::getThreads(void) const {
+  return m_threads;
+}
+
+/**
+ * Split up the work between the threads, and wait for it to be done.
+ * This must only be called from one thread at a time.
+ *
+ * /arg /c count The number of work items
+ * /arg /c func The work function, which is called with a range of work items
+ */
+void ADSimPeaksWorkers::run(size_t count, const t_func &func) {
+  if (count == 0) {
+    return;
+  }
+  m_active = static_cast<epicsUInt32>(std::min(static_cast<size_t>(m_threads), count));
+  p_func = &func;
+  if (m_active == 1) {
+    runRange(0, count);
+    p_func = NULL;
+    return;
+  }
+
+  m_count = count;
+  m_remaining.store(m_active - 1);
+  for (epicsUInt32 i=1; i<m_active; i++) {
+    epicsEventSignal(m_workers[i-1]->start);
+  }
+  runRange(0, count/m_active);
+  while (m_remaining.load() > 0) {
+    epicsEventWait(m_done);
+  }
+  p_func = NULL;
+}
+
+/**
+ * The worker thread function. This waits for work, and
+ * does the range of work items for this thread.
+ *
+ * /arg /c worker The worker
+ */
+void ADSimPeaksWorkers::workerTask(s_worker *worker) {
+  const epicsUInt32 index = worker->index;
+  epicsUInt32 placementGeneration = 0;
+
+  while (true) {
+    epicsEventWait(worker->start);
+    if (m_placement.generation() != placementGeneration) {
+      placementGeneration = m_placement.generation();
+      m_placement.apply(worker->name);
+    }
+    size_t begin = (m_count*index)/m_active;
+    size_t end = (m_count*(index+1))/m_active;
+    runRange(begin, end);
+    if (--m_remaining == 0) {
+      epicsEventSignal(m_done);
+    }
+  }
+}
+
+/**
+ * Do one range of work items, and add it to the trace.
+ *
+ * /arg /c begin The first work item
+ * /arg /c end One past the last work item
+ */
+void ADSimPeaksWorkers::runRange(size_t begin, size_t end) {
+  epicsUInt64 traceStart = m_trace.now();
+  (*p_func)(begin, end);
+  m_trace.complete("worker", traceStart, static_cast<epicsFloat64>(begin));
+}
@@ -0,0 +1,72 @@
+/**
+ * \brief Pool of worker threads used by the ADSimPeaks
+ *        areaDetector driver to split up the rendering.
+ *
+ * More detailed documentation can be found in the source file.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#ifndef ADSIMPEAKSWORKERS_H
+#define ADSIMPEAKSWORKERS_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <functional>
+
+#include <epicsTypes.h>
+#include <epicsEvent.h>
+
+#include "ADSimPeaksPlacement.h"
+#include "ADSimPeaksTrace.h"
+
+class ADSimPeaksWorkers
+{
+ public:
+  ADSimPeaksWorkers(const std::string &name, ADSimPeaksPlacement &placement, ADSimPeaksTrace &trace);
+  virtual ~ADSimPeaksWorkers(void);
+
+  /**
+   * The work function. This is called with a range [begin, end) of the work items.
+   */
+  typedef std::function<void(size_t begin, size_t end)> t_func;
+
+  static const epicsUInt32 s_maxThreads;
+
+  void setThreads(epicsUInt32 threads);
+  epicsUInt32 getThreads(void) const;
+  void run(size_t count, const t_func &func);
+
+  /**
+   * A worker thread. Worker 0 is the calling thread, so this is only used for the others.
+   */
+  struct s_worker {
+    ADSimPeaksWorkers *owner;
+    epicsUInt32 index;
+    epicsEventId start;
+    std::string name;
+  };
+
+  void workerTask(s_worker *worker);
+
+ private:
+
+  void runRange(size_t begin, size_t end);
+
+  std::string m_name;
+  ADSimPeaksPlacement &m_placement;
+  ADSimPeaksTrace &m_trace;
+  epicsUInt32 m_threads;
+  std::vector<s_worker*> m_workers;
+  const t_func *p_func;
+  size_t m_count;
+  epicsUInt32 m_active;
+  std::atomic<epicsUInt32> m_remaining;
+  epicsEventId m_done;
+
+};
+
+#endif //ADSIMPEAKSWORKERS_H
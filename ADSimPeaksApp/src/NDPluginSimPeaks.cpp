@@ -0,0 +1,516 @@
+/**
+ * \brief areaDetector plugin to add simulated peaks to the
+ *        NDArrays from another driver or plugin.
+ *
+ * This can be used to inject synthetic peaks into real camera images, to
+ * test the sensitivity of an analysis on a realistic background. The peaks
+ * use the same shapes (ADSimPeaksPeak) and the same peak parameters as the
+ * ADSimPeaks driver, so the ADSimPeaks1DPeak.template and ADSimPeaks2DPeak.template
+ * database files can be loaded for the plugin port (with one Asyn address per peak).
+ * 1D arrays use the 1D peak types, and 2D arrays use the 2D peak types. Other
+ * arrays (eg. color images) are passed on without any peaks.
+ *
+ * The incoming array is never modified. If there are no peaks that overlap the
+ * array, the incoming array is passed on to the downstream plugins without being
+ * copied. Otherwise the array is copied once, and the peaks are added in place
+ * into the copy. Only the pixels inside the support of each peak are visited.
+ * The support is the peak MinX/MaxX/MinY/MaxY boundaries (as for the driver),
+ * further limited to a number of FWHM either side of the peak position (the
+ * Support parameter, 0 to use only the boundaries). Each peak is scaled so that
+ * its maximum is the peak amplitude, and the Scale parameter multiplies all the peaks.
+ *
+ * The peak parameters are read once per array with the plugin locked, and
+ * the peaks are added with the plugin unlocked. The list of peaks for an array
+ * is kept on the stack of the thread that processes it, so several arrays can
+ * be processed at the same time (maxThreads > 1). ADSimPeaksPeak has no state,
+ * so it can be shared by the threads.
+ *
+ * The plugin is created with the NDSimPeaksConfigure iocsh command:
+ *
+ * NDSimPeaksConfigure(portName, queueSize, blockingCallbacks, NDArrayPort, NDArrayAddr,
+ *                     maxPeaks, maxBuffers, maxMemory, priority, stackSize, maxThreads)
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+#include <epicsExport.h>
+#include <iocsh.h>
+
+#include "NDPluginSimPeaks.h"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+
+//Definitions of static class data members
+const string NDPluginSimPeaks::s_className = "NDPluginSimPeaks";
+// Constant used to test for 0.0
+const epicsFloat64 NDPluginSimPeaks::s_zeroCheck = 1e-12;
+
+/**
+ * Constructor. There is one Asyn address for each peak.
+ *
+ * \arg \c portName The Asyn port name
+ * \arg \c queueSize The number of NDArrays that the input queue can hold
+ * \arg \c blockingCallbacks Set to 1 to process the arrays in the callback thread
+ * \arg \c NDArrayPort The Asyn port of the driver or plugin that provides the arrays
+ * \arg \c NDArrayAddr The Asyn address of the driver or plugin that provides the arrays
+ * \arg \c maxPeaks The maximum number of peaks
+ * \arg \c maxBuffers The asynPortDriver max buffers (0=unlimited)
+ * \arg \c maxMemory The asynPortDriver max memory (0=unlimited)
+ * \arg \c priority The asynPortDriver priority (0=default)
+ * \arg \c stackSize The asynPortDriver stackSize (0=default)
+ * \arg \c maxThreads The maximum number of plugin threads
+ */
+NDPluginSimPeaks::NDPluginSimPeaks(const char *portName, int queueSize, int blockingCallbacks,
+				   const char *NDArrayPort, int NDArrayAddr, int maxPeaks,
+				   int maxBuffers, size_t maxMemory, int priority, int stackSize, int maxThreads)
+  : NDPluginDriver(portName, queueSize, blockingCallbacks, NDArrayPort, NDArrayAddr,
+		   std::max(1, maxPeaks), maxBuffers, maxMemory,
+		   asynInt32Mask | asynFloat64Mask | asynGenericPointerMask,
+		   asynInt32Mask | asynFloat64Mask | asynGenericPointerMask,
+		   ASYN_MULTIDEVICE, 1, priority, stackSize, maxThreads),
+    m_maxPeaks(static_cast<epicsUInt32>(std::max(1, maxPeaks)))
+{
+  bool paramStatus = true;
+
+  string functionName(s_className + "::" + __func__);
+
+  createParam(NDSPScaleParamString, asynParamFloat64, &NDSPScaleParam);
+  createParam(NDSPSupportParamString, asynParamFloat64, &NDSPSupportParam);
+  createParam(NDSPPeaksParamString, asynParamInt32, &NDSPPeaksParam);
+  createParam(NDSPPixelsParamString, asynParamInt32, &NDSPPixelsParam);
+  createParam(ADSPPeakType1DParamString, asynParamInt32, &NDSPPeakType1DParam);
+  createParam(ADSPPeakType2DParamString, asynParamInt32, &NDSPPeakType2DParam);
+  createParam(ADSPPeakPosXParamString, asynParamFloat64, &NDSPPeakPosXParam);
+  createParam(ADSPPeakPosYParamString, asynParamFloat64, &NDSPPeakPosYParam);
+  createParam(ADSPPeakFWHMXParamString, asynParamFloat64, &NDSPPeakFWHMXParam);
+  createParam(ADSPPeakFWHMYParamString, asynParamFloat64, &NDSPPeakFWHMYParam);
+  createParam(ADSPPeakAmpParamString, asynParamFloat64, &NDSPPeakAmpParam);
+  createParam(ADSPPeakCorParamString, asynParamFloat64, &NDSPPeakCorParam);
+  createParam(ADSPPeakP1ParamString, asynParamFloat64, &NDSPPeakP1Param);
+  createParam(ADSPPeakP2ParamString, asynParamFloat64, &NDSPPeakP2Param);
+  createParam(ADSPPeakMinXParamString, asynParamInt32, &NDSPPeakMinXParam);
+  createParam(ADSPPeakMinYParamString, asynParamInt32, &NDSPPeakMinYParam);
+  createParam(ADSPPeakMaxXParamString, asynParamInt32, &NDSPPeakMaxXParam);
+  createParam(ADSPPeakMaxYParamString, asynParamInt32, &NDSPPeakMaxYParam);
+
+  //Initialize non static, non const, data members
+  paramStatus = ((setDoubleParam(NDSPScaleParam, 1.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(NDSPSupportParam, 5.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(NDSPPeaksParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(NDSPPixelsParam, 0) == asynSuccess) && paramStatus);
+  for (epicsUInt32 peak=0; peak<m_maxPeaks; peak++) {
+    paramStatus = ((setIntegerParam(peak, NDSPPeakType1DParam, 0) == asynSuccess) && paramStatus);
+    paramStatus = ((setIntegerParam(peak, NDSPPeakType2DParam, 0) == asynSuccess) && paramStatus);
+    paramStatus = ((setDoubleParam(peak, NDSPPeakPosXParam, 0.0) == asynSuccess) && paramStatus);
+    paramStatus = ((setDoubleParam(peak, NDSPPeakPosYParam, 0.0) == asynSuccess) && paramStatus);
+    paramStatus = ((setDoubleParam(peak, NDSPPeakFWHMXParam, 1.0) == asynSuccess) && paramStatus);
+    paramStatus = ((setDoubleParam(peak, NDSPPeakFWHMYParam, 1.0) == asynSuccess) && paramStatus);
+    paramStatus = ((setDoubleParam(peak, NDSPPeakAmpParam, 0.0) == asynSuccess) && paramStatus);
+    paramStatus = ((setDoubleParam(peak, NDSPPeakCorParam, 0.0) == asynSuccess) && paramStatus);
+    paramStatus = ((setDoubleParam(peak, NDSPPeakP1Param, 0.0) == asynSuccess) && paramStatus);
+    paramStatus = ((setDoubleParam(peak, NDSPPeakP2Param, 0.0) == asynSuccess) && paramStatus);
+    paramStatus = ((setIntegerParam(peak, NDSPPeakMinXParam, 0) == asynSuccess) && paramStatus);
+    paramStatus = ((setIntegerParam(peak, NDSPPeakMinYParam, 0) == asynSuccess) && paramStatus);
+    paramStatus = ((setIntegerParam(peak, NDSPPeakMaxXParam, 0) == asynSuccess) && paramStatus);
+    paramStatus = ((setIntegerParam(peak, NDSPPeakMaxYParam, 0) == asynSuccess) && paramStatus);
+    callParamCallbacks(peak);
+  }
+  if (!paramStatus) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+	      "%s unable to set plugin parameters in constructor.\n", functionName.c_str());
+  }
+
+  setStringParam(NDPluginDriverPluginType, "NDPluginSimPeaks");
+
+  //Try to connect to the array port
+  connectToArrayPort();
+}
+
+/**
+ * Destructor. This should never be called.
+ */
+NDPluginSimPeaks::~NDPluginSimPeaks()
+{
+}
+
+/**
+ * Process an incoming NDArray. The peaks are added to a copy of the array,
+ * which is passed on to the downstream plugins. The incoming array is passed
+ * on unchanged if no peaks overlap it.
+ *
+ * /arg /c pArray The incoming NDArray
+ */
+void NDPluginSimPeaks::processCallbacks(NDArray *pArray)
+{
+  NDArray *pOutput = NULL;
+  size_t pixels = 0;
+  std::vector<s_overlay_peak> overlay;
+
+  string functionName(s_className + "::" + __func__);
+
+  NDPluginDriver::beginProcessCallbacks(pArray);
+
+  //Only 1D and 2D (mono) arrays are supported
+  bool is2d = (pArray->ndims == 2);
+  if ((pArray->ndims != 1) && (!is2d)) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+	      "%s only 1D and 2D arrays are supported (ndims=%d).\n", functionName.c_str(), pArray->ndims);
+  } else {
+    planPeaks(is2d, pArray->dims[0].size, is2d ? pArray->dims[1].size : 1, overlay);
+  }
+
+  if (overlay.empty()) {
+    //Pass on the incoming array without copying it
+    pArray->reserve();
+    NDPluginDriver::endProcessCallbacks(pArray, false, false);
+  } else {
+    pOutput = this->pNDArrayPool->copy(pArray, NULL, true);
+    if (pOutput == NULL) {
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+		"%s failed to copy NDArray.\n", functionName.c_str());
+    } else {
+      this->unlock();
+      pixels = addPeaks(pOutput, is2d, pArray->dims[0].size, overlay);
+      this->lock();
+      NDPluginDriver::endProcessCallbacks(pOutput, false, true);
+    }
+  }
+
+  setIntegerParam(NDSPPeaksParam, static_cast<epicsInt32>(overlay.size()));
+  setIntegerParam(NDSPPixelsParam, static_cast<epicsInt32>(pixels));
+  callParamCallbacks();
+}
+
+/**
+ * Read the peak parameters, and work out the scale factor and the support of
+ * each peak for the size of the array. Peaks that don't overlap the array are
+ * not included. This must be called with the plugin locked.
+ *
+ * /arg /c is2d Set to true for a 2D array
+ * /arg /c sizeX The number of pixels in the X dimension
+ * /arg /c sizeY The number of pixels in the Y dimension (1 for a 1D array)
+ * /arg /c overlay This will be used to return the peaks to add to the array
+ */
+void NDPluginSimPeaks::planPeaks(bool is2d, size_t sizeX, size_t sizeY, std::vector<s_overlay_peak> &overlay)
+{
+  epicsInt32 type = 0;
+  epicsInt32 intParam = 0;
+  epicsFloat64 floatParam = 0.0;
+  epicsFloat64 scale = 0.0;
+  epicsFloat64 support = 0.0;
+  epicsFloat64 result_max = 0.0;
+  ADSimPeaksData peak_data;
+
+  overlay.clear();
+  if ((sizeX == 0) || (sizeY == 0)) {
+    return;
+  }
+  getDoubleParam(NDSPScaleParam, &scale);
+  getDoubleParam(NDSPSupportParam, &support);
+  const epicsFloat64 lastX = static_cast<epicsFloat64>(sizeX-1);
+  const epicsFloat64 lastY = static_cast<epicsFloat64>(sizeY-1);
+
+  for (epicsUInt32 peak=0; peak<m_maxPeaks; peak++) {
+    getIntegerParam(peak, is2d ? NDSPPeakType2DParam : NDSPPeakType1DParam, &type);
+    if (type <= 0) {
+      continue;
+    }
+
+    peak_data.clear();
+    getDoubleParam(peak, NDSPPeakPosXParam, &floatParam);
+    peak_data.setPositionX(floatParam);
+    getDoubleParam(peak, NDSPPeakPosYParam, &floatParam);
+    peak_data.setPositionY(floatParam);
+    getDoubleParam(peak, NDSPPeakFWHMXParam, &floatParam);
+    peak_data.setFWHMX(floatParam);
+    getDoubleParam(peak, NDSPPeakFWHMYParam, &floatParam);
+    peak_data.setFWHMY(floatParam);
+    getDoubleParam(peak, NDSPPeakAmpParam, &floatParam);
+    peak_data.setAmplitude(floatParam);
+    getDoubleParam(peak, NDSPPeakCorParam, &floatParam);
+    peak_data.setCorrelation(floatParam);
+    getDoubleParam(peak, NDSPPeakP1Param, &floatParam);
+    peak_data.setParam1(floatParam);
+    getDoubleParam(peak, NDSPPeakP2Param, &floatParam);
+    peak_data.setParam2(floatParam);
+
+    //The boundaries, as for the driver (a maximum of 0 means the end of the array)
+    epicsFloat64 minX = 0.0;
+    epicsFloat64 maxX = lastX;
+    epicsFloat64 minY = 0.0;
+    epicsFloat64 maxY = lastY;
+    getIntegerParam(peak, NDSPPeakMinXParam, &intParam);
+    minX = std::max(0.0, static_cast<epicsFloat64>(intParam));
+    getIntegerParam(peak, NDSPPeakMaxXParam, &intParam);
+    if (intParam > 0) {
+      maxX = std::min(lastX, static_cast<epicsFloat64>(intParam));
+    }
+    if (is2d) {
+      getIntegerParam(peak, NDSPPeakMinYParam, &intParam);
+      minY = std::max(0.0, static_cast<epicsFloat64>(intParam));
+      getIntegerParam(peak, NDSPPeakMaxYParam, &intParam);
+      if (intParam > 0) {
+	maxY = std::min(lastY, static_cast<epicsFloat64>(intParam));
+      }
+    }
+
+    //Limit the peak to a number of FWHM either side of the position
+    if (support > 0.0) {
+      epicsFloat64 halfX = support*fabs(peak_data.getFWHMX());
+      minX = std::max(minX, floor(peak_data.getPositionX() - halfX));
+      maxX = std::min(maxX, ceil(peak_data.getPositionX() + halfX));
+      if (is2d) {
+	epicsFloat64 halfY = support*fabs(peak_data.getFWHMY());
+	minY = std::max(minY, floor(peak_data.getPositionY() - halfY));
+	maxY = std::min(maxY, ceil(peak_data.getPositionY() + halfY));
+      }
+    }
+    if ((minX > maxX) || (minY > maxY)) {
+      continue;
+    }
+
+    //Scale the peak to the desired height
+    ADSimPeaksPeak::e_status peak_status = ADSimPeaksPeak::e_status::error;
+    peak_data.setBinX(peak_data.getPositionX());
+    if (is2d) {
+      peak_data.setBinY(peak_data.getPositionY());
+      peak_status = m_peaks.compute2D(peak_data, static_cast<ADSimPeaksPeak::e_type_2d>(type), result_max);
+    } else {
+      peak_status = m_peaks.compute1D(peak_data, static_cast<ADSimPeaksPeak::e_type_1d>(type), result_max);
+    }
+    if (peak_status != ADSimPeaksPeak::e_status::success) {
+      continue;
+    }
+
+    s_overlay_peak overlay_peak;
+    overlay_peak.data = peak_data;
+    overlay_peak.type = type;
+    overlay_peak.scale = scale * peak_data.getAmplitude() / zeroCheck(result_max);
+    overlay_peak.minX = static_cast<epicsUInt32>(minX);
+    overlay_peak.maxX = static_cast<epicsUInt32>(maxX);
+    overlay_peak.minY = static_cast<epicsUInt32>(minY);
+    overlay_peak.maxY = static_cast<epicsUInt32>(maxY);
+    overlay.push_back(overlay_peak);
+  }
+}
+
+/**
+ * Add the peaks to an array, using the data type of the array.
+ *
+ * /arg /c pArray The array (which must not be shared with anything else)
+ * /arg /c is2d Set to true for a 2D array
+ * /arg /c sizeX The number of pixels in the X dimension
+ * /arg /c overlay The peaks to add
+ *
+ * /return The number of pixels that were changed (counting overlapping peaks more than once)
+ */
+size_t NDPluginSimPeaks::addPeaks(NDArray *pArray, bool is2d, size_t sizeX, std::vector<s_overlay_peak> &overlay)
+{
+  switch (pArray->dataType) {
+  case NDInt8:
+    return addPeaksT<epicsInt8>(pArray, is2d, sizeX, overlay);
+  case NDUInt8:
+    return addPeaksT<epicsUInt8>(pArray, is2d, sizeX, overlay);
+  case NDInt16:
+    return addPeaksT<epicsInt16>(pArray, is2d, sizeX, overlay);
+  case NDUInt16:
+    return addPeaksT<epicsUInt16>(pArray, is2d, sizeX, overlay);
+  case NDInt32:
+    return addPeaksT<epicsInt32>(pArray, is2d, sizeX, overlay);
+  case NDUInt32:
+    return addPeaksT<epicsUInt32>(pArray, is2d, sizeX, overlay);
+  case NDInt64:
+    return addPeaksT<epicsInt64>(pArray, is2d, sizeX, overlay);
+  case NDUInt64:
+    return addPeaksT<epicsUInt64>(pArray, is2d, sizeX, overlay);
+  case NDFloat32:
+    return addPeaksT<epicsFloat32>(pArray, is2d, sizeX, overlay);
+  case NDFloat64:
+    return addPeaksT<epicsFloat64>(pArray, is2d, sizeX, overlay);
+  default:
+    return 0;
+  }
+}
+
+/**
+ * Add the peaks to an array of type T. Only the pixels inside the support
+ * of each peak are visited. The 1D shapes that can be calculated for a
+ * span of bins at once (see ADSimPeaksPeak::span1D) are done that way.
+ *
+ * /arg /c pArray The array
+ * /arg /c is2d Set to true for a 2D array
+ * /arg /c sizeX The number of pixels in the X dimension
+ * /arg /c overlay The peaks to add
+ *
+ * /return The number of pixels that were changed
+ */
+template <typename T> size_t NDPluginSimPeaks::addPeaksT(NDArray *pArray, bool is2d, size_t sizeX,
+							  std::vector<s_overlay_peak> &overlay)
+{
+  epicsFloat64 result = 0.0;
+  size_t pixels = 0;
+  std::vector<epicsFloat64> span;
+  T *pData = static_cast<T*>(pArray->pData);
+
+  for (size_t i=0; i<overlay.size(); i++) {
+    s_overlay_peak &overlay_peak = overlay[i];
+    const epicsUInt32 x0 = overlay_peak.minX;
+    const epicsUInt32 x1 = overlay_peak.maxX;
+    for (epicsUInt32 bin_y=overlay_peak.minY; bin_y<=overlay_peak.maxY; bin_y++) {
+      T *pRow = pData + static_cast<size_t>(bin_y)*sizeX;
+      if (!is2d) {
+	ADSimPeaksPeak::e_type_1d peak_type_1d = static_cast<ADSimPeaksPeak::e_type_1d>(overlay_peak.type);
+	if (m_peaks.hasSpan1D(peak_type_1d)) {
+	  span.assign(x1-x0+1, 0.0);
+	  m_peaks.span1D(overlay_peak.data, peak_type_1d, overlay_peak.scale, x0, x1, &span[0]);
+	  for (epicsUInt32 bin_x=x0; bin_x<=x1; bin_x++) {
+	    pRow[bin_x] += static_cast<T>(span[bin_x-x0]);
+	  }
+	} else {
+	  for (epicsUInt32 bin_x=x0; bin_x<=x1; bin_x++) {
+	    overlay_peak.data.setBinX(bin_x);
+	    if (m_peaks.compute1D(overlay_peak.data, peak_type_1d, result) == ADSimPeaksPeak::e_status::success) {
+	      pRow[bin_x] += static_cast<T>(result*overlay_peak.scale);
+	    }
+	  }
+	}
+      } else {
+	ADSimPeaksPeak::e_type_2d peak_type_2d = static_cast<ADSimPeaksPeak::e_type_2d>(overlay_peak.type);
+	overlay_peak.data.setBinY(bin_y);
+	for (epicsUInt32 bin_x=x0; bin_x<=x1; bin_x++) {
+	  overlay_peak.data.setBinX(bin_x);
+	  if (m_peaks.compute2D(overlay_peak.data, peak_type_2d, result) == ADSimPeaksPeak::e_status::success) {
+	    pRow[bin_x] += static_cast<T>(result*overlay_peak.scale);
+	  }
+	}
+      }
+      pixels += x1 - x0 + 1;
+    }
+  }
+
+  return pixels;
+}
+
+/**
+ * Report the plugin status.
+ *
+ * /arg /c fp The file pointer
+ * /arg /c details The level of detail
+ */
+void NDPluginSimPeaks::report(FILE *fp, int details)
+{
+  epicsInt32 intParam = 0;
+  epicsFloat64 floatParam = 0.0;
+
+  fprintf(fp, "%s port %s\n", s_className.c_str(), this->portName);
+  if (details > 0) {
+    fprintf(fp, "  max peaks: %u\n", m_maxPeaks);
+    getDoubleParam(NDSPScaleParam, &floatParam);
+    fprintf(fp, "  scale: %f\n", floatParam);
+    getDoubleParam(NDSPSupportParam, &floatParam);
+    fprintf(fp, "  support (FWHM): %f\n", floatParam);
+    getIntegerParam(NDSPPeaksParam, &intParam);
+    fprintf(fp, "  peaks in last array: %d\n", intParam);
+    getIntegerParam(NDSPPixelsParam, &intParam);
+    fprintf(fp, "  pixels changed in last array: %d\n", intParam);
+  }
+
+  NDPluginDriver::report(fp, details);
+}
+
+/**
+ * Avoid dividing by zero when scaling a peak.
+ *
+ * /arg /c value The value to check
+ *
+ * /return The value, or 1.0 if it is very close to zero
+ */
+epicsFloat64 NDPluginSimPeaks::zeroCheck(epicsFloat64 value)
+{
+  if ((value > -s_zeroCheck) && (value < s_zeroCheck)) {
+    return 1.0;
+  } else {
+    return value;
+  }
+}
+
+/*************************************************************************************/
+/** The following functions have C linkage, and can be called directly or from iocsh */
+
+extern "C" {
+
+  /**
+   * Config function for IOC shell. It instantiates an instance of the plugin.
+   */
+  asynStatus NDSimPeaksConfigure(const char *portName, int queueSize, int blockingCallbacks,
+				 const char *NDArrayPort, int NDArrayAddr, int maxPeaks,
+				 int maxBuffers, size_t maxMemory, int priority, int stackSize, int maxThreads)
+  {
+    asynStatus status = asynSuccess;
+
+    try {
+      NDPluginSimPeaks *pPlugin = new NDPluginSimPeaks(portName, queueSize, blockingCallbacks,
+						       NDArrayPort, NDArrayAddr, maxPeaks,
+						       maxBuffers, maxMemory, priority, stackSize, maxThreads);
+      status = pPlugin->start();
+      if (status == asynSuccess) {
+	cerr << "Created NDPluginSimPeaks OK." << endl;
+      } else {
+	cerr << "Problem starting NDPluginSimPeaks" << endl;
+      }
+    } catch (...) {
+      cerr << __func__ << " exception caught when trying to construct NDPluginSimPeaks." << endl;
+      status = asynError;
+    }
+
+    return(status);
+  }
+
+  // Code for iocsh registration
+  static const iocshArg NDSimPeaksConfigureArg0 = {"Port Name", iocshArgString};
+  static const iocshArg NDSimPeaksConfigureArg1 = {"Queue Size", iocshArgInt};
+  static const iocshArg NDSimPeaksConfigureArg2 = {"Blocking Callbacks", iocshArgInt};
+  static const iocshArg NDSimPeaksConfigureArg3 = {"NDArray Port", iocshArgString};
+  static const iocshArg NDSimPeaksConfigureArg4 = {"NDArray Addr", iocshArgInt};
+  static const iocshArg NDSimPeaksConfigureArg5 = {"Max Peaks", iocshArgInt};
+  static const iocshArg NDSimPeaksConfigureArg6 = {"maxBuffers", iocshArgInt};
+  static const iocshArg NDSimPeaksConfigureArg7 = {"maxMemory", iocshArgInt};
+  static const iocshArg NDSimPeaksConfigureArg8 = {"priority", iocshArgInt};
+  static const iocshArg NDSimPeaksConfigureArg9 = {"stackSize", iocshArgInt};
+  static const iocshArg NDSimPeaksConfigureArg10 = {"maxThreads", iocshArgInt};
+  static const iocshArg * const NDSimPeaksConfigureArgs[] =  {&NDSimPeaksConfigureArg0,
+							      &NDSimPeaksConfigureArg1,
+							      &NDSimPeaksConfigureArg2,
+							      &NDSimPeaksConfigureArg3,
+							      &NDSimPeaksConfigureArg4,
+							      &NDSimPeaksConfigureArg5,
+							      &NDSimPeaksConfigureArg6,
+							      &NDSimPeaksConfigureArg7,
+							      &NDSimPeaksConfigureArg8,
+							      &NDSimPeaksConfigureArg9,
+							      &NDSimPeaksConfigureArg10};
+  static const iocshFuncDef configNDSimPeaks = {"NDSimPeaksConfigure", 11, NDSimPeaksConfigureArgs};
+  static void configNDSimPeaksCallFunc(const iocshArgBuf *args)
+  {
+    NDSimPeaksConfigure(args[0].sval, args[1].ival, args[2].ival, args[3].sval, args[4].ival,
+			args[5].ival, args[6].ival, args[7].ival, args[8].ival, args[9].ival,
+			args[10].ival);
+  }
+
+  static void NDSimPeaksRegister(void)
+  {
+    iocshRegister(&configNDSimPeaks, configNDSimPeaksCallFunc);
+  }
+
+  epicsExportRegistrar(NDSimPeaksRegister);
+
+} // Extern "C"
@@ -0,0 +1,93 @@
+/**
+ * \brief areaDetector plugin to add simulated peaks to the
+ *        NDArrays from another driver or plugin.
+ *
+ * More detailed documentation can be found in the source file.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#ifndef NDPLUGINSIMPEAKS_H
+#define NDPLUGINSIMPEAKS_H
+
+#include <string>
+#include <vector>
+
+#include <epicsTypes.h>
+#include <NDPluginDriver.h>
+
+#include "ADSimPeaks.h"
+#include "ADSimPeaksData.h"
+#include "ADSimPeaksPeak.h"
+
+// Overlay Params (the peak params are the same as the ADSimPeaks driver)
+#define NDSPScaleParamString       "ADSP_OVERLAY_SCALE"
+#define NDSPSupportParamString     "ADSP_OVERLAY_SUPPORT"
+#define NDSPPeaksParamString       "ADSP_OVERLAY_PEAKS"
+#define NDSPPixelsParamString      "ADSP_OVERLAY_PIXELS"
+
+class NDPluginSimPeaks : public NDPluginDriver {
+ public:
+  NDPluginSimPeaks(const char *portName, int queueSize, int blockingCallbacks,
+		   const char *NDArrayPort, int NDArrayAddr, int maxPeaks,
+		   int maxBuffers, size_t maxMemory, int priority, int stackSize, int maxThreads);
+  virtual ~NDPluginSimPeaks();
+
+  virtual void report(FILE *fp, int details);
+
+ protected:
+
+  void processCallbacks(NDArray *pArray);
+
+  int NDSPScaleParam;
+  int NDSPSupportParam;
+  int NDSPPeaksParam;
+  int NDSPPixelsParam;
+  int NDSPPeakType1DParam;
+  int NDSPPeakType2DParam;
+  int NDSPPeakPosXParam;
+  int NDSPPeakPosYParam;
+  int NDSPPeakFWHMXParam;
+  int NDSPPeakFWHMYParam;
+  int NDSPPeakAmpParam;
+  int NDSPPeakCorParam;
+  int NDSPPeakP1Param;
+  int NDSPPeakP2Param;
+  int NDSPPeakMinXParam;
+  int NDSPPeakMinYParam;
+  int NDSPPeakMaxXParam;
+  int NDSPPeakMaxYParam;
+
+ private:
+
+  /**
+   * A peak to be added to the array, with its scale factor
+   * and the range of pixels that it covers.
+   */
+  struct s_overlay_peak {
+    ADSimPeaksData data;
+    epicsInt32 type;
+    epicsFloat64 scale;
+    epicsUInt32 minX;
+    epicsUInt32 maxX;
+    epicsUInt32 minY;
+    epicsUInt32 maxY;
+  };
+
+  void planPeaks(bool is2d, size_t sizeX, size_t sizeY, std::vector<s_overlay_peak> &overlay);
+  size_t addPeaks(NDArray *pArray, bool is2d, size_t sizeX, std::vector<s_overlay_peak> &overlay);
+  template <typename T> size_t addPeaksT(NDArray *pArray, bool is2d, size_t sizeX,
+					 std::vector<s_overlay_peak> &overlay);
+  epicsFloat64 zeroCheck(epicsFloat64 value);
+
+  static const std::string s_className;
+  static const epicsFloat64 s_zeroCheck;
+
+  epicsUInt32 m_maxPeaks;
+  ADSimPeaksPeak m_peaks;
+
+};
+
+#endif //NDPLUGINSIMPEAKS_H
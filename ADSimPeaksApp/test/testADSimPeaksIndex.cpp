@@ -0,0 +1,207 @@
+/**
+ * \brief Unit tests for the chunk and row index calculations used to
+ *        render frames with more than 2^31 elements.
+ *
+ * The frame geometry is 65536 x 65537 bins (more than 2^32 elements). The
+ * index arithmetic is checked, a few rows of the difference array
+ * (ADSimPeaksDiff) are applied, and a frame is planned (ADSimPeaksPlan) and
+ * a few chunks past element 2^31 are rendered in the same way as the driver.
+ * Everything is rendered into a buffer of one chunk, so a full frame is
+ * never allocated.
+ *
+ * \author Matt Pearson
+ * \date Oct 18th, 2026
+ *
+ */
+
+#include <vector>
+#include <cmath>
+
+#include <epicsTypes.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include <ADSimPeaksPlan.h>
+#include <ADSimPeaksDiff.h>
+#include <ADSimPeaksData.h>
+#include <ADSimPeaksPeak.h>
+
+static const epicsUInt32 s_sizeX = 65536;
+static const epicsUInt32 s_sizeY = 65537;
+
+/**
+ * Check the index of a bin in a frame with more than 2^32 elements.
+ */
+static void testIndex(void)
+{
+  testDiag("Bin index");
+  const size_t last = ADSimPeaksPlan::index(s_sizeX-1, s_sizeY-1, s_sizeX);
+  testOk(last == 4295032831ULL, "index of the last bin is %llu", static_cast<unsigned long long>(last));
+  testOk1(ADSimPeaksPlan::index(0, 32768, s_sizeX) == 2147483648ULL);
+  testOk1(ADSimPeaksPlan::index(0, 65536, s_sizeX) > 0xFFFFFFFFULL);
+}
+
+/**
+ * Check the chunk geometry, and that the chunks cover the whole frame.
+ */
+static void testChunks(void)
+{
+  epicsUInt32 chunkCols = 0;
+  epicsUInt32 chunkRows = 0;
+
+  testDiag("Chunk geometry");
+  ADSimPeaksPlan::chunkSize(32768, s_sizeX, s_sizeY, chunkCols, chunkRows);
+  testOk((chunkCols == 32768) && (chunkRows == 1), "part of a row: %u x %u", chunkCols, chunkRows);
+  ADSimPeaksPlan::chunkSize(262144, s_sizeX, s_sizeY, chunkCols, chunkRows);
+  testOk((chunkCols == s_sizeX) && (chunkRows == 4), "block of rows: %u x %u", chunkCols, chunkRows);
+  ADSimPeaksPlan::chunkSize(0, 1, 1, chunkCols, chunkRows);
+  testOk((chunkCols == 1) && (chunkRows == 1), "minimum chunk: %u x %u", chunkCols, chunkRows);
+
+  // Blocks of rows: the last chunk only has one row
+  ADSimPeaksPlan::chunkSize(262144, s_sizeX, s_sizeY, chunkCols, chunkRows);
+  epicsUInt32 numChunks = 0;
+  epicsUInt32 lastStart = 0;
+  epicsUInt32 lastEnd = 0;
+  size_t elements = 0;
+  for (epicsUInt32 r0=0; r0<s_sizeY; r0+=chunkRows) {
+    epicsUInt32 r1 = ADSimPeaksPlan::chunkEnd(r0, chunkRows, s_sizeY);
+    elements += static_cast<size_t>(r1-r0+1)*s_sizeX;
+    lastStart = r0;
+    lastEnd = r1;
+    numChunks++;
+  }
+  testOk(numChunks == 16385, "number of row chunks %u", numChunks);
+  testOk((lastStart == 65536) && (lastEnd == 65536), "last row chunk %u to %u", lastStart, lastEnd);
+  testOk1(elements == static_cast<size_t>(s_sizeX)*s_sizeY);
+
+  // Parts of rows
+  ADSimPeaksPlan::chunkSize(32768, s_sizeX, s_sizeY, chunkCols, chunkRows);
+  numChunks = 0;
+  elements = 0;
+  for (epicsUInt32 r0=0; r0<s_sizeY; r0+=chunkRows) {
+    epicsUInt32 r1 = ADSimPeaksPlan::chunkEnd(r0, chunkRows, s_sizeY);
+    for (epicsUInt32 c0=0; c0<s_sizeX; c0+=chunkCols) {
+      epicsUInt32 c1 = ADSimPeaksPlan::chunkEnd(c0, chunkCols, s_sizeX);
+      elements += static_cast<size_t>(r1-r0+1)*(c1-c0+1);
+      numChunks++;
+    }
+  }
+  testOk(numChunks == 2*s_sizeY, "number of chunks %u", numChunks);
+  testOk1(elements == static_cast<size_t>(s_sizeX)*s_sizeY);
+
+  // The end of a chunk must not overflow near 2^32
+  testOk1(ADSimPeaksPlan::chunkEnd(0xFFFFFF00U, 0x1000U, 0xFFFFFFFFU) == 0xFFFFFFFEU);
+  testOk1(ADSimPeaksPlan::chunkEnd(0xFFFFF000U, 0x100U, 0xFFFFFFFFU) == 0xFFFFF0FFU);
+}
+
+/**
+ * Apply the last rows of a difference array, one chunk at a time.
+ */
+static void testDiff(void)
+{
+  ADSimPeaksDiff diff;
+  const epicsUInt32 width = 32768;
+  std::vector<epicsFloat64> chunk(width, 0.0);
+
+  testDiag("Difference array");
+  diff.reset(s_sizeX, s_sizeY);
+  diff.addBox(65530, 65535, 65535, 65536, 2.0);
+  diff.addSegment(65536, 100, 199, 1.0, 0.5);
+
+  // A row with nothing in it
+  diff.applyRow(65534, width, s_sizeX-1, &chunk[0]);
+  bool empty = true;
+  for (epicsUInt32 i=0; i<width; i++) {
+    empty = (empty && (chunk[i] == 0.0));
+  }
+  testOk(empty, "row 65534 is empty");
+
+  // The first chunk of this row is skipped
+  chunk.assign(width, 0.0);
+  diff.applyRow(65535, width, s_sizeX-1, &chunk[0]);
+  testOk1(chunk[65529-width] == 0.0);
+  testOk1(chunk[65530-width] == 2.0);
+  testOk1(chunk[width-1] == 2.0);
+
+  // The last row, in two chunks
+  chunk.assign(width, 0.0);
+  diff.applyRow(65536, 0, width-1, &chunk[0]);
+  testOk1(chunk[99] == 0.0);
+  testOk1(chunk[100] == 51.0);
+  testOk1(chunk[199] == 100.5);
+  testOk1(chunk[200] == 0.0);
+  chunk.assign(width, 0.0);
+  diff.applyRow(65536, width, s_sizeX-1, &chunk[0]);
+  testOk1(chunk[0] == 0.0);
+  testOk1(chunk[65530-width] == 2.0);
+  testOk1(chunk[width-1] == 2.0);
+}
+
+/**
+ * Render a chunk of the model, and return the index of its first element in the frame.
+ */
+static size_t renderChunk(ADSimPeaksPlan &plan, epicsUInt32 bin_y, epicsUInt32 c0, epicsUInt32 c1,
+			  std::vector<epicsFloat64> &chunk)
+{
+  chunk.assign(c1-c0+1, 0.0);
+  plan.background(bin_y, c0, c1, &chunk[0]);
+  plan.peaks(bin_y, c0, c1, &chunk[0]);
+  return ADSimPeaksPlan::index(c0, bin_y, s_sizeX);
+}
+
+/**
+ * Plan a frame with a background, a Gaussian peak (rendered bin by bin) and
+ * a square peak (rendered with the difference array), then render the chunks
+ * of the rows at element 2^31 and at the end of the frame.
+ */
+static void testRender(void)
+{
+  ADSimPeaksPlan plan;
+  ADSimPeaksData gaussian;
+  ADSimPeaksData square;
+  std::vector<epicsFloat64> chunk;
+  epicsUInt32 chunkCols = 0;
+  epicsUInt32 chunkRows = 0;
+  const epicsFloat64 tolerance = 1e-9;
+
+  testDiag("Render past element 2^31");
+  plan.begin(s_sizeX, s_sizeY, true, false);
+  plan.setBackground(ADSimPeaksPlan::e_axis::x, ADSimPeaksPlan::e_bg_type::polynomial, 1.0, 0.001, 0.0, 0.0, 0.0);
+  plan.setBackground(ADSimPeaksPlan::e_axis::y, ADSimPeaksPlan::e_bg_type::polynomial, 0.0, 0.0001, 0.0, 0.0, 0.0);
+  gaussian.setPositionX(40000);
+  gaussian.setPositionY(65536);
+  gaussian.setFWHMX(8);
+  gaussian.setFWHMY(8);
+  gaussian.setAmplitude(100);
+  plan.addPeak(static_cast<epicsInt32>(ADSimPeaksPeak::e_type_2d::gaussian), gaussian, 0, 0, 0, 0);
+  square.setPositionX(1000);
+  square.setPositionY(65530);
+  square.setFWHMX(20);
+  square.setFWHMY(20);
+  square.setAmplitude(5);
+  plan.addPeak(static_cast<epicsInt32>(ADSimPeaksPeak::e_type_2d::square), square, 0, 0, 0, 0);
+  ADSimPeaksPlan::chunkSize(32768, s_sizeX, s_sizeY, chunkCols, chunkRows);
+
+  // The first chunk at element 2^31 only has the background
+  size_t start = renderChunk(plan, 32768, 0, ADSimPeaksPlan::chunkEnd(0, chunkCols, s_sizeX), chunk);
+  testOk(start == 2147483648ULL, "chunk starts at element %llu", static_cast<unsigned long long>(start));
+  testOk(fabs(chunk[0] - 4.2768) < tolerance, "background %f", chunk[0]);
+
+  // The last row, which has the square in the first chunk and the Gaussian in the second
+  renderChunk(plan, 65536, 0, ADSimPeaksPlan::chunkEnd(0, chunkCols, s_sizeX), chunk);
+  testOk(fabs(chunk[990] - 8.5436) < tolerance, "outside the square %f", chunk[990]);
+  testOk(fabs(chunk[1000] - 13.5536) < tolerance, "inside the square %f", chunk[1000]);
+  start = renderChunk(plan, 65536, chunkCols, ADSimPeaksPlan::chunkEnd(chunkCols, chunkCols, s_sizeX), chunk);
+  testOk(start == 4295000064ULL, "last chunk starts at element %llu", static_cast<unsigned long long>(start));
+  testOk(fabs(chunk[40000-chunkCols] - 147.5536) < tolerance, "Gaussian peak %f", chunk[40000-chunkCols]);
+}
+
+MAIN(testADSimPeaksIndex)
+{
+  testPlan(30);
+  testIndex();
+  testChunks();
+  testDiff();
+  testRender();
+  return testDone();
+}